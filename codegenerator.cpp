@@ -1018,7 +1018,8 @@ QString CodeGenerator::generateScenePrg(const QString &sceneName,
         fullPath = m_projectData.path + "/" + fullPath;
       }
 
-      if (loader.loadMap(fullPath, internalData, nullptr)) {
+      if (loader.loadMapChunks(fullPath, internalData,
+                               RayMapFormat::ChunkEntities)) {
         // Processes for these entities are now handled by autogen_entities.prg
         // via a centralized scan during project generation.
 
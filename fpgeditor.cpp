@@ -10,6 +10,51 @@
 #include <QBuffer>
 #include <QImageReader>
 #include <QLineEdit>
+#include <QComboBox>
+#include <QEventLoop>
+#include <QProgressDialog>
+#include <QRunnable>
+#include <QSettings>
+#include <QThreadPool>
+
+namespace {
+
+// Writes the FPG off the GUI thread, reporting progress to the dialog and
+// quitting the caller's event loop when done
+class FPGSaveTask : public QRunnable
+{
+public:
+    FPGSaveTask(const QString &filename, const QVector<FPGImage> &images,
+                int compressionLevel, QProgressDialog *progress,
+                QEventLoop *loop, bool *success)
+        : m_filename(filename), m_images(images),
+          m_compressionLevel(compressionLevel), m_progress(progress),
+          m_loop(loop), m_success(success) {}
+
+    void run() override
+    {
+        QProgressDialog *progress = m_progress;
+        *m_success = FPGLoader::saveFPGImages(
+            m_filename, m_images, m_compressionLevel,
+            [progress](int current, int, const QString &) {
+                QMetaObject::invokeMethod(progress, "setValue",
+                                          Qt::QueuedConnection,
+                                          Q_ARG(int, current));
+            });
+        m_images.clear();
+        QMetaObject::invokeMethod(m_loop, "quit", Qt::QueuedConnection);
+    }
+
+private:
+    QString m_filename;
+    QVector<FPGImage> m_images;
+    int m_compressionLevel;
+    QProgressDialog *m_progress;
+    QEventLoop *m_loop;
+    bool *m_success;
+};
+
+} // namespace
 
 FPGEditor::FPGEditor(QWidget *parent)
     : QDialog(parent)
@@ -499,7 +544,8 @@ bool FPGEditor::saveFPGFile(const QString &filepath)
         return false;
     }
     
-    // Create custom dialog with checkbox
+    // Create custom dialog with the compression level
+    QSettings settings("BennuGD", "RayMapEditor");
     QDialog dialog(this);
     dialog.setWindowTitle(tr("Opciones de Guardado"));
     QVBoxLayout *layout = new QVBoxLayout(&dialog);
@@ -509,9 +555,15 @@ bool FPGEditor::saveFPGFile(const QString &filepath)
                                    "pero pueden tardar más en cargarse."));
     layout->addWidget(label);
     
-    QCheckBox *compressCheckbox = new QCheckBox(tr("Comprimir con gzip"));
-    compressCheckbox->setChecked(false);
-    layout->addWidget(compressCheckbox);
+    QComboBox *compressionCombo = new QComboBox;
+    compressionCombo->addItem(tr("Sin comprimir"), FPGLoader::NoCompression);
+    compressionCombo->addItem(tr("Compresión rápida (guardados frecuentes)"),
+                              FPGLoader::FastCompression);
+    compressionCombo->addItem(tr("Compresión máxima"), FPGLoader::BestCompression);
+    int index = compressionCombo->findData(
+        settings.value("fpgCompressionLevel", FPGLoader::NoCompression).toInt());
+    compressionCombo->setCurrentIndex(qMax(0, index));
+    layout->addWidget(compressionCombo);
     
     QDialogButtonBox *buttonBox = new QDialogButtonBox(
         QDialogButtonBox::Ok | QDialogButtonBox::Cancel);
@@ -523,10 +575,25 @@ bool FPGEditor::saveFPGFile(const QString &filepath)
         return false;
     }
     
-    bool compress = compressCheckbox->isChecked();
-    
-    // Save FPG
-    bool success = FPGLoader::saveFPG(filepath, m_textures, compress);
+    int compressionLevel = compressionCombo->currentData().toInt();
+    settings.setValue("fpgCompressionLevel", compressionLevel);
+    
+    // Save FPG on a worker thread; the progress dialog keeps the UI alive.
+    // It is application modal and shown at once: the nested event loop below
+    // must not deliver input that edits, saves or reloads meanwhile
+    QVector<FPGImage> images = FPGLoader::toImages(m_textures);
+    QProgressDialog progress(tr("Guardando FPG..."), QString(), 0, images.size(), this);
+    progress.setWindowModality(Qt::ApplicationModal);
+    progress.setMinimumDuration(0);
+    progress.setValue(0);
+    progress.show();
+    
+    QEventLoop loop;
+    bool success = false;
+    QThreadPool::globalInstance()->start(new FPGSaveTask(
+        filepath, images, compressionLevel, &progress, &loop, &success));
+    loop.exec();
+    progress.setValue(images.size());
     
     if (!success) {
         QMessageBox::warning(this, tr("Error"),
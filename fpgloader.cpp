@@ -1,371 +1,642 @@
 #include "fpgloader.h"
 #include <QFile>
-#include <QDataStream>
 #include <QDebug>
 #include <QMessageBox>
+#include <QRunnable>
+#include <QSaveFile>
+#include <QThreadPool>
+#include <QtEndian>
+#include <algorithm>
+#include <cstring>
 #include <zlib.h>
 
-FPGLoader::FPGLoader()
-{
-}
+namespace {
 
-bool FPGLoader::loadFPG(const QString &filename, QVector<TextureEntry> &textures,
-                        std::function<void(int, int, const QString&)> progressCallback)
+const int FPG_HEADER_SIZE = 8;        // "f32\x1A\x0D\x0A\x00" + versión
+const int FPG_CHUNK_HEADER_SIZE = 68; // Campos de FPG_CHUNK en el archivo
+const int FPG_MAX_SIDE = 4096;
+const int FPG_MAX_CODE = 100000;
+const int FPG_INPUT_BLOCK = 64 * 1024; // Lectura del archivo comprimido
+
+// Lectura secuencial del FPG. Si está comprimido con gzip se infla sobre
+// la marcha directamente en el buffer del llamador, sin cargar el archivo
+// ni el resultado completos en memoria.
+class FPGStream
 {
-    QFile file(filename);
-    if (!file.open(QIODevice::ReadOnly)) {
-        qWarning() << "No se pudo abrir el archivo .fpg:" << filename;
-        return false;
+public:
+    explicit FPGStream(QFile &file)
+        : m_file(file), m_gzip(false), m_end(false), m_pos(0) {}
+    ~FPGStream()
+    {
+        if (m_gzip)
+            inflateEnd(&m_strm);
     }
 
-    // Leer header principal (8 bytes)
-    QByteArray headerBytes = file.read(8);
-    qDebug() << "Header leído (hex):" << headerBytes.toHex();
-
-    QByteArray uncompressedData;
-
-    // Detectar gzip
-    if (headerBytes.startsWith(QByteArray::fromHex("1f8b"))) {
-        qDebug() << "Archivo FPG comprimido con gzip detectado";
-
-        // Volver al inicio y leer todo para descompresión
-        file.seek(0);
-        QByteArray compressedData = file.readAll();
-
-        // Descompresión robusta con buffer dinámico
-        z_stream strm;
-        strm.zalloc = Z_NULL;
-        strm.zfree = Z_NULL;
-        strm.opaque = Z_NULL;
-        strm.avail_in = compressedData.size();
-        strm.next_in = (Bytef*)compressedData.data();
-
-        // Inicializar inflate con modo gzip (+16)
-        int ret = inflateInit2(&strm, 15 + 16);
-        if (ret != Z_OK) {
-            qDebug() << "inflateInit2 failed:" << ret;
-            qWarning() << "Fallo al inicializar descompresión gzip";
+    bool open()
+    {
+        m_gzip = m_file.peek(2) == QByteArray::fromHex("1f8b");
+        if (!m_gzip)
+            return true;
+
+        m_strm.zalloc = Z_NULL;
+        m_strm.zfree = Z_NULL;
+        m_strm.opaque = Z_NULL;
+        m_strm.next_in = Z_NULL;
+        m_strm.avail_in = 0;
+        m_input.resize(FPG_INPUT_BLOCK);
+        // Modo gzip (+16)
+        if (inflateInit2(&m_strm, 15 + 16) != Z_OK) {
+            m_gzip = false;
             return false;
         }
+        return true;
+    }
 
-        // Buffer dinámico que crece según necesidad
-        QByteArray buffer;
-        buffer.resize(4096); // Tamaño inicial
-
-        do {
-            strm.avail_out = buffer.size();
-            strm.next_out = (Bytef*)buffer.data();
+    bool isCompressed() const { return m_gzip; }
 
-            ret = inflate(&strm, Z_NO_FLUSH);
+    // Posición en el FPG descomprimido
+    qint64 pos() const { return m_pos; }
 
-            if (ret == Z_STREAM_ERROR) {
-                qDebug() << "inflate error:" << ret;
-                inflateEnd(&strm);
-                qWarning() << "Error durante descompresión gzip";
+    // Lee exactamente size bytes; false al llegar al final o ante un error
+    bool read(char *dst, qint64 size)
+    {
+        if (!m_gzip) {
+            if (m_file.read(dst, size) != size)
                 return false;
-            }
-
-            // Calcular bytes descomprimidos en esta iteración
-            size_t have = buffer.size() - strm.avail_out;
-            uncompressedData.append(buffer.data(), have);
+            m_pos += size;
+            return true;
+        }
+        if (m_end || size > 0x7fffffff)
+            return false;
 
-            // Si necesitamos más espacio, agrandar buffer
-            if (strm.avail_out == 0) {
-                buffer.resize(buffer.size() * 2);
+        m_strm.next_out = reinterpret_cast<Bytef *>(dst);
+        m_strm.avail_out = uInt(size);
+        while (m_strm.avail_out > 0) {
+            if (m_strm.avail_in == 0) {
+                qint64 got = m_file.read(m_input.data(), m_input.size());
+                if (got <= 0)
+                    return false;
+                m_strm.next_in = reinterpret_cast<Bytef *>(m_input.data());
+                m_strm.avail_in = uInt(got);
             }
 
-        } while (ret != Z_STREAM_END);
+            int ret = inflate(&m_strm, Z_NO_FLUSH);
+            if (ret == Z_STREAM_END) {
+                m_end = true;
+                break;
+            }
+            if (ret != Z_OK && ret != Z_BUF_ERROR)
+                return false;
+        }
+        if (m_strm.avail_out > 0)
+            return false;
+        m_pos += size;
+        return true;
+    }
 
-        inflateEnd(&strm);
-        qDebug() << "Descompresión exitosa - Bytes descomprimidos:" << uncompressedData.size();
+    bool skip(qint64 size)
+    {
+        if (!m_gzip) {
+            if (m_pos + size > m_file.size() || !m_file.seek(m_pos + size))
+                return false;
+            m_pos += size;
+            return true;
+        }
 
-    } else {
-        // Archivo sin comprimir
-        file.seek(0);
-        uncompressedData = file.readAll();
-        qDebug() << "Archivo FPG sin comprimir detectado";
+        // Un archivo comprimido solo se puede recorrer inflándolo
+        if (m_skipBuffer.isEmpty())
+            m_skipBuffer.resize(FPG_INPUT_BLOCK);
+        while (size > 0) {
+            qint64 step = qMin<qint64>(size, m_skipBuffer.size());
+            if (!read(m_skipBuffer.data(), step))
+                return false;
+            size -= step;
+        }
+        return true;
     }
 
-    file.close();
+    // Solo hacia delante en archivos comprimidos
+    bool seek(qint64 pos)
+    {
+        if (pos < m_pos) {
+            if (m_gzip || !m_file.seek(pos))
+                return false;
+            m_pos = pos;
+            return true;
+        }
+        return skip(pos - m_pos);
+    }
 
-    // Validar magic number del formato FPG (case-insensitive)
-    if (uncompressedData.size() < 8) {
+private:
+    QFile &m_file;
+    bool m_gzip;
+    bool m_end;
+    qint64 m_pos;
+    z_stream m_strm;
+    QByteArray m_input;
+    QByteArray m_skipBuffer;
+};
+
+// Valida la cabecera "f32" del FPG (case-insensitive)
+bool readFPGHeader(FPGStream &stream)
+{
+    char header[FPG_HEADER_SIZE];
+    if (!stream.read(header, FPG_HEADER_SIZE)) {
         qWarning() << "Archivo FPG demasiado pequeño";
         return false;
     }
 
-    QString magicOriginal = QString::fromLatin1(uncompressedData.left(7));
-    QString magicBase = magicOriginal.left(3).toUpper();
-
-    if (magicBase != "F32") {
+    QString magicOriginal = QString::fromLatin1(header, 7);
+    if (magicOriginal.left(3).toUpper() != "F32") {
         qWarning() << QString("Formato .fpg inválido - se esperaba 'F32*', se encontró '%1'")
                           .arg(magicOriginal);
         return false;
     }
+    return true;
+}
 
-    qDebug() << "Magic number original:" << magicOriginal;
-    qDebug() << "Magic number validado correctamente";
+// Lee la cabecera del siguiente chunk y salta sus control points. Devuelve
+// false al final del archivo o si la cabecera no es válida
+bool readChunkHeader(FPGStream &stream, FPG_CHUNK &chunk)
+{
+    char chunkHeader[FPG_CHUNK_HEADER_SIZE];
+    if (!stream.read(chunkHeader, FPG_CHUNK_HEADER_SIZE))
+        return false; // Fin del archivo
+
+    // FPG_CHUNK en little-endian: code, regsize, name[32], filename[12],
+    // width, height, flags
+    const uchar *fields = reinterpret_cast<const uchar *>(chunkHeader);
+    chunk.code = qFromLittleEndian<qint32>(fields);
+    chunk.regsize = qFromLittleEndian<qint32>(fields + 4);
+    chunk.width = qFromLittleEndian<qint32>(fields + 52);
+    chunk.height = qFromLittleEndian<qint32>(fields + 56);
+    chunk.flags = qFromLittleEndian<qint32>(fields + 60);
+
+    // Validar que el código sea razonable (evitar IDs basura como 0xFFFFFFFF)
+    if (chunk.code < 0 || chunk.code > FPG_MAX_CODE ||
+        chunk.width <= 0 || chunk.height <= 0 || chunk.flags < 0) {
+        qDebug() << "Chunk inválido en" << stream.pos() << ", finalizando lectura";
+        return false;
+    }
 
-    // Configurar QDataStream con endianness correcto
-    QDataStream in(uncompressedData);
-    in.setByteOrder(QDataStream::LittleEndian);  // ¡CRUCIAL! BennuGD2 usa little-endian
-    in.setFloatingPointPrecision(QDataStream::SinglePrecision);
+    // Control points (x, y de 16 bits), el editor no los usa
+    return chunk.flags == 0 ||
+           stream.skip(qint64(chunk.flags) * sizeof(FPG_CONTROL_POINT));
+}
 
-    // Saltar header (8 bytes)
-    in.skipRawData(8);
+// Lee los píxeles de un mapa directamente en la memoria de un QImage.
+// Los bytes B, G, R, A de cada píxel son un entero little-endian
+// 0xAARRGGBB, el formato de Format_ARGB32: se leen tal cual, sin
+// intercambiar canales (filas de width * 4 bytes, sin relleno)
+bool readChunkPixels(FPGStream &stream, int width, int height, QImage &image)
+{
+    image = QImage(width, height, QImage::Format_ARGB32);
+    if (image.isNull()) {
+        qWarning() << "Error al crear QImage de" << width << "x" << height;
+        return false;
+    }
 
-    // Procesar chunks del archivo FPG
-    int chunkCount = 0;
-    textures.clear();
+    qint64 pixelDataSize = qint64(width) * height * 4;
+    if (!stream.read(reinterpret_cast<char *>(image.bits()), pixelDataSize)) {
+        qDebug() << "Error: no se pudieron leer todos los bytes del chunk";
+        return false;
+    }
+#if Q_BYTE_ORDER == Q_BIG_ENDIAN
+    quint32 *pixels = reinterpret_cast<quint32 *>(image.bits());
+    for (qint64 i = 0; i < pixelDataSize / 4; i++)
+        pixels[i] = qFromLittleEndian(pixels[i]);
+#endif
+    return true;
+}
 
-    qDebug() << "Iniciando lectura de chunks...";
+// Convierte un mapa al formato interno de QPixmap en un hilo del pool: el
+// premultiplicado usa las rutas SIMD de Qt y QPixmap::fromImage queda en
+// una copia en el hilo de la interfaz
+class PremultiplyTask : public QRunnable
+{
+public:
+    explicit PremultiplyTask(FPGImage *image) : m_image(image) {}
 
-    while (!in.atEnd()) {
-        // Check if we have enough bytes left for a chunk header (68 bytes minimum)
-        if (in.device()->bytesAvailable() < 68) {
-            qDebug() << "No hay suficientes bytes para otro chunk, finalizando lectura";
-            break;
+    void run() override
+    {
+        m_image->image = std::move(m_image->image)
+                             .convertToFormat(QImage::Format_ARGB32_Premultiplied);
+    }
+
+private:
+    FPGImage *m_image;
+};
+
+// Recoge los mapas leídos mientras el pool los convierte
+class ImageCollector
+{
+public:
+    ~ImageCollector() { finish(nullptr); }
+
+    void add(int code, const QImage &image)
+    {
+        FPGImage *result = new FPGImage;
+        result->code = code;
+        result->image = image;
+        m_decoded.append(result);
+        m_pool.start(new PremultiplyTask(result));
+    }
+
+    void finish(QVector<FPGImage> *images)
+    {
+        m_pool.waitForDone();
+        if (images) {
+            images->reserve(images->size() + m_decoded.size());
+            for (FPGImage *result : m_decoded)
+                images->append(*result);
         }
-        
-        // Leer estructura FPG_info usando operadores >> que respetan endianness
-        FPG_CHUNK chunk;
-        in >> chunk.code >> chunk.regsize;
-        in.readRawData(chunk.name, 32);
-        in.readRawData(chunk.filename, 12);
-        in >> chunk.width >> chunk.height >> chunk.flags;
-
-        if (in.status() != QDataStream::Ok) {
-            qDebug() << "Error leyendo chunk header";
-            break;
+        qDeleteAll(m_decoded);
+        m_decoded.clear();
+    }
+
+private:
+    QThreadPool m_pool;
+    QList<FPGImage *> m_decoded;
+};
+
+// Recorre el FPG en una sola pasada. Anota la posición de cada mapa en
+// index (si no es nulo) y decodifica los códigos de wanted, o todos si
+// wanted es nulo
+bool scanFPG(const QString &filename, QVector<FPGIndexEntry> *index,
+             QVector<FPGImage> *images, const QSet<int> *wanted,
+             std::function<void(int, int, const QString&)> progressCallback)
+{
+    QFile file(filename);
+    if (!file.open(QIODevice::ReadOnly)) {
+        qWarning() << "No se pudo abrir el archivo .fpg:" << filename;
+        return false;
+    }
+
+    FPGStream stream(file);
+    if (!stream.open()) {
+        qWarning() << "Fallo al inicializar descompresión gzip";
+        return false;
+    }
+    if (!readFPGHeader(stream))
+        return false;
+
+    // Cada mapa se infla directamente en la memoria de su QImage y se pasa
+    // al pool para premultiplicarlo mientras se lee el siguiente
+    ImageCollector collector;
+    int chunkCount = 0;
+    FPG_CHUNK chunk;
+    while (readChunkHeader(stream, chunk)) {
+        qint64 pixelDataSize = qint64(chunk.width) * chunk.height * 4; // BGRA
+        bool oversized = chunk.width > FPG_MAX_SIDE || chunk.height > FPG_MAX_SIDE;
+        if (oversized)
+            qDebug() << "Chunk" << chunk.code << "demasiado grande, saltando";
+
+        if (index && !oversized) {
+            FPGIndexEntry entry;
+            entry.code = chunk.code;
+            entry.offset = stream.pos();
+            entry.width = chunk.width;
+            entry.height = chunk.height;
+            index->append(entry);
         }
 
-        qDebug() << QString("Chunk %1 : código=%2, tamaño=%3x%4, flags=%5")
-                        .arg(chunkCount + 1)
-                        .arg(chunk.code)
-                        .arg(chunk.width)
-                        .arg(chunk.height)
-                        .arg(chunk.flags);
-
-        // Validar dimensiones del chunk
-        if (chunk.width <= 0 || chunk.height <= 0 ||
-            chunk.width > 4096 || chunk.height > 4096) {
-            qDebug() << "Chunk con dimensiones inválidas, saltando";
+        bool decode = images && !oversized && (!wanted || wanted->contains(chunk.code));
+        if (!decode) {
+            if (!stream.skip(pixelDataSize))
+                break;
             continue;
         }
-        
-        // Validar que el código sea razonable (evitar IDs basura como 0xFFFFFFFF)
-        if (chunk.code < 0 || chunk.code > 100000) {
-            qDebug() << "Chunk con código inválido:" << chunk.code << ", finalizando lectura";
+
+        QImage image;
+        if (!readChunkPixels(stream, chunk.width, chunk.height, image))
             break;
-        }
+        collector.add(chunk.code, image);
 
-        // Leer control points si flags > 0
-        if (chunk.flags > 0) {
-            int numPoints = chunk.flags;
-            for (int i = 0; i < numPoints; i++) {
-                int16_t x, y;
-                in >> x >> y;
-            }
+        // Reportar progreso si hay callback
+        if (progressCallback) {
+            QString texName = QString("Textura %1").arg(chunk.code);
+            progressCallback(chunkCount, -1, texName); // -1 = total desconocido aún
         }
+        chunkCount++;
+    }
 
-        // Calcular tamaño de datos de píxeles según formato
-        int pixelDataSize = chunk.width * chunk.height * 4; // 32 bits RGBA
+    collector.finish(images);
+    return true;
+}
 
-        // Leer datos de píxeles
-        char* pixelBuffer = new char[pixelDataSize];
-        int bytesRead = in.readRawData(pixelBuffer, pixelDataSize);
+// Escritura secuencial del FPG. Con compresión los datos pasan por deflate
+// según llegan y se escriben en bloques de FPG_INPUT_BLOCK, sin construir el
+// archivo en memoria
+class FPGWriter
+{
+public:
+    FPGWriter(QIODevice &file, int level)
+        : m_file(file), m_level(level), m_deflating(false) {}
+    ~FPGWriter()
+    {
+        if (m_deflating)
+            deflateEnd(&m_strm);
+    }
 
-        if (bytesRead != pixelDataSize) {
-            qDebug() << "Error: no se pudieron leer todos los bytes del chunk";
-            delete[] pixelBuffer;
-            break;
-        }
+    bool open()
+    {
+        if (m_level <= 0)
+            return true;
 
-        // Convertir de BGRA a RGBA manualmente para corregir colores
-        for (int i = 0; i < pixelDataSize; i += 4) {
-            char temp = pixelBuffer[i];
-            pixelBuffer[i] = pixelBuffer[i + 2];   // R = B
-            pixelBuffer[i + 2] = temp;             // B = R
-            // G y A permanecen igual
-        }
+        memset(&m_strm, 0, sizeof(m_strm));
+        // Modo gzip (+16)
+        if (deflateInit2(&m_strm, m_level, Z_DEFLATED, 15 + 16, 8,
+                         Z_DEFAULT_STRATEGY) != Z_OK)
+            return false;
+        m_block.resize(FPG_INPUT_BLOCK);
+        m_deflating = true;
+        return true;
+    }
 
-        // Crear QImage desde el buffer corregido
-        QImage image(reinterpret_cast<const uchar*>(pixelBuffer),
-                     chunk.width, chunk.height, QImage::Format_RGBA8888);
-
-        if (!image.isNull()) {
-            // Crear QPixmap y añadir a textures
-            QPixmap pixmap = QPixmap::fromImage(image);
-            TextureEntry tex(filename, chunk.code);
-            tex.pixmap = pixmap;
-            textures.append(tex);
-            qDebug() << "Textura" << chunk.code << "cargada exitosamente";
-            
-            // Reportar progreso si hay callback
-            if (progressCallback) {
-                QString texName = QString("Textura %1").arg(chunk.code);
-                progressCallback(chunkCount, -1, texName); // -1 = total desconocido aún
-            }
-        } else {
-            qWarning() << "Error al crear QImage para chunk" << chunk.code;
-        }
+    bool write(const char *data, qint64 size)
+    {
+        if (!m_deflating)
+            return m_file.write(data, size) == size;
+        return deflateData(data, size, Z_NO_FLUSH);
+    }
 
-        delete[] pixelBuffer;
-        chunkCount++;
+    // Vacía deflate y escribe el final del gzip
+    bool finish()
+    {
+        if (!m_deflating)
+            return true;
+        bool ok = deflateData(nullptr, 0, Z_FINISH);
+        deflateEnd(&m_strm);
+        m_deflating = false;
+        return ok;
+    }
 
-        // Límite de seguridad para evitar bucles infinitos
-        if (chunkCount > 1000) {
-            qDebug() << "Alcanzado límite máximo de chunks";
+private:
+    bool deflateData(const char *data, qint64 size, int flush)
+    {
+        if (size > 0x7fffffff)
+            return false;
+
+        m_strm.next_in = reinterpret_cast<Bytef *>(const_cast<char *>(data));
+        m_strm.avail_in = uInt(size);
+        int ret;
+        do {
+            m_strm.next_out = reinterpret_cast<Bytef *>(m_block.data());
+            m_strm.avail_out = uInt(m_block.size());
+            ret = deflate(&m_strm, flush);
+            if (ret == Z_STREAM_ERROR)
+                return false;
+            qint64 have = m_block.size() - m_strm.avail_out;
+            if (have > 0 && m_file.write(m_block.constData(), have) != have)
+                return false;
+        } while (m_strm.avail_out == 0);
+        return flush != Z_FINISH || ret == Z_STREAM_END;
+    }
+
+    QIODevice &m_file;
+    int m_level;
+    bool m_deflating;
+    z_stream m_strm;
+    QByteArray m_block;
+};
+
+// Pasa un mapa a ARGB32 sin premultiplicar en un hilo del pool: en memoria
+// es BGRA little-endian, el orden del FPG, y se escribe sin más copias
+class UnpremultiplyTask : public QRunnable
+{
+public:
+    explicit UnpremultiplyTask(QImage *image) : m_image(image) {}
+
+    void run() override
+    {
+        *m_image = std::move(*m_image).convertToFormat(QImage::Format_ARGB32);
+    }
+
+private:
+    QImage *m_image;
+};
+
+// Escribe un chunk: cabecera FPG_CHUNK sin control points y píxeles BGRA
+bool writeChunk(FPGWriter &writer, int code, const QString &name, const QImage &image)
+{
+    qint64 pixelDataSize = qint64(image.width()) * image.height() * 4;
+
+    // Regsize: size of data + struct remaining fields (starting from name)
+    // name(32) + filename(12) + width(4) + height(4) + flags(4) = 56 bytes
+    // + control points (flags * 4) (0 in this case)
+    // + pixel data
+    char chunkHeader[FPG_CHUNK_HEADER_SIZE];
+    memset(chunkHeader, 0, sizeof(chunkHeader));
+    uchar *fields = reinterpret_cast<uchar *>(chunkHeader);
+    qToLittleEndian<qint32>(code, fields);
+    qToLittleEndian<qint32>(qint32(56 + pixelDataSize), fields + 4);
+
+    QByteArray baseName = name.left(31).toLatin1();
+    memcpy(chunkHeader + 8, baseName.constData(), baseName.size());
+    memcpy(chunkHeader + 40, baseName.constData(), qMin(baseName.size(), 11));
+
+    qToLittleEndian<qint32>(image.width(), fields + 52);
+    qToLittleEndian<qint32>(image.height(), fields + 56);
+    qToLittleEndian<qint32>(0, fields + 60); // No control points
+    if (!writer.write(chunkHeader, FPG_CHUNK_HEADER_SIZE))
+        return false;
+
+#if Q_BYTE_ORDER == Q_BIG_ENDIAN
+    QVector<quint32> line(image.width());
+    for (int y = 0; y < image.height(); y++) {
+        const quint32 *pixels = reinterpret_cast<const quint32 *>(image.constScanLine(y));
+        for (int x = 0; x < image.width(); x++)
+            line[x] = qToLittleEndian(pixels[x]);
+        if (!writer.write(reinterpret_cast<const char *>(line.constData()),
+                          image.width() * 4))
+            return false;
+    }
+    return true;
+#else
+    // Filas de 32 bits sin relleno: la imagen se escribe de una vez
+    return writer.write(reinterpret_cast<const char *>(image.constBits()),
+                        pixelDataSize);
+#endif
+}
+
+} // namespace
+
+FPGLoader::FPGLoader()
+{
+}
+
+bool FPGLoader::loadFPG(const QString &filename, QVector<TextureEntry> &textures,
+                        std::function<void(int, int, const QString&)> progressCallback)
+{
+    QVector<FPGImage> images;
+    bool ok = loadFPGImages(filename, images, progressCallback);
+
+    textures.clear();
+    textures.reserve(images.size());
+    for (FPGImage &image : images) {
+        TextureEntry tex(filename, image.code);
+        tex.pixmap = QPixmap::fromImage(std::move(image.image));
+        textures.append(tex);
+    }
+    return ok;
+}
+
+bool FPGLoader::loadFPGImages(const QString &filename, QVector<FPGImage> &images,
+                              std::function<void(int, int, const QString&)> progressCallback)
+{
+    images.clear();
+    if (!scanFPG(filename, nullptr, &images, nullptr, progressCallback))
+        return false;
+
+    qDebug() << "Texturas FPG cargadas:" << images.size();
+    return images.size() > 0;
+}
+
+bool FPGLoader::indexFPG(const QString &filename, QVector<FPGIndexEntry> &index,
+                         QVector<FPGImage> *images, const QSet<int> &decodeCodes)
+{
+    index.clear();
+    if (images)
+        images->clear();
+    if (!scanFPG(filename, &index, images, &decodeCodes, nullptr))
+        return false;
+
+    qDebug() << "FPG indexado:" << index.size() << "mapas,"
+             << (images ? images->size() : 0) << "decodificados";
+    return index.size() > 0;
+}
+
+bool FPGLoader::loadFPGImages(const QString &filename,
+                              const QVector<FPGIndexEntry> &entries,
+                              QVector<FPGImage> &images)
+{
+    images.clear();
+    if (entries.isEmpty())
+        return true;
+
+    QFile file(filename);
+    if (!file.open(QIODevice::ReadOnly)) {
+        qWarning() << "No se pudo abrir el archivo .fpg:" << filename;
+        return false;
+    }
+
+    FPGStream stream(file);
+    if (!stream.open() || !readFPGHeader(stream))
+        return false;
+
+    // En orden de posición: un FPG comprimido solo se recorre hacia delante
+    QVector<FPGIndexEntry> sorted = entries;
+    std::sort(sorted.begin(), sorted.end(),
+              [](const FPGIndexEntry &a, const FPGIndexEntry &b) {
+                  return a.offset < b.offset;
+              });
+
+    ImageCollector collector;
+    bool ok = true;
+    for (const FPGIndexEntry &entry : sorted) {
+        QImage image;
+        if (!stream.seek(entry.offset) ||
+            !readChunkPixels(stream, entry.width, entry.height, image)) {
+            qWarning() << "No se pudo leer el mapa" << entry.code << "de" << filename;
+            ok = false;
             break;
         }
+        collector.add(entry.code, image);
     }
 
-    qDebug() << "Procesados" << chunkCount << "chunks";
-    qDebug() << "Texturas FPG cargadas:" << textures.size();
-
-    return textures.size() > 0;
+    collector.finish(&images);
+    return ok;
 }
 
 bool FPGLoader::saveFPG(const QString &filename, const QVector<TextureEntry> &textures, bool compress)
 {
-    if (textures.isEmpty()) {
+    return saveFPGImages(filename, toImages(textures),
+                         compress ? DefaultCompression : NoCompression);
+}
+
+QVector<FPGImage> FPGLoader::toImages(const QVector<TextureEntry> &textures)
+{
+    // toImage() comparte los píxeles del pixmap siempre que puede: la copia
+    // de verdad se hace al convertir cada mapa mientras se guarda
+    QVector<FPGImage> images;
+    images.reserve(textures.size());
+    for (const TextureEntry &tex : textures) {
+        if (tex.pixmap.isNull()) continue;
+
+        FPGImage image;
+        image.code = tex.id;
+        image.name = tex.filename;
+        image.image = tex.pixmap.toImage();
+        images.append(image);
+    }
+    return images;
+}
+
+bool FPGLoader::saveFPGImages(const QString &filename, const QVector<FPGImage> &images,
+                              int compressionLevel,
+                              std::function<void(int, int, const QString&)> progressCallback)
+{
+    if (images.isEmpty()) {
         qWarning() << "No textures to save";
         return false;
     }
-    
-    QByteArray fpgData;
-    QDataStream out(&fpgData, QIODevice::WriteOnly);
-    out.setByteOrder(QDataStream::LittleEndian);
-    out.setFloatingPointPrecision(QDataStream::SinglePrecision);
-    
+
+    // Se escribe en un archivo temporal que sustituye al FPG solo al terminar
+    QSaveFile file(filename);
+    if (!file.open(QIODevice::WriteOnly)) {
+        qWarning() << "Failed to open file for writing:" << filename;
+        return false;
+    }
+
+    FPGWriter writer(file, qBound(0, compressionLevel, 9));
+    if (!writer.open()) {
+        qWarning() << "Failed to initialize compression";
+        return false;
+    }
+
     // Write FPG header correctly "f32\x1A\x0D\x0A\x00\x00" (8 bytes)
     // Standard BennuGD header structure for 32-bit FPG
     const char header[8] = {'f', '3', '2', '\x1A', '\x0D', '\x0A', '\x00', '\x00'};
-    out.writeRawData(header, 8);
-    
-    qDebug() << "Writing FPG with" << textures.size() << "textures";
-    
-    // Write each texture as a chunk
-    for (const TextureEntry &tex : textures) {
-        if (tex.pixmap.isNull()) continue;
-        
-        // Convert pixmap to image
-        QImage image = tex.pixmap.toImage().convertToFormat(QImage::Format_RGBA8888);
-        
-        // Calculate data size
-        int pixelDataSize = image.width() * image.height() * 4;
-        
-        // Write chunk header
-        FPG_CHUNK chunk;
-        chunk.code = tex.id;
-        
-        // Regsize: size of data + struct remaining fields (starting from name)
-        // name(32) + filename(12) + width(4) + height(4) + flags(4) = 56 bytes
-        // + control points (flags * 4) (0 in this case)
-        // + pixel data
-        chunk.regsize = 56 + pixelDataSize;
-        
-        // Fill name and filename
-        memset(chunk.name, 0, 32);
-        memset(chunk.filename, 0, 12);
-        
-        QString baseName = tex.filename;
-        if (baseName.length() > 31) baseName = baseName.left(31);
-        strncpy(chunk.name, baseName.toLatin1().constData(), 31);
-        
-        QString shortName = baseName;
-        if (shortName.length() > 11) shortName = shortName.left(11);
-        strncpy(chunk.filename, shortName.toLatin1().constData(), 11);
-        
-        chunk.width = image.width();
-        chunk.height = image.height();
-        chunk.flags = 0; // No control points
-        
-        qDebug() << "Writing texture" << chunk.code << "size:" << chunk.width << "x" << chunk.height << "regsize:" << chunk.regsize;
-        
-        // Write chunk header - ensure we write int32 values
-        qint32 code32 = chunk.code;
-        qint32 regsize32 = chunk.regsize;
-        qint32 width32 = chunk.width;
-        qint32 height32 = chunk.height;
-        qint32 flags32 = chunk.flags;
-        
-        out << code32 << regsize32;
-        out.writeRawData(chunk.name, 32);
-        out.writeRawData(chunk.filename, 12);
-        out << width32 << height32 << flags32;
-        
-        // Convert RGBA to BGRA for FPG format
-        // pixelDataSize already calculated above
-        char* pixelBuffer = new char[pixelDataSize];
-        memcpy(pixelBuffer, image.constBits(), pixelDataSize);
-        
-        // Swap R and B channels
-        for (int i = 0; i < pixelDataSize; i += 4) {
-            char temp = pixelBuffer[i];
-            pixelBuffer[i] = pixelBuffer[i + 2];   // R = B
-            pixelBuffer[i + 2] = temp;             // B = R
-        }
-        
-        // Write pixel data
-        out.writeRawData(pixelBuffer, pixelDataSize);
-        delete[] pixelBuffer;
-    }
-    
-    // Write to file
-    QFile file(filename);
-    if (!file.open(QIODevice::WriteOnly)) {
-        qWarning() << "Failed to open file for writing:" << filename;
+    if (!writer.write(header, 8)) {
+        qWarning() << "Error writing FPG:" << filename;
         return false;
     }
-    
-    if (compress) {
-        // Compress with gzip
-        z_stream strm;
-        strm.zalloc = Z_NULL;
-        strm.zfree = Z_NULL;
-        strm.opaque = Z_NULL;
-        
-        int ret = deflateInit2(&strm, Z_DEFAULT_COMPRESSION, Z_DEFLATED, 15 + 16, 8, Z_DEFAULT_STRATEGY);
-        if (ret != Z_OK) {
-            qWarning() << "Failed to initialize compression";
-            file.close();
-            return false;
+
+    qDebug() << "Writing FPG with" << images.size() << "textures";
+
+    // Los mapas se convierten en paralelo por tandas y cada tanda se escribe
+    // en orden y se libera: en memoria solo hay una tanda convertida
+    QThreadPool pool;
+    const int batchSize = qMax(1, pool.maxThreadCount()) * 2;
+    for (int first = 0; first < images.size(); first += batchSize) {
+        int count = qMin(batchSize, images.size() - first);
+        QVector<QImage> batch(count);
+        for (int i = 0; i < count; i++) {
+            batch[i] = images[first + i].image;
+            pool.start(new UnpremultiplyTask(&batch[i]));
         }
-        
-        strm.avail_in = fpgData.size();
-        strm.next_in = (Bytef*)fpgData.data();
-        
-        // Allocate buffer large enough for compressed data
-        // deflateBound gives upper bound on compressed size
-        uLong compressedBound = deflateBound(&strm, fpgData.size());
-        QByteArray compressedData;
-        compressedData.resize(compressedBound);
-        
-        strm.avail_out = compressedData.size();
-        strm.next_out = (Bytef*)compressedData.data();
-        
-        ret = deflate(&strm, Z_FINISH);
-        if (ret != Z_STREAM_END) {
-            qWarning() << "Compression failed, ret =" << ret;
-            deflateEnd(&strm);
-            file.close();
-            return false;
+        pool.waitForDone();
+
+        for (int i = 0; i < count; i++) {
+            const FPGImage &source = images[first + i];
+            if (!writeChunk(writer, source.code, source.name, batch[i])) {
+                qWarning() << "Error writing texture" << source.code << "to" << filename;
+                return false;
+            }
+            batch[i] = QImage();
+
+            if (progressCallback)
+                progressCallback(first + i + 1, images.size(),
+                                 QString("Textura %1").arg(source.code));
         }
-        
-        uLong compressedSize = compressedData.size() - strm.avail_out;
-        deflateEnd(&strm);
-        
-        qDebug() << "Compressed" << fpgData.size() << "bytes to" << compressedSize << "bytes";
-        
-        file.write(compressedData.data(), compressedSize);
-    } else {
-        // Write uncompressed
-        file.write(fpgData);
-    }
-    
-    file.close();
-    qDebug() << "FPG saved successfully:" << filename << "(" << textures.size() << "textures)";
+    }
+
+    if (!writer.finish() || !file.commit()) {
+        qWarning() << "Error writing FPG:" << filename;
+        return false;
+    }
+
+    qDebug() << "FPG saved successfully:" << filename << "(" << images.size() << "textures)";
     return true;
 }
 
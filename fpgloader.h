@@ -4,6 +4,8 @@
 #include <QString>
 #include <QVector>
 #include <QMap>
+#include <QSet>
+#include <QImage>
 #include <QPixmap>
 #include <functional>
 #include "mapdata.h"
@@ -24,6 +26,23 @@ typedef struct {
     uint16_t y;
 } FPG_CONTROL_POINT;
 
+// Posición de un mapa dentro del FPG, para decodificarlo más tarde
+struct FPGIndexEntry {
+    int code;
+    qint64 offset; // Inicio de los píxeles en el FPG descomprimido
+    int width;
+    int height;
+
+    qint64 byteSize() const { return qint64(width) * height * 4; }
+};
+
+// Mapa decodificado de un FPG, antes de convertirlo en QPixmap
+struct FPGImage {
+    int code;
+    QImage image;
+    QString name; // Nombre del mapa al guardar
+};
+
 class FPGLoader
 {
 public:
@@ -33,10 +52,48 @@ public:
     // progressCallback: función opcional que recibe (current, total, textureName)
     static bool loadFPG(const QString &filename, QVector<TextureEntry> &textures,
                        std::function<void(int, int, const QString&)> progressCallback = nullptr);
+
+    // Igual que loadFPG pero solo decodifica a QImage: se puede llamar desde
+    // un hilo de trabajo (QPixmap solo existe en el hilo de la interfaz).
+    // Lee el archivo en una sola pasada sin límite de mapas; las imágenes
+    // salen en ARGB32 premultiplicado, convertidas en paralelo
+    static bool loadFPGImages(const QString &filename, QVector<FPGImage> &images,
+                              std::function<void(int, int, const QString&)> progressCallback = nullptr);
+
+    // Recorre las cabeceras del FPG y anota dónde está cada mapa, saltando
+    // los píxeles. Si images no es nulo decodifica además, en la misma
+    // pasada, los mapas de decodeCodes
+    static bool indexFPG(const QString &filename, QVector<FPGIndexEntry> &index,
+                         QVector<FPGImage> *images = nullptr,
+                         const QSet<int> &decodeCodes = QSet<int>());
+
+    // Decodifica solo los mapas indicados, obtenidos con indexFPG. En un FPG
+    // comprimido hay que inflar hasta cada mapa: conviene pedirlos juntos
+    static bool loadFPGImages(const QString &filename,
+                              const QVector<FPGIndexEntry> &entries,
+                              QVector<FPGImage> &images);
     
+    // Niveles de gzip para saveFPGImages
+    enum CompressionLevel {
+        NoCompression = 0,
+        FastCompression = 1,    // Guardados frecuentes
+        DefaultCompression = 6,
+        BestCompression = 9
+    };
+
     // Guardar archivo FPG
     static bool saveFPG(const QString &filename, const QVector<TextureEntry> &textures,
                        bool compress = false);
+
+    // Igual que saveFPG desde mapas en QImage, así que se puede llamar desde
+    // un hilo de trabajo. Los mapas se convierten en paralelo y los chunks se
+    // comprimen y escriben según se generan
+    static bool saveFPGImages(const QString &filename, const QVector<FPGImage> &images,
+                              int compressionLevel = NoCompression,
+                              std::function<void(int, int, const QString&)> progressCallback = nullptr);
+
+    // Texturas como QImage para saveFPGImages (hilo de la interfaz)
+    static QVector<FPGImage> toImages(const QVector<TextureEntry> &textures);
     
     // Obtener mapa de texturas por ID
     static QMap<int, QPixmap> getTextureMap(const QVector<TextureEntry> &textures);
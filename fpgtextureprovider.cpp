@@ -0,0 +1,110 @@
+#include "fpgtextureprovider.h"
+#include <QDebug>
+#include <algorithm>
+#include <climits>
+
+namespace {
+const qint64 DEFAULT_BUDGET = 256 * 1024 * 1024;
+
+int costOf(const QPixmap &pixmap) {
+  qint64 bytes = qint64(pixmap.width()) * pixmap.height() * 4;
+  return int(qMax<qint64>(1, bytes / 1024));
+}
+} // namespace
+
+FPGTextureProvider::FPGTextureProvider() { setMemoryBudget(DEFAULT_BUDGET); }
+
+bool FPGTextureProvider::open(const QString &filename) {
+  QVector<FPGIndexEntry> index;
+  if (!FPGLoader::indexFPG(filename, index)) {
+    close();
+    return false;
+  }
+  setIndex(filename, index);
+  return true;
+}
+
+void FPGTextureProvider::setIndex(const QString &filename,
+                                  const QVector<FPGIndexEntry> &index) {
+  close();
+  m_filename = filename;
+  m_index.reserve(index.size());
+  for (const FPGIndexEntry &entry : index)
+    m_index.insert(entry.code, entry);
+}
+
+void FPGTextureProvider::close() {
+  m_filename.clear();
+  m_index.clear();
+  m_cache.clear();
+}
+
+QList<int> FPGTextureProvider::codes() const {
+  QList<int> result = m_index.keys();
+  std::sort(result.begin(), result.end());
+  return result;
+}
+
+QSize FPGTextureProvider::textureSize(int code) const {
+  auto it = m_index.constFind(code);
+  if (it == m_index.constEnd())
+    return QSize();
+  return QSize(it->width, it->height);
+}
+
+QPixmap FPGTextureProvider::texture(int code) {
+  if (QPixmap *cached = m_cache.object(code))
+    return *cached;
+
+  QSet<int> codes;
+  codes.insert(code);
+  return textures(codes).value(code);
+}
+
+QMap<int, QPixmap> FPGTextureProvider::textures(const QSet<int> &codes) {
+  // Hits first; misses are decoded together in one pass over the file
+  QMap<int, QPixmap> result;
+  QVector<FPGIndexEntry> missing;
+  for (int code : codes) {
+    if (QPixmap *cached = m_cache.object(code))
+      result.insert(code, *cached);
+    else if (m_index.contains(code))
+      missing.append(m_index.value(code));
+  }
+  if (missing.isEmpty())
+    return result;
+
+  QVector<FPGImage> images;
+  if (!FPGLoader::loadFPGImages(m_filename, missing, images))
+    qWarning() << "FPG changed on disk or unreadable:" << m_filename;
+
+  for (const FPGImage &image : images) {
+    QPixmap pixmap = QPixmap::fromImage(image.image);
+    result.insert(image.code, pixmap);
+    cache(image.code, pixmap);
+  }
+  return result;
+}
+
+void FPGTextureProvider::insert(int code, const QImage &image) {
+  if (m_index.contains(code))
+    cache(code, QPixmap::fromImage(image));
+}
+
+void FPGTextureProvider::cache(int code, const QPixmap &pixmap) {
+  // QCache deletes the pixmap itself if it is larger than the whole budget
+  m_cache.insert(code, new QPixmap(pixmap), costOf(pixmap));
+}
+
+void FPGTextureProvider::setMemoryBudget(qint64 bytes) {
+  qint64 kb = qBound<qint64>(1, bytes / 1024, INT_MAX);
+  m_cache.setMaxCost(int(kb));
+}
+
+qint64 FPGTextureProvider::memoryBudget() const {
+  return qint64(m_cache.maxCost()) * 1024;
+}
+
+qint64 FPGTextureProvider::memoryUsage() const {
+  return qint64(m_cache.totalCost()) * 1024;
+}
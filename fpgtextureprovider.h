@@ -0,0 +1,69 @@
+#ifndef FPGTEXTUREPROVIDER_H
+#define FPGTEXTUREPROVIDER_H
+
+#include "fpgloader.h"
+#include <QCache>
+#include <QHash>
+#include <QList>
+#include <QMap>
+#include <QPixmap>
+#include <QSet>
+#include <QSize>
+#include <QString>
+#include <QVector>
+
+/**
+ * FPGTextureProvider - Textures of one FPG, decoded on first use
+ *
+ * Opening an FPG only reads its chunk headers (FPGLoader::indexFPG), so the
+ * provider knows every code, its size and where its pixels are without
+ * decoding anything. texture() decodes a map the first time it is asked for
+ * and keeps it in an LRU cache; once the cache exceeds memoryBudget() the
+ * least recently used textures are dropped and decoded again if needed.
+ *
+ * Startup cost and resident memory follow what the map references, not the
+ * size of the FPG. Ask for several textures with textures() when possible:
+ * missing maps are then decoded in one pass over the file, which matters for
+ * compressed FPGs.
+ *
+ * QPixmaps only exist on the GUI thread, so the provider must be used there.
+ */
+class FPGTextureProvider {
+public:
+  FPGTextureProvider();
+
+  // Reads the FPG index; false if the file is not a valid FPG
+  bool open(const QString &filename);
+  // Adopts an index built elsewhere (the map loader's worker thread)
+  void setIndex(const QString &filename, const QVector<FPGIndexEntry> &index);
+  void close();
+
+  bool isOpen() const { return !m_filename.isEmpty(); }
+  QString fileName() const { return m_filename; }
+
+  int count() const { return m_index.size(); }
+  bool contains(int code) const { return m_index.contains(code); }
+  QList<int> codes() const; // Ascending
+  QSize textureSize(int code) const;
+
+  // Null pixmap if the code is not in the FPG
+  QPixmap texture(int code);
+  QMap<int, QPixmap> textures(const QSet<int> &codes);
+
+  // Adds an already decoded map (decoded while indexing)
+  void insert(int code, const QImage &image);
+
+  void setMemoryBudget(qint64 bytes);
+  qint64 memoryBudget() const;
+  qint64 memoryUsage() const;
+
+private:
+  Q_DISABLE_COPY(FPGTextureProvider)
+  void cache(int code, const QPixmap &pixmap);
+
+  QString m_filename;
+  QHash<int, FPGIndexEntry> m_index;
+  QCache<int, QPixmap> m_cache; // Cost in KB
+};
+
+#endif // FPGTEXTUREPROVIDER_H
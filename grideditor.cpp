@@ -16,26 +16,64 @@
 #include <QMouseEvent>
 #include <QPainter>
 #include <QPen>
+#include <QSettings>
 #include <QUrl>
 #include <QWheelEvent>
+#include <algorithm>
 #include <cfloat>
 #include <cmath>
 
+// Level of detail for the 2D view
+namespace {
+const float LOD_MARKER_ZOOM = 0.35f;    // Below: markers become plain dots
+const float LOD_THIN_WALL_ZOOM = 0.5f;  // Below: 1px walls
+const int MIN_LABEL_SECTOR_PIXELS = 32; // Sector labels need this much room
+const int MIN_GRID_PIXELS = 8;          // Closest allowed grid line spacing
+const int MARKER_DOT_PIXELS = 4;        // Markers merge within a dot
+
+// Selection indexes sorted, without duplicates and inside [0, size)
+QList<int> validIndexes(QList<int> indexes, int size) {
+  std::sort(indexes.begin(), indexes.end());
+  indexes.erase(std::unique(indexes.begin(), indexes.end()), indexes.end());
+  QList<int> valid;
+  for (int idx : indexes) {
+    if (idx >= 0 && idx < size)
+      valid.append(idx);
+  }
+  return valid;
+}
+
+// Adds a list edit to an undo step, or drops it when it holds no items
+template <typename T>
+void appendStep(MapMacroCommand *step, ListEditCommand<T> *edit) {
+  if (edit->isEmpty())
+    delete edit;
+  else
+    step->append(edit);
+}
+} // namespace
+
 GridEditor::GridEditor(QWidget *parent)
-    : QWidget(parent), m_mapData(new MapData()), m_editMode(MODE_SELECT_SECTOR),
+    : QWidget(parent), m_mapData(new MapData()), m_textureRegistry(nullptr),
+      m_editMode(MODE_SELECT_SECTOR),
       m_selectedTexture(1), m_selectedSector(-1), m_selectedWall(-1),
       m_selectedWallSector(-1), m_selectedWallIndex(-1), m_selectedEntity(-1),
       m_zoom(1.0f), m_panX(0.0f), m_panY(0.0f), m_isDrawing(false),
       m_isDraggingSector(false), m_isDraggingEntity(false), m_draggedVertex(-1),
       m_isSelecting(false), m_isMovingMultiSelection(false),
       m_hasCameraPosition(false), m_cameraX(0.0f), m_cameraY(0.0f),
-      m_manualPortalMode(false), m_isMovingGroup(false), m_movingGroupId(-1),
+      m_layerDirty(true), m_manualPortalMode(false), m_isMovingGroup(false), m_movingGroupId(-1),
       m_showGrid(true) // Default true
 {
   setMinimumSize(800, 600);
   setMouseTracking(true);
   setFocusPolicy(Qt::StrongFocus);
   setAcceptDrops(true); // Enable Drag & Drop
+
+  // History budget in MB (see MapUndoStack)
+  QSettings settings("BennuGD", "RayMapEditor");
+  m_undoStack.setMemoryLimit(
+      settings.value("undoMemoryLimitMB", 64).toLongLong() * 1024 * 1024);
 }
 
 GridEditor::~GridEditor() {
@@ -48,48 +86,29 @@ void GridEditor::newMap() {
   if (m_mapData)
     delete m_mapData;
   m_mapData = new MapData();
-  update();
+  m_undoStack.clear();
+  m_spatialIndex.invalidate();
+  invalidateStaticLayer();
 }
 
-void GridEditor::setTextures(const QMap<int, QPixmap> &textures) {
-  m_textures = textures;
-
-  // Sync map data textures so they are available when passing MapData to other
-  // widgets
-  if (m_mapData) {
-    QSet<int> existingIds;
-    // Update existing entries
-    for (TextureEntry &entry : m_mapData->textures) {
-      existingIds.insert(entry.id);
-      if (textures.contains(entry.id)) {
-        entry.pixmap = textures[entry.id];
-      }
-    }
-
-    // Add missing textures from the map (e.g. if loaded from FPG directly)
-    QMapIterator<int, QPixmap> i(textures);
-    while (i.hasNext()) {
-      i.next();
-      if (!existingIds.contains(i.key())) {
-        TextureEntry newEntry;
-        newEntry.id = i.key();
-        newEntry.pixmap = i.value();
-        newEntry.filename = QString::number(i.key()); // Fallback filename
-        // Width/Height not stored in struct, stored in pixmap
-        m_mapData->textures.append(newEntry);
-      }
-    }
-  }
-
+void GridEditor::invalidateStaticLayer() {
+  m_layerDirty = true;
   update();
 }
 
+void GridEditor::setTextureRegistry(TextureRegistry *registry) {
+  if (m_textureRegistry == registry)
+    return;
+  m_textureRegistry = registry;
+  invalidateStaticLayer();
+}
+
 void GridEditor::setEditMode(EditMode mode) {
   m_editMode = mode;
   m_isDrawing = false;
   m_currentPolygon.clear();
   m_draggedVertex = -1;
-  update();
+  invalidateStaticLayer();
 }
 
 void GridEditor::setSelectedTexture(int textureId) {
@@ -98,12 +117,12 @@ void GridEditor::setSelectedTexture(int textureId) {
 
 void GridEditor::setSelectedSector(int sectorId) {
   m_selectedSector = sectorId;
-  update();
+  invalidateStaticLayer();
 }
 
 void GridEditor::setSelectedWall(int wallId) {
   m_selectedWall = wallId;
-  update();
+  invalidateStaticLayer();
 }
 
 void GridEditor::setZoom(float zoom) {
@@ -113,7 +132,7 @@ void GridEditor::setZoom(float zoom) {
 
 void GridEditor::showGrid(bool show) {
   m_showGrid = show;
-  update();
+  invalidateStaticLayer();
 }
 
 void GridEditor::panView(int dx, int dy) {
@@ -126,7 +145,7 @@ void GridEditor::setCameraPosition(float x, float y) {
   m_hasCameraPosition = true;
   m_cameraX = x;
   m_cameraY = y;
-  update();
+  invalidateStaticLayer();
 }
 
 void GridEditor::getCameraPosition(float &x, float &y) const {
@@ -160,10 +179,12 @@ int GridEditor::findSectorAt(const QPointF &worldPos) {
   if (!m_mapData)
     return -1;
 
+  m_spatialIndex.sync(*m_mapData);
+
   // Find ALL sectors that contain this point
   QVector<int> candidateSectors;
 
-  for (int i = 0; i < m_mapData->sectors.size(); i++) {
+  for (int i : m_spatialIndex.sectorsAt(worldPos)) {
     const Sector &sector = m_mapData->sectors[i];
 
     // Ray casting algorithm
@@ -205,29 +226,14 @@ int GridEditor::findSectorAt(const QPointF &worldPos) {
   int bestSector = candidateSectors[0];
   // Removed: nesting level check (v9 format is flat)
 
-  // Calculate area of first candidate
-  float minArea = 0.0f;
-  const Sector &firstSector = m_mapData->sectors[bestSector];
-  for (int j = 0; j < firstSector.vertices.size(); j++) {
-    int next = (j + 1) % firstSector.vertices.size();
-    minArea += firstSector.vertices[j].x() * firstSector.vertices[next].y();
-    minArea -= firstSector.vertices[next].x() * firstSector.vertices[j].y();
-  }
-  minArea = std::abs(minArea) / 2.0f;
+  float minArea = m_spatialIndex.sectorArea(bestSector);
 
   for (int i = 1; i < candidateSectors.size(); i++) {
     int sectorIdx = candidateSectors[i];
-    const Sector &sector = m_mapData->sectors[sectorIdx];
     // Removed: nestingLevel check
 
-    // Calculate area using shoelace formula
-    float area = 0.0f;
-    for (int j = 0; j < sector.vertices.size(); j++) {
-      int next = (j + 1) % sector.vertices.size();
-      area += sector.vertices[j].x() * sector.vertices[next].y();
-      area -= sector.vertices[next].x() * sector.vertices[j].y();
-    }
-    area = std::abs(area) / 2.0f;
+    // Shoelace area, cached by the spatial index
+    float area = m_spatialIndex.sectorArea(sectorIdx);
 
     // Prefer smaller area if tied (most specific sector)
     if (area < minArea) {
@@ -268,25 +274,24 @@ int GridEditor::findWallAt(const QPointF &worldPos, float tolerance) {
   // SECOND PASS: If no wall found in current sector, check all sectors
   // This allows selecting walls in other sectors if we click far from current
   // sector walls
-  for (int s = 0; s < m_mapData->sectors.size(); s++) {
+  m_spatialIndex.sync(*m_mapData);
+  for (const MapSpatialIndex::SectorItem &item :
+       m_spatialIndex.wallsNear(worldPos, minDist)) {
     // Skip current sector as we already checked it
-    if (s == m_selectedSector)
+    if (item.sector == m_selectedSector)
       continue;
 
-    const Sector &sector = m_mapData->sectors[s];
-    for (int w = 0; w < sector.walls.size(); w++) {
-      const Wall &wall = sector.walls[w];
+    const Wall &wall = m_mapData->sectors[item.sector].walls[item.item];
 
-      QPointF p1(wall.x1, wall.y1);
-      QPointF p2(wall.x2, wall.y2);
+    QPointF p1(wall.x1, wall.y1);
+    QPointF p2(wall.x2, wall.y2);
 
-      float dist = pointToLineDistance(worldPos, p1, p2);
+    float dist = pointToLineDistance(worldPos, p1, p2);
 
-      if (dist < minDist) {
-        minDist = dist;
-        closestWall = w;
-        closestSector = s;
-      }
+    if (dist < minDist) {
+      minDist = dist;
+      closestWall = item.item;
+      closestSector = item.sector;
     }
   }
 
@@ -307,19 +312,18 @@ int GridEditor::findVertexAt(const QPointF &worldPos, int &sectorId,
   int closestVertex = -1;
   sectorId = -1;
 
-  for (int i = 0; i < m_mapData->sectors.size(); i++) {
-    const Sector &sector = m_mapData->sectors[i];
-    for (int j = 0; j < sector.vertices.size(); j++) {
-      QPointF v = sector.vertices[j];
-      float dx = worldPos.x() - v.x();
-      float dy = worldPos.y() - v.y();
-      float dist = std::sqrt(dx * dx + dy * dy);
+  m_spatialIndex.sync(*m_mapData);
+  for (const MapSpatialIndex::SectorItem &item :
+       m_spatialIndex.verticesNear(worldPos, minDist)) {
+    QPointF v = m_mapData->sectors[item.sector].vertices[item.item];
+    float dx = worldPos.x() - v.x();
+    float dy = worldPos.y() - v.y();
+    float dist = std::sqrt(dx * dx + dy * dy);
 
-      if (dist < minDist) {
-        minDist = dist;
-        closestVertex = j;
-        sectorId = i;
-      }
+    if (dist < minDist) {
+      minDist = dist;
+      closestVertex = item.item;
+      sectorId = item.sector;
     }
   }
 
@@ -333,7 +337,8 @@ int GridEditor::findSpawnFlagAt(const QPointF &worldPos, float tolerance) {
   float minDist = tolerance / m_zoom;
   int closestFlag = -1;
 
-  for (int i = 0; i < m_mapData->spawnFlags.size(); i++) {
+  m_spatialIndex.sync(*m_mapData);
+  for (int i : m_spatialIndex.spawnFlagsNear(worldPos, minDist)) {
     const SpawnFlag &flag = m_mapData->spawnFlags[i];
     float dx = worldPos.x() - flag.x;
     float dy = worldPos.y() - flag.y;
@@ -355,7 +360,8 @@ int GridEditor::findLightAt(const QPointF &worldPos, float tolerance) {
   float minDist = tolerance / m_zoom;
   int closestLight = -1;
 
-  for (int i = 0; i < m_mapData->lights.size(); i++) {
+  m_spatialIndex.sync(*m_mapData);
+  for (int i : m_spatialIndex.lightsNear(worldPos, minDist)) {
     const Light &light = m_mapData->lights[i];
     float dx = worldPos.x() - light.x;
     float dy = worldPos.y() - light.y;
@@ -377,7 +383,8 @@ int GridEditor::findEntityAt(const QPointF &worldPos, float tolerance) {
   float minDist = tolerance / m_zoom;
   int closestEntity = -1;
 
-  for (int i = 0; i < m_mapData->entities.size(); i++) {
+  m_spatialIndex.sync(*m_mapData);
+  for (int i : m_spatialIndex.entitiesNear(worldPos, minDist)) {
     const EntityInstance &ent = m_mapData->entities[i];
     float dx = worldPos.x() - ent.x;
     float dy = worldPos.y() - ent.y;
@@ -425,41 +432,24 @@ void GridEditor::paintEvent(QPaintEvent *event) {
     firstPaint = false;
   }
 
-  QPainter painter(this);
-  painter.setRenderHint(QPainter::Antialiasing);
-
-  // Clear background
-  painter.fillRect(rect(), QColor(40, 40, 40));
+  // Static map content only changes with edits, selection or the view
+  LayerKey key = currentLayerKey();
+  if (m_layerDirty || m_layer.isNull() || !(key == m_layerKey)) {
+    renderLayer(key);
+    m_layerKey = key;
+    m_layerDirty = false;
+  }
 
-  // Draw grid
-  drawGrid(painter);
+  QPainter painter(this);
+  painter.drawPixmap(0, 0, m_layer);
 
   if (!m_mapData)
     return;
 
-  // Draw sectors
-  drawSectors(painter);
-
-  // Draw walls
-  drawWalls(painter);
-
-  // Draw portals
-  drawPortals(painter);
-
-  // Draw sprites
-  drawSprites(painter);
-
-  // Draw spawn flags
-  drawSpawnFlags(painter);
-
-  // Draw entities
-  drawEntities(painter);
-
-  // Draw camera
-  drawCamera(painter);
+  painter.setRenderHint(QPainter::Antialiasing);
 
-  // Draw lights
-  drawLights(painter);
+  // Draw selected wall and spawn flags
+  drawSelectionOverlay(painter);
 
   // Draw current polygon being drawn
   if (m_editMode == MODE_DRAW_SECTOR && !m_currentPolygon.isEmpty()) {
@@ -541,11 +531,74 @@ void GridEditor::paintEvent(QPaintEvent *event) {
   drawCursorInfo(painter);
 }
 
+GridEditor::LayerKey GridEditor::currentLayerKey() const {
+  LayerKey key;
+  key.zoom = m_zoom;
+  key.panX = m_panX;
+  key.panY = m_panY;
+  key.size = size();
+  key.devicePixelRatio = devicePixelRatioF();
+  key.highlightedSector = m_selectedWall < 0 ? m_selectedSector : -1;
+  return key;
+}
+
+void GridEditor::renderLayer(const LayerKey &key) {
+  m_layer = QPixmap(key.size * key.devicePixelRatio);
+  m_layer.setDevicePixelRatio(key.devicePixelRatio);
+
+  QPainter painter(&m_layer);
+  painter.setRenderHint(QPainter::Antialiasing);
+
+  // Clear background
+  painter.fillRect(rect(), QColor(40, 40, 40));
+
+  // Draw grid
+  drawGrid(painter);
+
+  if (!m_mapData)
+    return;
+
+  // Items outside the view are culled through the spatial index
+  m_spatialIndex.sync(*m_mapData);
+
+  // Draw sectors
+  drawSectors(painter);
+
+  // Draw walls
+  drawWalls(painter);
+
+  // Draw portals
+  drawPortals(painter);
+
+  // Draw sprites
+  drawSprites(painter);
+
+  // Draw spawn flags
+  drawSpawnFlags(painter);
+
+  // Draw entities
+  drawEntities(painter);
+
+  // Draw camera
+  drawCamera(painter);
+
+  // Draw lights
+  drawLights(painter);
+}
+
+QRectF GridEditor::visibleWorldRect(int marginPixels) const {
+  QPointF margin(marginPixels / m_zoom, marginPixels / m_zoom);
+  return QRectF(screenToWorld(QPoint(0, 0)) - margin,
+                screenToWorld(QPoint(width(), height())) + margin);
+}
+
 void GridEditor::drawGrid(QPainter &painter) {
   painter.setPen(QPen(QColor(60, 60, 60), 1));
 
-  // Draw grid lines every 64 units
+  // Draw grid lines every 64 units, doubled while they would be too dense
   int gridSize = 64;
+  while (gridSize * m_zoom < MIN_GRID_PIXELS)
+    gridSize *= 2;
 
   // Calculate visible range
   QPointF topLeft = screenToWorld(QPoint(0, 0));
@@ -578,7 +631,9 @@ void GridEditor::drawGrid(QPainter &painter) {
 }
 
 void GridEditor::drawSectors(QPainter &painter) {
-  for (int i = 0; i < m_mapData->sectors.size(); i++) {
+  // Margin keeps labels of sectors just off screen
+  QRectF view = visibleWorldRect(64);
+  for (int i : m_spatialIndex.sectorsIn(view)) {
     const Sector &sector = m_mapData->sectors[i];
 
     if (sector.vertices.size() < 3)
@@ -603,6 +658,12 @@ void GridEditor::drawSectors(QPainter &painter) {
     painter.setPen(Qt::NoPen);
     painter.drawPolygon(polygon);
 
+    // Labels only where they fit inside the sector on screen
+    QRectF screenBounds = polygon.boundingRect();
+    if (screenBounds.width() < MIN_LABEL_SECTOR_PIXELS ||
+        screenBounds.height() < MIN_LABEL_SECTOR_PIXELS / 2)
+      continue;
+
     // Draw sector ID and Slope Info
     QPointF center(0, 0);
     for (const QPointF &v : sector.vertices) {
@@ -619,44 +680,95 @@ void GridEditor::drawSectors(QPainter &painter) {
 }
 
 void GridEditor::drawWalls(QPainter &painter) {
-  for (int s = 0; s < m_mapData->sectors.size(); s++) {
-    const Sector &sector = m_mapData->sectors[s];
-    for (int w = 0; w < sector.walls.size(); w++) {
-      const Wall &wall = sector.walls[w];
-      QPoint p1 = worldToScreen(QPointF(wall.x1, wall.y1));
-      QPoint p2 = worldToScreen(QPointF(wall.x2, wall.y2));
-
-      // Color based on selection and portal status
-      QColor color;
-      if (s == m_selectedWallSector && w == m_selectedWallIndex) {
-        color = QColor(255, 255, 0); // Yellow for selected
-      } else if (wall.portal_id >= 0) {
-        color = QColor(0, 255, 0); // Green for portals
-      } else {
-        color = QColor(150, 150, 150); // Gray for solid walls
-      }
+  // Walls are batched per color; ones that collapse into a single pixel
+  // are drawn as points. The selected wall is drawn by
+  // drawSelectionOverlay().
+  QVector<QLine> solidLines, portalLines;
+  QVector<QPoint> solidPoints, portalPoints;
+  for (const MapSpatialIndex::SectorItem &item :
+       m_spatialIndex.wallsIn(visibleWorldRect(2))) {
+    const Wall &wall = m_mapData->sectors[item.sector].walls[item.item];
+    QPoint p1 = worldToScreen(QPointF(wall.x1, wall.y1));
+    QPoint p2 = worldToScreen(QPointF(wall.x2, wall.y2));
+
+    // Color based on portal status
+    bool portal = wall.portal_id >= 0;
+    if (p1 == p2)
+      (portal ? portalPoints : solidPoints).append(p1);
+    else
+      (portal ? portalLines : solidLines).append(QLine(p1, p2));
+  }
+
+  int penWidth = m_zoom < LOD_THIN_WALL_ZOOM ? 1 : 2;
+  painter.setPen(QPen(QColor(150, 150, 150), penWidth)); // Gray for solid
+  painter.drawLines(solidLines);
+  painter.drawPoints(solidPoints.constData(), solidPoints.size());
+  painter.setPen(QPen(QColor(0, 255, 0), penWidth)); // Green for portals
+  painter.drawLines(portalLines);
+  painter.drawPoints(portalPoints.constData(), portalPoints.size());
+}
 
-      painter.setPen(QPen(color, 2));
-      painter.drawLine(p1, p2);
-    }
+void GridEditor::drawMarkerDots(QPainter &painter,
+                                const QVector<QPointF> &positions,
+                                const QColor &color) {
+  // One dot per occupied MARKER_DOT_PIXELS cell on screen
+  QSet<quint64> cells;
+  QVector<QPoint> dots;
+  for (const QPointF &position : positions) {
+    QPoint p = worldToScreen(position);
+    int cx = (int)std::floor(p.x() / (float)MARKER_DOT_PIXELS);
+    int cy = (int)std::floor(p.y() / (float)MARKER_DOT_PIXELS);
+    quint64 key = ((quint64)(quint32)cx << 32) | (quint32)cy;
+    if (cells.contains(key))
+      continue;
+    cells.insert(key);
+    dots.append(QPoint(cx * MARKER_DOT_PIXELS + MARKER_DOT_PIXELS / 2,
+                       cy * MARKER_DOT_PIXELS + MARKER_DOT_PIXELS / 2));
   }
+
+  painter.setPen(QPen(color, MARKER_DOT_PIXELS, Qt::SolidLine, Qt::SquareCap));
+  painter.drawPoints(dots.constData(), dots.size());
 }
 
 void GridEditor::drawPortals(QPainter &painter) {
   painter.setPen(QPen(QColor(0, 255, 0, 128), 1, Qt::DashLine));
 
+  QRectF view = visibleWorldRect(2);
+  QVector<QLine> lines;
   for (const Portal &portal : m_mapData->portals) {
+    if (qMax(portal.x1, portal.x2) < view.left() ||
+        qMin(portal.x1, portal.x2) > view.right() ||
+        qMax(portal.y1, portal.y2) < view.top() ||
+        qMin(portal.y1, portal.y2) > view.bottom())
+      continue;
+
     QPoint p1 = worldToScreen(QPointF(portal.x1, portal.y1));
     QPoint p2 = worldToScreen(QPointF(portal.x2, portal.y2));
-    painter.drawLine(p1, p2);
+    if (p1 != p2)
+      lines.append(QLine(p1, p2));
   }
+  painter.drawLines(lines);
 }
 
 void GridEditor::drawSprites(QPainter &painter) {
   painter.setBrush(QBrush(QColor(255, 128, 0)));
   painter.setPen(QPen(QColor(255, 200, 0), 2));
 
+  QRectF view = visibleWorldRect(8);
+  if (m_zoom < LOD_MARKER_ZOOM) {
+    QVector<QPointF> positions;
+    for (const SpriteData &sprite : m_mapData->sprites) {
+      if (view.contains(QPointF(sprite.x, sprite.y)))
+        positions.append(QPointF(sprite.x, sprite.y));
+    }
+    drawMarkerDots(painter, positions, QColor(255, 128, 0));
+    return;
+  }
+
   for (const SpriteData &sprite : m_mapData->sprites) {
+    if (!view.contains(QPointF(sprite.x, sprite.y)))
+      continue;
+
     QPoint pos = worldToScreen(QPointF(sprite.x, sprite.y));
     painter.drawEllipse(pos, 5, 5);
   }
@@ -666,31 +778,69 @@ void GridEditor::drawSpawnFlags(QPainter &painter) {
   painter.setBrush(QBrush(QColor(255, 0, 255)));
   painter.setPen(QPen(QColor(255, 128, 255), 2));
 
+  // CRITICAL: If an entity with the same spawn_id exists, don't draw the
+  // spawn flag to avoid visual "garbage" (redundant pink squares under
+  // entities).
+  QSet<int> entitySpawnIds;
+  for (const EntityInstance &ent : m_mapData->entities)
+    entitySpawnIds.insert(ent.spawn_id);
+
+  // Selected flags are highlighted by drawSelectionOverlay()
+  QRectF view = visibleWorldRect(64);
+  if (m_zoom < LOD_MARKER_ZOOM) {
+    QVector<QPointF> positions;
+    for (const SpawnFlag &flag : m_mapData->spawnFlags) {
+      if (!entitySpawnIds.contains(flag.flagId) &&
+          view.contains(QPointF(flag.x, flag.y)))
+        positions.append(QPointF(flag.x, flag.y));
+    }
+    drawMarkerDots(painter, positions, QColor(255, 0, 255));
+    return;
+  }
+
   for (int i = 0; i < m_mapData->spawnFlags.size(); ++i) {
     const SpawnFlag &flag = m_mapData->spawnFlags[i];
-
-    // CRITICAL: If an entity with the same spawn_id exists, don't draw the
-    // spawn flag to avoid visual "garbage" (redundant pink squares under
-    // entities).
-    bool isEntity = false;
-    for (const EntityInstance &ent : m_mapData->entities) {
-      if (ent.spawn_id == flag.flagId) {
-        isEntity = true;
-        break;
-      }
-    }
-    if (isEntity)
+    if (entitySpawnIds.contains(flag.flagId) ||
+        !view.contains(QPointF(flag.x, flag.y)))
       continue;
 
     QPoint pos = worldToScreen(QPointF(flag.x, flag.y));
+    painter.drawRect(pos.x() - 5, pos.y() - 5, 10, 10);
+    painter.drawText(pos + QPoint(8, 0), QString::number(flag.flagId));
+  }
+}
 
-    // Highlight selected
-    if (m_multiSelectedSpawnFlags.contains(i)) {
-      painter.setPen(QPen(Qt::yellow, 3));
-    } else {
-      painter.setPen(QPen(QColor(255, 128, 255), 2));
+void GridEditor::drawSelectionOverlay(QPainter &painter) {
+  // Selected wall
+  if (m_selectedWallSector >= 0 &&
+      m_selectedWallSector < m_mapData->sectors.size()) {
+    const Sector &sector = m_mapData->sectors[m_selectedWallSector];
+    if (m_selectedWallIndex >= 0 && m_selectedWallIndex < sector.walls.size()) {
+      const Wall &wall = sector.walls[m_selectedWallIndex];
+      painter.setPen(QPen(QColor(255, 255, 0), 2)); // Yellow for selected
+      painter.drawLine(worldToScreen(QPointF(wall.x1, wall.y1)),
+                       worldToScreen(QPointF(wall.x2, wall.y2)));
     }
+  }
 
+  // Selected spawn flags (hidden ones stay hidden, see drawSpawnFlags)
+  if (m_multiSelectedSpawnFlags.isEmpty())
+    return;
+
+  QSet<int> entitySpawnIds;
+  for (const EntityInstance &ent : m_mapData->entities)
+    entitySpawnIds.insert(ent.spawn_id);
+
+  painter.setBrush(QBrush(QColor(255, 0, 255)));
+  painter.setPen(QPen(Qt::yellow, 3));
+  for (int i : m_multiSelectedSpawnFlags) {
+    if (i < 0 || i >= m_mapData->spawnFlags.size())
+      continue;
+    const SpawnFlag &flag = m_mapData->spawnFlags[i];
+    if (entitySpawnIds.contains(flag.flagId))
+      continue;
+
+    QPoint pos = worldToScreen(QPointF(flag.x, flag.y));
     painter.drawRect(pos.x() - 5, pos.y() - 5, 10, 10);
     painter.drawText(pos + QPoint(8, 0), QString::number(flag.flagId));
   }
@@ -788,6 +938,7 @@ void GridEditor::mousePressEvent(QMouseEvent *event) {
   // Handle group movement mode
   if (m_isMovingGroup && event->button() == Qt::LeftButton) {
     m_groupMoveStart = worldPos;
+    m_dragOrigin = groupAnchor();
     return;
   }
 
@@ -804,6 +955,7 @@ void GridEditor::mousePressEvent(QMouseEvent *event) {
       if (vertexIdx >= 0) {
         m_draggedVertex = vertexIdx;
         m_selectedSector = sectorId;
+        m_dragOrigin = m_mapData->sectors[sectorId].vertices[vertexIdx];
         emit vertexSelected(sectorId, vertexIdx);
       }
       break;
@@ -814,7 +966,7 @@ void GridEditor::mousePressEvent(QMouseEvent *event) {
       int lightIdx = findLightAt(worldPos);
       if (lightIdx >= 0) {
         emit lightSelected(lightIdx, m_mapData->lights[lightIdx]);
-        update();
+        invalidateStaticLayer();
         break;
       }
 
@@ -823,7 +975,7 @@ void GridEditor::mousePressEvent(QMouseEvent *event) {
       if (entityIdx >= 0) {
         m_selectedEntity = entityIdx;
         emit entitySelected(entityIdx, m_mapData->entities[entityIdx]);
-        update();
+        invalidateStaticLayer();
         break;
       }
 
@@ -835,7 +987,7 @@ void GridEditor::mousePressEvent(QMouseEvent *event) {
         m_selectedWallSector = m_selectedSector;
         m_selectedWallIndex = wallIdx; // This is actually the wall index
         emit wallSelected(m_selectedWallSector, m_selectedWallIndex);
-        update();
+        invalidateStaticLayer();
       } else {
         // No wall found - check if clicked inside a sector
         int sectorIdx = findSectorAt(worldPos);
@@ -852,7 +1004,7 @@ void GridEditor::mousePressEvent(QMouseEvent *event) {
                                      tr("Grupo seleccionado. Arrastra para "
                                         "mover todos los sectores del grupo.\n"
                                         "Presiona ESC para cancelar."));
-            update();
+            invalidateStaticLayer();
             return;
           }
 
@@ -861,6 +1013,7 @@ void GridEditor::mousePressEvent(QMouseEvent *event) {
             // Start Dragging Sector
             m_isDraggingSector = true;
             m_dragStartPos = worldPos;
+            m_dragOrigin = m_mapData->sectors[sectorIdx].vertices.value(0);
             setCursor(Qt::SizeAllCursor);
           } else {
             // Select new sector
@@ -869,7 +1022,7 @@ void GridEditor::mousePressEvent(QMouseEvent *event) {
             m_selectedWallIndex = -1;
             emit sectorSelected(m_mapData->sectors[sectorIdx].sector_id);
           }
-          update();
+          invalidateStaticLayer();
         } else {
           // Deselect if clicked in void?
           // m_selectedSector = -1;
@@ -894,7 +1047,7 @@ void GridEditor::mousePressEvent(QMouseEvent *event) {
       int lightIdx = findLightAt(worldPos);
       if (lightIdx >= 0) {
         emit lightSelected(lightIdx, m_mapData->lights[lightIdx]);
-        update();
+        invalidateStaticLayer();
         break;
       }
 
@@ -909,7 +1062,7 @@ void GridEditor::mousePressEvent(QMouseEvent *event) {
           setGroupMoveMode(groupId);
           m_groupMoveStart = worldPos;
           // Optional: Feedback?
-          update();
+          invalidateStaticLayer();
           return;
         }
 
@@ -918,6 +1071,7 @@ void GridEditor::mousePressEvent(QMouseEvent *event) {
           // Start Dragging Sector
           m_isDraggingSector = true;
           m_dragStartPos = worldPos;
+          m_dragOrigin = m_mapData->sectors[sectorIdx].vertices.value(0);
           setCursor(Qt::SizeAllCursor);
         } else {
           // Select new sector
@@ -931,7 +1085,7 @@ void GridEditor::mousePressEvent(QMouseEvent *event) {
         // m_selectedSector = -1;
         // emit sectorSelected(-1);
       }
-      update();
+      invalidateStaticLayer();
       break;
     }
 
@@ -943,10 +1097,15 @@ void GridEditor::mousePressEvent(QMouseEvent *event) {
         flag.x = worldPos.x();
         flag.y = worldPos.y();
         flag.z = 0.0f;
-        m_mapData->spawnFlags.append(flag);
+        auto *insert = new ListEditCommand<SpawnFlag>(
+            tr("Colocar spawn flag"), &MapData::spawnFlags,
+            ListEditCommand<SpawnFlag>::Insert);
+        insert->addItem(m_mapData->spawnFlags.size(), flag);
+        pushCommand(insert);
+        emit mapChanged();
       }
       emit spawnFlagPlaced(flagId, worldPos.x(), worldPos.y());
-      update();
+      invalidateStaticLayer();
       break;
     }
 
@@ -958,7 +1117,7 @@ void GridEditor::mousePressEvent(QMouseEvent *event) {
       } else {
         // Placement
         Light light;
-        light.id = m_mapData ? m_mapData->lights.size() : 0;
+        light.id = m_mapData ? m_mapData->getNextLightId() : 0;
         light.x = worldPos.x();
         light.y = worldPos.y();
         light.z = 64.0f;
@@ -968,18 +1127,23 @@ void GridEditor::mousePressEvent(QMouseEvent *event) {
         light.color_g = 255;
         light.color_b = 255;
         if (m_mapData) {
-          m_mapData->lights.append(light);
+          auto *insert = new ListEditCommand<Light>(
+              tr("Colocar luz"), &MapData::lights,
+              ListEditCommand<Light>::Insert);
+          insert->addItem(m_mapData->lights.size(), light);
+          pushCommand(insert);
           emit lightSelected(m_mapData->lights.size() - 1, light);
+          emit mapChanged();
         }
       }
-      update();
+      invalidateStaticLayer();
       break;
     }
 
     case MODE_PLACE_DECAL_FLOOR:
     case MODE_PLACE_DECAL_CEILING:
       emit decalPlaced(worldPos.x(), worldPos.y());
-      update();
+      invalidateStaticLayer();
       break;
 
     case MODE_MANUAL_PORTAL: {
@@ -989,7 +1153,7 @@ void GridEditor::mousePressEvent(QMouseEvent *event) {
         // findWallAt updates m_selectedSector
         emit portalWallSelected(m_selectedSector, wallIdx);
         // Force update to show potential highlight if we add it later
-        update();
+        invalidateStaticLayer();
       }
       break;
     }
@@ -1002,13 +1166,15 @@ void GridEditor::mousePressEvent(QMouseEvent *event) {
 
         m_isDraggingEntity = true;
         m_dragStartPos = worldPos;
+        m_dragOrigin = QPointF(m_mapData->entities[entityIdx].x,
+                               m_mapData->entities[entityIdx].y);
         setCursor(Qt::SizeAllCursor);
       } else {
         m_selectedEntity = -1;
         EntityInstance empty; // Dummy for deselection
         emit entitySelected(-1, empty);
       }
-      update();
+      invalidateStaticLayer();
       break;
     }
 
@@ -1057,6 +1223,7 @@ void GridEditor::mousePressEvent(QMouseEvent *event) {
       if (clickedOnSelected) {
         m_isMovingMultiSelection = true;
         m_multiMoveStartPos = worldPos;
+        m_multiMoveOffset = QPointF();
         m_initialMultiSelectedSectorVertices.clear();
         m_initialMultiSelectedEntityPositions.clear();
         m_initialMultiSelectedLightPositions.clear();
@@ -1090,7 +1257,7 @@ void GridEditor::mousePressEvent(QMouseEvent *event) {
         m_multiSelectedEntities.clear();
         m_multiSelectedSpawnFlags.clear();
         m_multiSelectedLights.clear();
-        update();
+        invalidateStaticLayer();
       }
       break;
     }
@@ -1103,14 +1270,14 @@ void GridEditor::mousePressEvent(QMouseEvent *event) {
     int lightIdx = findLightAt(worldPos);
     if (lightIdx >= 0 && m_mapData) {
       emit lightSelected(lightIdx, m_mapData->lights[lightIdx]);
-      update();
+      invalidateStaticLayer();
       return;
     }
 
     int entityIdx = findEntityAt(worldPos);
     if (entityIdx >= 0 && m_mapData) {
       emit entitySelected(entityIdx, m_mapData->entities[entityIdx]);
-      update();
+      invalidateStaticLayer();
       return;
     }
 
@@ -1143,13 +1310,14 @@ void GridEditor::mousePressEvent(QMouseEvent *event) {
           newSector.walls.append(wall);
         }
 
-        m_mapData->sectors.append(newSector);
+        m_mapData->addSector(newSector);
+        recordSectorInsert(m_mapData->sectors.size() - 1);
         emit sectorCreated(
             newSector.sector_id); // NEW: Notify that sector was created
       }
 
       m_currentPolygon.clear();
-      update();
+      invalidateStaticLayer();
     }
   }
 }
@@ -1167,7 +1335,7 @@ void GridEditor::mouseMoveEvent(QMouseEvent *event) {
     panView(dx, dy);
 
     m_lastMousePos = event->pos();
-    update();
+    invalidateStaticLayer();
     return;
   }
 
@@ -1211,7 +1379,8 @@ void GridEditor::mouseMoveEvent(QMouseEvent *event) {
       }
     }
 
-    update();
+    m_spatialIndex.invalidate();
+    invalidateStaticLayer();
     return;
   }
 
@@ -1243,7 +1412,9 @@ void GridEditor::mouseMoveEvent(QMouseEvent *event) {
     }
 
     m_dragStartPos = worldPos;
-    update();
+    m_mapData->markSectorDirty(sec.sector_id);
+    m_spatialIndex.updateSector(*m_mapData, m_selectedSector);
+    invalidateStaticLayer();
     emit mapChanged();
     return; // Consume event
   }
@@ -1268,7 +1439,9 @@ void GridEditor::mouseMoveEvent(QMouseEvent *event) {
         }
       }
 
-      update();
+      m_mapData->markSectorDirty(sector.sector_id);
+      m_spatialIndex.updateSector(*m_mapData, m_selectedSector);
+      invalidateStaticLayer();
       emit mapChanged();
     }
   }
@@ -1284,7 +1457,8 @@ void GridEditor::mouseMoveEvent(QMouseEvent *event) {
     ent.y += dy;
 
     m_dragStartPos = worldPos;
-    update();
+    m_spatialIndex.updateEntity(*m_mapData, m_selectedEntity);
+    invalidateStaticLayer();
     // Emit updated entity to panel (and visual mode via MainWindow)
     // We reuse entitySelected to update panel values, OR create a new signal if
     // needed. But MainWindow::onEntityChanged handles updateEntity (which loops
@@ -1307,6 +1481,7 @@ void GridEditor::mouseMoveEvent(QMouseEvent *event) {
   // Multi-selection movement
   if (m_isMovingMultiSelection && m_mapData) {
     QPointF offset = worldPos - m_multiMoveStartPos;
+    m_multiMoveOffset = offset;
 
     // Move sectors
     for (int idx : m_multiSelectedSectors) {
@@ -1364,7 +1539,8 @@ void GridEditor::mouseMoveEvent(QMouseEvent *event) {
       }
     }
 
-    update();
+    m_spatialIndex.invalidate();
+    invalidateStaticLayer();
     return;
   }
 
@@ -1378,24 +1554,87 @@ void GridEditor::mouseMoveEvent(QMouseEvent *event) {
 
 void GridEditor::mouseReleaseEvent(QMouseEvent *event) {
   if (event->button() == Qt::LeftButton) {
+    if (m_draggedVertex >= 0 && m_selectedSector >= 0 &&
+        m_selectedSector < m_mapData->sectors.size()) {
+      const Sector &sector = m_mapData->sectors[m_selectedSector];
+      if (m_draggedVertex < sector.vertices.size() &&
+          sector.vertices[m_draggedVertex] != m_dragOrigin) {
+        recordCommand(new VertexMoveCommand(sector.sector_id, m_draggedVertex,
+                                            m_dragOrigin,
+                                            sector.vertices[m_draggedVertex]));
+      }
+    }
     m_draggedVertex = -1;
     if (m_isDraggingSector) {
       m_isDraggingSector = false;
       setCursor(Qt::ArrowCursor);
 
-      // Auto-detect parent
-      autoParentSector(m_selectedSector);
+      if (m_selectedSector >= 0 &&
+          m_selectedSector < m_mapData->sectors.size()) {
+        const Sector &sector = m_mapData->sectors[m_selectedSector];
+        auto *move = new TranslateCommand(
+            tr("Mover sector"), sector.vertices.value(0) - m_dragOrigin);
+        move->sectorIds.append(sector.sector_id);
+        recordMove(move, true); // Auto-detects the parent
+      }
 
       emit mapChanged(); // Ensure final position is synced
     }
     if (m_isDraggingEntity) {
       m_isDraggingEntity = false;
       setCursor(Qt::ArrowCursor);
+
+      if (m_selectedEntity >= 0 &&
+          m_selectedEntity < m_mapData->entities.size()) {
+        const EntityInstance &ent = m_mapData->entities[m_selectedEntity];
+        auto *move = new TranslateCommand(tr("Mover entidad"),
+                                          QPointF(ent.x, ent.y) - m_dragOrigin);
+        move->entitySpawnIds.append(ent.spawn_id);
+        recordMove(move, false);
+      }
+
       emit mapChanged(); // Important to notify changes
     }
+    if (m_isMovingGroup && m_movingGroupId >= 0 && m_mapData) {
+      auto *move =
+          new TranslateCommand(tr("Mover grupo"), groupAnchor() - m_dragOrigin);
+      for (auto it = m_originalGroupPositions.constBegin();
+           it != m_originalGroupPositions.constEnd(); ++it)
+        move->sectorIds.append(it.key());
+      recordMove(move, false);
+    }
 
     if (m_isMovingMultiSelection) {
       m_isMovingMultiSelection = false;
+
+      // One step for the whole move. Spawn flags of moved entities followed
+      // them, so they are part of it too.
+      auto *move =
+          new TranslateCommand(tr("Mover selección"), m_multiMoveOffset);
+      for (int idx : m_multiSelectedSectors) {
+        if (m_initialMultiSelectedSectorVertices.contains(idx))
+          move->sectorIds.append(m_mapData->sectors[idx].sector_id);
+      }
+      for (int idx : m_multiSelectedEntities) {
+        if (m_initialMultiSelectedEntityPositions.contains(idx)) {
+          int spawnId = m_mapData->entities[idx].spawn_id;
+          move->entitySpawnIds.append(spawnId);
+          for (const SpawnFlag &flag : m_mapData->spawnFlags) {
+            if (flag.flagId == spawnId) {
+              move->spawnFlagIds.append(spawnId);
+              break;
+            }
+          }
+        }
+      }
+      for (int idx : m_multiSelectedSpawnFlags) {
+        if (m_initialMultiSelectedSpawnFlagPositions.contains(idx)) {
+          int flagId = m_mapData->spawnFlags[idx].flagId;
+          if (!move->spawnFlagIds.contains(flagId))
+            move->spawnFlagIds.append(flagId);
+        }
+      }
+
       m_initialMultiSelectedSectorVertices.clear();
       m_initialMultiSelectedEntityPositions.clear();
       m_initialMultiSelectedSpawnFlagPositions.clear();
@@ -1403,12 +1642,10 @@ void GridEditor::mouseReleaseEvent(QMouseEvent *event) {
       setCursor(Qt::ArrowCursor);
 
       // Auto-parent all moved sectors
-      for (int idx : m_multiSelectedSectors) {
-        autoParentSector(idx);
-      }
+      recordMove(move, true);
 
       emit mapChanged();
-      update();
+      invalidateStaticLayer();
     }
 
     if (m_editMode == MODE_MULTI_SELECT && m_isSelecting) {
@@ -1457,7 +1694,7 @@ void GridEditor::mouseReleaseEvent(QMouseEvent *event) {
           }
         }
       }
-      update();
+      invalidateStaticLayer();
     }
   } else if (event->button() == Qt::MiddleButton) {
     setCursor(Qt::CrossCursor);
@@ -1562,16 +1799,23 @@ void GridEditor::contextMenuEvent(QContextMenuEvent *event) {
     } else if (pasteAction && selectedItem == pasteAction) {
       pasteSelection();
     } else if (selectedItem == deleteAction) {
-      // Find and remove all associated spawn flags
+      // The entity and all its associated spawn flags, as one undo step
       int spawnId = ent.spawn_id;
-      for (int i = m_mapData->spawnFlags.size() - 1; i >= 0; --i) {
-        if (m_mapData->spawnFlags[i].flagId == spawnId) {
-          m_mapData->spawnFlags.removeAt(i);
-        }
+      auto *flags = new ListEditCommand<SpawnFlag>(
+          QString(), &MapData::spawnFlags, ListEditCommand<SpawnFlag>::Remove);
+      for (int i = 0; i < m_mapData->spawnFlags.size(); ++i) {
+        if (m_mapData->spawnFlags[i].flagId == spawnId)
+          flags->addItem(i, m_mapData->spawnFlags[i]);
       }
+      auto *entities = new ListEditCommand<EntityInstance>(
+          QString(), &MapData::entities,
+          ListEditCommand<EntityInstance>::Remove);
+      entities->addItem(entityIdx, ent);
 
-      // Remove entity
-      m_mapData->entities.removeAt(entityIdx);
+      auto *step = new MapMacroCommand(tr("Eliminar entidad"));
+      appendStep(step, entities);
+      appendStep(step, flags);
+      pushCommand(step);
 
       // Clear selection if this entity was selected
       if (m_selectedEntity == entityIdx) {
@@ -1584,7 +1828,7 @@ void GridEditor::contextMenuEvent(QContextMenuEvent *event) {
       }
 
       emit mapChanged();
-      update();
+      invalidateStaticLayer();
     }
     return;
   }
@@ -1607,11 +1851,14 @@ void GridEditor::contextMenuEvent(QContextMenuEvent *event) {
     if (pasteAction && selectedItem == pasteAction) {
       pasteSelection();
     } else if (selectedItem == deleteAction) {
-      // Find and remove associated entity
+      // The spawn flag and its associated entity, as one undo step
       int flagId = flag.flagId;
+      auto *entities = new ListEditCommand<EntityInstance>(
+          QString(), &MapData::entities,
+          ListEditCommand<EntityInstance>::Remove);
       for (int i = 0; i < m_mapData->entities.size(); ++i) {
         if (m_mapData->entities[i].spawn_id == flagId) {
-          m_mapData->entities.removeAt(i);
+          entities->addItem(i, m_mapData->entities[i]);
 
           // Clear selection if this entity was selected
           if (m_selectedEntity == i) {
@@ -1624,11 +1871,16 @@ void GridEditor::contextMenuEvent(QContextMenuEvent *event) {
           break;
         }
       }
-
-      // Remove spawn flag
-      m_mapData->spawnFlags.removeAt(flagIdx);
+      auto *flags = new ListEditCommand<SpawnFlag>(
+          QString(), &MapData::spawnFlags, ListEditCommand<SpawnFlag>::Remove);
+      flags->addItem(flagIdx, flag);
+
+      auto *step = new MapMacroCommand(tr("Eliminar spawn flag"));
+      appendStep(step, entities);
+      appendStep(step, flags);
+      pushCommand(step);
       emit mapChanged();
-      update();
+      invalidateStaticLayer();
     }
     return;
   }
@@ -1692,6 +1944,8 @@ void GridEditor::mouseDoubleClickEvent(QMouseEvent *event) {
         m_selectedSector < m_mapData->sectors.size()) {
 
       Sector &sector = m_mapData->sectors[m_selectedSector];
+      SectorEditCommand *split = new SectorEditCommand(tr("Dividir pared"));
+      Sector before = sector;
 
       // Calculate insertion index
       // Wall i connects vertex i to i+1
@@ -1750,8 +2004,13 @@ void GridEditor::mouseDoubleClickEvent(QMouseEvent *event) {
         sector.walls.append(newWall);
       }
 
+      split->addSector(before, sector);
+      recordCommand(split);
+      m_mapData->markSectorDirty(sector.sector_id);
+      m_spatialIndex.invalidate();
+
       m_selectedWall = -1; // Deselect to avoid index errors
-      update();
+      invalidateStaticLayer();
       QMessageBox::information(this, tr("Split Wall"),
                                tr("Wall split successfully!"));
     }
@@ -1780,9 +2039,10 @@ void GridEditor::setGroupMoveMode(int groupId) {
       }
     }
   }
+  m_dragOrigin = groupAnchor();
 
   setCursor(Qt::SizeAllCursor);
-  update();
+  invalidateStaticLayer();
 }
 
 void GridEditor::cancelGroupMove() {
@@ -1790,7 +2050,7 @@ void GridEditor::cancelGroupMove() {
   m_movingGroupId = -1;
   m_originalGroupPositions.clear();
   setCursor(Qt::ArrowCursor);
-  update();
+  invalidateStaticLayer();
 }
 
 /* ============================================================================
@@ -1838,8 +2098,7 @@ void GridEditor::dropEvent(QDropEvent *event) {
       entity.z = 0.0f;
       entity.spawn_id = m_mapData->getNextSpawnEntityId();
 
-      m_mapData->entities.append(entity);
-      update();
+      addDroppedEntity(entity);
       event->acceptProposedAction();
     } else if (ext == "campath") {
       // Camera Path Trigger
@@ -1857,18 +2116,42 @@ void GridEditor::dropEvent(QDropEvent *event) {
       entity.z = 0.0f;
       entity.spawn_id = m_mapData->getNextSpawnEntityId();
 
-      m_mapData->entities.append(entity);
-      update();
+      addDroppedEntity(entity);
       event->acceptProposedAction();
     }
   }
 }
 
+void GridEditor::addDroppedEntity(const EntityInstance &entity) {
+  auto *insert = new ListEditCommand<EntityInstance>(
+      tr("Añadir entidad"), &MapData::entities,
+      ListEditCommand<EntityInstance>::Insert);
+  insert->addItem(m_mapData->entities.size(), entity);
+  pushCommand(insert);
+  emit mapChanged();
+  invalidateStaticLayer();
+}
+
 void GridEditor::drawEntities(QPainter &painter) {
   if (!m_mapData)
     return;
 
+  // Margin keeps asset name labels of entities just off screen
+  QRectF view = visibleWorldRect(200);
+  if (m_zoom < LOD_MARKER_ZOOM) {
+    QVector<QPointF> positions;
+    for (const EntityInstance &entity : m_mapData->entities) {
+      if (view.contains(QPointF(entity.x, entity.y)))
+        positions.append(QPointF(entity.x, entity.y));
+    }
+    drawMarkerDots(painter, positions, QColor(0, 200, 255));
+    return;
+  }
+
   for (const EntityInstance &entity : m_mapData->entities) {
+    if (!view.contains(QPointF(entity.x, entity.y)))
+      continue;
+
     if (entity.type == "campath") {
       painter.setBrush(QBrush(QColor(255, 128, 0))); // Orange for paths
       painter.setPen(QPen(QColor(255, 100, 0), 2));
@@ -1913,7 +2196,26 @@ void GridEditor::drawLights(QPainter &painter) {
   if (!m_mapData)
     return;
 
+  QRectF view = visibleWorldRect(0);
+
+  // Zoomed out, lights are dots without rays or radius
+  if (m_zoom < LOD_MARKER_ZOOM) {
+    QVector<QPointF> positions;
+    for (const Light &light : m_mapData->lights) {
+      if (view.contains(QPointF(light.x, light.y)))
+        positions.append(QPointF(light.x, light.y));
+    }
+    drawMarkerDots(painter, positions, QColor(255, 255, 160));
+    return;
+  }
+
   for (const Light &light : m_mapData->lights) {
+    // Cull by the larger of the radius circle and the icon
+    float extent = qMax(light.radius, 12.0f / m_zoom);
+    if (!view.intersects(QRectF(light.x - extent, light.y - extent,
+                                extent * 2.0f, extent * 2.0f)))
+      continue;
+
     QPoint pos = worldToScreen(QPointF(light.x, light.y));
 
     // Draw light icon (a yellow circle with rays)
@@ -1940,9 +2242,13 @@ void GridEditor::drawLights(QPainter &painter) {
 
 void GridEditor::updateEntity(int index, const EntityInstance &entity) {
   if (index >= 0 && index < m_mapData->entities.size()) {
+    // Drags record a single move when they end
+    if (!m_isDraggingEntity && !m_isMovingMultiSelection)
+      recordCommand(new EntityEditCommand(m_mapData->entities[index], entity));
     m_mapData->entities[index] = entity;
+    m_spatialIndex.updateEntity(*m_mapData, index);
     emit mapChanged();
-    update();
+    invalidateStaticLayer();
   }
 }
 
@@ -2022,68 +2328,191 @@ void GridEditor::autoParentSector(int sectorIdx) {
   }
 }
 
+/* ============================================================================
+   UNDO / REDO
+   ============================================================================
+ */
+
+void GridEditor::pushCommand(MapCommand *command) {
+  m_undoStack.push(command, *m_mapData);
+  m_spatialIndex.invalidate();
+}
+
+void GridEditor::recordCommand(MapCommand *command) {
+  m_undoStack.record(command);
+}
+
+bool GridEditor::undo() {
+  int count = itemCount();
+  if (!m_undoStack.undo(*m_mapData))
+    return false;
+  historyChanged(itemCount() != count);
+  return true;
+}
+
+bool GridEditor::redo() {
+  int count = itemCount();
+  if (!m_undoStack.redo(*m_mapData))
+    return false;
+  historyChanged(itemCount() != count);
+  return true;
+}
+
+void GridEditor::historyChanged(bool listsChanged) {
+  // Selections are indexes; they only survive if no list changed size
+  if (listsChanged) {
+    m_selectedSector = -1;
+    m_selectedWallSector = -1;
+    m_selectedWallIndex = -1;
+    m_selectedEntity = -1;
+    m_multiSelectedSectors.clear();
+    m_multiSelectedEntities.clear();
+    m_multiSelectedSpawnFlags.clear();
+    m_multiSelectedLights.clear();
+  }
+  m_spatialIndex.invalidate();
+  invalidateStaticLayer();
+  emit mapChanged();
+}
+
+int GridEditor::itemCount() const {
+  return m_mapData->sectors.size() + m_mapData->portals.size() +
+         m_mapData->entities.size() + m_mapData->spawnFlags.size() +
+         m_mapData->lights.size();
+}
+
+void GridEditor::recordSectorInsert(int index) {
+  if (index < 0 || index >= m_mapData->sectors.size())
+    return;
+
+  // The parent link is a separate command: it also edits the parent's list
+  Sector sector = m_mapData->sectors[index];
+  int parentId = sector.parent_sector_id;
+  sector.parent_sector_id = -1;
+
+  auto *insert = new ListEditCommand<Sector>(
+      tr("Crear sector"), &MapData::sectors, ListEditCommand<Sector>::Insert);
+  insert->addItem(index, sector);
+  if (parentId < 0) {
+    recordCommand(insert);
+    return;
+  }
+
+  auto *step = new MapMacroCommand(insert->text());
+  step->append(insert);
+  step->append(new SectorParentCommand(sector.sector_id, -1, parentId));
+  recordCommand(step);
+}
+
+void GridEditor::recordMove(TranslateCommand *move, bool reparent) {
+  QList<MapCommand *> parents;
+  if (reparent) {
+    for (int sectorId : move->sectorIds) {
+      int idx = m_mapData->sectorIndex(sectorId);
+      if (idx < 0)
+        continue;
+      int before = m_mapData->sectors[idx].parent_sector_id;
+      autoParentSector(idx);
+      int after = m_mapData->sectors[idx].parent_sector_id;
+      if (after != before)
+        parents.append(new SectorParentCommand(sectorId, before, after));
+    }
+  }
+
+  if (parents.isEmpty()) {
+    if (move->isNull())
+      delete move; // Click without drag
+    else
+      recordCommand(move);
+    return;
+  }
+
+  auto *step = new MapMacroCommand(move->text());
+  step->append(move);
+  for (MapCommand *parent : parents)
+    step->append(parent);
+  recordCommand(step);
+}
+
+QPointF GridEditor::groupAnchor() const {
+  if (!m_mapData || m_originalGroupPositions.isEmpty())
+    return QPointF();
+  const Sector *sector =
+      m_mapData->findSector(m_originalGroupPositions.firstKey());
+  return sector ? sector->vertices.value(0) : QPointF();
+}
+
 void GridEditor::deleteSelection() {
   if (!m_mapData)
     return;
 
+  // Everything is collected by its current index before anything is
+  // removed, so one list does not shift the indexes of the next
+
   // Lights
-  std::sort(m_multiSelectedLights.begin(), m_multiSelectedLights.end(),
-            std::greater<int>());
-  for (int idx : m_multiSelectedLights) {
-    if (idx >= 0 && idx < m_mapData->lights.size())
-      m_mapData->lights.removeAt(idx);
-  }
+  auto *lights = new ListEditCommand<Light>(QString(), &MapData::lights,
+                                            ListEditCommand<Light>::Remove);
+  for (int idx : validIndexes(m_multiSelectedLights, m_mapData->lights.size()))
+    lights->addItem(idx, m_mapData->lights[idx]);
   m_multiSelectedLights.clear();
 
-  // Entities
-  std::sort(m_multiSelectedEntities.begin(), m_multiSelectedEntities.end(),
-            std::greater<int>());
-  for (int idx : m_multiSelectedEntities) {
-    if (idx >= 0 && idx < m_mapData->entities.size()) {
-      // Also remove all associated spawn flags if any
-      int spawnId = m_mapData->entities[idx].spawn_id;
-      for (int i = m_mapData->spawnFlags.size() - 1; i >= 0; --i) {
-        if (m_mapData->spawnFlags[i].flagId == spawnId) {
-          m_mapData->spawnFlags.removeAt(i);
-        }
-      }
-      m_mapData->entities.removeAt(idx);
-    }
+  // Entities, with all their associated spawn flags
+  auto *entities = new ListEditCommand<EntityInstance>(
+      QString(), &MapData::entities, ListEditCommand<EntityInstance>::Remove);
+  QSet<int> removedSpawnIds;
+  for (int idx :
+       validIndexes(m_multiSelectedEntities, m_mapData->entities.size())) {
+    entities->addItem(idx, m_mapData->entities[idx]);
+    removedSpawnIds.insert(m_mapData->entities[idx].spawn_id);
   }
   m_multiSelectedEntities.clear();
   m_selectedEntity = -1;
 
-  // Spawn Flags (Directly selected ones)
-  std::sort(m_multiSelectedSpawnFlags.begin(), m_multiSelectedSpawnFlags.end(),
-            std::greater<int>());
-  for (int idx : m_multiSelectedSpawnFlags) {
-    if (idx >= 0 && idx < m_mapData->spawnFlags.size()) {
-      m_mapData->spawnFlags.removeAt(idx);
-    }
+  // Spawn Flags (directly selected ones and those of the entities)
+  QList<int> flagIndexes = m_multiSelectedSpawnFlags;
+  for (int i = 0; i < m_mapData->spawnFlags.size(); ++i) {
+    if (removedSpawnIds.contains(m_mapData->spawnFlags[i].flagId))
+      flagIndexes.append(i);
   }
+  auto *flags = new ListEditCommand<SpawnFlag>(
+      QString(), &MapData::spawnFlags, ListEditCommand<SpawnFlag>::Remove);
+  for (int idx : validIndexes(flagIndexes, m_mapData->spawnFlags.size()))
+    flags->addItem(idx, m_mapData->spawnFlags[idx]);
   m_multiSelectedSpawnFlags.clear();
 
-  // Sectors
-  std::sort(m_multiSelectedSectors.begin(), m_multiSelectedSectors.end(),
-            std::greater<int>());
-  for (int idx : m_multiSelectedSectors) {
-    if (idx >= 0 && idx < m_mapData->sectors.size()) {
-      // Find and remove portals associated with this sector
-      int sectorId = m_mapData->sectors[idx].sector_id;
-      for (int p = m_mapData->portals.size() - 1; p >= 0; --p) {
-        if (m_mapData->portals[p].sector_a == sectorId ||
-            m_mapData->portals[p].sector_b == sectorId) {
-          m_mapData->portals.removeAt(p);
-        }
-      }
-      m_mapData->sectors.removeAt(idx);
-    }
+  // Sectors, with the portals associated with them
+  auto *sectors = new ListEditCommand<Sector>(QString(), &MapData::sectors,
+                                              ListEditCommand<Sector>::Remove);
+  QSet<int> removedSectorIds;
+  for (int idx :
+       validIndexes(m_multiSelectedSectors, m_mapData->sectors.size())) {
+    sectors->addItem(idx, m_mapData->sectors[idx]);
+    removedSectorIds.insert(m_mapData->sectors[idx].sector_id);
+  }
+  auto *portals = new ListEditCommand<Portal>(QString(), &MapData::portals,
+                                              ListEditCommand<Portal>::Remove);
+  for (int p = 0; p < m_mapData->portals.size(); ++p) {
+    const Portal &portal = m_mapData->portals[p];
+    if (removedSectorIds.contains(portal.sector_a) ||
+        removedSectorIds.contains(portal.sector_b))
+      portals->addItem(p, portal);
   }
   m_multiSelectedSectors.clear();
   m_selectedSector = -1;
 
+  auto *step = new MapMacroCommand(tr("Eliminar selección"));
+  appendStep(step, lights);
+  appendStep(step, entities);
+  appendStep(step, flags);
+  appendStep(step, portals);
+  appendStep(step, sectors);
+  if (step->isEmpty())
+    delete step;
+  else
+    pushCommand(step);
+
   emit mapChanged();
-  update();
+  invalidateStaticLayer();
 }
 
 void GridEditor::copySelection() {
@@ -2158,6 +2587,16 @@ void GridEditor::pasteSelection() {
   m_multiSelectedEntities.clear();
   m_multiSelectedLights.clear();
 
+  // The pasted items are appended; undo removes them again
+  auto *sectors = new ListEditCommand<Sector>(QString(), &MapData::sectors,
+                                              ListEditCommand<Sector>::Insert);
+  auto *entities = new ListEditCommand<EntityInstance>(
+      QString(), &MapData::entities, ListEditCommand<EntityInstance>::Insert);
+  auto *flags = new ListEditCommand<SpawnFlag>(
+      QString(), &MapData::spawnFlags, ListEditCommand<SpawnFlag>::Insert);
+  auto *lights = new ListEditCommand<Light>(QString(), &MapData::lights,
+                                            ListEditCommand<Light>::Insert);
+
   for (Sector s : m_copyBufferSectors) {
     s.sector_id = m_mapData->getNextSectorId();
     for (int i = 0; i < s.vertices.size(); ++i) {
@@ -2171,8 +2610,9 @@ void GridEditor::pasteSelection() {
       s.walls[i].y2 += offset.y();
       s.walls[i].portal_id = -1; // Portals are not copied for now to avoid mess
     }
-    m_mapData->sectors.append(s);
+    m_mapData->addSector(s);
     m_multiSelectedSectors.append(m_mapData->sectors.size() - 1);
+    sectors->addItem(m_mapData->sectors.size() - 1, s);
   }
 
   for (EntityInstance e : m_copyBufferEntities) {
@@ -2186,20 +2626,33 @@ void GridEditor::pasteSelection() {
     flag.x = e.x;
     flag.y = e.y;
     flag.z = e.z;
-    m_mapData->spawnFlags.append(flag);
+    m_mapData->addSpawnFlag(flag);
+    flags->addItem(m_mapData->spawnFlags.size() - 1, flag);
 
-    m_mapData->entities.append(e);
+    m_mapData->addEntity(e);
     m_multiSelectedEntities.append(m_mapData->entities.size() - 1);
+    entities->addItem(m_mapData->entities.size() - 1, e);
   }
 
   for (Light l : m_copyBufferLights) {
     l.x += offset.x();
     l.y += offset.y();
-    l.id = m_mapData->lights.size();
-    m_mapData->lights.append(l);
+    l.id = m_mapData->getNextLightId();
+    m_mapData->addLight(l);
     m_multiSelectedLights.append(m_mapData->lights.size() - 1);
+    lights->addItem(m_mapData->lights.size() - 1, l);
   }
 
+  auto *step = new MapMacroCommand(tr("Pegar"));
+  appendStep(step, sectors);
+  appendStep(step, flags);
+  appendStep(step, entities);
+  appendStep(step, lights);
+  if (step->isEmpty())
+    delete step;
+  else
+    recordCommand(step);
+
   emit mapChanged();
-  update();
+  invalidateStaticLayer();
 }
@@ -2,12 +2,16 @@
 #define GRIDEDITOR_H
 
 #include "mapdata.h"
+#include "mapspatialindex.h"
+#include "mapundo.h"
 #include <QMap>
 #include <QPixmap>
 #include <QPoint>
 #include <QVector>
 #include <QWidget>
 
+class TextureRegistry;
+
 class GridEditor : public QWidget {
   Q_OBJECT
 
@@ -19,12 +23,17 @@ public:
   MapData *mapData() const { return m_mapData; }
   void newMap(); // Reset map
 
+  // Repaint after map edits: the cached map layer is redrawn too. A plain
+  // update() keeps the layer (hover feedback, zoom and pan).
+  void invalidateStaticLayer();
+
   // File management
   QString fileName() const { return m_fileName; }
   void setFileName(const QString &file) { m_fileName = file; }
 
-  // Textures
-  void setTextures(const QMap<int, QPixmap> &textures);
+  // Textures, shared with the other views (not owned)
+  void setTextureRegistry(TextureRegistry *registry);
+  TextureRegistry *textureRegistry() const { return m_textureRegistry; }
 
   // Edit modes
   enum EditMode {
@@ -77,6 +86,21 @@ public:
   int findSectorAt(
       const QPointF &worldPos); // Made public for use in MainWindow
 
+  // Call after moving map items from outside the editor
+  void invalidateSpatialIndex() { m_spatialIndex.invalidate(); }
+
+  // Undo history. pushCommand() applies the command, recordCommand() takes
+  // one whose edit was already made. Call clearHistory() after replacing
+  // the whole MapData.
+  void pushCommand(MapCommand *command);
+  void recordCommand(MapCommand *command);
+  bool undo();
+  bool redo();
+  void clearHistory() { m_undoStack.clear(); }
+  // Records sectors[index], just added, as a "create sector" step
+  void recordSectorInsert(int index);
+  const MapUndoStack &undoStack() const { return m_undoStack; }
+
 signals:
   void statusMessage(const QString &msg); // NEW: Consolidated status signal
   void sectorSelected(int sectorId);
@@ -114,8 +138,9 @@ protected:
   void dropEvent(QDropEvent *event) override;
 
 private:
+  void addDroppedEntity(const EntityInstance &entity); // Undoable
   MapData *m_mapData;
-  QMap<int, QPixmap> m_textures;
+  TextureRegistry *m_textureRegistry;
   EditMode m_editMode;
   int m_selectedTexture;
   int m_selectedSector;
@@ -136,6 +161,7 @@ private:
   // Multi-selection movement
   bool m_isMovingMultiSelection;
   QPointF m_multiMoveStartPos;
+  QPointF m_multiMoveOffset; // Applied so far, for the undo record
   QMap<int, QVector<QPointF>> m_initialMultiSelectedSectorVertices;
   QMap<int, QPointF> m_initialMultiSelectedEntityPositions;
   QMap<int, QPointF> m_initialMultiSelectedSpawnFlagPositions;
@@ -161,6 +187,7 @@ private:
   int m_draggedVertex;               // For MODE_EDIT_VERTICES
   QPoint m_lastMousePos;             // For panning
   QPointF m_dragStartPos;            // NEW: For calculating delta
+  QPointF m_dragOrigin;              // Dragged item position at press (undo)
 
   // Camera
   bool m_hasCameraPosition;
@@ -169,6 +196,30 @@ private:
   // Cursor tracking
   QPointF m_lastCursorPos;
 
+  // Cached map layer (grid, sectors, walls and markers) for the current
+  // view. Overlays are painted over it on every repaint.
+  struct LayerKey {
+    float zoom;
+    float panX, panY;
+    QSize size;
+    qreal devicePixelRatio;
+    int highlightedSector; // Filled differently, -1 = none
+
+    bool operator==(const LayerKey &other) const {
+      return zoom == other.zoom && panX == other.panX && panY == other.panY &&
+             size == other.size &&
+             devicePixelRatio == other.devicePixelRatio &&
+             highlightedSector == other.highlightedSector;
+    }
+  };
+  QPixmap m_layer;
+  LayerKey m_layerKey;
+  bool m_layerDirty;
+
+  LayerKey currentLayerKey() const;
+  void renderLayer(const LayerKey &key);
+  QRectF visibleWorldRect(int marginPixels) const;
+
   // Rendering helpers
   void drawGrid(QPainter &painter);
   void drawSectors(QPainter &painter);
@@ -178,7 +229,10 @@ private:
   void drawSpawnFlags(QPainter &painter);
   void drawEntities(QPainter &painter); // NEW: Draw MD3 entities
   void drawLights(QPainter &painter);   // NEW: Draw omni lights
+  void drawMarkerDots(QPainter &painter, const QVector<QPointF> &positions,
+                      const QColor &color); // Zoomed-out markers
   void drawCamera(QPainter &painter);
+  void drawSelectionOverlay(QPainter &painter);
   void drawCurrentPolygon(QPainter &painter);
   void drawCursorInfo(QPainter &painter);
   bool m_manualPortalMode;
@@ -199,6 +253,7 @@ private:
                             const QPointF &lineEnd) const;
 
   // Hit testing
+  MapSpatialIndex m_spatialIndex; // Synced lazily by the find*At functions
 
   int findWallAt(const QPointF &worldPos, float tolerance = 10.0f);
   int findEntityAt(const QPointF &worldPos, float tolerance = 10.0f);
@@ -210,6 +265,15 @@ private:
   // Auto-parent sector after move
   void autoParentSector(int sectorIdx);
 
+  // Undo: records a drag that ended; reparent runs autoParentSector() on
+  // the moved sectors and records the parent changes in the same step
+  void recordMove(TranslateCommand *move, bool reparent);
+  void historyChanged(bool listsChanged); // After undo/redo
+  int itemCount() const;
+  QPointF groupAnchor() const; // First vertex of the moving group
+
+  MapUndoStack m_undoStack;
+
   QString m_fileName;
   bool m_showGrid;
 };
@@ -1,9 +1,13 @@
 #include "insertboxdialog.h"
+#include <QAbstractItemView>
+#include <QEvent>
 #include <QLabel>
+#include <QScrollBar>
 #include <QVBoxLayout>
 
-InsertBoxDialog::InsertBoxDialog(const QMap<int, QPixmap> &textureCache, QWidget *parent)
+InsertBoxDialog::InsertBoxDialog(const TextureSource &source, QWidget *parent)
     : QDialog(parent)
+    , m_source(source)
 {
     setWindowTitle(tr("Insertar Caja"));
     setModal(true);
@@ -54,34 +58,13 @@ InsertBoxDialog::InsertBoxDialog(const QMap<int, QPixmap> &textureCache, QWidget
     QGroupBox *textureGroup = new QGroupBox(tr("Texturas"));
     QFormLayout *textureLayout = new QFormLayout(textureGroup);
     
-    // Wall texture combo
-    m_wallTextureCombo = new QComboBox();
-    m_wallTextureCombo->setIconSize(QSize(64, 64));
-    m_wallTextureCombo->setToolTip(tr("Textura para las paredes"));
-    for (auto it = textureCache.constBegin(); it != textureCache.constEnd(); ++it) {
-        QPixmap scaled = it.value().scaled(64, 64, Qt::KeepAspectRatio, Qt::SmoothTransformation);
-        m_wallTextureCombo->addItem(QIcon(scaled), QString::number(it.key()), it.key());
-    }
+    m_wallTextureCombo = createTextureCombo(tr("Textura para las paredes"));
     textureLayout->addRow(tr("Paredes:"), m_wallTextureCombo);
     
-    // Floor texture combo
-    m_floorTextureCombo = new QComboBox();
-    m_floorTextureCombo->setIconSize(QSize(64, 64));
-    m_floorTextureCombo->setToolTip(tr("Textura para el suelo"));
-    for (auto it = textureCache.constBegin(); it != textureCache.constEnd(); ++it) {
-        QPixmap scaled = it.value().scaled(64, 64, Qt::KeepAspectRatio, Qt::SmoothTransformation);
-        m_floorTextureCombo->addItem(QIcon(scaled), QString::number(it.key()), it.key());
-    }
+    m_floorTextureCombo = createTextureCombo(tr("Textura para el suelo"));
     textureLayout->addRow(tr("Suelo:"), m_floorTextureCombo);
     
-    // Ceiling texture combo
-    m_ceilingTextureCombo = new QComboBox();
-    m_ceilingTextureCombo->setIconSize(QSize(64, 64));
-    m_ceilingTextureCombo->setToolTip(tr("Textura para el techo"));
-    for (auto it = textureCache.constBegin(); it != textureCache.constEnd(); ++it) {
-        QPixmap scaled = it.value().scaled(64, 64, Qt::KeepAspectRatio, Qt::SmoothTransformation);
-        m_ceilingTextureCombo->addItem(QIcon(scaled), QString::number(it.key()), it.key());
-    }
+    m_ceilingTextureCombo = createTextureCombo(tr("Textura para el techo"));
     textureLayout->addRow(tr("Techo:"), m_ceilingTextureCombo);
     
     mainLayout->addWidget(textureGroup);
@@ -100,3 +83,71 @@ InsertBoxDialog::InsertBoxDialog(const QMap<int, QPixmap> &textureCache, QWidget
     connect(m_buttonBox, &QDialogButtonBox::rejected, this, &QDialog::reject);
     mainLayout->addWidget(m_buttonBox);
 }
+
+// Texture combos list every ID; icons are decoded for the current item and
+// for the rows the open popup shows, as they scroll into view
+QComboBox *InsertBoxDialog::createTextureCombo(const QString &toolTip)
+{
+    QComboBox *combo = new QComboBox();
+    combo->setIconSize(QSize(64, 64));
+    combo->setToolTip(toolTip);
+    for (int id : m_source.ids)
+        combo->addItem(QString::number(id), id);
+
+    m_textureCombos.append(combo);
+    combo->view()->installEventFilter(this);
+    connect(combo->view()->verticalScrollBar(), &QScrollBar::valueChanged, this,
+            [this, combo]() { loadVisibleIcons(combo); });
+    connect(combo, QOverload<int>::of(&QComboBox::currentIndexChanged),
+            this, [this, combo]() { loadVisibleIcons(combo); });
+    loadVisibleIcons(combo);
+    return combo;
+}
+
+bool InsertBoxDialog::eventFilter(QObject *watched, QEvent *event)
+{
+    if (event->type() == QEvent::Show) {
+        for (QComboBox *combo : m_textureCombos) {
+            if (combo->view() == watched)
+                loadVisibleIcons(combo);
+        }
+    }
+    return QDialog::eventFilter(watched, event);
+}
+
+void InsertBoxDialog::loadVisibleIcons(QComboBox *combo)
+{
+    if (!m_source.load || combo->count() == 0)
+        return;
+
+    // Current item, plus the popup rows on screen when it is open
+    QSet<int> rows;
+    rows.insert(qMax(0, combo->currentIndex()));
+    QAbstractItemView *view = combo->view();
+    if (view->isVisible()) {
+        QRect area = view->viewport()->rect();
+        int first = view->indexAt(area.topLeft()).row();
+        int last = view->indexAt(area.bottomLeft()).row();
+        if (first < 0)
+            first = 0;
+        if (last < 0)
+            last = combo->count() - 1;
+        for (int row = first; row <= last; row++)
+            rows.insert(row);
+    }
+
+    QSet<int> ids;
+    for (int row : rows) {
+        if (combo->itemIcon(row).isNull())
+            ids.insert(combo->itemData(row).toInt());
+    }
+    if (ids.isEmpty())
+        return;
+
+    QMap<int, QPixmap> pixmaps = m_source.load(ids);
+    for (int row : rows) {
+        QPixmap pixmap = pixmaps.value(combo->itemData(row).toInt());
+        if (!pixmap.isNull())
+            combo->setItemIcon(row, QIcon(pixmap.scaled(64, 64, Qt::KeepAspectRatio, Qt::SmoothTransformation)));
+    }
+}
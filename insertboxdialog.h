@@ -10,13 +10,14 @@
 #include <QComboBox>
 #include <QPixmap>
 #include <QMap>
+#include "textureselector.h"
 
 class InsertBoxDialog : public QDialog
 {
     Q_OBJECT
 
 public:
-    explicit InsertBoxDialog(const QMap<int, QPixmap> &textureCache, QWidget *parent = nullptr);
+    explicit InsertBoxDialog(const TextureSource &source, QWidget *parent = nullptr);
     
     // Getters for configuration
     float getWidth() const { return m_widthSpin->value(); }
@@ -27,7 +28,15 @@ public:
     int getFloorTexture() const { return m_floorTextureCombo->currentData().toInt(); }
     int getCeilingTexture() const { return m_ceilingTextureCombo->currentData().toInt(); }
 
+protected:
+    bool eventFilter(QObject *watched, QEvent *event) override;
+
 private:
+    QComboBox *createTextureCombo(const QString &toolTip);
+    void loadVisibleIcons(QComboBox *combo);
+
+    TextureSource m_source;
+    QList<QComboBox *> m_textureCombos;
     QDoubleSpinBox *m_widthSpin;
     QDoubleSpinBox *m_heightSpin;
     QDoubleSpinBox *m_floorZSpin;
@@ -15,6 +15,8 @@
 #include "fpgloader.h"
 #include "grideditor.h"      // Added based on instruction
 #include "insertboxdialog.h" // Insert Box dialog
+#include "maploader.h"
+#include "mapsaveservice.h"
 #include "md3generator.h"
 #include "meshgeneratordialog.h"
 #include "npcpatheditor.h"
@@ -47,6 +49,7 @@
 #include <QSettings>
 #include <QStatusBar>
 #include <QStyle>
+#include <QTimer>
 #include <QToolBar>
 #include <QVBoxLayout>
 #include <algorithm> // for std::max/min // Added based on instruction
@@ -56,10 +59,12 @@ MainWindow::MainWindow(QWidget *parent)
     : QMainWindow(parent), m_currentFPG(0), m_selectedSectorId(-1),
       m_selectedWallId(-1), m_selectedDecalId(-1), m_assetBrowser(nullptr),
       m_codeEditorDialog(nullptr), m_tabWidget(nullptr),
-      m_visualModeWidget(nullptr), m_consoleWidget(nullptr),
+      m_visualModeWidget(nullptr), m_visualUpdateTimer(nullptr),
+      m_consoleWidget(nullptr),
       m_consoleDock(nullptr), m_codePreviewPanel(nullptr),
       m_codePreviewDock(nullptr), m_buildManager(nullptr),
-      m_projectManager(nullptr), m_assetDock(nullptr), m_sectorPanel(nullptr),
+      m_saveService(nullptr), m_mapLoader(nullptr), m_projectManager(nullptr),
+      m_assetDock(nullptr), m_sectorPanel(nullptr),
       m_wallPanel(nullptr), m_entityPanel(nullptr), m_sectorListDock(nullptr),
       m_sceneEntitiesDock(nullptr), m_sceneEntitiesTree(nullptr),
       m_sectorTree(nullptr), m_sectorIdLabel(nullptr),
@@ -76,6 +81,43 @@ MainWindow::MainWindow(QWidget *parent)
   qDebug() << "MainWindow construction started...";
   m_projectManager = new ProjectManager(this); // Initialize ProjectManager
 
+  // Textures shared by every view, filled from the current FPG
+  m_textureRegistry = new TextureRegistry(this);
+
+  // Maps are written on a worker thread; the UI never waits on the disk
+  m_saveService = new MapSaveService(this);
+  connect(m_saveService, &MapSaveService::saveFinished, this,
+          &MainWindow::onMapSaved);
+  connect(m_saveService, &MapSaveService::autosaveRequested, this,
+          &MainWindow::onAutosave);
+  {
+    QSettings settings("BennuGD", "RayMapEditor");
+    m_saveService->setAutosaveInterval(
+        settings.value("autosaveInterval", 5).toInt());
+    // Decoded FPG textures kept in memory, in MB (see FPGTextureProvider)
+    m_textureProvider.setMemoryBudget(
+        settings.value("textureMemoryBudgetMB", 256).toLongLong() * 1024 *
+        1024);
+  }
+
+  // Edits that come in bursts (drags, spin boxes) update the 3D view once
+  // per frame
+  m_visualUpdateTimer = new QTimer(this);
+  m_visualUpdateTimer->setSingleShot(true);
+  m_visualUpdateTimer->setInterval(1000 / 60);
+  connect(m_visualUpdateTimer, &QTimer::timeout, this,
+          &MainWindow::applyVisualModeUpdate);
+
+  // Maps are opened on a worker too, tab contents arrive in stages
+  m_mapLoader = new MapLoader(this);
+  connect(m_mapLoader, &MapLoader::geometryLoaded, this,
+          &MainWindow::onMapGeometryLoaded);
+  connect(m_mapLoader, &MapLoader::mapLoaded, this, &MainWindow::onMapLoaded);
+  connect(m_mapLoader, &MapLoader::texturesLoaded, this,
+          &MainWindow::onMapTexturesLoaded);
+  connect(m_mapLoader, &MapLoader::loadFailed, this,
+          &MainWindow::onMapLoadFailed);
+
   setWindowTitle("RayMap Editor");
   setWindowIcon(QIcon(":/icon.png"));
   resize(1280, 800);
@@ -306,6 +348,67 @@ void MainWindow::createMenus() {
   m_recentMapsMenu = fileMenu->addMenu(tr("Mapas Recientes"));
   updateRecentMapsMenu();
 
+  // Compression of saved maps: smaller files vs faster saves. The engine's
+  // map loader only reads uncompressed v32 maps, so compressed levels and
+  // the chunked format are marked as editor-only
+  QMenu *compressionMenu = fileMenu->addMenu(tr("Compresión de Mapas"));
+  const QString runtimeWarning =
+      tr("Los mapas comprimidos con gzip o guardados por bloques no los puede "
+         "leer el cargador de mapas del motor: úsalos solo para guardar "
+         "copias del editor.");
+  compressionMenu->setToolTipsVisible(true);
+  compressionMenu->menuAction()->setToolTip(runtimeWarning);
+  QAction *warningAction = compressionMenu->addAction(
+      tr("Aviso: el motor solo carga mapas sin comprimir"));
+  warningAction->setEnabled(false);
+  warningAction->setToolTip(runtimeWarning);
+  compressionMenu->addSeparator();
+  QActionGroup *compressionGroup = new QActionGroup(this);
+  compressionGroup->setExclusive(true);
+  const int savedLevel = mapCompressionLevel();
+  auto addCompressionLevel = [&](const QString &text, int level) {
+    QAction *action = compressionMenu->addAction(text);
+    action->setCheckable(true);
+    action->setChecked(level == savedLevel);
+    if (level != RayMapFormat::NoCompression)
+      action->setToolTip(runtimeWarning);
+    compressionGroup->addAction(action);
+    connect(action, &QAction::triggered, this, [level]() {
+      QSettings settings("BennuGD", "RayMapEditor");
+      settings.setValue("mapCompressionLevel", level);
+    });
+  };
+  addCompressionLevel(tr("Sin comprimir"), RayMapFormat::NoCompression);
+  addCompressionLevel(tr("Rápida (gzip 1, solo editor)"),
+                      RayMapFormat::FastCompression);
+  addCompressionLevel(tr("Normal (gzip 6, solo editor)"),
+                      RayMapFormat::DefaultCompression);
+  addCompressionLevel(tr("Máxima (gzip 9, solo editor)"),
+                      RayMapFormat::BestCompression);
+  addCompressionLevel(tr("Por bloques (v33, solo editor)"),
+                      MapSaveService::ChunkedFormat);
+
+  // Autosave interval in minutes (QSettings "autosaveInterval")
+  QMenu *autosaveMenu = fileMenu->addMenu(tr("Autoguardado"));
+  QActionGroup *autosaveGroup = new QActionGroup(this);
+  autosaveGroup->setExclusive(true);
+  const int savedInterval = m_saveService->autosaveInterval();
+  auto addAutosaveInterval = [&](const QString &text, int minutes) {
+    QAction *action = autosaveMenu->addAction(text);
+    action->setCheckable(true);
+    action->setChecked(minutes == savedInterval);
+    autosaveGroup->addAction(action);
+    connect(action, &QAction::triggered, this, [this, minutes]() {
+      QSettings settings("BennuGD", "RayMapEditor");
+      settings.setValue("autosaveInterval", minutes);
+      m_saveService->setAutosaveInterval(minutes);
+    });
+  };
+  addAutosaveInterval(tr("Desactivado"), 0);
+  addAutosaveInterval(tr("Cada minuto"), 1);
+  addAutosaveInterval(tr("Cada 5 minutos"), 5);
+  addAutosaveInterval(tr("Cada 10 minutos"), 10);
+
   fileMenu->addSeparator();
 
   // -- Project Settings & Publish --
@@ -336,6 +439,25 @@ void MainWindow::createMenus() {
   fileMenu->addSeparator();
   fileMenu->addAction(m_exitAction);
 
+  // === EDIT MENU ===
+  QMenu *editMenu = menuBar()->addMenu(tr("&Editar"));
+  QAction *undoAction =
+      editMenu->addAction(tr("&Deshacer"), this, &MainWindow::onUndo);
+  undoAction->setShortcut(QKeySequence::Undo);
+  QAction *redoAction =
+      editMenu->addAction(tr("&Rehacer"), this, &MainWindow::onRedo);
+  redoAction->setShortcut(QKeySequence::Redo);
+  connect(editMenu, &QMenu::aboutToShow, this,
+          [this, undoAction, redoAction]() {
+            GridEditor *editor = getCurrentEditor();
+            QString undo = editor ? editor->undoStack().undoText() : QString();
+            QString redo = editor ? editor->undoStack().redoText() : QString();
+            undoAction->setText(undo.isEmpty() ? tr("&Deshacer")
+                                               : tr("&Deshacer %1").arg(undo));
+            redoAction->setText(redo.isEmpty() ? tr("&Rehacer")
+                                               : tr("&Rehacer %1").arg(redo));
+          });
+
   // === VIEW MENU ===
   QMenu *viewMenu = menuBar()->addMenu(tr("&Ver"));
   viewMenu->addAction(m_zoomInAction);
@@ -1243,11 +1365,13 @@ void MainWindow::onNewMap() {
           &MainWindow::onEntityChanged); // Live visual update
   connect(editor, &GridEditor::requestEditEntityBehavior, this,
           &MainWindow::onEditEntityBehavior);
+  connect(editor, &GridEditor::mapChanged, this,
+          &MainWindow::updateVisualMode);
   connect(editor, &GridEditor::lightSelected, this,
           &MainWindow::onLightSelected);
 
   // Apply current textures to it
-  editor->setTextures(m_textureCache);
+  editor->setTextureRegistry(m_textureRegistry);
 
   // Add to tab
   int index = m_tabWidget->addTab(
@@ -1284,11 +1408,9 @@ void MainWindow::onSaveMap() {
     editor->mapData()->camera.z = 32.0f; // Default height
   }
 
-  if (RayMapFormat::saveMap(editor->fileName(), *editor->mapData())) {
-    m_statusLabel->setText(tr("Mapa guardado: %1").arg(editor->fileName()));
-  } else {
-    QMessageBox::critical(this, tr("Error"), tr("No se pudo guardar el mapa."));
-  }
+  m_saveService->save(editor->fileName(), *editor->mapData(),
+                      mapCompressionLevel());
+  m_statusLabel->setText(tr("Guardando mapa: %1...").arg(editor->fileName()));
 }
 
 void MainWindow::onSaveMapAs() {
@@ -1333,16 +1455,87 @@ void MainWindow::onSaveMapAs() {
     editor->mapData()->camera.z = 32.0f; // Default height
   }
 
-  if (RayMapFormat::saveMap(filename, *editor->mapData())) {
-    editor->setFileName(filename);
+  // The tab takes the new name in onMapSaved, once the file is written
+  m_pendingRenames.insert(filename, editor);
+  m_saveService->save(filename, *editor->mapData(), mapCompressionLevel());
+  m_statusLabel->setText(tr("Guardando mapa: %1...").arg(filename));
+}
+
+void MainWindow::onMapSaved(const QString &filename, bool ok) {
+  QPointer<GridEditor> renamed = m_pendingRenames.take(filename);
+  if (ok && renamed && renamed->fileName() != filename) {
+    m_saveService->forget(autosaveKey(renamed));
+    m_untitledKeys.remove(renamed);
+    renamed->setFileName(filename);
     updateWindowTitle();
-    m_tabWidget->setTabText(m_tabWidget->currentIndex(),
-                            QFileInfo(filename).fileName());
+    int index = m_tabWidget->indexOf(renamed);
+    if (index >= 0)
+      m_tabWidget->setTabText(index, QFileInfo(filename).fileName());
     addToRecentMaps(filename);
+  }
+
+  if (ok) {
     m_statusLabel->setText(tr("Mapa guardado: %1").arg(filename));
   } else {
-    QMessageBox::critical(this, tr("Error"), tr("No se pudo guardar el mapa."));
+    QMessageBox::critical(this, tr("Error"),
+                          tr("No se pudo guardar el mapa:\n%1").arg(filename));
+  }
+}
+
+void MainWindow::onUndo() {
+  GridEditor *editor = getCurrentEditor();
+  if (!editor)
+    return;
+
+  QString text = editor->undoStack().undoText();
+  if (!editor->undo()) {
+    m_statusLabel->setText(tr("Nada que deshacer"));
+    return;
+  }
+  updateSectorList();
+  updateSectorPanel();
+  updateWallPanel();
+  m_statusLabel->setText(tr("Deshecho: %1").arg(text));
+}
+
+void MainWindow::onRedo() {
+  GridEditor *editor = getCurrentEditor();
+  if (!editor)
+    return;
+
+  QString text = editor->undoStack().redoText();
+  if (!editor->redo()) {
+    m_statusLabel->setText(tr("Nada que rehacer"));
+    return;
   }
+  updateSectorList();
+  updateSectorPanel();
+  updateWallPanel();
+  m_statusLabel->setText(tr("Rehecho: %1").arg(text));
+}
+
+void MainWindow::onAutosave() {
+  for (int i = 0; i < m_tabWidget->count(); i++) {
+    GridEditor *ed = qobject_cast<GridEditor *>(m_tabWidget->widget(i));
+    if (!ed || isMapLoading(ed))
+      continue;
+    QString key = autosaveKey(ed);
+    if (m_saveService->autosave(key, *ed->mapData()))
+      m_statusLabel->setText(tr("Autoguardado: %1").arg(key));
+  }
+}
+
+QString MainWindow::autosaveKey(const GridEditor *editor) {
+  if (!editor->fileName().isEmpty())
+    return editor->fileName();
+  // Untitled maps get a name of their own, so they neither overwrite each
+  // other nor move to another file when tabs are reordered or closed
+  auto it = m_untitledKeys.find(editor);
+  if (it == m_untitledKeys.end()) {
+    it = m_untitledKeys.insert(
+        editor, QString("sin_titulo_%1").arg(m_nextUntitledKey++));
+  }
+  return *it;
 }
 
 void MainWindow::onCameraPlaced(float x, float y) {
@@ -1371,7 +1564,7 @@ void MainWindow::onImportWLD() {
     editor->setEditMode(static_cast<GridEditor::EditMode>(
         m_modeGroup->checkedAction()->data().toInt()));
     editor->showGrid(m_viewGridAction->isChecked());
-    editor->setTextures(m_textureCache);
+    editor->setTextureRegistry(m_textureRegistry);
 
     // Connect signals
     connect(editor, &GridEditor::statusMessage, this,
@@ -1389,6 +1582,8 @@ void MainWindow::onImportWLD() {
             &MainWindow::onEntitySelected);
     connect(editor, &GridEditor::entityMoved, this,
             &MainWindow::onEntityChanged);
+    connect(editor, &GridEditor::mapChanged, this,
+            &MainWindow::updateVisualMode);
     connect(editor, &GridEditor::lightSelected, this,
             &MainWindow::onLightSelected);
 
@@ -1413,52 +1608,10 @@ void MainWindow::onLoadFPG() {
   if (filename.isEmpty())
     return;
 
-  QVector<TextureEntry> textures; // Declared here
-
-  // Load FPG with progress callback
-  // FPGLoader is static, use class name
-  bool success = FPGLoader::loadFPG(
-      filename, textures, [this](int current, int total, const QString &name) {
-        m_statusLabel->setText(
-            tr("Loading FPG: %1/%2 - %3").arg(current).arg(total).arg(name));
-        qApp->processEvents();
-      });
-
-  if (success) {
-    // Convert to texture map
-    QMap<int, QPixmap> textureMap = FPGLoader::getTextureMap(textures);
-
-    // Store textures in map data
-    // m_mapData accessed via current editor or we need to update all open
-    // editors? Let's assume global FPG for now like before
-
-    // m_mapData.textures.clear(); // NO, we don't have m_mapData member anymore
-
-    m_textureCache.clear();
-    for (const TextureEntry &entry : textures) {
-      m_textureCache[entry.id] = entry.pixmap;
-    }
-
-    // Update Grid Editor
-    // Update all editors
-    for (int i = 0; i < m_tabWidget->count(); i++) {
-      GridEditor *ed = qobject_cast<GridEditor *>(m_tabWidget->widget(i));
-      if (ed) {
-        ed->setTextures(m_textureCache);
-        ed->update();
-      }
-    }
-
-    // Cache textures for selector
-    m_textureCache.clear();
-    for (const TextureEntry &entry : textures) {
-      m_textureCache[entry.id] = entry.pixmap;
-    }
-
+  if (openFPG(filename)) {
     addToRecentFPGs(filename);
-    m_currentFPGPath = filename; // Store FPG path using correct member
     m_statusLabel->setText(tr("FPG loaded: %1 textures from %2")
-                               .arg(textures.size())
+                               .arg(m_textureProvider.count())
                                .arg(filename));
   } else {
     QMessageBox::critical(
@@ -1528,6 +1681,12 @@ void MainWindow::addToRecentMaps(const QString &filename) {
   updateRecentMapsMenu();
 }
 
+int MainWindow::mapCompressionLevel() const {
+  QSettings settings("BennuGD", "RayMapEditor");
+  return settings.value("mapCompressionLevel", RayMapFormat::NoCompression)
+      .toInt();
+}
+
 void MainWindow::addToRecentFPGs(const QString &filename) {
   QSettings settings("BennuGD", "RayMapEditor");
   QStringList recentFPGs = settings.value("recentFPGs").toStringList();
@@ -1555,33 +1714,11 @@ void MainWindow::openRecentFPG() {
   if (action) {
     QString filename = action->data().toString();
 
-    QVector<TextureEntry> textures;
-    bool success = FPGLoader::loadFPG(filename, textures, nullptr);
-
-    if (success) {
-      m_currentFPGPath = filename; // Consistent variable
+    if (openFPG(filename)) {
       addToRecentFPGs(filename);
-
-      QMap<int, QPixmap> textureMap = FPGLoader::getTextureMap(textures);
-      m_textureCache.clear();
-      for (auto it = textureMap.begin(); it != textureMap.end(); ++it) {
-        m_textureCache.insert(it.key(), it.value());
-      }
-      // Also populate cache from Vector if needed, but getTextureMap does it.
-      // Wait, previous code used loop over map
-      m_textureCache = textureMap; // Simple assignment
-
       m_statusLabel->setText(tr("FPG cargado: %1 (%2 texturas)")
                                  .arg(filename)
-                                 .arg(m_textureCache.size()));
-
-      for (int i = 0; i < m_tabWidget->count(); i++) {
-        GridEditor *ed = qobject_cast<GridEditor *>(m_tabWidget->widget(i));
-        if (ed) {
-          ed->setTextures(m_textureCache);
-          ed->update();
-        }
-      }
+                                 .arg(m_textureProvider.count()));
     }
   }
 }
@@ -1612,19 +1749,23 @@ void MainWindow::onZoomReset() {
 void MainWindow::onToggleVisualMode() {
   if (!m_visualModeWidget) {
     m_visualModeWidget = new VisualModeWidget();
+    m_visualModeWidget->setTextureRegistry(m_textureRegistry);
   }
 
   if (m_visualModeWidget->isVisible()) {
     m_visualModeWidget->hide();
+    // A hidden view is rebuilt on show, it holds no arrays of the map
+    m_visualSnapshot = VisualSnapshot();
   } else {
     GridEditor *editor = getCurrentEditor();
     if (editor) {
+      // Full rebuild, pending incremental updates are covered by it
+      editor->mapData()->takeDirtySectors();
       m_visualModeWidget->setMapData(*editor->mapData());
-      // Load textures to visual mode... this might be heavy if done every time
-      // ideally VisualModeWidget should share texture cache or similar
-      for (auto it = m_textureCache.begin(); it != m_textureCache.end(); ++it) {
-        m_visualModeWidget->loadTexture(it.key(), it.value().toImage());
-      }
+      takeVisualSnapshot(*editor->mapData());
+      // Only the textures the open maps use are decoded; the view uploads
+      // what changed in the registry since it was last shown
+      refreshTextureCache();
 
       m_visualModeWidget->show();
       m_visualModeWidget->raise();
@@ -1708,7 +1849,8 @@ void MainWindow::onSectorFloorZChanged(double value) {
     for (Sector &sector : editor->mapData()->sectors) {
       if (sector.sector_id == m_selectedSectorId) {
         sector.floor_z = value;
-        editor->update();
+        editor->invalidateStaticLayer();
+        editor->mapData()->markSectorDirty(sector.sector_id);
         updateVisualMode();
         break;
       }
@@ -1725,7 +1867,8 @@ void MainWindow::onSectorCeilingZChanged(double value) {
     for (Sector &sector : editor->mapData()->sectors) {
       if (sector.sector_id == m_selectedSectorId) {
         sector.ceiling_z = value;
-        editor->update();
+        editor->invalidateStaticLayer();
+        editor->mapData()->markSectorDirty(sector.sector_id);
         updateVisualMode();
         break;
       }
@@ -1742,7 +1885,8 @@ void MainWindow::onSectorFloorTextureChanged(int value) {
     for (Sector &sector : editor->mapData()->sectors) {
       if (sector.sector_id == m_selectedSectorId) {
         sector.floor_texture_id = value;
-        editor->update();
+        editor->invalidateStaticLayer();
+        editor->mapData()->markSectorDirty(sector.sector_id);
         updateVisualMode();
         break;
       }
@@ -1759,7 +1903,8 @@ void MainWindow::onSectorCeilingTextureChanged(int value) {
     for (Sector &sector : editor->mapData()->sectors) {
       if (sector.sector_id == m_selectedSectorId) {
         sector.ceiling_texture_id = value;
-        editor->update();
+        editor->invalidateStaticLayer();
+        editor->mapData()->markSectorDirty(sector.sector_id);
         updateVisualMode();
         break;
       }
@@ -1791,7 +1936,8 @@ void MainWindow::onSectorFluidChanged(int index) {
       }
 
       updateSectorPanel(); // Refresh checkboxes
-      editor->update();
+      editor->invalidateStaticLayer();
+      editor->mapData()->markSectorDirty(sector.sector_id);
       updateVisualMode();
       break;
     }
@@ -1809,7 +1955,8 @@ void MainWindow::onSectorScrollXChanged(bool checked) {
         sector.flags |= 8;
       else
         sector.flags &= ~8;
-      editor->update();
+      editor->invalidateStaticLayer();
+      editor->mapData()->markSectorDirty(sector.sector_id);
       updateVisualMode();
       break;
     }
@@ -1827,7 +1974,8 @@ void MainWindow::onSectorScrollYChanged(bool checked) {
         sector.flags |= 16;
       else
         sector.flags &= ~16;
-      editor->update();
+      editor->invalidateStaticLayer();
+      editor->mapData()->markSectorDirty(sector.sector_id);
       updateVisualMode();
       break;
     }
@@ -1844,7 +1992,8 @@ void MainWindow::onSectorLiquidFloorChanged(bool checked) {
         sector.flags |= 32;
       else
         sector.flags &= ~32;
-      editor->update();
+      editor->invalidateStaticLayer();
+      editor->mapData()->markSectorDirty(sector.sector_id);
       updateVisualMode();
       break;
     }
@@ -1861,7 +2010,8 @@ void MainWindow::onSectorLiquidCeilingChanged(bool checked) {
         sector.flags |= 64;
       else
         sector.flags &= ~64;
-      editor->update();
+      editor->invalidateStaticLayer();
+      editor->mapData()->markSectorDirty(sector.sector_id);
       updateVisualMode();
       break;
     }
@@ -1878,7 +2028,8 @@ void MainWindow::onSectorLiquidWallsChanged(bool checked) {
         sector.flags |= 128;
       else
         sector.flags &= ~128;
-      editor->update();
+      editor->invalidateStaticLayer();
+      editor->mapData()->markSectorDirty(sector.sector_id);
       updateVisualMode();
       break;
     }
@@ -1895,7 +2046,8 @@ void MainWindow::onSectorLiquidRipplesChanged(bool checked) {
         sector.flags |= 256; /* RAY_SECTOR_FLAG_RIPPLES */
       else
         sector.flags &= ~256;
-      editor->update();
+      editor->invalidateStaticLayer();
+      editor->mapData()->markSectorDirty(sector.sector_id);
       updateVisualMode();
       break;
     }
@@ -1909,6 +2061,7 @@ void MainWindow::onSectorLiquidIntensityChanged(double value) {
   for (Sector &sector : editor->mapData()->sectors) {
     if (sector.sector_id == m_selectedSectorId) {
       sector.liquid_intensity = (float)value;
+      editor->mapData()->markSectorDirty(sector.sector_id);
       updateVisualMode();
       break;
     }
@@ -1922,6 +2075,7 @@ void MainWindow::onSectorLiquidSpeedChanged(double value) {
   for (Sector &sector : editor->mapData()->sectors) {
     if (sector.sector_id == m_selectedSectorId) {
       sector.liquid_speed = (float)value;
+      editor->mapData()->markSectorDirty(sector.sector_id);
       updateVisualMode();
       break;
     }
@@ -1937,6 +2091,7 @@ void MainWindow::onSectorFogChanged() {
       sector.fog_density = (float)m_sectorFogDensitySpin->value();
       sector.fog_start = (float)m_sectorFogStartSpin->value();
       sector.fog_end = (float)m_sectorFogEndSpin->value();
+      editor->mapData()->markSectorDirty(sector.sector_id);
       updateVisualMode();
       break;
     }
@@ -1959,6 +2114,7 @@ void MainWindow::onSectorFogColorClicked() {
         sector.fog_color_b = color.blueF();
         m_sectorFogColorButton->setStyleSheet(
             QString("background-color: %1;").arg(color.name()));
+        editor->mapData()->markSectorDirty(sector.sector_id);
         updateVisualMode();
       }
       break;
@@ -1985,13 +2141,14 @@ void MainWindow::onSelectSectorFloorTexture() {
     return;
   }
 
-  TextureSelector selector(m_textureCache, this);
+  TextureSelector selector(paletteTextures(), this);
   if (selector.exec() == QDialog::Accepted) {
     int textureId = selector.selectedTextureId();
 
     // Direct update
     map->sectors[sectorIndex].floor_texture_id = textureId;
-    editor->update();
+    editor->invalidateStaticLayer();
+    map->markSectorDirty(map->sectors[sectorIndex].sector_id);
     updateVisualMode();
 
     // Update UI preventing signal loop
@@ -2020,13 +2177,14 @@ void MainWindow::onSelectSectorCeilingTexture() {
     return;
   }
 
-  TextureSelector selector(m_textureCache, this);
+  TextureSelector selector(paletteTextures(), this);
   if (selector.exec() == QDialog::Accepted) {
     int textureId = selector.selectedTextureId();
 
     // Direct update
     map->sectors[sectorIndex].ceiling_texture_id = textureId;
-    editor->update();
+    editor->invalidateStaticLayer();
+    map->markSectorDirty(map->sectors[sectorIndex].sector_id);
     updateVisualMode();
 
     // Update UI preventing signal loop
@@ -2059,9 +2217,12 @@ void MainWindow::onWallTextureLowerChanged(int value) {
   if (m_selectedSectorId >= 0 && m_selectedSectorId < map->sectors.size() &&
       m_selectedWallId >= 0 &&
       m_selectedWallId < map->sectors[m_selectedSectorId].walls.size()) {
+    Wall before = map->sectors[m_selectedSectorId].walls[m_selectedWallId];
     map->sectors[m_selectedSectorId].walls[m_selectedWallId].texture_id_lower =
         value;
-    editor->update();
+    recordWallEdit(editor, before);
+    map->markSectorDirty(map->sectors[m_selectedSectorId].sector_id);
+    editor->invalidateStaticLayer();
     updateVisualMode();
   }
 }
@@ -2075,9 +2236,12 @@ void MainWindow::onWallTextureMiddleChanged(int value) {
   if (m_selectedSectorId >= 0 && m_selectedSectorId < map->sectors.size() &&
       m_selectedWallId >= 0 &&
       m_selectedWallId < map->sectors[m_selectedSectorId].walls.size()) {
+    Wall before = map->sectors[m_selectedSectorId].walls[m_selectedWallId];
     map->sectors[m_selectedSectorId].walls[m_selectedWallId].texture_id_middle =
         value;
-    editor->update();
+    recordWallEdit(editor, before);
+    map->markSectorDirty(map->sectors[m_selectedSectorId].sector_id);
+    editor->invalidateStaticLayer();
     updateVisualMode();
   }
 }
@@ -2091,15 +2255,18 @@ void MainWindow::onWallTextureUpperChanged(int value) {
   if (m_selectedSectorId >= 0 && m_selectedSectorId < map->sectors.size() &&
       m_selectedWallId >= 0 &&
       m_selectedWallId < map->sectors[m_selectedSectorId].walls.size()) {
+    Wall before = map->sectors[m_selectedSectorId].walls[m_selectedWallId];
     map->sectors[m_selectedSectorId].walls[m_selectedWallId].texture_id_upper =
         value;
-    editor->update();
+    recordWallEdit(editor, before);
+    map->markSectorDirty(map->sectors[m_selectedSectorId].sector_id);
+    editor->invalidateStaticLayer();
     updateVisualMode();
   }
 }
 
 void MainWindow::onSelectWallTextureLower() {
-  TextureSelector selector(m_textureCache, this);
+  TextureSelector selector(paletteTextures(), this);
   if (selector.exec() == QDialog::Accepted) {
     int textureId = selector.selectedTextureId();
     m_wallTextureLowerSpin->setValue(textureId);
@@ -2107,7 +2274,7 @@ void MainWindow::onSelectWallTextureLower() {
 }
 
 void MainWindow::onSelectWallTextureMiddle() {
-  TextureSelector selector(m_textureCache, this);
+  TextureSelector selector(paletteTextures(), this);
   if (selector.exec() == QDialog::Accepted) {
     int textureId = selector.selectedTextureId();
     m_wallTextureMiddleSpin->setValue(textureId);
@@ -2115,7 +2282,7 @@ void MainWindow::onSelectWallTextureMiddle() {
 }
 
 void MainWindow::onSelectWallTextureUpper() {
-  TextureSelector selector(m_textureCache, this);
+  TextureSelector selector(paletteTextures(), this);
   if (selector.exec() == QDialog::Accepted) {
     int textureId = selector.selectedTextureId();
     m_wallTextureUpperSpin->setValue(textureId);
@@ -2144,7 +2311,7 @@ void MainWindow::onApplyTextureToAllWalls() {
     wall.texture_id_middle = textureId;
   }
 
-  editor->update();
+  editor->invalidateStaticLayer();
   updateVisualMode();
 
   QMessageBox::information(this, tr("Éxito"),
@@ -2163,7 +2330,7 @@ void MainWindow::onWallSplitLowerChanged(double value) {
     for (Wall &wall : sector.walls) {
       if (wall.wall_id == m_selectedWallId) {
         wall.texture_split_z_lower = value;
-        editor->update();
+        editor->invalidateStaticLayer();
         updateVisualMode();
         return;
       }
@@ -2180,7 +2347,7 @@ void MainWindow::onWallSplitUpperChanged(double value) {
     for (Wall &wall : sector.walls) {
       if (wall.wall_id == m_selectedWallId) {
         wall.texture_split_z_upper = value;
-        editor->update();
+        editor->invalidateStaticLayer();
         return;
       }
     }
@@ -2302,7 +2469,7 @@ void MainWindow::onManualPortalWallSelected(int sectorIndex, int wallIndex) {
     portal.x2 = wallA.x2;
     portal.y2 = wallA.y2;
 
-    map->portals.append(portal);
+    map->addPortal(portal);
 
     // Assign IDs
     wallA.portal_id = portal.portal_id;
@@ -2319,7 +2486,7 @@ void MainWindow::onManualPortalWallSelected(int sectorIndex, int wallIndex) {
       wallB.texture_id_lower = wallB.texture_id_middle;
     }
 
-    editor->update(); // Redraw
+    editor->invalidateStaticLayer(); // Redraw
 
     QMessageBox::information(
         this, tr("Portal Creado"),
@@ -2355,6 +2522,10 @@ void MainWindow::onDetectPortals() {
   if (reply != QMessageBox::Yes)
     return;
 
+  // Every sector may be split or relinked: keep the whole lists for undo
+  QVector<Sector> sectorsBefore = map->sectors;
+  QVector<Portal> portalsBefore = map->portals;
+
   // Clear existing portals
   map->portals.clear();
 
@@ -2502,7 +2673,7 @@ void MainWindow::onDetectPortals() {
             portal.x2 = wallA.x2;
             portal.y2 = wallA.y2;
 
-            map->portals.append(portal);
+            map->addPortal(portal);
 
             wallA.portal_id = portal.portal_id;
             wallB.portal_id = portal.portal_id;
@@ -2515,7 +2686,16 @@ void MainWindow::onDetectPortals() {
     }
   }
 
-  editor->update();
+  auto *detect = new SectorEditCommand(tr("Detectar portales"));
+  for (int i = 0; i < sectorsBefore.size(); i++)
+    detect->addSector(sectorsBefore[i], map->sectors[i]);
+  detect->setPortals(portalsBefore, map->portals);
+  editor->recordCommand(detect);
+  map->invalidateIndexes();
+  map->dirtySectorIds.clear(); // Portal list replaced, full 3D rebuild
+
+  editor->invalidateSpatialIndex();
+  editor->invalidateStaticLayer();
   updateVisualMode();
 
   QString resultMsg;
@@ -2569,7 +2749,7 @@ void MainWindow::onDeletePortal(int sectorIndex, int wallIndex) {
   bool removed = false;
   for (int i = 0; i < map->portals.size(); i++) {
     if (map->portals[i].portal_id == portalId) {
-      map->portals.removeAt(i);
+      map->removePortalAt(i);
       removed = true;
       break;
     }
@@ -2586,7 +2766,7 @@ void MainWindow::onDeletePortal(int sectorIndex, int wallIndex) {
     }
   }
 
-  editor->update();
+  editor->invalidateStaticLayer();
   updateVisualMode();
   m_statusLabel->setText(tr("Portal %1 eliminado (referencias limpiadas: %2)")
                              .arg(portalId)
@@ -2776,6 +2956,13 @@ void MainWindow::updateWallPanel() {
   }
 }
 
+void MainWindow::recordWallEdit(GridEditor *editor, const Wall &before) {
+  const Sector &sector = editor->mapData()->sectors[m_selectedSectorId];
+  editor->recordCommand(new WallEditCommand(sector.sector_id, m_selectedWallId,
+                                            before,
+                                            sector.walls[m_selectedWallId]));
+}
+
 /* ============================================================================
    NESTED SECTOR SLOTS
    ============================================================================
@@ -2962,7 +3149,7 @@ void MainWindow::onSectorTreeContextMenu(const QPoint &pos) {
           }
           m_statusLabel->setText(
               tr("Sector padre asignado al grupo '%1'").arg(group->name));
-          editor->update();
+          editor->invalidateStaticLayer();
         } else {
           qDebug() << "ERROR: Group" << groupId << "not found!";
         }
@@ -2977,7 +3164,7 @@ void MainWindow::onSectorTreeContextMenu(const QPoint &pos) {
       // Remove group but keep sectors
       for (int i = 0; i < map->sectorGroups.size(); i++) {
         if (map->sectorGroups[i].group_id == groupId) {
-          map->sectorGroups.removeAt(i);
+          map->removeGroupAt(i);
           updateSectorList();
           break;
         }
@@ -2995,15 +3182,18 @@ void MainWindow::onSectorTreeContextMenu(const QPoint &pos) {
       // Find and remove sector
       for (int i = 0; i < map->sectors.size(); i++) {
         if (map->sectors[i].sector_id == sectorId) {
-          map->sectors.removeAt(i);
+          auto *step = new MapMacroCommand(tr("Eliminar sector"));
+          auto *remove = new ListEditCommand<Sector>(
+              QString(), &MapData::sectors, ListEditCommand<Sector>::Remove);
+          remove->addItem(i, map->sectors[i]);
+          step->append(remove);
 
           // Remove from any groups
-          for (SectorGroup &group : map->sectorGroups) {
-            group.sector_ids.removeAll(sectorId);
-          }
+          step->append(new GroupMembershipCommand(*map, sectorId));
+          editor->pushCommand(step);
 
           updateSectorList();
-          editor->update();
+          editor->invalidateStaticLayer();
         }
       }
     });
@@ -3044,10 +3234,14 @@ void MainWindow::deleteSelectedSector() {
   }
 
   if (sectorIndex >= 0) {
-    map->sectors.removeAt(sectorIndex);
+    auto *remove = new ListEditCommand<Sector>(
+        tr("Eliminar sector"), &MapData::sectors,
+        ListEditCommand<Sector>::Remove);
+    remove->addItem(sectorIndex, map->sectors[sectorIndex]);
+    editor->pushCommand(remove);
     m_selectedSectorId = -1;
     updateSectorList();
-    editor->update();
+    editor->invalidateStaticLayer();
     updateVisualMode();
     m_statusLabel->setText(tr("Sector eliminado"));
   }
@@ -3119,10 +3313,11 @@ void MainWindow::pasteSector() {
   }
 
   // Add to map
-  map->sectors.append(newSector);
+  map->addSector(newSector);
+  editor->recordSectorInsert(map->sectors.size() - 1);
 
   updateSectorList();
-  editor->update();
+  editor->invalidateStaticLayer();
   updateVisualMode();
   m_statusLabel->setText(
       tr("Sector pegado como ID %1").arg(newSector.sector_id));
@@ -3180,6 +3375,7 @@ void MainWindow::moveSelectedSector() {
     for (int i = 0; i < map->sectors.size(); i++) {
       if (map->sectors[i].sector_id == m_selectedSectorId) {
         Sector &sec = map->sectors[i];
+        Sector before = sec;
 
         // Update vertices
         for (int v = 0; v < sec.vertices.size(); v++) {
@@ -3201,7 +3397,13 @@ void MainWindow::moveSelectedSector() {
         }
         sec.portal_ids.clear();
 
-        editor->update();
+        auto *move = new SectorEditCommand(tr("Mover sector"));
+        move->addSector(before, sec);
+        editor->recordCommand(move);
+        map->markSectorDirty(sec.sector_id);
+
+        editor->invalidateSpatialIndex();
+        editor->invalidateStaticLayer();
         updateVisualMode();
         m_statusLabel->setText(tr("Sector movido"));
         break;
@@ -3286,9 +3488,10 @@ void MainWindow::onCreateRectangle() {
     newSector.walls.append(wall);
   }
 
-  map->sectors.append(newSector);
+  map->addSector(newSector);
+  editor->recordSectorInsert(map->sectors.size() - 1);
   updateSectorList();
-  editor->update();
+  editor->invalidateStaticLayer();
   updateVisualMode();
 
   m_statusLabel->setText(tr("Rectángulo %1x%2 creado (Sector %3)")
@@ -3345,9 +3548,10 @@ void MainWindow::onCreateCircle() {
     newSector.walls.append(wall);
   }
 
-  map->sectors.append(newSector);
+  map->addSector(newSector);
+  editor->recordSectorInsert(map->sectors.size() - 1);
   updateSectorList();
-  editor->update();
+  editor->invalidateStaticLayer();
   updateVisualMode();
 
   m_statusLabel->setText(tr("Círculo de radio %1 creado (Sector %2)")
@@ -3367,7 +3571,7 @@ void MainWindow::onInsertBox() {
   auto *map = editor->mapData();
 
   // Show configuration dialog with texture previews
-  InsertBoxDialog dialog(m_textureCache, this);
+  InsertBoxDialog dialog(paletteTextures(), this);
   if (dialog.exec() != QDialog::Accepted) {
     return;
   }
@@ -3463,7 +3667,7 @@ void MainWindow::onInsertBox() {
   newSector.vertices.append(QPointF(centerX - hw, centerY + hh)); // Top-left
 
   // Add sector to map
-  map->sectors.append(newSector);
+  map->addSector(newSector);
   int newSectorIndex = map->sectors.size() - 1;
 
   // Auto-detect parent sector (sector containing the box center)
@@ -3514,9 +3718,11 @@ void MainWindow::onInsertBox() {
   // The motor will automatically detect this as a nested sector using AABB
   // checks in ray_detect_nested_sectors() and create portals if needed
 
+  editor->recordSectorInsert(newSectorIndex);
+
   // Update UI
   updateSectorList();
-  editor->update();
+  editor->invalidateStaticLayer();
   updateVisualMode();
 
   m_statusLabel->setText(tr("Caja creada (Sector %1) en (%2, %3)")
@@ -3712,15 +3918,17 @@ void MainWindow::onPortalUpperChanged(int val) {
       m_selectedWallId >= 0 &&
       m_selectedWallId < map->sectors[m_selectedSectorId].walls.size()) {
 
+    Wall before = map->sectors[m_selectedSectorId].walls[m_selectedWallId];
     map->sectors[m_selectedSectorId].walls[m_selectedWallId].texture_id_upper =
         val;
+    recordWallEdit(editor, before);
 
     // Sync the standard upper spinbox
     m_wallTextureUpperSpin->blockSignals(true);
     m_wallTextureUpperSpin->setValue(val);
     m_wallTextureUpperSpin->blockSignals(false);
 
-    editor->update();
+    editor->invalidateStaticLayer();
     updateVisualMode();
   }
 }
@@ -3735,21 +3943,23 @@ void MainWindow::onPortalLowerChanged(int val) {
       m_selectedWallId >= 0 &&
       m_selectedWallId < map->sectors[m_selectedSectorId].walls.size()) {
 
+    Wall before = map->sectors[m_selectedSectorId].walls[m_selectedWallId];
     map->sectors[m_selectedSectorId].walls[m_selectedWallId].texture_id_lower =
         val;
+    recordWallEdit(editor, before);
 
     // Sync the standard lower spinbox
     m_wallTextureLowerSpin->blockSignals(true);
     m_wallTextureLowerSpin->setValue(val);
     m_wallTextureLowerSpin->blockSignals(false);
 
-    editor->update();
+    editor->invalidateStaticLayer();
     updateVisualMode();
   }
 }
 
 void MainWindow::onSelectPortalUpper() {
-  TextureSelector selector(m_textureCache, this);
+  TextureSelector selector(paletteTextures(), this);
   if (selector.exec() == QDialog::Accepted) {
     int textureId = selector.selectedTextureId();
     m_portalUpperSpin->setValue(textureId); // Triggers onPortalUpperChanged
@@ -3757,7 +3967,7 @@ void MainWindow::onSelectPortalUpper() {
 }
 
 void MainWindow::onSelectPortalLower() {
-  TextureSelector selector(m_textureCache, this);
+  TextureSelector selector(paletteTextures(), this);
   if (selector.exec() == QDialog::Accepted) {
     int textureId = selector.selectedTextureId();
     m_portalLowerSpin->setValue(textureId); // Triggers onPortalLowerChanged
@@ -3773,11 +3983,121 @@ void MainWindow::onSkyboxTextureChanged(int value) {
 }
 
 void MainWindow::updateVisualMode() {
+  if (!m_visualUpdateTimer->isActive())
+    m_visualUpdateTimer->start();
+}
+
+void MainWindow::applyVisualModeUpdate() {
   GridEditor *editor = getCurrentEditor();
-  if (m_visualModeWidget && m_visualModeWidget->isVisible() && editor) {
-    m_visualModeWidget->setMapData(*editor->mapData(),
-                                   false); // false = Don't reset camera
+  if (!editor)
+    return;
+
+  // Always consume the dirty set: a hidden view is fully rebuilt on show
+  MapData *map = editor->mapData();
+  QSet<int> dirtySectors = map->takeDirtySectors();
+  if (!m_visualModeWidget || !m_visualModeWidget->isVisible())
+    return;
+
+  const VisualSnapshot &last = m_visualSnapshot;
+  bool sameGeometry = last.sectors.constData() == map->sectors.constData() &&
+                      last.portals.constData() == map->portals.constData();
+  bool incremental = !dirtySectors.isEmpty() || sameGeometry;
+
+  // Textures picked since the view was shown are decoded on first use,
+  // the view is subscribed to the registry and uploads them. Only the
+  // sectors rebuilt now can use new ones, unless the whole map is
+  QSet<int> used = incremental ? map->textureIds(dirtySectors)
+                               : map->textureIds();
+  for (int id : used) {
+    if (!m_textureRegistry->contains(id) && m_textureProvider.contains(id))
+      m_textureRegistry->setTexture(id, m_textureProvider.texture(id));
+  }
+
+  if (incremental) {
+    // Only these sectors changed, rebuild their geometry in place
+    if (!dirtySectors.isEmpty())
+      m_visualModeWidget->updateSectors(*map, dirtySectors);
+    // Entity drags and sky changes leave the sectors alone; lights, spawn
+    // flags and the rest are not drawn by the view
+    if (last.entities.constData() != map->entities.constData() ||
+        last.skyTextureId != map->skyTextureID)
+      m_visualModeWidget->updateEntities(*map);
+  } else {
+    // Geometry edited without marking its sectors (or another tab)
+    m_visualModeWidget->setMapData(*map, false); // false = Keep the camera
+  }
+  takeVisualSnapshot(*map);
+}
+
+void MainWindow::takeVisualSnapshot(const MapData &mapData) {
+  m_visualSnapshot.sectors = mapData.sectors;
+  m_visualSnapshot.portals = mapData.portals;
+  m_visualSnapshot.entities = mapData.entities;
+  m_visualSnapshot.skyTextureId = mapData.skyTextureID;
+}
+
+bool MainWindow::openFPG(const QString &filename) {
+  if (!m_textureProvider.open(filename))
+    return false;
+
+  if (filename != m_currentFPGPath) {
+    m_textureRegistry->clear(); // Another FPG: views start over
+  } else {
+    // Same FPG saved again: registered textures are decoded from the new
+    // file and only the ones whose pixels changed are replaced, so the views
+    // keep their uploads for the rest. Codes the file lost are removed
+    QSet<int> registered;
+    for (int id : m_textureRegistry->ids()) {
+      if (m_textureProvider.contains(id))
+        registered.insert(id);
+      else
+        m_textureRegistry->removeTexture(id);
+    }
+    QMap<int, QPixmap> current = m_textureProvider.textures(registered);
+    for (auto it = current.constBegin(); it != current.constEnd(); ++it) {
+      if (it.value().toImage() != m_textureRegistry->image(it.key()))
+        m_textureRegistry->setTexture(it.key(), it.value());
+    }
+  }
+  m_currentFPGPath = filename;
+  refreshTextureCache();
+  return true;
+}
+
+void MainWindow::refreshTextureCache() {
+  QSet<int> used;
+  for (int i = 0; i < m_tabWidget->count(); i++) {
+    GridEditor *editor = qobject_cast<GridEditor *>(m_tabWidget->widget(i));
+    if (editor)
+      used.unite(editor->mapData()->textureIds());
+  }
+  // Registered textures are kept, so views only receive the new ones
+  for (int id : m_textureRegistry->ids())
+    used.remove(id);
+  m_textureRegistry->setTextures(m_textureProvider.textures(used));
+}
+
+TextureSource MainWindow::paletteTextures() {
+  // Pickers lay out every code at once and only ask for the thumbnails in
+  // view, through the provider's cache
+  TextureSource source;
+  if (!m_textureProvider.isOpen()) {
+    TextureRegistry *registry = m_textureRegistry;
+    source.ids = registry->ids();
+    source.load = [registry](const QSet<int> &ids) -> QMap<int, QPixmap> {
+      QMap<int, QPixmap> result;
+      for (int id : ids)
+        result.insert(id, registry->pixmap(id));
+      return result;
+    };
+  } else {
+    FPGTextureProvider *provider = &m_textureProvider;
+    source.ids = provider->codes();
+    source.load = [provider](const QSet<int> &ids) {
+      return provider->textures(ids);
+    };
   }
+  return source;
 }
 
 /* ============================================================================
@@ -3841,8 +4161,8 @@ void MainWindow::onDecalPlaced(float x, float y) {
   decal.alpha = m_decalAlphaSpin->value();
   decal.render_order = m_decalRenderOrderSpin->value();
 
-  map->decals.append(decal);
-  editor->update();
+  map->addDecal(decal);
+  editor->invalidateStaticLayer();
 
   // Auto-select the newly created decal and show properties panel
   m_selectedDecalId = decal.id;
@@ -3871,7 +4191,7 @@ void MainWindow::onDecalXChanged(double value) {
   Decal *decal = map->findDecal(m_selectedDecalId);
   if (decal) {
     decal->x = value;
-    editor->update();
+    editor->invalidateStaticLayer();
   }
 }
 
@@ -3884,7 +4204,7 @@ void MainWindow::onDecalYChanged(double value) {
   Decal *decal = map->findDecal(m_selectedDecalId);
   if (decal) {
     decal->y = value;
-    editor->update();
+    editor->invalidateStaticLayer();
   }
 }
 
@@ -3897,7 +4217,7 @@ void MainWindow::onDecalWidthChanged(double value) {
   Decal *decal = map->findDecal(m_selectedDecalId);
   if (decal) {
     decal->width = value;
-    editor->update();
+    editor->invalidateStaticLayer();
   }
 }
 
@@ -3910,7 +4230,7 @@ void MainWindow::onDecalHeightChanged(double value) {
   Decal *decal = map->findDecal(m_selectedDecalId);
   if (decal) {
     decal->height = value;
-    editor->update();
+    editor->invalidateStaticLayer();
   }
 }
 
@@ -3923,7 +4243,7 @@ void MainWindow::onDecalRotationChanged(double value) {
   Decal *decal = map->findDecal(m_selectedDecalId);
   if (decal) {
     decal->rotation = value * M_PI / 180.0f; // Degrees to radians
-    editor->update();
+    editor->invalidateStaticLayer();
   }
 }
 
@@ -3936,12 +4256,12 @@ void MainWindow::onDecalTextureChanged(int value) {
   Decal *decal = map->findDecal(m_selectedDecalId);
   if (decal) {
     decal->texture_id = value;
-    editor->update();
+    editor->invalidateStaticLayer();
   }
 }
 
 void MainWindow::onSelectDecalTexture() {
-  TextureSelector selector(m_textureCache, this);
+  TextureSelector selector(paletteTextures(), this);
   if (selector.exec() == QDialog::Accepted) {
     int textureId = selector.selectedTextureId();
     m_decalTextureSpin->setValue(textureId);
@@ -3957,7 +4277,7 @@ void MainWindow::onDecalAlphaChanged(double value) {
   Decal *decal = map->findDecal(m_selectedDecalId);
   if (decal) {
     decal->alpha = value;
-    editor->update();
+    editor->invalidateStaticLayer();
   }
 }
 
@@ -3970,7 +4290,7 @@ void MainWindow::onDecalRenderOrderChanged(int value) {
   Decal *decal = map->findDecal(m_selectedDecalId);
   if (decal) {
     decal->render_order = value;
-    editor->update();
+    editor->invalidateStaticLayer();
   }
 }
 
@@ -3982,10 +4302,10 @@ void MainWindow::onDeleteDecal() {
 
   for (int i = 0; i < map->decals.size(); i++) {
     if (map->decals[i].id == m_selectedDecalId) {
-      map->decals.removeAt(i);
+      map->removeDecalAt(i);
       m_selectedDecalId = -1;
       m_decalDock->hide();
-      editor->update();
+      editor->invalidateStaticLayer();
       m_statusLabel->setText(tr("Decal eliminado"));
       break;
     }
@@ -4062,31 +4382,10 @@ void MainWindow::onFPGReloaded() {
   if (m_currentFPGPath.isEmpty())
     return;
 
-  QVector<TextureEntry> textures;
-  bool success = FPGLoader::loadFPG(m_currentFPGPath, textures);
-
-  if (success) {
-    QMap<int, QPixmap> textureMap = FPGLoader::getTextureMap(textures);
-
-    m_textureCache.clear();
-    for (const TextureEntry &entry : textures) {
-      m_textureCache[entry.id] = entry.pixmap;
-    }
-
-    // Apply to all editors
-    for (int i = 0; i < m_tabWidget->count(); i++) {
-      GridEditor *editor = qobject_cast<GridEditor *>(m_tabWidget->widget(i));
-      if (editor) {
-        editor->mapData()->textures.clear();
-        for (const TextureEntry &entry : textures) {
-          editor->mapData()->textures.append(entry);
-        }
-        editor->setTextures(textureMap);
-      }
-    }
-
+  // Only the textures that changed reach the registry and the views
+  if (openFPG(m_currentFPGPath)) {
     m_statusLabel->setText(
-        tr("FPG reloaded: %1 textures").arg(textures.size()));
+        tr("FPG reloaded: %1 textures").arg(m_textureProvider.count()));
   }
 }
 
@@ -4199,6 +4498,11 @@ void MainWindow::onTabCloseRequested(int index) {
 
   // Check for unsaved changes logic here if needed
 
+  if (GridEditor *editor = qobject_cast<GridEditor *>(widget)) {
+    m_saveService->forget(autosaveKey(editor));
+    m_untitledKeys.remove(editor);
+  }
+
   m_tabWidget->removeTab(index);
   delete widget; // Virtual destructor handles cleanup
 
@@ -4245,7 +4549,21 @@ void MainWindow::onTabChanged(int index) {
 }
 
 GridEditor *MainWindow::getCurrentEditor() const {
-  return qobject_cast<GridEditor *>(m_tabWidget->currentWidget());
+  GridEditor *editor = qobject_cast<GridEditor *>(m_tabWidget->currentWidget());
+  // Saving or editing a half-read map would drop what is not loaded yet
+  if (editor && isMapLoading(editor))
+    return nullptr;
+  return editor;
+}
+
+bool MainWindow::isMapLoading(const GridEditor *editor) const {
+  // Tabs stay disabled from onMapGeometryLoaded until onMapLoaded
+  return !editor->isEnabledTo(m_tabWidget);
+}
+
+bool MainWindow::currentMapLoading() const {
+  GridEditor *editor = qobject_cast<GridEditor *>(m_tabWidget->currentWidget());
+  return editor && isMapLoading(editor);
 }
 
 void MainWindow::openMapFile(const QString &filename) {
@@ -4258,106 +4576,142 @@ void MainWindow::openMapFile(const QString &filename) {
       return;
     }
   }
+  if (m_mapLoader->isLoading(filename))
+    return;
+
+  // Auto-load FPG with same base name if it exists
+  QFileInfo mapInfo(filename);
+  QString baseName = mapInfo.completeBaseName();
+  QString mapDir = mapInfo.absolutePath();
+
+  QStringList fpgPaths;
+  fpgPaths << mapDir + "/" + baseName + ".fpg";
+  fpgPaths << mapDir + "/" + baseName + ".map";
+
+  if (m_projectManager && !m_projectManager->getProjectPath().isEmpty()) {
+    QString projectPath = m_projectManager->getProjectPath();
+    fpgPaths << projectPath + "/assets/fpg/" + baseName + ".fpg";
+    fpgPaths << projectPath + "/assets/fpg/" + baseName + ".map";
+  }
+
+  // Parsing and FPG decoding run on a worker; the on*Loaded slots below
+  // build the tab as each stage arrives
+  m_mapLoader->open(filename, fpgPaths);
+  m_statusLabel->setText(tr("Abriendo mapa: %1...").arg(filename));
+}
+
+GridEditor *MainWindow::findEditor(const QString &filename) const {
+  for (int i = 0; i < m_tabWidget->count(); i++) {
+    GridEditor *ed = qobject_cast<GridEditor *>(m_tabWidget->widget(i));
+    if (ed && ed->fileName() == filename)
+      return ed;
+  }
+  return nullptr;
+}
 
+void MainWindow::onMapGeometryLoaded(const QString &filename,
+                                     const MapData &geometry) {
   GridEditor *editor =
       new GridEditor(const_cast<MainWindow *>(this)); // Parent is this
-  if (RayMapFormat::loadMap(filename, *editor->mapData())) {
-    editor->setFileName(filename);
+  *editor->mapData() = geometry;
+  editor->setFileName(filename);
 
-    // Setup editor
-    editor->setEditMode(static_cast<GridEditor::EditMode>(
-        m_modeGroup->checkedAction()->data().toInt()));
-    if (m_viewGridAction) {
-      editor->showGrid(m_viewGridAction->isChecked());
-    }
-    editor->setTextures(m_textureCache);
+  // Setup editor
+  editor->setEditMode(static_cast<GridEditor::EditMode>(
+      m_modeGroup->checkedAction()->data().toInt()));
+  if (m_viewGridAction) {
+    editor->showGrid(m_viewGridAction->isChecked());
+  }
+  editor->setTextureRegistry(m_textureRegistry);
 
-    // Connect signals
-    connect(editor, &GridEditor::statusMessage, this,
-            [this](const QString &msg) { m_statusLabel->setText(msg); });
-    connect(editor, &GridEditor::wallSelected, this,
-            &MainWindow::onWallSelected);
-    connect(editor, &GridEditor::sectorSelected, this,
-            &MainWindow::onSectorSelected);
-    connect(editor, &GridEditor::decalPlaced, this, &MainWindow::onDecalPlaced);
-    connect(editor, &GridEditor::cameraPlaced, this,
-            &MainWindow::onCameraPlaced);
-    connect(editor, &GridEditor::entitySelected, this,
-            &MainWindow::onEntitySelected);
-    connect(editor, &GridEditor::entityMoved, this,
-            &MainWindow::onEntityChanged);
-    connect(editor, &GridEditor::requestEditEntityBehavior, this,
-            &MainWindow::onEditEntityBehavior);
-    connect(editor, &GridEditor::lightSelected, this,
-            &MainWindow::onLightSelected);
+  // Connect signals
+  connect(editor, &GridEditor::statusMessage, this,
+          [this](const QString &msg) { m_statusLabel->setText(msg); });
+  connect(editor, &GridEditor::wallSelected, this,
+          &MainWindow::onWallSelected);
+  connect(editor, &GridEditor::sectorSelected, this,
+          &MainWindow::onSectorSelected);
+  connect(editor, &GridEditor::decalPlaced, this, &MainWindow::onDecalPlaced);
+  connect(editor, &GridEditor::cameraPlaced, this,
+          &MainWindow::onCameraPlaced);
+  connect(editor, &GridEditor::entitySelected, this,
+          &MainWindow::onEntitySelected);
+  connect(editor, &GridEditor::entityMoved, this,
+          &MainWindow::onEntityChanged);
+  connect(editor, &GridEditor::requestEditEntityBehavior, this,
+          &MainWindow::onEditEntityBehavior);
+  connect(editor, &GridEditor::mapChanged, this,
+          &MainWindow::updateVisualMode);
+  connect(editor, &GridEditor::lightSelected, this,
+          &MainWindow::onLightSelected);
 
-    m_tabWidget->addTab(editor, QFileInfo(filename).fileName());
-    m_tabWidget->setCurrentWidget(editor);
+  // The geometry can be viewed now, but edits wait for the whole map
+  editor->setEnabled(false);
 
-    addToRecentMaps(filename);
-    updateSectorList();
-    updateWindowTitle();
-    updateVisualMode();
+  m_tabWidget->addTab(editor, QFileInfo(filename).fileName());
+  m_tabWidget->setCurrentWidget(editor);
+
+  updateSectorList();
+  updateWindowTitle();
+  m_statusLabel->setText(tr("Cargando mapa: %1...").arg(filename));
+}
 
-    // Auto-load FPG with same base name if it exists
-    QFileInfo mapInfo(filename);
-    QString baseName = mapInfo.completeBaseName();
-    QString mapDir = mapInfo.absolutePath();
+void MainWindow::onMapLoaded(const QString &filename, const MapData &mapData) {
+  GridEditor *editor = findEditor(filename);
+  if (!editor)
+    return; // Tab closed while loading
 
-    QStringList fpgPaths;
-    fpgPaths << mapDir + "/" + baseName + ".fpg";
-    fpgPaths << mapDir + "/" + baseName + ".map";
+  *editor->mapData() = mapData;
+  editor->clearHistory();
+  refreshTextureCache(); // Decodes this map's textures if an FPG is open
+  editor->invalidateSpatialIndex();
+  editor->setEnabled(true);
+  editor->invalidateStaticLayer();
 
-    if (m_projectManager && !m_projectManager->getProjectPath().isEmpty()) {
-      QString projectPath = m_projectManager->getProjectPath();
-      fpgPaths << projectPath + "/assets/fpg/" + baseName + ".fpg";
-      fpgPaths << projectPath + "/assets/fpg/" + baseName + ".map";
-    }
+  addToRecentMaps(filename);
+  updateSectorList();
+  updateVisualMode();
+  m_statusLabel->setText(tr("Mapa cargado: %1").arg(filename));
+}
 
-    bool fpgLoaded = false;
-    for (const QString &fpgPath : fpgPaths) {
-      if (QFile::exists(fpgPath)) {
-        qDebug() << "Auto-loading FPG:" << fpgPath;
-
-        QVector<TextureEntry> textures;
-        bool success = FPGLoader::loadFPG(
-            fpgPath, textures,
-            [this](int current, int total, const QString &name) {
-              m_statusLabel->setText(tr("Loading FPG: %1/%2 - %3")
-                                         .arg(current)
-                                         .arg(total)
-                                         .arg(name));
-              qApp->processEvents();
-            });
-
-        if (success) {
-          m_textureCache.clear();
-          for (const TextureEntry &entry : textures) {
-            m_textureCache[entry.id] = entry.pixmap;
-          }
+void MainWindow::onMapTexturesLoaded(const QString &filename,
+                                     const QString &fpgPath,
+                                     const QVector<FPGIndexEntry> &index,
+                                     const QVector<FPGImage> &images) {
+  GridEditor *editor = findEditor(filename);
+  if (!editor)
+    return;
 
-          editor->setTextures(m_textureCache);
+  // The worker decoded what this map uses, the rest waits in the index. A
+  // map of the FPG already open only adds the textures it brings
+  if (fpgPath != m_currentFPGPath || !m_textureProvider.isOpen()) {
+    m_textureProvider.setIndex(fpgPath, index);
+    m_textureRegistry->clear();
+  }
+  for (const FPGImage &image : images) {
+    if (!m_textureRegistry->contains(image.code))
+      m_textureProvider.insert(image.code, image.image);
+  }
+  m_currentFPGPath = fpgPath;
+  refreshTextureCache();
 
-          addToRecentFPGs(fpgPath);
-          m_currentFPGPath = fpgPath;
-          fpgLoaded = true;
-          qDebug() << "Auto-loaded FPG:" << fpgPath << "with" << textures.size()
-                   << "textures";
-        }
-        break;
-      }
-    }
+  addToRecentFPGs(fpgPath);
+  qDebug() << "Auto-loaded FPG:" << fpgPath << "with" << index.size()
+           << "textures," << images.size() << "decoded";
 
-    if (fpgLoaded) {
-      m_statusLabel->setText(tr("Mapa y FPG cargados: %1").arg(filename));
-    } else {
-      m_statusLabel->setText(tr("Mapa cargado: %1").arg(filename));
-    }
-  } else {
-    delete editor;
-    QMessageBox::critical(const_cast<MainWindow *>(this), tr("Error"),
-                          tr("No se pudo cargar el mapa %1").arg(filename));
+  m_statusLabel->setText(tr("Mapa y FPG cargados: %1").arg(filename));
+  updateVisualMode();
+}
+
+void MainWindow::onMapLoadFailed(const QString &filename) {
+  // Remove the tab if the geometry had already been shown
+  if (GridEditor *editor = findEditor(filename)) {
+    m_tabWidget->removeTab(m_tabWidget->indexOf(editor));
+    editor->deleteLater();
   }
+  m_statusLabel->clear();
+  QMessageBox::critical(const_cast<MainWindow *>(this), tr("Error"),
+                        tr("No se pudo cargar el mapa %1").arg(filename));
 }
 
 /* ============================================================================
@@ -4411,7 +4765,7 @@ void MainWindow::onEditEntityBehavior(int index, const EntityInstance &entity) {
     EntityInstance updatedEntity = dialog.getEntity();
     editor->updateEntity(index, updatedEntity);
     m_entityPanel->setEntity(index, updatedEntity);
-    editor->update();
+    editor->invalidateStaticLayer();
   }
 }
 
@@ -4434,14 +4788,9 @@ void MainWindow::onEditSceneEntityBehavior(SceneEntity *ent) {
 void MainWindow::onEntityChanged(int index, EntityInstance entity) {
   GridEditor *editor = getCurrentEditor();
   if (editor) {
+    // Visual mode is refreshed through GridEditor::mapChanged
     editor->updateEntity(index, entity);
-    editor->update(); // Redraw grid
-
-    // Update visual mode
-    if (m_visualModeWidget && m_visualModeWidget->isVisible()) {
-      m_visualModeWidget->setMapData(*editor->mapData(),
-                                     false); // false = don't reset camera
-    }
+    editor->invalidateStaticLayer(); // Redraw grid
   }
 }
 
@@ -4683,7 +5032,7 @@ void MainWindow::onManageNPCPaths() {
     }
 
     // Mark map as modified
-    editor->update();
+    editor->invalidateStaticLayer();
   }
 }
 
@@ -4753,7 +5102,8 @@ void MainWindow::onLightChanged() {
     light.intensity = m_lightIntensitySpin->value();
     light.falloff = m_lightFalloffSpin->value();
 
-    editor->update();
+    editor->invalidateSpatialIndex();
+    editor->invalidateStaticLayer();
     updateVisualMode();
   }
 }
@@ -4831,10 +5181,14 @@ void MainWindow::onDeleteLight() {
   if (QMessageBox::question(this, tr("Eliminar Luz"),
                             tr("¿Deseas eliminar la luz seleccionada?")) ==
       QMessageBox::Yes) {
-    editor->mapData()->lights.removeAt(m_selectedLightIndex);
+    auto *remove = new ListEditCommand<Light>(
+        tr("Eliminar luz"), &MapData::lights, ListEditCommand<Light>::Remove);
+    remove->addItem(m_selectedLightIndex,
+                    editor->mapData()->lights[m_selectedLightIndex]);
+    editor->pushCommand(remove);
     m_selectedLightIndex = -1;
     updateLightPanel();
-    editor->update();
+    editor->invalidateStaticLayer();
     updateVisualMode();
   }
 }
@@ -4846,7 +5200,7 @@ void MainWindow::onSectorFloorNormalChanged(int val) {
     for (Sector &sector : editor->mapData()->sectors) {
       if (sector.sector_id == m_selectedSectorId) {
         sector.floor_normal_id = val;
-        editor->update();
+        editor->invalidateStaticLayer();
         updateVisualMode();
         break;
       }
@@ -4860,7 +5214,7 @@ void MainWindow::onSectorCeilingNormalChanged(int val) {
     for (Sector &sector : editor->mapData()->sectors) {
       if (sector.sector_id == m_selectedSectorId) {
         sector.ceiling_normal_id = val;
-        editor->update();
+        editor->invalidateStaticLayer();
         updateVisualMode();
         break;
       }
@@ -4869,14 +5223,14 @@ void MainWindow::onSectorCeilingNormalChanged(int val) {
 }
 
 void MainWindow::onSelectSectorFloorNormal() {
-  TextureSelector selector(m_textureCache, this);
+  TextureSelector selector(paletteTextures(), this);
   if (selector.exec() == QDialog::Accepted) {
     m_sectorFloorNormalSpin->setValue(selector.selectedTextureId());
   }
 }
 
 void MainWindow::onSelectSectorCeilingNormal() {
-  TextureSelector selector(m_textureCache, this);
+  TextureSelector selector(paletteTextures(), this);
   if (selector.exec() == QDialog::Accepted) {
     m_sectorCeilingNormalSpin->setValue(selector.selectedTextureId());
   }
@@ -4889,11 +5243,14 @@ void MainWindow::onWallNormalLowerChanged(int val) {
       m_selectedWallId >= 0 &&
       m_selectedWallId <
           editor->mapData()->sectors[m_selectedSectorId].walls.size()) {
+    Wall before =
+        editor->mapData()->sectors[m_selectedSectorId].walls[m_selectedWallId];
     editor->mapData()
         ->sectors[m_selectedSectorId]
         .walls[m_selectedWallId]
         .texture_id_lower_normal = val;
-    editor->update();
+    recordWallEdit(editor, before);
+    editor->invalidateStaticLayer();
     updateVisualMode();
   }
 }
@@ -4905,11 +5262,14 @@ void MainWindow::onWallNormalMiddleChanged(int val) {
       m_selectedWallId >= 0 &&
       m_selectedWallId <
           editor->mapData()->sectors[m_selectedSectorId].walls.size()) {
+    Wall before =
+        editor->mapData()->sectors[m_selectedSectorId].walls[m_selectedWallId];
     editor->mapData()
         ->sectors[m_selectedSectorId]
         .walls[m_selectedWallId]
         .texture_id_middle_normal = val;
-    editor->update();
+    recordWallEdit(editor, before);
+    editor->invalidateStaticLayer();
     updateVisualMode();
   }
 }
@@ -4921,31 +5281,34 @@ void MainWindow::onWallNormalUpperChanged(int val) {
       m_selectedWallId >= 0 &&
       m_selectedWallId <
           editor->mapData()->sectors[m_selectedSectorId].walls.size()) {
+    Wall before =
+        editor->mapData()->sectors[m_selectedSectorId].walls[m_selectedWallId];
     editor->mapData()
         ->sectors[m_selectedSectorId]
         .walls[m_selectedWallId]
         .texture_id_upper_normal = val;
-    editor->update();
+    recordWallEdit(editor, before);
+    editor->invalidateStaticLayer();
     updateVisualMode();
   }
 }
 
 void MainWindow::onSelectWallNormalLower() {
-  TextureSelector selector(m_textureCache, this);
+  TextureSelector selector(paletteTextures(), this);
   if (selector.exec() == QDialog::Accepted) {
     m_wallNormalLowerSpin->setValue(selector.selectedTextureId());
   }
 }
 
 void MainWindow::onSelectWallNormalMiddle() {
-  TextureSelector selector(m_textureCache, this);
+  TextureSelector selector(paletteTextures(), this);
   if (selector.exec() == QDialog::Accepted) {
     m_wallNormalMiddleSpin->setValue(selector.selectedTextureId());
   }
 }
 
 void MainWindow::onSelectWallNormalUpper() {
-  TextureSelector selector(m_textureCache, this);
+  TextureSelector selector(paletteTextures(), this);
   if (selector.exec() == QDialog::Accepted) {
     m_wallNormalUpperSpin->setValue(selector.selectedTextureId());
   }
@@ -6,6 +6,9 @@
 #include "consolewidget.h"
 #include "entitypropertypanel.h"
 #include "fpgeditor.h"
+#include "fpgloader.h"
+#include "fpgtextureprovider.h"
+#include "textureregistry.h"
 #include "grideditor.h"
 #include "mapdata.h"
 #include "textureselector.h"
@@ -17,10 +20,12 @@
 #include <QDockWidget>
 #include <QDoubleSpinBox>
 #include <QGroupBox>
+#include <QHash>
 #include <QLabel>
 #include <QListWidget>
 #include <QMainWindow>
 #include <QMap>
+#include <QPointer>
 #include <QPushButton>
 #include <QSpinBox>
 #include <QTabWidget>
@@ -29,6 +34,9 @@
 #include <QTreeWidgetItem>
 
 class BuildManager;
+class MapLoader;
+class MapSaveService;
+class QTimer;
 #include "projectmanager.h"
 class AssetBrowser;
 struct SceneEntity;
@@ -53,6 +61,16 @@ private slots:
   void onOpenMap();
   void onSaveMap();
   void onSaveMapAs();
+  void onMapSaved(const QString &filename, bool ok);
+  void onAutosave();
+  void onUndo();
+  void onRedo();
+  void onMapGeometryLoaded(const QString &filename, const MapData &geometry);
+  void onMapLoaded(const QString &filename, const MapData &mapData);
+  void onMapTexturesLoaded(const QString &filename, const QString &fpgPath,
+                           const QVector<FPGIndexEntry> &index,
+                           const QVector<FPGImage> &images);
+  void onMapLoadFailed(const QString &filename);
   void onImportWLD(); // Import WLD file
   void onLoadFPG();
   void onExit();
@@ -177,8 +195,15 @@ private slots:
   void pasteSector();
   void moveSelectedSector();
 
-  // Visual Mode Update
+  // Visual Mode Update. Requests are coalesced, the view is updated at most
+  // once per frame by applyVisualModeUpdate()
   void updateVisualMode();
+  void applyVisualModeUpdate();
+
+  // FPG textures: the file is indexed, only what the open maps use is decoded
+  bool openFPG(const QString &filename);
+  void refreshTextureCache();
+  TextureSource paletteTextures(); // Whole FPG, decoded as pickers scroll
 
   // Recent files helpers
   void updateRecentMapsMenu();
@@ -240,9 +265,31 @@ private slots:
 private:
   // UI Components
   QTabWidget *m_tabWidget;              // Replaces m_gridEditor
-  GridEditor *getCurrentEditor() const; // Helper to get current tab
+  // Helper to get current tab; null while its map is still being loaded
+  GridEditor *getCurrentEditor() const;
+  GridEditor *findEditor(const QString &filename) const; // Tab of a map
+  bool isMapLoading(const GridEditor *editor) const; // Geometry only so far
+  QString autosaveKey(const GridEditor *editor);
+  bool currentMapLoading() const;
+  // gzip level for saved maps (0 = uncompressed), stored in QSettings
+  int mapCompressionLevel() const;
+  void recordWallEdit(GridEditor *editor,
+                      const Wall &before); // Undo step for the selected wall
 
   VisualModeWidget *m_visualModeWidget;
+  QTimer *m_visualUpdateTimer;
+  // What the 3D view was last built from. The arrays are implicitly shared,
+  // so a data pointer that moved tells which part of the map was edited
+  struct VisualSnapshot {
+    QVector<Sector> sectors;
+    QVector<Portal> portals;
+    QVector<EntityInstance> entities;
+    int skyTextureId;
+
+    VisualSnapshot() : skyTextureId(0) {}
+  };
+  VisualSnapshot m_visualSnapshot;
+  void takeVisualSnapshot(const MapData &mapData);
 
   // Console
   ConsoleWidget *m_consoleWidget;
@@ -258,13 +305,24 @@ private:
   // Build System
   BuildManager *m_buildManager;
 
+  // Background map saving and autosave
+  MapSaveService *m_saveService;
+  MapLoader *m_mapLoader; // Asynchronous, staged map opening
+  // Save As in flight: target file -> editor renamed once it is written
+  QHash<QString, QPointer<GridEditor>> m_pendingRenames;
+  // Untitled maps keep one autosave name while their tab lives
+  QHash<const GridEditor *, QString> m_untitledKeys;
+  int m_nextUntitledKey = 1;
+
   // Project System
   ProjectManager *m_projectManager;
   AssetBrowser *m_assetBrowser;
   QDockWidget *m_assetDock;
 
-  // Texture cache for selector
-  QMap<int, QPixmap> m_textureCache;
+  // Textures used by the open maps, shared by every view; the rest of the
+  // FPG is decoded on demand by the provider
+  TextureRegistry *m_textureRegistry;
+  FPGTextureProvider m_textureProvider; // Current FPG, indexed
 
   // Property panels
   QWidget *m_sectorPanel;
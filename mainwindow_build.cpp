@@ -3,6 +3,7 @@
 #include "codegenerator.h"
 #include "consolewidget.h"
 #include "mainwindow.h"
+#include "mapsaveservice.h"
 #include "processgenerator.h"
 #include "projectmanager.h"
 #include "raymapformat.h"
@@ -62,8 +63,15 @@ void MainWindow::setupBuildSystem() {
 }
 
 void MainWindow::onBuildProject() {
+  // Saving now would write the partially loaded map over the file
+  if (currentMapLoading()) {
+    m_statusLabel->setText(tr("Espere a que termine de cargar el mapa"));
+    return;
+  }
+
   // Auto-save map before build
   onSaveMap();
+  m_saveService->waitForDone(); // The build reads the map from disk
 
   QString projectPath;
 
@@ -97,8 +105,15 @@ void MainWindow::onBuildProject() {
 }
 
 void MainWindow::onRunProject() {
+  // Saving now would write the partially loaded map over the file
+  if (currentMapLoading()) {
+    m_statusLabel->setText(tr("Espere a que termine de cargar el mapa"));
+    return;
+  }
+
   // Auto-save map before run
   onSaveMap();
+  m_saveService->waitForDone(); // The build reads the map from disk
 
   QString projectPath;
 
@@ -121,8 +136,15 @@ void MainWindow::onRunProject() {
 }
 
 void MainWindow::onBuildAndRun() {
+  // Saving now would write the partially loaded map over the file
+  if (currentMapLoading()) {
+    m_statusLabel->setText(tr("Espere a que termine de cargar el mapa"));
+    return;
+  }
+
   // Auto-save map before build & run
   onSaveMap();
+  m_saveService->waitForDone(); // The build reads the map from disk
 
   QString projectPath;
 
@@ -343,7 +365,8 @@ void MainWindow::onGenerateCode() {
             fullMapPath = projectDir.absolutePath() + "/" + fullMapPath;
           }
 
-          if (loader.loadMap(fullMapPath, hybridMap, nullptr)) {
+          if (loader.loadMapChunks(fullMapPath, hybridMap,
+                                   RayMapFormat::ChunkEntities)) {
             for (const auto &hEnt : hybridMap.entities) {
               entities.append(hEnt);
 
@@ -3,6 +3,7 @@
 
 #include <QByteArray>
 #include <QColor>
+#include <QHash>
 #include <QPixmap>
 #include <QPointF>
 #include <QSet>
@@ -520,134 +521,380 @@ struct MapData {
   /* Texturas cargadas */
   QVector<TextureEntry> textures;
 
+  /* Sectores editados desde la ultima actualizacion de la vista 3D (no se
+     guarda). Permite reconstruir solo su geometria. */
+  QSet<int> dirtySectorIds;
+
   MapData() {}
 
-  /* Helper: Get next sector ID */
-  int getNextSectorId() const {
-    int maxId = -1;
-    for (const Sector &s : sectors) {
-      if (s.sector_id > maxId)
-        maxId = s.sector_id;
+  /* Helper: Mark a sector (by ID) for incremental geometry rebuild */
+  void markSectorDirty(int sectorId) { dirtySectorIds.insert(sectorId); }
+
+  /* Helper: Return and clear the dirty sector set */
+  QSet<int> takeDirtySectors() {
+    QSet<int> dirty = dirtySectorIds;
+    dirtySectorIds.clear();
+    return dirty;
+  }
+
+  /* Helper: FPG codes referenced by the map (0 = no texture) */
+  QSet<int> textureIds() const {
+    QSet<int> ids;
+    for (const Sector &sector : sectors)
+      addTextureIds(sector, ids);
+    for (const SpriteData &sprite : sprites)
+      ids << sprite.texture_id;
+    for (const Decal &decal : decals)
+      ids << decal.texture_id;
+    for (const Terrain &terrain : terrains) {
+      for (int i = 0; i < 4; i++)
+        ids << terrain.texture_ids[i];
+    }
+    ids << skyTextureID;
+    ids.remove(0);
+    return ids;
+  }
+
+  /* Helper: FPG codes of some sectors (by ID) plus the sky, what an
+     incremental 3D update can start using */
+  QSet<int> textureIds(const QSet<int> &sectorIds) const {
+    QSet<int> ids;
+    for (int sectorId : sectorIds) {
+      if (const Sector *sector = findSector(sectorId))
+        addTextureIds(*sector, ids);
+    }
+    ids << skyTextureID;
+    ids.remove(0);
+    return ids;
+  }
+
+  static void addTextureIds(const Sector &sector, QSet<int> &ids) {
+    ids << sector.floor_texture_id << sector.ceiling_texture_id
+        << sector.floor_normal_id << sector.ceiling_normal_id;
+    for (const Wall &wall : sector.walls) {
+      ids << wall.texture_id_lower << wall.texture_id_middle
+          << wall.texture_id_upper << wall.texture_id_lower_normal
+          << wall.texture_id_middle_normal << wall.texture_id_upper_normal;
     }
-    return maxId + 1;
   }
 
-  /* Helper: Get next group ID */
-  int getNextGroupId() const {
-    int maxId = -1;
-    for (const SectorGroup &g : sectorGroups) {
-      if (g.group_id > maxId)
-        maxId = g.group_id;
+  /* Helper: Reserve the next sector ID. IDs come from monotonic counters,
+     so each call returns a new one even before the item is added. */
+  int getNextSectorId() {
+    ensureIndexes();
+    return nextSectorId++;
+  }
+
+  /* Helper: Reserve the next group ID */
+  int getNextGroupId() {
+    ensureIndexes();
+    return nextGroupId++;
+  }
+
+  /* Helper: Index of a sector in sectors by ID, -1 if missing */
+  int sectorIndex(int sectorId) const {
+    ensureIndexes();
+    int index = sectorIndexById.value(sectorId, -1);
+    if (index >= 0 && sectors[index].sector_id != sectorId) {
+      refreshIndexes(false); // List reordered in place
+      index = sectorIndexById.value(sectorId, -1);
     }
-    return maxId + 1;
+    return index;
   }
 
   /* Helper: Find sector by ID */
   Sector *findSector(int sectorId) {
-    for (Sector &s : sectors) {
-      if (s.sector_id == sectorId)
-        return &s;
-    }
-    return nullptr;
+    int index = sectorIndex(sectorId);
+    return index >= 0 ? &sectors[index] : nullptr;
   }
 
   const Sector *findSector(int sectorId) const {
-    for (const Sector &s : sectors) {
-      if (s.sector_id == sectorId)
-        return &s;
-    }
-    return nullptr;
+    int index = sectorIndex(sectorId);
+    return index >= 0 ? &sectors[index] : nullptr;
   }
 
   /* Helper: Find group by ID */
   SectorGroup *findGroup(int groupId) {
-    for (SectorGroup &g : sectorGroups) {
-      if (g.group_id == groupId)
-        return &g;
-    }
-    return nullptr;
+    int index = groupIndex(groupId);
+    return index >= 0 ? &sectorGroups[index] : nullptr;
   }
 
   const SectorGroup *findGroup(int groupId) const {
-    for (const SectorGroup &g : sectorGroups) {
-      if (g.group_id == groupId)
-        return &g;
-    }
-    return nullptr;
+    int index = groupIndex(groupId);
+    return index >= 0 ? &sectorGroups[index] : nullptr;
   }
 
   /* Helper: Find which group contains a sector */
   int findGroupForSector(int sectorId) const {
-    for (const SectorGroup &g : sectorGroups) {
-      if (g.sector_ids.contains(sectorId)) {
-        return g.group_id;
+    ensureIndexes();
+    int groupId = groupIdBySectorId.value(sectorId, -1);
+    if (groupId >= 0) {
+      const SectorGroup *group = findGroup(groupId);
+      if (!group || !group->sector_ids.contains(sectorId)) {
+        refreshIndexes(false); // Membership edited in place
+        groupId = groupIdBySectorId.value(sectorId, -1);
       }
     }
-    return -1;
+    return groupId;
   }
 
-  /* Helper: Get next wall ID */
-  int getNextWallId() const {
-    int maxId = -1;
-    for (const Sector &s : sectors) {
-      for (const Wall &w : s.walls) {
-        if (w.wall_id > maxId)
-          maxId = w.wall_id;
-      }
-    }
-    return maxId + 1;
+  /* Helper: Reserve the next wall ID */
+  int getNextWallId() {
+    ensureIndexes();
+    return nextWallId++;
   }
 
-  /* Helper: Get next portal ID */
-  int getNextPortalId() const {
-    int maxId = -1;
-    for (const Portal &p : portals) {
-      if (p.portal_id > maxId)
-        maxId = p.portal_id;
-    }
-    return maxId + 1;
+  /* Helper: Reserve the next portal ID */
+  int getNextPortalId() {
+    ensureIndexes();
+    return nextPortalId++;
   }
 
-  /* Helper: Get next decal ID */
-  int getNextDecalId() const {
-    int maxId = -1;
-    for (const Decal &d : decals) {
-      if (d.id > maxId)
-        maxId = d.id;
-    }
-    return maxId + 1;
+  /* Helper: Reserve the next decal ID */
+  int getNextDecalId() {
+    ensureIndexes();
+    return nextDecalId++;
   }
 
-  /* Helper: Get next unified ID for SpawnFlags and Entities */
-  int getNextSpawnEntityId() const {
-    int maxId = 0;
-    for (const SpawnFlag &f : spawnFlags) {
-      if (f.flagId > maxId)
-        maxId = f.flagId;
-    }
-    for (const EntityInstance &e : entities) {
-      if (e.spawn_id > maxId)
-        maxId = e.spawn_id;
-    }
-    return maxId + 1;
+  /* Helper: Reserve the next light ID. Light IDs only identify lights in
+     the undo history. */
+  int getNextLightId() {
+    ensureIndexes();
+    return nextLightId++;
+  }
+
+  /* Helper: Reserve the next unified ID for SpawnFlags and Entities */
+  int getNextSpawnEntityId() {
+    ensureIndexes();
+    return nextSpawnEntityId++;
   }
 
   /* Helper: Find portal by ID */
   Portal *findPortal(int portal_id) {
-    for (Portal &p : portals) {
-      if (p.portal_id == portal_id)
-        return &p;
-    }
-    return nullptr;
+    int index = portalIndex(portal_id);
+    return index >= 0 ? &portals[index] : nullptr;
+  }
+
+  const Portal *findPortal(int portal_id) const {
+    int index = portalIndex(portal_id);
+    return index >= 0 ? &portals[index] : nullptr;
   }
 
   /* Helper: Find decal by ID */
   Decal *findDecal(int decal_id) {
-    for (Decal &d : decals) {
-      if (d.id == decal_id)
-        return &d;
+    ensureIndexes();
+    int index = decalIndexById.value(decal_id, -1);
+    if (index >= 0 && decals[index].id != decal_id) {
+      refreshIndexes(false);
+      index = decalIndexById.value(decal_id, -1);
+    }
+    return index >= 0 ? &decals[index] : nullptr;
+  }
+
+  /* Mutations that keep the ID indexes current. Code that edits the vectors
+     directly must call invalidateIndexes() (or rebuildIndexes() after
+     filling a map from scratch, which also resets the ID counters). */
+  void addSector(const Sector &sector) {
+    ensureIndexes();
+    if (!sectorIndexById.contains(sector.sector_id))
+      sectorIndexById.insert(sector.sector_id, sectors.size());
+    sectors.append(sector);
+    indexedSectorCount = sectors.size();
+    nextSectorId = qMax(nextSectorId, sector.sector_id + 1);
+    for (const Wall &w : sector.walls)
+      nextWallId = qMax(nextWallId, w.wall_id + 1);
+    for (int i = 0; i < sectorGroups.size(); i++) {
+      if (sectorGroups[i].sector_ids.contains(sector.sector_id))
+        groupIdBySectorId.insert(sector.sector_id, sectorGroups[i].group_id);
+    }
+  }
+
+  void removeSectorAt(int index) {
+    sectors.removeAt(index);
+    invalidateIndexes(); // Later sectors shift
+  }
+
+  void addPortal(const Portal &portal) {
+    ensureIndexes();
+    if (!portalIndexById.contains(portal.portal_id))
+      portalIndexById.insert(portal.portal_id, portals.size());
+    portals.append(portal);
+    indexedPortalCount = portals.size();
+    nextPortalId = qMax(nextPortalId, portal.portal_id + 1);
+  }
+
+  void removePortalAt(int index) {
+    portals.removeAt(index);
+    invalidateIndexes();
+  }
+
+  void addDecal(const Decal &decal) {
+    ensureIndexes();
+    if (!decalIndexById.contains(decal.id))
+      decalIndexById.insert(decal.id, decals.size());
+    decals.append(decal);
+    indexedDecalCount = decals.size();
+    nextDecalId = qMax(nextDecalId, decal.id + 1);
+  }
+
+  void removeDecalAt(int index) {
+    decals.removeAt(index);
+    invalidateIndexes();
+  }
+
+  void addEntity(const EntityInstance &entity) {
+    ensureIndexes();
+    entities.append(entity);
+    nextSpawnEntityId = qMax(nextSpawnEntityId, entity.spawn_id + 1);
+  }
+
+  void addSpawnFlag(const SpawnFlag &flag) {
+    ensureIndexes();
+    spawnFlags.append(flag);
+    nextSpawnEntityId = qMax(nextSpawnEntityId, flag.flagId + 1);
+  }
+
+  void addLight(const Light &light) {
+    ensureIndexes();
+    lights.append(light);
+    nextLightId = qMax(nextLightId, light.id + 1);
+  }
+
+  void removeGroupAt(int index) {
+    sectorGroups.removeAt(index);
+    invalidateIndexes();
+  }
+
+  void removeSectorFromGroups(int sectorId) {
+    for (SectorGroup &group : sectorGroups)
+      group.sector_ids.removeAll(sectorId);
+    groupIdBySectorId.remove(sectorId);
+  }
+
+  void invalidateIndexes() { indexesValid = false; }
+
+  void rebuildIndexes() { refreshIndexes(true); }
+
+private:
+  /* ID -> position hashes and ID counters (not saved). Counters only grow
+     unless rebuildIndexes() is called. A changed size of a hashed vector
+     also means it was edited directly, so the hashes are rebuilt. A lookup
+     that lands on another ID rebuilds once and looks again; a missing ID is
+     simply missing. Entities, spawn flags and lights have no hash: add them
+     with addEntity(), addSpawnFlag() and addLight() so the counters see
+     their IDs. */
+  mutable bool indexesValid = false;
+  mutable QHash<int, int> sectorIndexById;
+  mutable QHash<int, int> portalIndexById;
+  mutable QHash<int, int> decalIndexById;
+  mutable QHash<int, int> groupIndexById;
+  mutable QHash<int, int> groupIdBySectorId;
+  mutable int indexedSectorCount = 0;
+  mutable int indexedPortalCount = 0;
+  mutable int indexedDecalCount = 0;
+  mutable int indexedGroupCount = 0;
+  mutable int nextSectorId = 0;
+  mutable int nextWallId = 0;
+  mutable int nextPortalId = 0;
+  mutable int nextDecalId = 0;
+  mutable int nextGroupId = 0;
+  mutable int nextSpawnEntityId = 1;
+  mutable int nextLightId = 0;
+
+  void ensureIndexes() const {
+    if (!indexesValid || indexedSectorCount != sectors.size() ||
+        indexedPortalCount != portals.size() ||
+        indexedDecalCount != decals.size() ||
+        indexedGroupCount != sectorGroups.size())
+      refreshIndexes(false);
+  }
+
+  int portalIndex(int portalId) const {
+    ensureIndexes();
+    int index = portalIndexById.value(portalId, -1);
+    if (index >= 0 && portals[index].portal_id != portalId) {
+      refreshIndexes(false);
+      index = portalIndexById.value(portalId, -1);
+    }
+    return index;
+  }
+
+  int groupIndex(int groupId) const {
+    ensureIndexes();
+    int index = groupIndexById.value(groupId, -1);
+    if (index >= 0 && sectorGroups[index].group_id != groupId) {
+      refreshIndexes(false);
+      index = groupIndexById.value(groupId, -1);
+    }
+    return index;
+  }
+
+  void refreshIndexes(bool resetCounters) const {
+    // The first item wins for duplicate IDs, like the old linear scans
+    int maxSector = -1, maxWall = -1, maxPortal = -1, maxDecal = -1;
+    int maxGroup = -1, maxSpawnEntity = 0, maxLight = -1;
+
+    sectorIndexById.clear();
+    for (int i = sectors.size() - 1; i >= 0; i--) {
+      const Sector &s = sectors[i];
+      sectorIndexById.insert(s.sector_id, i);
+      maxSector = qMax(maxSector, s.sector_id);
+      for (const Wall &w : s.walls)
+        maxWall = qMax(maxWall, w.wall_id);
     }
-    return nullptr;
+
+    portalIndexById.clear();
+    for (int i = portals.size() - 1; i >= 0; i--) {
+      portalIndexById.insert(portals[i].portal_id, i);
+      maxPortal = qMax(maxPortal, portals[i].portal_id);
+    }
+
+    decalIndexById.clear();
+    for (int i = decals.size() - 1; i >= 0; i--) {
+      decalIndexById.insert(decals[i].id, i);
+      maxDecal = qMax(maxDecal, decals[i].id);
+    }
+
+    groupIndexById.clear();
+    groupIdBySectorId.clear();
+    for (int i = sectorGroups.size() - 1; i >= 0; i--) {
+      const SectorGroup &g = sectorGroups[i];
+      groupIndexById.insert(g.group_id, i);
+      maxGroup = qMax(maxGroup, g.group_id);
+      for (int sectorId : g.sector_ids)
+        groupIdBySectorId.insert(sectorId, g.group_id);
+    }
+
+    for (const SpawnFlag &f : spawnFlags)
+      maxSpawnEntity = qMax(maxSpawnEntity, f.flagId);
+    for (const EntityInstance &e : entities)
+      maxSpawnEntity = qMax(maxSpawnEntity, e.spawn_id);
+    for (const Light &l : lights)
+      maxLight = qMax(maxLight, l.id);
+
+    if (resetCounters) {
+      nextSectorId = maxSector + 1;
+      nextWallId = maxWall + 1;
+      nextPortalId = maxPortal + 1;
+      nextDecalId = maxDecal + 1;
+      nextGroupId = maxGroup + 1;
+      nextSpawnEntityId = maxSpawnEntity + 1;
+      nextLightId = maxLight + 1;
+    } else {
+      nextSectorId = qMax(nextSectorId, maxSector + 1);
+      nextWallId = qMax(nextWallId, maxWall + 1);
+      nextPortalId = qMax(nextPortalId, maxPortal + 1);
+      nextDecalId = qMax(nextDecalId, maxDecal + 1);
+      nextGroupId = qMax(nextGroupId, maxGroup + 1);
+      nextSpawnEntityId = qMax(nextSpawnEntityId, maxSpawnEntity + 1);
+      nextLightId = qMax(nextLightId, maxLight + 1);
+    }
+
+    indexedSectorCount = sectors.size();
+    indexedPortalCount = portals.size();
+    indexedDecalCount = decals.size();
+    indexedGroupCount = sectorGroups.size();
+    indexesValid = true;
   }
 };
 
@@ -0,0 +1,138 @@
+#include "maploader.h"
+#include "raymapformat.h"
+#include <QFile>
+#include <QMutexLocker>
+#include <QRunnable>
+#include <QThreadPool>
+
+// Reads one map and its FPG, publishing each stage as it completes
+class LoadTask : public QRunnable {
+public:
+  LoadTask(MapLoader *loader, const QString &filename,
+           const QStringList &fpgCandidates)
+      : m_loader(loader), m_filename(filename), m_fpgCandidates(fpgCandidates) {
+  }
+
+  void run() override {
+    MapData mapData;
+    auto onGeometry = [this](const MapData &geometry) {
+      {
+        QMutexLocker locker(&m_loader->m_mutex);
+        m_loader->job(m_filename).geometry = geometry;
+      }
+      m_loader->publish(m_filename, MapLoader::StageGeometry);
+    };
+
+    if (!RayMapFormat::loadMap(m_filename, mapData, nullptr, onGeometry)) {
+      m_loader->publish(m_filename, MapLoader::StageFailed);
+      return;
+    }
+    {
+      QMutexLocker locker(&m_loader->m_mutex);
+      m_loader->job(m_filename).mapData = mapData;
+    }
+    m_loader->publish(m_filename, MapLoader::StageMap);
+
+    for (const QString &fpgPath : m_fpgCandidates) {
+      if (!QFile::exists(fpgPath))
+        continue;
+
+      // Index the whole FPG but decode only what the map references, both in
+      // the same pass; the rest is decoded on demand
+      QVector<FPGIndexEntry> index;
+      QVector<FPGImage> images;
+      if (!FPGLoader::indexFPG(fpgPath, index, &images, mapData.textureIds()))
+        continue;
+
+      {
+        QMutexLocker locker(&m_loader->m_mutex);
+        MapLoader::Job &job = m_loader->job(m_filename);
+        job.fpgPath = fpgPath;
+        job.fpgIndex = index;
+        job.images = images;
+      }
+      m_loader->publish(m_filename, MapLoader::StageTextures);
+      break;
+    }
+    m_loader->publish(m_filename, MapLoader::StageDone);
+  }
+
+private:
+  MapLoader *m_loader;
+  QString m_filename;
+  QStringList m_fpgCandidates;
+};
+
+MapLoader::MapLoader(QObject *parent)
+    : QObject(parent), m_pool(new QThreadPool(this)) {
+  m_pool->setMaxThreadCount(2);
+}
+
+MapLoader::~MapLoader() { m_pool->waitForDone(); }
+
+void MapLoader::open(const QString &filename,
+                     const QStringList &fpgCandidates) {
+  if (m_loading.contains(filename))
+    return;
+  m_loading.insert(filename);
+  m_pool->start(new LoadTask(this, filename, fpgCandidates));
+}
+
+bool MapLoader::isLoading(const QString &filename) const {
+  return m_loading.contains(filename);
+}
+
+void MapLoader::publish(const QString &filename, int stage) {
+  QMetaObject::invokeMethod(this, "onStageReady", Qt::QueuedConnection,
+                            Q_ARG(QString, filename), Q_ARG(int, stage));
+}
+
+void MapLoader::onStageReady(const QString &filename, int stage) {
+  // Stages of one file arrive in order; take this stage's data out of the
+  // shared job so the worker's copy is the only other reference
+  Job result;
+  {
+    QMutexLocker locker(&m_mutex);
+    Job &job = m_jobs[filename];
+    switch (stage) {
+    case StageGeometry:
+      result.geometry = job.geometry;
+      job.geometry = MapData();
+      break;
+    case StageMap:
+      result.mapData = job.mapData;
+      job.mapData = MapData();
+      break;
+    case StageTextures:
+      result.fpgPath = job.fpgPath;
+      result.fpgIndex = job.fpgIndex;
+      result.images = job.images;
+      job.fpgIndex.clear();
+      job.images.clear();
+      break;
+    }
+  }
+
+  switch (stage) {
+  case StageGeometry:
+    emit geometryLoaded(filename, result.geometry);
+    break;
+  case StageMap:
+    emit mapLoaded(filename, result.mapData);
+    break;
+  case StageTextures:
+    emit texturesLoaded(filename, result.fpgPath, result.fpgIndex,
+                        result.images);
+    break;
+  case StageFailed:
+    emit loadFailed(filename);
+    break;
+  }
+
+  // Failed or Done is the last stage a task publishes
+  if (stage == StageFailed || stage == StageDone) {
+    m_loading.remove(filename);
+    QMutexLocker locker(&m_mutex);
+    m_jobs.remove(filename);
+  }
+}
@@ -0,0 +1,81 @@
+#ifndef MAPLOADER_H
+#define MAPLOADER_H
+
+#include "fpgloader.h"
+#include "mapdata.h"
+#include <QHash>
+#include <QMutex>
+#include <QObject>
+#include <QSet>
+#include <QString>
+#include <QStringList>
+#include <QVector>
+
+class QThreadPool;
+
+/**
+ * MapLoader - Opens maps on a worker thread, in stages
+ *
+ * open() returns at once. The worker parses the file and publishes three
+ * stages, each delivered as a signal on the GUI thread:
+ *
+ *   geometryLoaded  camera, sectors and portals, as soon as they are read
+ *   mapLoaded       the complete map (entities, sprites, lights, paths...)
+ *   texturesLoaded  the index of the first existing FPG of the candidate
+ *                   list and the maps the level references, decoded to
+ *                   QImage (QPixmaps must be made on the GUI thread)
+ *
+ * so the 2D view can draw the geometry while the rest is still being read.
+ * loadFailed replaces mapLoaded if the file cannot be parsed.
+ */
+class MapLoader : public QObject {
+  Q_OBJECT
+
+public:
+  explicit MapLoader(QObject *parent = nullptr);
+  ~MapLoader() override;
+
+  // fpgCandidates: FPG files to try after the map, in order
+  void open(const QString &filename, const QStringList &fpgCandidates);
+  bool isLoading(const QString &filename) const;
+
+signals:
+  void geometryLoaded(const QString &filename, const MapData &geometry);
+  void mapLoaded(const QString &filename, const MapData &mapData);
+  void texturesLoaded(const QString &filename, const QString &fpgPath,
+                      const QVector<FPGIndexEntry> &index,
+                      const QVector<FPGImage> &images);
+  void loadFailed(const QString &filename);
+
+private slots:
+  void onStageReady(const QString &filename, int stage);
+
+private:
+  enum Stage {
+    StageGeometry,
+    StageMap,
+    StageTextures,
+    StageFailed,
+    StageDone
+  };
+
+  // Results handed from the worker to the GUI thread
+  struct Job {
+    MapData geometry;
+    MapData mapData;
+    QString fpgPath;
+    QVector<FPGIndexEntry> fpgIndex;
+    QVector<FPGImage> images;
+  };
+
+  friend class LoadTask;
+  void publish(const QString &filename, int stage);
+  Job &job(const QString &filename) { return m_jobs[filename]; }
+
+  QThreadPool *m_pool;
+  QMutex m_mutex; // Guards m_jobs
+  QHash<QString, Job> m_jobs;
+  QSet<QString> m_loading; // GUI thread only
+};
+
+#endif // MAPLOADER_H
@@ -0,0 +1,174 @@
+#include "mapsaveservice.h"
+#include "raymapformat.h"
+#include <QDebug>
+#include <QDir>
+#include <QFile>
+#include <QFileInfo>
+#include <QMutexLocker>
+#include <QRunnable>
+#include <QStandardPaths>
+#include <QThreadPool>
+#include <QTimer>
+
+namespace {
+
+// Snapshot for the worker. Textures hold QPixmaps, which must not be
+// released outside the GUI thread, and neither writer saves them.
+MapData takeSnapshot(const MapData &mapData) {
+  MapData snapshot = mapData;
+  snapshot.textures.clear();
+  snapshot.dirtySectorIds.clear();
+  return snapshot;
+}
+
+// True while both still share every saved array, i.e. nothing was edited
+bool sharesData(const MapData &a, const MapData &b) {
+  return a.sectors.constData() == b.sectors.constData() &&
+         a.portals.constData() == b.portals.constData() &&
+         a.sprites.constData() == b.sprites.constData() &&
+         a.spawnFlags.constData() == b.spawnFlags.constData() &&
+         a.decals.constData() == b.decals.constData() &&
+         a.terrains.constData() == b.terrains.constData() &&
+         a.entities.constData() == b.entities.constData() &&
+         a.lights.constData() == b.lights.constData() &&
+         a.sectorGroups.constData() == b.sectorGroups.constData() &&
+         a.npcPaths.constData() == b.npcPaths.constData() &&
+         a.camera.x == b.camera.x && a.camera.y == b.camera.y &&
+         a.camera.z == b.camera.z && a.camera.rotation == b.camera.rotation &&
+         a.camera.pitch == b.camera.pitch &&
+         a.skyTextureID == b.skyTextureID;
+}
+
+} // namespace
+
+// Saves the latest snapshot queued for one file
+class SaveTask : public QRunnable {
+public:
+  SaveTask(MapSaveService *service, const QString &filename)
+      : m_service(service), m_filename(filename) {}
+
+  void run() override {
+    MapSaveService::PendingSave pending;
+    if (!m_service->takePending(m_filename, pending))
+      return;
+
+    // Autosaves are only reopened by the editor: the chunked format keeps
+    // its IDs and every section. Explicit saves stay readable by the engine
+    // unless ChunkedFormat was picked
+    bool chunked = pending.autosave ||
+                   pending.compressionLevel == MapSaveService::ChunkedFormat;
+    bool ok = chunked
+                  ? RayMapFormat::saveChunkedMap(m_filename, pending.snapshot)
+                  : RayMapFormat::saveMap(m_filename, pending.snapshot,
+                                          nullptr, pending.compressionLevel);
+    QMetaObject::invokeMethod(m_service, "onSaveDone", Qt::QueuedConnection,
+                              Q_ARG(QString, m_filename), Q_ARG(bool, ok),
+                              Q_ARG(bool, pending.autosave));
+  }
+
+private:
+  MapSaveService *m_service;
+  QString m_filename;
+};
+
+MapSaveService::MapSaveService(QObject *parent)
+    : QObject(parent), m_pool(new QThreadPool(this)),
+      m_autosaveTimer(new QTimer(this)), m_autosaveMinutes(0), m_running(0) {
+  // One writer: saves to the same file must not overlap
+  m_pool->setMaxThreadCount(1);
+  connect(m_autosaveTimer, &QTimer::timeout, this,
+          &MapSaveService::autosaveRequested);
+}
+
+MapSaveService::~MapSaveService() { m_pool->waitForDone(); }
+
+void MapSaveService::save(const QString &filename, const MapData &mapData,
+                          int compressionLevel) {
+  MapData snapshot = takeSnapshot(mapData);
+  m_autosaved[filename] = snapshot;
+  enqueue(filename, snapshot, compressionLevel, false);
+}
+
+bool MapSaveService::autosave(const QString &filename,
+                              const MapData &mapData) {
+  auto last = m_autosaved.constFind(filename);
+  if (last != m_autosaved.constEnd() && sharesData(*last, mapData))
+    return false;
+
+  MapData snapshot = takeSnapshot(mapData);
+  m_autosaved[filename] = snapshot;
+  enqueue(autosavePath(filename), snapshot, RayMapFormat::NoCompression,
+          true);
+  return true;
+}
+
+void MapSaveService::forget(const QString &filename) {
+  m_autosaved.remove(filename);
+}
+
+void MapSaveService::enqueue(const QString &filename, const MapData &mapData,
+                             int compressionLevel, bool autosave) {
+  QMutexLocker locker(&m_mutex);
+  bool queued = m_pending.contains(filename);
+  PendingSave &pending = m_pending[filename];
+  pending.snapshot = mapData;
+  pending.compressionLevel = compressionLevel;
+  pending.autosave = autosave;
+  if (queued)
+    return; // The queued task will write this newer snapshot
+
+  m_running++;
+  m_pool->start(new SaveTask(this, filename));
+}
+
+bool MapSaveService::takePending(const QString &filename,
+                                 PendingSave &pending) {
+  QMutexLocker locker(&m_mutex);
+  auto it = m_pending.find(filename);
+  if (it == m_pending.end())
+    return false;
+  pending = *it;
+  m_pending.erase(it);
+  return true;
+}
+
+void MapSaveService::onSaveDone(const QString &filename, bool ok,
+                                bool autosave) {
+  m_running--;
+  if (autosave) {
+    if (!ok)
+      qWarning() << "Autoguardado fallido:" << filename;
+    return;
+  }
+
+  // The map on disk is current again
+  if (ok)
+    QFile::remove(autosavePath(filename));
+  emit saveFinished(filename, ok);
+}
+
+void MapSaveService::waitForDone() { m_pool->waitForDone(); }
+
+bool MapSaveService::isBusy() const { return m_running > 0; }
+
+void MapSaveService::setAutosaveInterval(int minutes) {
+  m_autosaveMinutes = qMax(0, minutes);
+  if (m_autosaveMinutes > 0)
+    m_autosaveTimer->start(m_autosaveMinutes * 60 * 1000);
+  else
+    m_autosaveTimer->stop();
+}
+
+QString MapSaveService::autosavePath(const QString &filename) {
+  QFileInfo info(filename);
+  if (info.isAbsolute()) {
+    return info.absolutePath() + "/" + info.completeBaseName() +
+           ".autosave." + (info.suffix().isEmpty() ? "raymap" : info.suffix());
+  }
+
+  QString dir =
+      QStandardPaths::writableLocation(QStandardPaths::AppDataLocation) +
+      "/autosave";
+  QDir().mkpath(dir);
+  return dir + "/" + filename + ".raymap";
+}
@@ -0,0 +1,98 @@
+#ifndef MAPSAVESERVICE_H
+#define MAPSAVESERVICE_H
+
+#include "mapdata.h"
+#include <QHash>
+#include <QMutex>
+#include <QObject>
+#include <QString>
+
+class QThreadPool;
+class QTimer;
+
+/**
+ * MapSaveService - Saves maps on a worker thread
+ *
+ * save() copies the MapData, which only costs reference counts because every
+ * QVector in it is implicitly shared: the editor's next edit detaches its
+ * own copy and the worker keeps serializing the snapshot. saveMap() writes
+ * through QSaveFile, so the target is replaced atomically once the file is
+ * complete. Saves run one at a time; a save requested while another one to
+ * the same file is still queued replaces its snapshot.
+ *
+ * The autosave timer emits autosaveRequested(). The owner answers with
+ * autosave() for each open map, which skips maps unchanged since their last
+ * autosave and writes to autosavePath() in the chunked v33 format
+ * (RayMapFormat::saveChunkedMap). It keeps editor IDs, terrains, decals and
+ * groups; loadMap reads it back, the engine does not need to. An explicit
+ * save() with ChunkedFormat writes the same format, for editor-only copies
+ * whose entity chunk the build step reads on its own.
+ */
+class MapSaveService : public QObject {
+  Q_OBJECT
+
+public:
+  explicit MapSaveService(QObject *parent = nullptr);
+  ~MapSaveService() override;
+
+  // compressionLevel for save() that writes chunked v33 instead of saveMap
+  enum { ChunkedFormat = -1 };
+
+  // Queues a save of a snapshot of mapData and returns immediately.
+  // saveFinished() reports the result.
+  void save(const QString &filename, const MapData &mapData,
+            int compressionLevel = 0);
+
+  // Saves to autosavePath(filename) if the map changed since the last call.
+  // Returns false when nothing had to be written. An explicit save() of the
+  // map deletes its autosave file.
+  bool autosave(const QString &filename, const MapData &mapData);
+
+  // Drops the snapshot kept for filename (tab closed, map renamed). The
+  // autosave file itself stays on disk.
+  void forget(const QString &filename);
+
+  // Blocks until every queued save is on disk (build steps, exit)
+  void waitForDone();
+  bool isBusy() const;
+
+  // Minutes between autosaves, 0 disables them
+  void setAutosaveInterval(int minutes);
+  int autosaveInterval() const { return m_autosaveMinutes; }
+
+  // "/dir/map.raymap" -> "/dir/map.autosave.raymap". A bare name (untitled
+  // maps) goes to the autosave folder of the application data directory.
+  static QString autosavePath(const QString &filename);
+
+signals:
+  void saveFinished(const QString &filename, bool ok);
+  void autosaveRequested();
+
+private slots:
+  void onSaveDone(const QString &filename, bool ok, bool autosave);
+
+private:
+  struct PendingSave {
+    MapData snapshot;
+    int compressionLevel;
+    bool autosave;
+  };
+
+  friend class SaveTask;
+  void enqueue(const QString &filename, const MapData &mapData,
+               int compressionLevel, bool autosave);
+  bool takePending(const QString &filename, PendingSave &pending);
+
+  QThreadPool *m_pool;
+  QTimer *m_autosaveTimer;
+  int m_autosaveMinutes;
+
+  QMutex m_mutex;                        // Guards m_pending
+  QHash<QString, PendingSave> m_pending; // Queued, not started yet
+  int m_running;                         // Queued or running tasks
+
+  // Last autosaved snapshot per map, to detect changes (GUI thread only)
+  QHash<QString, MapData> m_autosaved;
+};
+
+#endif // MAPSAVESERVICE_H
@@ -0,0 +1,337 @@
+#include "mapspatialindex.h"
+#include <QtGlobal>
+#include <algorithm>
+#include <cmath>
+
+namespace {
+
+const float MIN_CELL_SIZE = 64.0f;
+const float MAX_CELL_SIZE = 4096.0f;
+const float DEFAULT_CELL_SIZE = 256.0f;
+
+template <typename T> void sortUnique(QVector<T> &items) {
+  std::sort(items.begin(), items.end());
+  items.erase(std::unique(items.begin(), items.end()), items.end());
+}
+
+// Remove the items of one sector from a cell list
+void removeSectorItems(QVector<MapSpatialIndex::SectorItem> &items,
+                       int sectorIndex) {
+  items.erase(std::remove_if(items.begin(), items.end(),
+                             [sectorIndex](
+                                 const MapSpatialIndex::SectorItem &item) {
+                               return item.sector == sectorIndex;
+                             }),
+              items.end());
+}
+
+} // namespace
+
+MapSpatialIndex::MapSpatialIndex()
+    : m_cellSize(DEFAULT_CELL_SIZE), m_valid(false) {}
+
+quint64 MapSpatialIndex::cellKey(int x, int y) {
+  return ((quint64)(quint32)x << 32) | (quint32)y;
+}
+
+MapSpatialIndex::CellRange MapSpatialIndex::cellRange(float minX, float minY,
+                                                      float maxX,
+                                                      float maxY) const {
+  CellRange range;
+  range.x0 = (int)std::floor(minX / m_cellSize);
+  range.y0 = (int)std::floor(minY / m_cellSize);
+  range.x1 = (int)std::floor(maxX / m_cellSize);
+  range.y1 = (int)std::floor(maxY / m_cellSize);
+  return range;
+}
+
+/* ============================================================================
+   MAINTENANCE
+   ============================================================================
+ */
+
+void MapSpatialIndex::sync(const MapData &map) {
+  if (!m_valid || map.sectors.size() != m_sectors.size() ||
+      map.entities.size() != m_entityCells.size() ||
+      map.lights.size() != m_lightCells.size() ||
+      map.spawnFlags.size() != m_spawnFlagCells.size()) {
+    rebuild(map);
+    return;
+  }
+
+  // Vertex insertion or deletion within a sector
+  for (int i = 0; i < map.sectors.size(); i++) {
+    const Sector &sector = map.sectors[i];
+    if (sector.vertices.size() != m_sectors[i].vertexCount ||
+        sector.walls.size() != m_sectors[i].wallCount)
+      updateSector(map, i);
+  }
+}
+
+void MapSpatialIndex::rebuild(const MapData &map) {
+  m_cells.clear();
+  m_sectors.clear();
+  m_entityCells.clear();
+  m_lightCells.clear();
+  m_spawnFlagCells.clear();
+
+  // Aim for a few sectors per cell over the map extent
+  float minX = 0.0f, minY = 0.0f, maxX = 0.0f, maxY = 0.0f;
+  bool first = true;
+  for (const Sector &sector : map.sectors) {
+    for (const QPointF &v : sector.vertices) {
+      if (first) {
+        minX = maxX = v.x();
+        minY = maxY = v.y();
+        first = false;
+      }
+      minX = qMin(minX, (float)v.x());
+      minY = qMin(minY, (float)v.y());
+      maxX = qMax(maxX, (float)v.x());
+      maxY = qMax(maxY, (float)v.y());
+    }
+  }
+  if (first) {
+    m_cellSize = DEFAULT_CELL_SIZE;
+  } else {
+    float area = (maxX - minX) * (maxY - minY);
+    m_cellSize = qBound(MIN_CELL_SIZE,
+                        std::sqrt(area / qMax(1, map.sectors.size())),
+                        MAX_CELL_SIZE);
+  }
+
+  m_sectors.resize(map.sectors.size());
+  for (int i = 0; i < map.sectors.size(); i++)
+    insertSector(map.sectors[i], i);
+
+  for (int i = 0; i < map.entities.size(); i++)
+    m_entityCells.append(insertPoint(&Cell::entities, i, map.entities[i].x,
+                                     map.entities[i].y));
+  for (int i = 0; i < map.lights.size(); i++)
+    m_lightCells.append(
+        insertPoint(&Cell::lights, i, map.lights[i].x, map.lights[i].y));
+  for (int i = 0; i < map.spawnFlags.size(); i++)
+    m_spawnFlagCells.append(insertPoint(&Cell::spawnFlags, i,
+                                        map.spawnFlags[i].x,
+                                        map.spawnFlags[i].y));
+
+  m_valid = true;
+}
+
+void MapSpatialIndex::updateSector(const MapData &map, int sectorIndex) {
+  if (!m_valid || sectorIndex < 0 || sectorIndex >= m_sectors.size() ||
+      sectorIndex >= map.sectors.size()) {
+    m_valid = false;
+    return;
+  }
+  removeSector(sectorIndex);
+  insertSector(map.sectors[sectorIndex], sectorIndex);
+}
+
+void MapSpatialIndex::updateEntity(const MapData &map, int index) {
+  if (!m_valid || index < 0 || index >= m_entityCells.size() ||
+      index >= map.entities.size()) {
+    m_valid = false;
+    return;
+  }
+  removePoint(&Cell::entities, m_entityCells[index], index);
+  m_entityCells[index] = insertPoint(&Cell::entities, index,
+                                     map.entities[index].x,
+                                     map.entities[index].y);
+}
+
+void MapSpatialIndex::insertSector(const Sector &sector, int sectorIndex) {
+  SectorEntry &entry = m_sectors[sectorIndex];
+  entry.wallCells.clear();
+  entry.vertexCells.clear();
+  entry.wallCount = sector.walls.size();
+  entry.vertexCount = sector.vertices.size();
+
+  // Same shoelace area as the picking code used to compute per query
+  float area = 0.0f;
+  for (int j = 0; j < sector.vertices.size(); j++) {
+    int next = (j + 1) % sector.vertices.size();
+    area += sector.vertices[j].x() * sector.vertices[next].y();
+    area -= sector.vertices[next].x() * sector.vertices[j].y();
+  }
+  entry.area = std::abs(area) / 2.0f;
+
+  // Empty range for sectors without vertices
+  entry.cells.x0 = entry.cells.y0 = 0;
+  entry.cells.x1 = entry.cells.y1 = -1;
+
+  if (!sector.vertices.isEmpty()) {
+    float minX = sector.vertices[0].x(), maxX = minX;
+    float minY = sector.vertices[0].y(), maxY = minY;
+    for (int j = 0; j < sector.vertices.size(); j++) {
+      const QPointF &v = sector.vertices[j];
+      minX = qMin(minX, (float)v.x());
+      minY = qMin(minY, (float)v.y());
+      maxX = qMax(maxX, (float)v.x());
+      maxY = qMax(maxY, (float)v.y());
+
+      CellRange cell = cellRange(v.x(), v.y(), v.x(), v.y());
+      m_cells[cellKey(cell.x0, cell.y0)].vertices.append({sectorIndex, j});
+      entry.vertexCells.append(cell);
+    }
+
+    entry.cells = cellRange(minX, minY, maxX, maxY);
+    for (int y = entry.cells.y0; y <= entry.cells.y1; y++) {
+      for (int x = entry.cells.x0; x <= entry.cells.x1; x++)
+        m_cells[cellKey(x, y)].sectors.append(sectorIndex);
+    }
+  }
+
+  for (int w = 0; w < sector.walls.size(); w++) {
+    const Wall &wall = sector.walls[w];
+    CellRange cells =
+        cellRange(qMin(wall.x1, wall.x2), qMin(wall.y1, wall.y2),
+                  qMax(wall.x1, wall.x2), qMax(wall.y1, wall.y2));
+    for (int y = cells.y0; y <= cells.y1; y++) {
+      for (int x = cells.x0; x <= cells.x1; x++)
+        m_cells[cellKey(x, y)].walls.append({sectorIndex, w});
+    }
+    entry.wallCells.append(cells);
+  }
+}
+
+void MapSpatialIndex::removeSector(int sectorIndex) {
+  SectorEntry &entry = m_sectors[sectorIndex];
+
+  for (int y = entry.cells.y0; y <= entry.cells.y1; y++) {
+    for (int x = entry.cells.x0; x <= entry.cells.x1; x++)
+      m_cells[cellKey(x, y)].sectors.removeAll(sectorIndex);
+  }
+  for (const CellRange &cells : entry.wallCells) {
+    for (int y = cells.y0; y <= cells.y1; y++) {
+      for (int x = cells.x0; x <= cells.x1; x++)
+        removeSectorItems(m_cells[cellKey(x, y)].walls, sectorIndex);
+    }
+  }
+  for (const CellRange &cell : entry.vertexCells)
+    removeSectorItems(m_cells[cellKey(cell.x0, cell.y0)].vertices,
+                      sectorIndex);
+}
+
+MapSpatialIndex::CellRange
+MapSpatialIndex::insertPoint(QVector<int> Cell::*list, int index, float x,
+                             float y) {
+  CellRange cell = cellRange(x, y, x, y);
+  (m_cells[cellKey(cell.x0, cell.y0)].*list).append(index);
+  return cell;
+}
+
+void MapSpatialIndex::removePoint(QVector<int> Cell::*list,
+                                  const CellRange &cell, int index) {
+  (m_cells[cellKey(cell.x0, cell.y0)].*list).removeAll(index);
+}
+
+/* ============================================================================
+   QUERIES
+   ============================================================================
+ */
+
+float MapSpatialIndex::sectorArea(int sectorIndex) const {
+  if (sectorIndex < 0 || sectorIndex >= m_sectors.size())
+    return 0.0f;
+  return m_sectors[sectorIndex].area;
+}
+
+QVector<const MapSpatialIndex::Cell *>
+MapSpatialIndex::cellsIn(float minX, float minY, float maxX,
+                         float maxY) const {
+  QVector<const Cell *> result;
+  CellRange cells = cellRange(minX, minY, maxX, maxY);
+
+  // Zoomed far out the box can span more cells than exist
+  qint64 count = (qint64)(cells.x1 - cells.x0 + 1) * (cells.y1 - cells.y0 + 1);
+  if (count > m_cells.size()) {
+    for (QHash<quint64, Cell>::const_iterator it = m_cells.begin();
+         it != m_cells.end(); ++it) {
+      int x = (int)(quint32)(it.key() >> 32);
+      int y = (int)(quint32)it.key();
+      if (x >= cells.x0 && x <= cells.x1 && y >= cells.y0 && y <= cells.y1)
+        result.append(&it.value());
+    }
+    return result;
+  }
+
+  for (int y = cells.y0; y <= cells.y1; y++) {
+    for (int x = cells.x0; x <= cells.x1; x++) {
+      QHash<quint64, Cell>::const_iterator it = m_cells.find(cellKey(x, y));
+      if (it != m_cells.end())
+        result.append(&it.value());
+    }
+  }
+  return result;
+}
+
+QVector<int> MapSpatialIndex::sectorsAt(const QPointF &pos) const {
+  CellRange cell = cellRange(pos.x(), pos.y(), pos.x(), pos.y());
+  QVector<int> result = m_cells.value(cellKey(cell.x0, cell.y0)).sectors;
+  std::sort(result.begin(), result.end());
+  return result;
+}
+
+QVector<int> MapSpatialIndex::sectorsIn(const QRectF &rect) const {
+  QVector<int> result;
+  for (const Cell *cell :
+       cellsIn(rect.left(), rect.top(), rect.right(), rect.bottom()))
+    result += cell->sectors;
+  sortUnique(result);
+  return result;
+}
+
+QVector<MapSpatialIndex::SectorItem>
+MapSpatialIndex::sectorItemsIn(QVector<SectorItem> Cell::*list, float minX,
+                               float minY, float maxX, float maxY) const {
+  QVector<SectorItem> result;
+  for (const Cell *cell : cellsIn(minX, minY, maxX, maxY))
+    result += cell->*list;
+  sortUnique(result);
+  return result;
+}
+
+QVector<int> MapSpatialIndex::pointsNear(QVector<int> Cell::*list,
+                                         const QPointF &pos,
+                                         float radius) const {
+  QVector<int> result;
+  for (const Cell *cell : cellsIn(pos.x() - radius, pos.y() - radius,
+                                  pos.x() + radius, pos.y() + radius))
+    result += cell->*list;
+  sortUnique(result);
+  return result;
+}
+
+QVector<MapSpatialIndex::SectorItem>
+MapSpatialIndex::wallsNear(const QPointF &pos, float radius) const {
+  return sectorItemsIn(&Cell::walls, pos.x() - radius, pos.y() - radius,
+                       pos.x() + radius, pos.y() + radius);
+}
+
+QVector<MapSpatialIndex::SectorItem>
+MapSpatialIndex::wallsIn(const QRectF &rect) const {
+  return sectorItemsIn(&Cell::walls, rect.left(), rect.top(), rect.right(),
+                       rect.bottom());
+}
+
+QVector<MapSpatialIndex::SectorItem>
+MapSpatialIndex::verticesNear(const QPointF &pos, float radius) const {
+  return sectorItemsIn(&Cell::vertices, pos.x() - radius, pos.y() - radius,
+                       pos.x() + radius, pos.y() + radius);
+}
+
+QVector<int> MapSpatialIndex::entitiesNear(const QPointF &pos,
+                                           float radius) const {
+  return pointsNear(&Cell::entities, pos, radius);
+}
+
+QVector<int> MapSpatialIndex::lightsNear(const QPointF &pos,
+                                         float radius) const {
+  return pointsNear(&Cell::lights, pos, radius);
+}
+
+QVector<int> MapSpatialIndex::spawnFlagsNear(const QPointF &pos,
+                                             float radius) const {
+  return pointsNear(&Cell::spawnFlags, pos, radius);
+}
@@ -0,0 +1,115 @@
+#ifndef MAPSPATIALINDEX_H
+#define MAPSPATIALINDEX_H
+
+#include "mapdata.h"
+#include <QHash>
+#include <QPointF>
+#include <QRectF>
+#include <QVector>
+
+/**
+ * MapSpatialIndex - Uniform grid over map items for 2D hit testing
+ *
+ * Buckets sectors (by bounding box), walls (by segment bounds), vertices,
+ * entities, lights and spawn flags into square cells, so picking only looks
+ * at items near the cursor. Queries return candidate indices into MapData in
+ * ascending order without duplicates; callers still run the exact test.
+ *
+ * The index follows the map lazily. sync() rebuilds it when invalidated or
+ * when an item was added or removed, and re-indexes a sector whose vertex
+ * or wall count changed. Moves that keep all counts must be reported with
+ * updateSector() / updateEntity() or invalidate().
+ */
+class MapSpatialIndex {
+public:
+  // Wall or vertex of a sector
+  struct SectorItem {
+    int sector;
+    int item;
+
+    bool operator==(const SectorItem &other) const {
+      return sector == other.sector && item == other.item;
+    }
+    bool operator<(const SectorItem &other) const {
+      return sector != other.sector ? sector < other.sector
+                                    : item < other.item;
+    }
+  };
+
+  MapSpatialIndex();
+
+  void invalidate() { m_valid = false; }
+  void sync(const MapData &map);
+
+  // Incremental updates after moving an item in place
+  void updateSector(const MapData &map, int sectorIndex);
+  void updateEntity(const MapData &map, int index);
+
+  // Candidates whose bounds contain pos / lie within radius of pos
+  QVector<int> sectorsAt(const QPointF &pos) const;
+  QVector<SectorItem> wallsNear(const QPointF &pos, float radius) const;
+  QVector<SectorItem> verticesNear(const QPointF &pos, float radius) const;
+  QVector<int> entitiesNear(const QPointF &pos, float radius) const;
+  QVector<int> lightsNear(const QPointF &pos, float radius) const;
+  QVector<int> spawnFlagsNear(const QPointF &pos, float radius) const;
+
+  // Candidates overlapping a rectangle, for viewport culling
+  QVector<int> sectorsIn(const QRectF &rect) const;
+  QVector<SectorItem> wallsIn(const QRectF &rect) const;
+
+  // Polygon area, cached when the sector is indexed
+  float sectorArea(int sectorIndex) const;
+
+private:
+  struct Cell {
+    QVector<int> sectors;
+    QVector<SectorItem> walls;
+    QVector<SectorItem> vertices;
+    QVector<int> entities;
+    QVector<int> lights;
+    QVector<int> spawnFlags;
+  };
+
+  // Inclusive range of cell coordinates
+  struct CellRange {
+    int x0, y0, x1, y1;
+  };
+
+  // What a sector inserted, so it can be taken out again
+  struct SectorEntry {
+    CellRange cells;
+    QVector<CellRange> wallCells;
+    QVector<CellRange> vertexCells;
+    int wallCount;
+    int vertexCount;
+    float area;
+  };
+
+  void rebuild(const MapData &map);
+  void insertSector(const Sector &sector, int sectorIndex);
+  void removeSector(int sectorIndex);
+  CellRange insertPoint(QVector<int> Cell::*list, int index, float x,
+                        float y);
+  void removePoint(QVector<int> Cell::*list, const CellRange &cells,
+                   int index);
+  QVector<const Cell *> cellsIn(float minX, float minY, float maxX,
+                                float maxY) const;
+  QVector<int> pointsNear(QVector<int> Cell::*list, const QPointF &pos,
+                          float radius) const;
+  QVector<SectorItem> sectorItemsIn(QVector<SectorItem> Cell::*list,
+                                    float minX, float minY, float maxX,
+                                    float maxY) const;
+
+  CellRange cellRange(float minX, float minY, float maxX, float maxY) const;
+  static quint64 cellKey(int x, int y);
+
+  QHash<quint64, Cell> m_cells;
+  QVector<SectorEntry> m_sectors;
+  QVector<CellRange> m_entityCells;
+  QVector<CellRange> m_lightCells;
+  QVector<CellRange> m_spawnFlagCells;
+  float m_cellSize;
+  bool m_valid;
+};
+
+#endif // MAPSPATIALINDEX_H
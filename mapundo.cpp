@@ -0,0 +1,425 @@
+#include "mapundo.h"
+#include <QCoreApplication>
+#include <QDateTime>
+
+namespace {
+
+QString tr(const char *text) {
+  return QCoreApplication::translate("MapUndo", text);
+}
+
+// Walls follow the vertices, as in GridEditor's drags
+void syncWalls(Sector &sector) {
+  for (int w = 0; w < sector.walls.size(); w++) {
+    int v1 = w;
+    int v2 = (w + 1) % sector.vertices.size();
+    if (v1 < sector.vertices.size() && v2 < sector.vertices.size()) {
+      sector.walls[w].x1 = sector.vertices[v1].x();
+      sector.walls[w].y1 = sector.vertices[v1].y();
+      sector.walls[w].x2 = sector.vertices[v2].x();
+      sector.walls[w].y2 = sector.vertices[v2].y();
+    }
+  }
+}
+
+qint64 vectorCost(int size, int itemSize) {
+  return qint64(size) * itemSize;
+}
+
+qint64 stringCost(const QString &text) { return text.size() * 2; }
+
+// One bit per entry that differs, so edits can tell if they touch the same
+// field
+template <int N> quint64 fieldMask(const bool (&changed)[N]) {
+  static_assert(N <= 64, "one bit per field");
+  quint64 mask = 0;
+  for (int i = 0; i < N; i++) {
+    if (changed[i])
+      mask |= quint64(1) << i;
+  }
+  return mask;
+}
+
+quint64 wallFields(const Wall &a, const Wall &b) {
+  const bool changed[] = {
+      a.wall_id != b.wall_id,
+      a.x1 != b.x1 || a.y1 != b.y1 || a.x2 != b.x2 || a.y2 != b.y2,
+      a.texture_id_lower != b.texture_id_lower,
+      a.texture_id_middle != b.texture_id_middle,
+      a.texture_id_upper != b.texture_id_upper,
+      a.texture_split_z_lower != b.texture_split_z_lower,
+      a.texture_split_z_upper != b.texture_split_z_upper,
+      a.texture_id_lower_normal != b.texture_id_lower_normal,
+      a.texture_id_middle_normal != b.texture_id_middle_normal,
+      a.texture_id_upper_normal != b.texture_id_upper_normal,
+      a.portal_id != b.portal_id,
+      a.flags != b.flags};
+  return fieldMask(changed);
+}
+
+// The behavior graph is not compared: an edit that only changes it has an
+// empty mask and is never merged
+quint64 entityFields(const EntityInstance &a, const EntityInstance &b) {
+  const bool changed[] = {
+      a.processName != b.processName,
+      a.assetPath != b.assetPath,
+      a.type != b.type,
+      a.x != b.x || a.y != b.y || a.z != b.z,
+      a.angle != b.angle,
+      a.activationType != b.activationType,
+      a.collisionTarget != b.collisionTarget,
+      a.isVisible != b.isVisible,
+      a.customAction != b.customAction,
+      a.eventName != b.eventName,
+      a.isPlayer != b.isPlayer,
+      a.controlType != b.controlType,
+      a.cameraFollow != b.cameraFollow,
+      a.cameraOffset_x != b.cameraOffset_x ||
+          a.cameraOffset_y != b.cameraOffset_y ||
+          a.cameraOffset_z != b.cameraOffset_z,
+      a.cameraRotation != b.cameraRotation,
+      a.initialRotation != b.initialRotation,
+      a.isIntro != b.isIntro,
+      a.npcPathId != b.npcPathId,
+      a.autoStartPath != b.autoStartPath,
+      a.snapToFloor != b.snapToFloor,
+      a.graphId != b.graphId,
+      a.startGraph != b.startGraph,
+      a.endGraph != b.endGraph,
+      a.animSpeed != b.animSpeed,
+      a.scale != b.scale,
+      a.billboard_directions != b.billboard_directions,
+      a.width != b.width || a.depth != b.depth || a.height != b.height,
+      a.collisionEnabled != b.collisionEnabled,
+      a.physicsEnabled != b.physicsEnabled,
+      a.physicsMass != b.physicsMass,
+      a.physicsFriction != b.physicsFriction,
+      a.physicsRestitution != b.physicsRestitution,
+      a.physicsGravityScale != b.physicsGravityScale,
+      a.physicsLinearDamping != b.physicsLinearDamping,
+      a.physicsAngularDamping != b.physicsAngularDamping,
+      a.physicsIsStatic != b.physicsIsStatic,
+      a.physicsIsKinematic != b.physicsIsKinematic,
+      a.physicsIsTrigger != b.physicsIsTrigger,
+      a.physicsLockRotX != b.physicsLockRotX ||
+          a.physicsLockRotY != b.physicsLockRotY ||
+          a.physicsLockRotZ != b.physicsLockRotZ,
+      a.physicsCollisionLayer != b.physicsCollisionLayer,
+      a.physicsCollisionMask != b.physicsCollisionMask};
+  return fieldMask(changed);
+}
+
+} // namespace
+
+/* ============================================================================
+   COMMANDS
+   ============================================================================
+ */
+
+MapMacroCommand::~MapMacroCommand() { qDeleteAll(m_commands); }
+
+void MapMacroCommand::undo(MapData &map) {
+  for (int i = m_commands.size() - 1; i >= 0; i--)
+    m_commands[i]->undo(map);
+}
+
+void MapMacroCommand::redo(MapData &map) {
+  for (MapCommand *command : m_commands)
+    command->redo(map);
+}
+
+qint64 MapMacroCommand::memoryCost() const {
+  qint64 cost = sizeof(*this);
+  for (const MapCommand *command : m_commands)
+    cost += command->memoryCost();
+  return cost;
+}
+
+QString VertexMoveCommand::text() const { return tr("Mover vértice"); }
+
+void VertexMoveCommand::apply(MapData &map, const QPointF &position) const {
+  Sector *sector = map.findSector(m_sectorId);
+  if (!sector || m_vertex >= sector->vertices.size())
+    return;
+  sector->vertices[m_vertex] = position;
+  syncWalls(*sector);
+  map.markSectorDirty(m_sectorId);
+}
+
+qint64 TranslateCommand::memoryCost() const {
+  return sizeof(*this) + stringCost(m_text) +
+         vectorCost(sectorIds.size() + entitySpawnIds.size() +
+                        spawnFlagIds.size(),
+                    sizeof(int));
+}
+
+void TranslateCommand::apply(MapData &map, const QPointF &offset) const {
+  for (int sectorId : sectorIds) {
+    Sector *sector = map.findSector(sectorId);
+    if (!sector)
+      continue;
+    for (QPointF &vertex : sector->vertices)
+      vertex += offset;
+    syncWalls(*sector);
+    map.markSectorDirty(sectorId);
+  }
+
+  for (EntityInstance &entity : map.entities) {
+    if (entitySpawnIds.contains(entity.spawn_id)) {
+      entity.x += offset.x();
+      entity.y += offset.y();
+    }
+  }
+
+  for (SpawnFlag &flag : map.spawnFlags) {
+    if (spawnFlagIds.contains(flag.flagId)) {
+      flag.x += offset.x();
+      flag.y += offset.y();
+    }
+  }
+}
+
+QString SectorParentCommand::text() const { return tr("Cambiar sector padre"); }
+
+void SectorParentCommand::setParent(MapData &map, int sectorId,
+                                    int parentId) {
+  Sector *sector = map.findSector(sectorId);
+  if (!sector || sector->parent_sector_id == parentId)
+    return;
+
+  if (Sector *oldParent = map.findSector(sector->parent_sector_id))
+    oldParent->child_sector_ids.removeAll(sectorId);
+
+  sector->parent_sector_id = parentId;
+
+  if (Sector *newParent = map.findSector(parentId)) {
+    if (!newParent->child_sector_ids.contains(sectorId))
+      newParent->child_sector_ids.append(sectorId);
+  }
+}
+
+WallEditCommand::WallEditCommand(int sectorId, int wallIndex,
+                                 const Wall &before, const Wall &after)
+    : m_sectorId(sectorId), m_wallIndex(wallIndex), m_before(before),
+      m_after(after), m_fields(wallFields(before, after)),
+      m_time(QDateTime::currentMSecsSinceEpoch()) {}
+
+QString WallEditCommand::text() const { return tr("Editar pared"); }
+
+bool WallEditCommand::mergeWith(const MapCommand *other) {
+  const WallEditCommand *edit = static_cast<const WallEditCommand *>(other);
+  if (edit->m_sectorId != m_sectorId || edit->m_wallIndex != m_wallIndex ||
+      edit->m_fields != m_fields || edit->m_time - m_time > MERGE_WINDOW_MS ||
+      wallFields(m_after, edit->m_before) != 0)
+    return false;
+  m_after = edit->m_after;
+  m_time = edit->m_time;
+  return true;
+}
+
+void WallEditCommand::apply(MapData &map, const Wall &wall) const {
+  Sector *sector = map.findSector(m_sectorId);
+  if (!sector || m_wallIndex >= sector->walls.size())
+    return;
+  sector->walls[m_wallIndex] = wall;
+  map.markSectorDirty(m_sectorId);
+}
+
+EntityEditCommand::EntityEditCommand(const EntityInstance &before,
+                                     const EntityInstance &after)
+    : m_before(before), m_after(after), m_fields(entityFields(before, after)),
+      m_time(QDateTime::currentMSecsSinceEpoch()) {}
+
+QString EntityEditCommand::text() const { return tr("Editar entidad"); }
+
+bool EntityEditCommand::mergeWith(const MapCommand *other) {
+  const EntityEditCommand *edit = static_cast<const EntityEditCommand *>(other);
+  if (edit->m_before.spawn_id != m_after.spawn_id || m_fields == 0 ||
+      edit->m_fields != m_fields || edit->m_time - m_time > MERGE_WINDOW_MS)
+    return false;
+  m_after = edit->m_after;
+  m_time = edit->m_time;
+  return true;
+}
+
+qint64 EntityEditCommand::memoryCost() const {
+  return sizeof(EntityEditCommand) - 2 * sizeof(EntityInstance) +
+         itemCost(m_before) + itemCost(m_after);
+}
+
+void EntityEditCommand::apply(MapData &map, const EntityInstance &current,
+                              const EntityInstance &target) {
+  for (EntityInstance &entity : map.entities) {
+    if (entity.spawn_id == current.spawn_id) {
+      entity = target;
+      return;
+    }
+  }
+}
+
+qint64 itemCost(const Sector &sector) {
+  return sizeof(Sector) + vectorCost(sector.vertices.size(), sizeof(QPointF)) +
+         vectorCost(sector.walls.size(), sizeof(Wall)) +
+         vectorCost(sector.portal_ids.size() + sector.child_sector_ids.size(),
+                    sizeof(int));
+}
+
+qint64 itemCost(const EntityInstance &entity) {
+  // Strings are implicitly shared with the map, count them anyway: the map
+  // may drop its copy while the history keeps this one
+  return sizeof(EntityInstance) + stringCost(entity.processName) +
+         stringCost(entity.assetPath) + stringCost(entity.type) +
+         stringCost(entity.collisionTarget) + stringCost(entity.customAction) +
+         stringCost(entity.eventName) +
+         vectorCost(entity.behaviorGraph.nodes.size(), sizeof(NodeData));
+}
+
+GroupMembershipCommand::GroupMembershipCommand(const MapData &map,
+                                               int sectorId)
+    : m_sectorId(sectorId) {
+  for (const SectorGroup &group : map.sectorGroups) {
+    if (group.sector_ids.contains(sectorId))
+      m_groupIds.append(group.group_id);
+  }
+}
+
+void GroupMembershipCommand::undo(MapData &map) {
+  for (int groupId : m_groupIds) {
+    if (SectorGroup *group = map.findGroup(groupId)) {
+      if (!group->sector_ids.contains(m_sectorId))
+        group->sector_ids.append(m_sectorId);
+    }
+  }
+  map.invalidateIndexes();
+}
+
+void GroupMembershipCommand::redo(MapData &map) {
+  map.removeSectorFromGroups(m_sectorId);
+}
+
+QString GroupMembershipCommand::text() const {
+  return tr("Quitar sector de grupos");
+}
+
+qint64 GroupMembershipCommand::memoryCost() const {
+  return sizeof(*this) + vectorCost(m_groupIds.size(), sizeof(int));
+}
+
+void SectorEditCommand::addSector(const Sector &before, const Sector &after) {
+  m_before.append(before);
+  m_after.append(after);
+}
+
+void SectorEditCommand::setPortals(const QVector<Portal> &before,
+                                   const QVector<Portal> &after) {
+  m_hasPortals = true;
+  m_portalsBefore = before;
+  m_portalsAfter = after;
+}
+
+qint64 SectorEditCommand::memoryCost() const {
+  qint64 cost = sizeof(*this) + stringCost(m_text) +
+                vectorCost(m_portalsBefore.size() + m_portalsAfter.size(),
+                           sizeof(Portal));
+  for (int i = 0; i < m_before.size(); i++)
+    cost += itemCost(m_before[i]) + itemCost(m_after[i]);
+  return cost;
+}
+
+void SectorEditCommand::apply(MapData &map, const QVector<Sector> &sectors,
+                              const QVector<Portal> &portals) const {
+  for (const Sector &target : sectors) {
+    if (Sector *sector = map.findSector(target.sector_id)) {
+      *sector = target;
+      map.markSectorDirty(target.sector_id);
+    }
+  }
+  if (m_hasPortals) {
+    map.portals = portals;
+    map.invalidateIndexes();
+    map.dirtySectorIds.clear(); // Portal list changed, full 3D rebuild
+  }
+}
+
+/* ============================================================================
+   STACK
+   ============================================================================
+ */
+
+MapUndoStack::MapUndoStack()
+    : m_index(0), m_memoryUsage(0), m_memoryLimit(64 * 1024 * 1024) {}
+
+MapUndoStack::~MapUndoStack() { qDeleteAll(m_commands); }
+
+void MapUndoStack::push(MapCommand *command, MapData &map) {
+  command->redo(map);
+  record(command);
+}
+
+void MapUndoStack::record(MapCommand *command) {
+  // A new edit discards the redo branch
+  while (m_commands.size() > m_index) {
+    MapCommand *dropped = m_commands.takeLast();
+    m_memoryUsage -= dropped->memoryCost();
+    delete dropped;
+  }
+
+  if (m_index > 0 && command->id() >= 0) {
+    MapCommand *top = m_commands.last();
+    qint64 topCost = top->memoryCost();
+    if (top->id() == command->id() && top->mergeWith(command)) {
+      m_memoryUsage += top->memoryCost() - topCost;
+      delete command;
+      return;
+    }
+  }
+
+  m_commands.append(command);
+  m_memoryUsage += command->memoryCost();
+  m_index = m_commands.size();
+  trim();
+}
+
+bool MapUndoStack::undo(MapData &map) {
+  if (!canUndo())
+    return false;
+  m_commands[--m_index]->undo(map);
+  return true;
+}
+
+bool MapUndoStack::redo(MapData &map) {
+  if (!canRedo())
+    return false;
+  m_commands[m_index++]->redo(map);
+  return true;
+}
+
+QString MapUndoStack::undoText() const {
+  return canUndo() ? m_commands[m_index - 1]->text() : QString();
+}
+
+QString MapUndoStack::redoText() const {
+  return canRedo() ? m_commands[m_index]->text() : QString();
+}
+
+void MapUndoStack::clear() {
+  qDeleteAll(m_commands);
+  m_commands.clear();
+  m_index = 0;
+  m_memoryUsage = 0;
+}
+
+void MapUndoStack::setMemoryLimit(qint64 bytes) {
+  m_memoryLimit = qMax<qint64>(0, bytes);
+  trim();
+}
+
+void MapUndoStack::trim() {
+  // Oldest steps go first; the latest one is always kept
+  while (m_memoryUsage > m_memoryLimit && m_index > 1) {
+    MapCommand *dropped = m_commands.takeFirst();
+    m_memoryUsage -= dropped->memoryCost();
+    delete dropped;
+    m_index--;
+  }
+}
@@ -0,0 +1,348 @@
+#ifndef MAPUNDO_H
+#define MAPUNDO_H
+
+#include "mapdata.h"
+#include <QList>
+#include <QPointF>
+#include <QString>
+#include <QVector>
+
+/**
+ * Undo history for map edits
+ *
+ * A MapCommand stores only what one edit changed: a vertex, a wall, the IDs
+ * of the moved items plus the offset, the removed sectors... never a MapData
+ * snapshot. Items are found by ID (sector_id, spawn_id, flagId, portal_id,
+ * light id), never by list index, so entries stay valid while the lists
+ * shift. Every edit of the lists still has to go through the stack: undo
+ * assumes the map is in the state the command left it.
+ *
+ * MapUndoStack follows QUndoStack: push() runs redo(), consecutive commands
+ * with the same id() are merged through mergeWith(), and the oldest steps
+ * are dropped once the estimated memory of the history exceeds
+ * memoryLimit(). Only panel edits merge, and only edits of the same field
+ * less than MERGE_WINDOW_MS apart (a spin box held down is one step). Drags
+ * are recorded once, on release, and never merge.
+ */
+class MapCommand {
+public:
+  virtual ~MapCommand() {}
+
+  virtual void undo(MapData &map) = 0;
+  virtual void redo(MapData &map) = 0;
+  virtual QString text() const = 0;
+
+  // Commands with the same id (>= 0) may be merged, -1 never merges
+  virtual int id() const { return -1; }
+  virtual bool mergeWith(const MapCommand *other) {
+    Q_UNUSED(other);
+    return false;
+  }
+
+  // Approximate bytes held by the command
+  virtual qint64 memoryCost() const = 0;
+
+protected:
+  enum CommandId { WallEditId = 1, EntityEditId };
+
+  // Longest pause between two edits that still merge
+  static const qint64 MERGE_WINDOW_MS = 1000;
+};
+
+// Several commands undone and redone as one step
+class MapMacroCommand : public MapCommand {
+public:
+  explicit MapMacroCommand(const QString &text) : m_text(text) {}
+  ~MapMacroCommand() override;
+
+  void append(MapCommand *command) { m_commands.append(command); }
+  bool isEmpty() const { return m_commands.isEmpty(); }
+
+  void undo(MapData &map) override;
+  void redo(MapData &map) override;
+  QString text() const override { return m_text; }
+  qint64 memoryCost() const override;
+
+private:
+  QString m_text;
+  QList<MapCommand *> m_commands;
+};
+
+// One vertex of a sector dragged to a new position
+class VertexMoveCommand : public MapCommand {
+public:
+  VertexMoveCommand(int sectorId, int vertex, const QPointF &from,
+                    const QPointF &to)
+      : m_sectorId(sectorId), m_vertex(vertex), m_from(from), m_to(to) {}
+
+  void undo(MapData &map) override { apply(map, m_from); }
+  void redo(MapData &map) override { apply(map, m_to); }
+  QString text() const override;
+  qint64 memoryCost() const override { return sizeof(*this); }
+
+private:
+  void apply(MapData &map, const QPointF &position) const;
+
+  int m_sectorId;
+  int m_vertex;
+  QPointF m_from, m_to;
+};
+
+// Sectors, entities and spawn flags moved by the same offset (sector and
+// group drags, multi-selection moves)
+class TranslateCommand : public MapCommand {
+public:
+  TranslateCommand(const QString &text, const QPointF &offset)
+      : m_text(text), m_offset(offset) {}
+
+  QVector<int> sectorIds;
+  QVector<int> entitySpawnIds;
+  QVector<int> spawnFlagIds;
+
+  bool isNull() const { return m_offset.isNull(); }
+
+  void undo(MapData &map) override { apply(map, -m_offset); }
+  void redo(MapData &map) override { apply(map, m_offset); }
+  QString text() const override { return m_text; }
+  qint64 memoryCost() const override;
+
+private:
+  void apply(MapData &map, const QPointF &offset) const;
+
+  QString m_text;
+  QPointF m_offset;
+};
+
+// Parent sector changed (autoParentSector after a move)
+class SectorParentCommand : public MapCommand {
+public:
+  SectorParentCommand(int sectorId, int fromParent, int toParent)
+      : m_sectorId(sectorId), m_from(fromParent), m_to(toParent) {}
+
+  void undo(MapData &map) override { setParent(map, m_sectorId, m_from); }
+  void redo(MapData &map) override { setParent(map, m_sectorId, m_to); }
+  QString text() const override;
+  qint64 memoryCost() const override { return sizeof(*this); }
+
+  // Moves sectorId to the children of parentId (-1 = no parent)
+  static void setParent(MapData &map, int sectorId, int parentId);
+
+private:
+  int m_sectorId;
+  int m_from, m_to;
+};
+
+// Fields of one wall (textures, normals, splits, flags). Walls are found by
+// index: wall_id is not reliable in older maps.
+class WallEditCommand : public MapCommand {
+public:
+  WallEditCommand(int sectorId, int wallIndex, const Wall &before,
+                  const Wall &after);
+
+  void undo(MapData &map) override { apply(map, m_before); }
+  void redo(MapData &map) override { apply(map, m_after); }
+  QString text() const override;
+  int id() const override { return WallEditId; }
+  bool mergeWith(const MapCommand *other) override;
+  qint64 memoryCost() const override { return sizeof(*this); }
+
+private:
+  void apply(MapData &map, const Wall &wall) const;
+
+  int m_sectorId;
+  int m_wallIndex;
+  Wall m_before, m_after;
+  quint64 m_fields; // Fields changed (see mapundo.cpp)
+  qint64 m_time;    // Of the last merged edit, ms since epoch
+};
+
+// Properties of one entity (panel and behavior edits)
+class EntityEditCommand : public MapCommand {
+public:
+  EntityEditCommand(const EntityInstance &before, const EntityInstance &after);
+
+  void undo(MapData &map) override { apply(map, m_after, m_before); }
+  void redo(MapData &map) override { apply(map, m_before, m_after); }
+  QString text() const override;
+  int id() const override { return EntityEditId; }
+  bool mergeWith(const MapCommand *other) override;
+  qint64 memoryCost() const override;
+
+private:
+  static void apply(MapData &map, const EntityInstance &current,
+                    const EntityInstance &target);
+
+  EntityInstance m_before, m_after;
+  quint64 m_fields; // 0 = only fields that are not compared (behavior)
+  qint64 m_time;
+};
+
+// Heap estimate of a stored item, for ListEditCommand::memoryCost()
+template <typename T> inline qint64 itemCost(const T &) { return sizeof(T); }
+qint64 itemCost(const Sector &sector);
+qint64 itemCost(const EntityInstance &entity);
+
+// ID that finds a stored item again in its list (ListEditCommand)
+inline int itemId(const Sector &sector) { return sector.sector_id; }
+inline int itemId(const Portal &portal) { return portal.portal_id; }
+inline int itemId(const EntityInstance &entity) { return entity.spawn_id; }
+inline int itemId(const SpawnFlag &flag) { return flag.flagId; }
+inline int itemId(const Light &light) { return light.id; }
+
+// Items inserted into or removed from one of the MapData lists. Holds only
+// those items and the positions they had, in ascending order. Removal looks
+// the items up by itemId(); the position is only tried first, and is where
+// undo puts a removed item back.
+template <typename T> class ListEditCommand : public MapCommand {
+public:
+  typedef QVector<T> MapData::*List;
+  enum Operation { Insert, Remove };
+
+  ListEditCommand(const QString &text, List list, Operation operation)
+      : m_text(text), m_list(list), m_operation(operation) {}
+
+  void addItem(int index, const T &item) {
+    m_indexes.append(index);
+    m_items.append(item);
+  }
+  bool isEmpty() const { return m_items.isEmpty(); }
+
+  void undo(MapData &map) override {
+    if (m_operation == Insert)
+      removeItems(map);
+    else
+      insertItems(map);
+  }
+  void redo(MapData &map) override {
+    if (m_operation == Insert)
+      insertItems(map);
+    else
+      removeItems(map);
+  }
+  QString text() const override { return m_text; }
+  qint64 memoryCost() const override {
+    qint64 cost = sizeof(*this) + m_indexes.size() * sizeof(int);
+    for (const T &item : m_items)
+      cost += itemCost(item);
+    return cost;
+  }
+
+private:
+  static int find(const QVector<T> &list, int id, int hint) {
+    if (hint < list.size() && itemId(list[hint]) == id)
+      return hint;
+    for (int i = 0; i < list.size(); i++) {
+      if (itemId(list[i]) == id)
+        return i;
+    }
+    return -1;
+  }
+  void insertItems(MapData &map) const {
+    QVector<T> &list = map.*m_list;
+    for (int i = 0; i < m_items.size(); i++) {
+      if (find(list, itemId(m_items[i]), m_indexes[i]) < 0)
+        list.insert(qMin(m_indexes[i], int(list.size())), m_items[i]);
+    }
+    changed(map);
+  }
+  void removeItems(MapData &map) const {
+    QVector<T> &list = map.*m_list;
+    for (int i = m_items.size() - 1; i >= 0; i--) {
+      int index = find(list, itemId(m_items[i]), m_indexes[i]);
+      if (index >= 0)
+        list.removeAt(index);
+    }
+    changed(map);
+  }
+  static void changed(MapData &map) {
+    map.invalidateIndexes();
+    map.dirtySectorIds.clear(); // Sector list changed, full 3D rebuild
+  }
+
+  QString m_text;
+  List m_list;
+  Operation m_operation;
+  QVector<int> m_indexes;
+  QVector<T> m_items;
+};
+
+// Sector removed from the groups that listed it
+class GroupMembershipCommand : public MapCommand {
+public:
+  // Records the groups listing sectorId; redo() removes it from them
+  GroupMembershipCommand(const MapData &map, int sectorId);
+
+  void undo(MapData &map) override;
+  void redo(MapData &map) override;
+  QString text() const override;
+  qint64 memoryCost() const override;
+
+private:
+  int m_sectorId;
+  QVector<int> m_groupIds; // Groups that contained the sector
+};
+
+// Whole sectors before and after an edit that rebuilds their vertices and
+// walls (wall splits, portal detection, moves from a dialog). Sectors are
+// found by sector_id. The portal list is stored only when the edit replaced
+// it (setPortals()).
+class SectorEditCommand : public MapCommand {
+public:
+  explicit SectorEditCommand(const QString &text)
+      : m_text(text), m_hasPortals(false) {}
+
+  void addSector(const Sector &before, const Sector &after);
+  void setPortals(const QVector<Portal> &before, const QVector<Portal> &after);
+  bool isEmpty() const { return m_before.isEmpty() && !m_hasPortals; }
+
+  void undo(MapData &map) override { apply(map, m_before, m_portalsBefore); }
+  void redo(MapData &map) override { apply(map, m_after, m_portalsAfter); }
+  QString text() const override { return m_text; }
+  qint64 memoryCost() const override;
+
+private:
+  void apply(MapData &map, const QVector<Sector> &sectors,
+             const QVector<Portal> &portals) const;
+
+  QString m_text;
+  QVector<Sector> m_before, m_after;
+  bool m_hasPortals;
+  QVector<Portal> m_portalsBefore, m_portalsAfter;
+};
+
+class MapUndoStack {
+public:
+  MapUndoStack();
+  ~MapUndoStack();
+
+  // Runs command->redo() and records it
+  void push(MapCommand *command, MapData &map);
+  // Records a command whose edit was already applied (drags)
+  void record(MapCommand *command);
+
+  bool undo(MapData &map);
+  bool redo(MapData &map);
+  bool canUndo() const { return m_index > 0; }
+  bool canRedo() const { return m_index < m_commands.size(); }
+  QString undoText() const;
+  QString redoText() const;
+
+  void clear();
+  int count() const { return m_commands.size(); }
+
+  // Bytes of history kept before the oldest steps are dropped
+  void setMemoryLimit(qint64 bytes);
+  qint64 memoryLimit() const { return m_memoryLimit; }
+  qint64 memoryUsage() const { return m_memoryUsage; }
+
+private:
+  Q_DISABLE_COPY(MapUndoStack)
+  void trim();
+
+  QList<MapCommand *> m_commands;
+  int m_index; // Commands before m_index are applied
+  qint64 m_memoryUsage;
+  qint64 m_memoryLimit;
+};
+
+#endif // MAPUNDO_H
@@ -0,0 +1,266 @@
+#include "polygontriangulator.h"
+#include <QtGlobal>
+#include <algorithm>
+
+namespace {
+
+// Twice the signed area of (o, a, b); positive when counter-clockwise
+double cross(const QPointF &o, const QPointF &a, const QPointF &b) {
+  return (a.x() - o.x()) * (b.y() - o.y()) - (a.y() - o.y()) * (b.x() - o.x());
+}
+
+double ringArea(const QVector<QPointF> &points, const QVector<int> &ring) {
+  double area = 0.0;
+  for (int i = 0; i < ring.size(); i++) {
+    const QPointF &a = points[ring[i]];
+    const QPointF &b = points[ring[(i + 1) % ring.size()]];
+    area += a.x() * b.y() - b.x() * a.y();
+  }
+  return area * 0.5;
+}
+
+// Inclusive test, triangle must be counter-clockwise
+bool pointInTriangle(const QPointF &p, const QPointF &a, const QPointF &b,
+                     const QPointF &c) {
+  return cross(a, b, p) >= 0.0 && cross(b, c, p) >= 0.0 &&
+         cross(c, a, p) >= 0.0;
+}
+
+bool pointInPolygon(const QPointF &p, const QVector<QPointF> &polygon) {
+  bool inside = false;
+  for (int i = 0, j = polygon.size() - 1; i < polygon.size(); j = i++) {
+    const QPointF &a = polygon[i];
+    const QPointF &b = polygon[j];
+    if ((a.y() > p.y()) != (b.y() > p.y()) &&
+        p.x() < (b.x() - a.x()) * (p.y() - a.y()) / (b.y() - a.y()) + a.x())
+      inside = !inside;
+  }
+  return inside;
+}
+
+// Whether the diagonal from ring position pos towards p leaves into the
+// polygon interior (ring is counter-clockwise)
+bool locallyInside(const QVector<QPointF> &points, const QVector<int> &ring,
+                   int pos, const QPointF &p) {
+  const QPointF &prev = points[ring[(pos + ring.size() - 1) % ring.size()]];
+  const QPointF &cur = points[ring[pos]];
+  const QPointF &next = points[ring[(pos + 1) % ring.size()]];
+  if (cross(prev, cur, next) >= 0.0) // Convex corner
+    return cross(prev, cur, p) >= 0.0 && cross(cur, next, p) >= 0.0;
+  return cross(prev, cur, p) >= 0.0 || cross(cur, next, p) >= 0.0;
+}
+
+// Splice a clockwise hole into the counter-clockwise ring with a bridge from
+// the hole's rightmost vertex to a visible ring vertex (Eberly's method)
+bool bridgeHole(const QVector<QPointF> &points, QVector<int> &ring,
+                const QVector<int> &hole) {
+  int holeStart = 0;
+  for (int i = 1; i < hole.size(); i++) {
+    if (points[hole[i]].x() > points[hole[holeStart]].x())
+      holeStart = i;
+  }
+  const QPointF m = points[hole[holeStart]];
+
+  // Nearest ring edge hit by a ray from m towards +x
+  int edge = -1;
+  double hitX = 0.0;
+  for (int i = 0; i < ring.size(); i++) {
+    const QPointF &a = points[ring[i]];
+    const QPointF &b = points[ring[(i + 1) % ring.size()]];
+    if (a.y() == b.y() || (a.y() > m.y()) == (b.y() > m.y()))
+      continue;
+    double x = a.x() + (m.y() - a.y()) * (b.x() - a.x()) / (b.y() - a.y());
+    if (x >= m.x() && (edge < 0 || x < hitX)) {
+      edge = i;
+      hitX = x;
+    }
+  }
+  if (edge < 0)
+    return false;
+
+  // Candidate is the edge endpoint furthest right; a reflex vertex inside
+  // (m, hit, candidate) would block it, take the one closest to the ray
+  const QPointF hit(hitX, m.y());
+  int edgeEnd = (edge + 1) % ring.size();
+  int bridge = points[ring[edge]].x() > points[ring[edgeEnd]].x() ? edge
+                                                                  : edgeEnd;
+  if (points[ring[edge]] == hit)
+    bridge = edge;
+  else if (points[ring[edgeEnd]] == hit)
+    bridge = edgeEnd;
+  const QPointF candidate = points[ring[bridge]];
+  if (candidate != hit) {
+    QPointF a = m, b = hit, c = candidate;
+    if (cross(a, b, c) < 0.0)
+      std::swap(b, c);
+    double bestTan = -1.0;
+    for (int i = 0; i < ring.size(); i++) {
+      const QPointF &p = points[ring[i]];
+      if (p == candidate || p.x() < m.x() || !pointInTriangle(p, a, b, c))
+        continue;
+      const QPointF &prev = points[ring[(i + ring.size() - 1) % ring.size()]];
+      const QPointF &next = points[ring[(i + 1) % ring.size()]];
+      if (cross(prev, p, next) >= 0.0)
+        continue; // Convex vertices cannot block visibility
+      double tan = qAbs(m.y() - p.y()) / qMax(p.x() - m.x(), 1e-12);
+      if (bestTan < 0.0 || tan < bestTan ||
+          (tan == bestTan && p.x() < points[ring[bridge]].x())) {
+        bestTan = tan;
+        bridge = i;
+      }
+    }
+  }
+
+  // Earlier bridges duplicate ring vertices; pick the copy whose corner
+  // the new bridge enters from the inside
+  for (int i = 0; i < ring.size(); i++) {
+    if (ring[i] == ring[bridge] && locallyInside(points, ring, i, m)) {
+      bridge = i;
+      break;
+    }
+  }
+
+  // ring: ..., bridge, m, hole..., m, bridge, ...
+  QVector<int> splice;
+  splice.reserve(hole.size() + 2);
+  for (int i = 0; i <= hole.size(); i++)
+    splice.append(hole[(holeStart + i) % hole.size()]);
+  splice.append(ring[bridge]);
+
+  QVector<int> joined;
+  joined.reserve(ring.size() + splice.size());
+  joined += ring.mid(0, bridge + 1);
+  joined += splice;
+  joined += ring.mid(bridge + 1);
+  ring = joined;
+  return true;
+}
+
+} // namespace
+
+bool PolygonTriangulator::triangulate(const QVector<QPointF> &outer,
+                                      const QVector<QVector<QPointF>> &holes,
+                                      QVector<quint32> &indices) {
+  if (outer.size() < 3)
+    return false;
+
+  QVector<QPointF> points = outer;
+  QVector<int> ring;
+  ring.reserve(outer.size());
+  for (int i = 0; i < outer.size(); i++)
+    ring.append(i);
+  if (ringArea(points, ring) < 0.0)
+    std::reverse(ring.begin(), ring.end());
+
+  // Holes as clockwise rings, bridged from the rightmost one inwards
+  QVector<QVector<int>> holeRings;
+  for (const QVector<QPointF> &hole : holes) {
+    int base = points.size();
+    points += hole;
+    if (hole.size() < 3)
+      continue;
+
+    bool inside = true;
+    for (const QPointF &p : hole) {
+      if (!pointInPolygon(p, outer)) {
+        inside = false;
+        break;
+      }
+    }
+    if (!inside)
+      continue;
+
+    QVector<int> holeRing;
+    for (int i = 0; i < hole.size(); i++)
+      holeRing.append(base + i);
+    double area = ringArea(points, holeRing);
+    if (qFuzzyIsNull(area))
+      continue;
+    if (area > 0.0)
+      std::reverse(holeRing.begin(), holeRing.end());
+    holeRings.append(holeRing);
+  }
+
+  auto maxX = [&points](const QVector<int> &holeRing) {
+    double x = points[holeRing[0]].x();
+    for (int index : holeRing)
+      x = qMax(x, points[index].x());
+    return x;
+  };
+  std::sort(holeRings.begin(), holeRings.end(),
+            [&maxX](const QVector<int> &a, const QVector<int> &b) {
+              return maxX(a) > maxX(b);
+            });
+  for (const QVector<int> &holeRing : holeRings)
+    bridgeHole(points, ring, holeRing);
+
+  // Ear clipping over a circular linked list of ring positions
+  int count = ring.size();
+  QVector<int> prev(count), next(count);
+  for (int i = 0; i < count; i++) {
+    prev[i] = (i + count - 1) % count;
+    next[i] = (i + 1) % count;
+  }
+
+  auto remove = [&](int node) {
+    next[prev[node]] = next[node];
+    prev[next[node]] = prev[node];
+    count--;
+  };
+
+  auto isEar = [&](int node) {
+    const QPointF &a = points[ring[prev[node]]];
+    const QPointF &b = points[ring[node]];
+    const QPointF &c = points[ring[next[node]]];
+    if (cross(a, b, c) <= 0.0)
+      return false;
+    for (int p = next[next[node]]; p != prev[node]; p = next[p]) {
+      const QPointF &point = points[ring[p]];
+      if (point == a || point == b || point == c)
+        continue; // Bridge copies of the triangle's own corners
+      if (pointInTriangle(point, a, b, c))
+        return false;
+    }
+    return true;
+  };
+
+  bool simple = true;
+  int node = 0;
+  int stalled = 0;
+  while (count > 3) {
+    const QPointF &a = points[ring[prev[node]]];
+    const QPointF &b = points[ring[node]];
+    const QPointF &c = points[ring[next[node]]];
+
+    // Collinear or spike vertices add no area
+    if (qFuzzyIsNull(cross(a, b, c))) {
+      int following = next[node];
+      remove(node);
+      node = following;
+      stalled = 0;
+      continue;
+    }
+
+    if (isEar(node) || stalled > count) {
+      // A full lap without ears means self-intersection: clip anyway so the
+      // area is still covered
+      if (stalled > count)
+        simple = false;
+      indices << ring[prev[node]] << ring[node] << ring[next[node]];
+      int following = next[node];
+      remove(node);
+      node = following;
+      stalled = 0;
+      continue;
+    }
+
+    node = next[node];
+    stalled++;
+  }
+
+  if (!qFuzzyIsNull(cross(points[ring[prev[node]]], points[ring[node]],
+                          points[ring[next[node]]])))
+    indices << ring[prev[node]] << ring[node] << ring[next[node]];
+
+  return simple;
+}
@@ -0,0 +1,26 @@
+#ifndef POLYGONTRIANGULATOR_H
+#define POLYGONTRIANGULATOR_H
+
+#include <QPointF>
+#include <QVector>
+
+/**
+ * PolygonTriangulator - Ear clipping for sector floors and ceilings
+ *
+ * Triangulates a simple polygon of any winding, convex or not, with optional
+ * holes (child sectors). Holes are first joined to the outer boundary with
+ * bridge edges, so triangles only reference input points: outer vertices are
+ * numbered first, then each hole's vertices in order.
+ */
+class PolygonTriangulator {
+public:
+  // Appends three indices per triangle, counter-clockwise in the map plane.
+  // Holes that are degenerate or not inside the outer polygon are ignored.
+  // Returns false if the polygon self-intersects; the output then still
+  // covers it, but triangles may overlap.
+  static bool triangulate(const QVector<QPointF> &outer,
+                          const QVector<QVector<QPointF>> &holes,
+                          QVector<quint32> &indices);
+};
+
+#endif // POLYGONTRIANGULATOR_H
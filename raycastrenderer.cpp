@@ -1,13 +1,48 @@
 #include "raycastrenderer.h"
 #include <QDebug>
+#include <QRunnable>
+#include <QThread>
+#include <QThreadPool>
 #include <QtMath>
+#include <cfloat>
 #include <cmath>
+#include <cstdint>
+#include <cstring>
+
+// Pool task: claims column tiles until the frame is done
+class RaycastRenderer::TileWorker : public QRunnable
+{
+public:
+    TileWorker(RaycastRenderer *renderer, TileContext *context)
+        : m_renderer(renderer)
+        , m_context(context)
+    {
+        setAutoDelete(true);
+    }
+    
+    void run() override
+    {
+        m_renderer->renderTiles(*m_context);
+    }
+
+private:
+    RaycastRenderer *m_renderer;
+    TileContext *m_context;
+};
 
 RaycastRenderer::RaycastRenderer()
     : m_shaderProgram(nullptr)
-    , m_stripVBO(nullptr)
-    , m_stripVAO(nullptr)
-    , m_defaultTexture(nullptr)
+    , m_quadVBO(nullptr)
+    , m_quadVAO(nullptr)
+    , m_frameTexture(nullptr)
+    , m_framePixels(nullptr)
+    , m_frameStride(0)
+    , m_threadPool(new QThreadPool())
+    , m_nextTile(0)
+    , m_tileCount(0)
+    , m_tileWidth(0)
+    , m_threadCount(0)
+    , m_deterministic(false)
     , m_cameraX(0.0f)
     , m_cameraY(0.0f)
     , m_cameraZ(32.0f)
@@ -16,14 +51,34 @@ RaycastRenderer::RaycastRenderer()
     , m_screenWidth(800)
     , m_screenHeight(600)
     , m_fov(M_PI / 3.0f) // 60 degrees
+    , m_projDist(1.0f)
+    , m_horizonY(300.0f)
+    , m_forwardX(1.0f)
+    , m_forwardZ(0.0f)
     , m_currentSector(-1)
     , m_initialized(false)
 {
+    // Default texture (white 1x1) for missing texture IDs
+    m_defaultTexture = QImage(1, 1, QImage::Format_RGB32);
+    m_defaultTexture.fill(Qt::white);
+    
+    // Workers stay alive between frames
+    m_threadPool->setExpiryTimeout(-1);
+    setThreadCount(0);
 }
 
 RaycastRenderer::~RaycastRenderer()
 {
     cleanup();
+    delete m_threadPool;
+}
+
+void RaycastRenderer::setThreadCount(int threads)
+{
+    m_threadCount = qMax(0, threads);
+    int effective = m_threadCount > 0 ? m_threadCount : QThread::idealThreadCount();
+    // The calling thread renders tiles too
+    m_threadPool->setMaxThreadCount(qMax(1, effective - 1));
 }
 
 bool RaycastRenderer::initialize()
@@ -34,11 +89,8 @@ bool RaycastRenderer::initialize()
     
     initializeOpenGLFunctions();
     
-    // Enable depth testing
-    glEnable(GL_DEPTH_TEST);
-    glDepthFunc(GL_LESS);
-    
-    // Disable back-face culling
+    // The frame is presented as a single screen-space quad
+    glDisable(GL_DEPTH_TEST);
     glDisable(GL_CULL_FACE);
     
     // Create shaders
@@ -47,18 +99,18 @@ bool RaycastRenderer::initialize()
         return false;
     }
     
-    // Create VBO for strip rendering
-    m_stripVBO = new QOpenGLBuffer(QOpenGLBuffer::VertexBuffer);
-    m_stripVBO->create();
-    m_stripVBO->bind();
-    m_stripVBO->setUsagePattern(QOpenGLBuffer::DynamicDraw);
-    // Allocate space for one vertical strip (6 vertices * 4 floats each)
-    m_stripVBO->allocate(6 * 4 * sizeof(float));
+    // Create VBO for the full screen quad
+    m_quadVBO = new QOpenGLBuffer(QOpenGLBuffer::VertexBuffer);
+    m_quadVBO->create();
+    m_quadVBO->bind();
+    m_quadVBO->setUsagePattern(QOpenGLBuffer::DynamicDraw);
+    // Allocate space for one quad (6 vertices * 4 floats each)
+    m_quadVBO->allocate(6 * 4 * sizeof(float));
     
     // Create VAO
-    m_stripVAO = new QOpenGLVertexArrayObject();
-    m_stripVAO->create();
-    m_stripVAO->bind();
+    m_quadVAO = new QOpenGLVertexArrayObject();
+    m_quadVAO->create();
+    m_quadVAO->bind();
     
     // Position attribute (x, y)
     glEnableVertexAttribArray(0);
@@ -68,15 +120,8 @@ bool RaycastRenderer::initialize()
     glEnableVertexAttribArray(1);
     glVertexAttribPointer(1, 2, GL_FLOAT, GL_FALSE, 4 * sizeof(float), (void*)(2 * sizeof(float)));
     
-    m_stripVAO->release();
-    m_stripVBO->release();
-    
-    // Create default texture
-    QImage defaultImage(1, 1, QImage::Format_RGB888);
-    defaultImage.fill(Qt::white);
-    m_defaultTexture = new QOpenGLTexture(defaultImage);
-    m_defaultTexture->setMinificationFilter(QOpenGLTexture::Nearest);
-    m_defaultTexture->setMagnificationFilter(QOpenGLTexture::Nearest);
+    m_quadVAO->release();
+    m_quadVBO->release();
     
     m_initialized = true;
     qDebug() << "RaycastRenderer initialized successfully";
@@ -92,17 +137,14 @@ void RaycastRenderer::cleanup()
     destroyShaders();
     
     // Clean up OpenGL resources
-    delete m_stripVBO;
-    delete m_stripVAO;
-    
-    for (QOpenGLTexture *texture : m_textures) {
-        delete texture;
-    }
-    m_textures.clear();
-    
-    if (m_defaultTexture) {
-        delete m_defaultTexture;
-        m_defaultTexture = nullptr;
+    delete m_quadVBO;
+    delete m_quadVAO;
+    m_quadVBO = nullptr;
+    m_quadVAO = nullptr;
+    
+    if (m_frameTexture) {
+        delete m_frameTexture;
+        m_frameTexture = nullptr;
     }
     
     m_initialized = false;
@@ -189,28 +231,13 @@ void RaycastRenderer::setCamera(float x, float y, float z, float yaw, float pitc
 
 void RaycastRenderer::loadTexture(int id, const QImage &image)
 {
-    if (!m_initialized) {
-        qWarning() << "Cannot load texture: renderer not initialized";
-        return;
-    }
-    
     if (image.isNull()) {
         qWarning() << "Cannot load texture" << id << ": image is null";
         return;
     }
     
-    // Delete existing texture if present
-    if (m_textures.contains(id)) {
-        delete m_textures[id];
-    }
-    
-    // Create new texture
-    QOpenGLTexture *texture = new QOpenGLTexture(image.mirrored(false, true));
-    texture->setMinificationFilter(QOpenGLTexture::Linear);
-    texture->setMagnificationFilter(QOpenGLTexture::Linear);
-    texture->setWrapMode(QOpenGLTexture::Repeat);
-    
-    m_textures[id] = texture;
+    // Keep a 32-bit copy so the rasterizer can index texels directly
+    m_textures[id] = image.convertToFormat(QImage::Format_RGB32);
 }
 
 void RaycastRenderer::setMapData(const MapData &mapData)
@@ -219,12 +246,17 @@ void RaycastRenderer::setMapData(const MapData &mapData)
     qDebug() << "RaycastRenderer::setMapData() CALLED";
     qDebug() << "========================================";
     
-    if (!m_initialized) {
-        qWarning() << "Cannot set map data: renderer not initialized";
-        return;
+    m_mapData = mapData;
+    
+    // Portals and walls reference sectors by ID, the column walk needs indices
+    m_sectorIndexById.clear();
+    m_sectorIndexById.reserve(m_mapData.sectors.size());
+    for (int i = 0; i < m_mapData.sectors.size(); i++) {
+        m_sectorIndexById.insert(m_mapData.sectors[i].sector_id, i);
     }
+    rebuildPortalIndex();
+    rebuildWallCache();
     
-    m_mapData = mapData;
     m_currentSector = findSectorAt(m_cameraX, m_cameraZ);  // Fixed: use Z not Y
     
     // Debug: Show bounds of first few sectors to understand coordinate system
@@ -285,14 +317,39 @@ void RaycastRenderer::setMapData(const MapData &mapData)
     qDebug() << "Map data loaded:" << mapData.sectors.size() << "sectors";
 }
 
+bool RaycastRenderer::updateSector(const Sector &sector, const QVector<Portal> &portals)
+{
+    int index = m_sectorIndexById.value(sector.sector_id, -1);
+    if (index < 0) {
+        qWarning() << "RaycastRenderer::updateSector: unknown sector" << sector.sector_id;
+        return false;
+    }
+    
+    m_mapData.sectors[index] = sector;
+    
+    // Sector indices do not move, so other sectors' neighbor columns only go
+    // stale when portals were added, removed or relinked. Shared data means
+    // the list is the one already indexed
+    if (portals.constData() != m_mapData.portals.constData()) {
+        m_mapData.portals = portals;
+        rebuildPortalIndex();
+        refreshNeighbors();
+    }
+    rebuildSectorWalls(index);
+    
+    if (index == m_currentSector || m_currentSector < 0) {
+        m_currentSector = findSectorAt(m_cameraX, m_cameraZ);
+    }
+    return true;
+}
+
 void RaycastRenderer::render(int width, int height)
 {
     if (!m_initialized) {
         return;
     }
     
-    m_screenWidth = width;
-    m_screenHeight = height;
+    renderToImage(width, height);
     
     // Set up orthographic projection for 2D screen-space rendering
     m_projectionMatrix.setToIdentity();
@@ -302,15 +359,69 @@ void RaycastRenderer::render(int width, int height)
     glClearColor(0.2f, 0.3f, 0.5f, 1.0f);
     glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
     
+    // (Re)create the frame texture when the viewport size changes
+    if (m_frameTexture && (m_frameTexture->width() != width || m_frameTexture->height() != height)) {
+        delete m_frameTexture;
+        m_frameTexture = nullptr;
+    }
+    if (!m_frameTexture) {
+        m_frameTexture = new QOpenGLTexture(QOpenGLTexture::Target2D);
+        m_frameTexture->setSize(width, height);
+        m_frameTexture->setFormat(QOpenGLTexture::RGBA8_UNorm);
+        m_frameTexture->setMinificationFilter(QOpenGLTexture::Nearest);
+        m_frameTexture->setMagnificationFilter(QOpenGLTexture::Nearest);
+        m_frameTexture->setWrapMode(QOpenGLTexture::ClampToEdge);
+        m_frameTexture->allocateStorage();
+    }
+    
+    // Format_RGB32 is stored as BGRA bytes; row 0 is the top of the screen
+    m_frameTexture->setData(QOpenGLTexture::BGRA, QOpenGLTexture::UInt8, m_frame.constBits());
+    
+    float w = (float)width;
+    float h = (float)height;
+    float vertices[] = {
+        // x, y, u, v
+        0.0f, 0.0f, 0.0f, 0.0f,
+        w,    0.0f, 1.0f, 0.0f,
+        w,    h,    1.0f, 1.0f,
+        
+        0.0f, 0.0f, 0.0f, 0.0f,
+        w,    h,    1.0f, 1.0f,
+        0.0f, h,    0.0f, 1.0f
+    };
+    
     // Use shader program
     m_shaderProgram->bind();
     m_shaderProgram->setUniformValue(m_uniformProjection, m_projectionMatrix);
     m_shaderProgram->setUniformValue(m_uniformTexture, 0);
     
+    m_quadVBO->bind();
+    m_quadVBO->write(0, vertices, sizeof(vertices));
+    m_frameTexture->bind(0);
+    
+    m_quadVAO->bind();
+    glDrawArrays(GL_TRIANGLES, 0, 6);
+    m_quadVAO->release();
+    
+    m_shaderProgram->release();
+}
+
+const QImage &RaycastRenderer::renderToImage(int width, int height)
+{
+    m_screenWidth = qMax(width, 1);
+    m_screenHeight = qMax(height, 1);
+    
+    if (m_frame.width() != m_screenWidth || m_frame.height() != m_screenHeight) {
+        m_frame = QImage(m_screenWidth, m_screenHeight, QImage::Format_RGB32);
+    }
+    
+    // Background (sky / void)
+    m_frame.fill(qRgb(51, 77, 128));
+    
     // Render frame using raycasting
     renderFrame();
     
-    m_shaderProgram->release();
+    return m_frame;
 }
 
 void RaycastRenderer::renderFrame()
@@ -336,250 +447,550 @@ void RaycastRenderer::renderFrame()
         debugOnce = false;
     }
     
-    int totalHits = 0;
+    // Planar projection: the ray for column x is forward + right * offset, so
+    // the ray parameter of a hit is already the perpendicular (fisheye-free)
+    // distance and every screen row maps to a single distance.
+    m_projDist = (m_screenWidth / 2.0f) / tanf(m_fov / 2.0f);
+    m_horizonY = m_screenHeight / 2.0f + m_screenHeight * tanf(m_cameraPitch);
+    m_forwardX = cosf(m_cameraYaw);
+    m_forwardZ = sinf(m_cameraYaw);
+    
+    // Detach once here; tiles write disjoint columns through the raw pointer
+    m_framePixels = reinterpret_cast<QRgb *>(m_frame.bits());
+    m_frameStride = m_frame.bytesPerLine() / sizeof(QRgb);
+    
+    // Split the frame into column tiles, a few per thread for load balancing
+    int threads = m_threadCount > 0 ? m_threadCount : QThread::idealThreadCount();
+    threads = qMax(1, threads);
+    m_tileWidth = qMax(MIN_TILE_WIDTH, (m_screenWidth + threads * 4 - 1) / (threads * 4));
+    m_tileCount = (m_screenWidth + m_tileWidth - 1) / m_tileWidth;
+    threads = qMin(threads, m_tileCount);
+    if (m_contexts.size() < threads) {
+        m_contexts.resize(threads);
+    }
+    m_nextTile = 0;
     
-    // Cast one ray per screen column
-    for (int x = 0; x < m_screenWidth; x++) {
-        // Calculate ray angle
-        float rayAngle = m_cameraYaw - m_fov / 2.0f + (x / (float)m_screenWidth) * m_fov;
-        
-        // Cast ray and get hits
-        QVector<RayHit> hits;
-        castRay(rayAngle, x, hits);
-        
-        if (!hits.isEmpty()) {
-            totalHits++;
-        }
-        
-        // Render this strip
-        renderStrip(x, hits);
+    // Detach here too: workers get plain pointers and never touch the
+    // QVector, whose non-const operator[] would check sharing concurrently
+    TileContext *contexts = m_contexts.data();
+    for (int i = 1; i < threads; i++) {
+        m_threadPool->start(new TileWorker(this, &contexts[i]));
     }
+    renderTiles(contexts[0]);
+    m_threadPool->waitForDone();
     
     static bool debugHits = true;
     if (debugHits) {
-        qDebug() << "Total strips with hits:" << totalHits << "out of" << m_screenWidth;
+        int totalHits = 0;
+        int totalPlanes = 0;
+        for (int i = 0; i < threads; i++) {
+            totalHits += contexts[i].hitColumns;
+            totalPlanes += contexts[i].totalPlanes;
+        }
+        qDebug() << "Total strips with hits:" << totalHits << "out of" << m_screenWidth
+                 << "- visplanes:" << totalPlanes << "- tiles:" << m_tileCount
+                 << "threads:" << threads;
         debugHits = false;
     }
 }
 
-void RaycastRenderer::castRay(float angle, int stripX, QVector<RayHit> &hits)
+void RaycastRenderer::renderTiles(TileContext &ctx)
 {
-    // Ray direction in XZ plane (2D top-down)
-    float rayDirX = cosf(angle);
-    float rayDirZ = sinf(angle);
-    
-    // Ray origin and end in XZ plane
-    QPointF rayStart(m_cameraX, m_cameraZ);
-    QPointF rayEnd(m_cameraX + rayDirX * 10000.0f, m_cameraZ + rayDirZ * 10000.0f);
+    ctx.hitColumns = 0;
+    ctx.totalPlanes = 0;
     
-    // Check all walls in current sector
-    if (m_currentSector < 0 || m_currentSector >= m_mapData.sectors.size()) {
-        return;
+    for (;;) {
+        int tile = m_nextTile.fetch_add(1);
+        if (tile >= m_tileCount) {
+            break;
+        }
+        int x0 = tile * m_tileWidth;
+        renderTile(ctx, x0, qMin(x0 + m_tileWidth, m_screenWidth));
+    }
+}
+
+void RaycastRenderer::renderTile(TileContext &ctx, int x0, int x1)
+{
+    float rightX = -m_forwardZ;
+    float rightZ = m_forwardX;
+    
+    // Reset visplanes
+    ctx.x0 = x0;
+    ctx.x1 = x1;
+    ctx.planeCount = 0;
+    ctx.planeIndexByKey.clear();
+    if (ctx.spanStart.size() < m_screenHeight) {
+        ctx.spanStart.resize(m_screenHeight);
+    }
+    if (ctx.hits.capacity() < MAX_PORTAL_DEPTH) {
+        ctx.hits.reserve(MAX_PORTAL_DEPTH);
     }
     
-    const Sector &sector = m_mapData.sectors[m_currentSector];
-    
-    static bool debugFirstRay = true;
-    
-    for (const Wall &wall : sector.walls) {
-        QPointF wallStart(wall.x1, wall.y1);
-        QPointF wallEnd(wall.x2, wall.y2);
-        QPointF intersection;
+    // Cast one ray per screen column, drawing walls and collecting planes
+    for (int x = x0; x < x1; x++) {
+        float offset = (x + 0.5f - m_screenWidth / 2.0f) / m_projDist;
         
-        if (lineIntersect(rayStart, rayEnd, wallStart, wallEnd, intersection)) {
-            if (debugFirstRay && stripX == m_screenWidth / 2) {
-                qDebug() << "Center ray hit wall at" << intersection << "distance from camera";
-            }
-            
-            RayHit hit;
-            
-            // Calculate distance (with fisheye correction) in XZ plane
-            float dx = intersection.x() - m_cameraX;
-            float dz = intersection.y() - m_cameraZ;  // QPointF.y() is our Z coordinate
-            hit.distance = dx * cosf(m_cameraYaw) + dz * sinf(m_cameraYaw);
-            
-            if (hit.distance < 0.1f) continue; // Too close
-            
-            hit.hitX = intersection.x();
-            hit.hitY = intersection.y();
-            
-            // Calculate texture U coordinate
-            float wallLength = sqrtf(powf(wall.x2 - wall.x1, 2) + powf(wall.y2 - wall.y1, 2));
-            float hitDist = sqrtf(powf(intersection.x() - wall.x1, 2) + powf(intersection.y() - wall.y1, 2));
-            hit.texU = hitDist / wallLength;
-            
-            // Wall height
-            hit.wallHeight = sector.ceiling_z - sector.floor_z;
-            
-            // Texture
-            hit.textureId = wall.texture_id_middle;
-            
-            // Portal info
-            hit.isPortal = (wall.portal_id >= 0);
-            if (hit.isPortal && wall.portal_id < m_mapData.portals.size()) {
-                const Portal &portal = m_mapData.portals[wall.portal_id];
-                hit.portalSectorId = (portal.sector_a == m_currentSector) ? portal.sector_b : portal.sector_a;
-            } else {
-                hit.portalSectorId = -1;
-            }
-            
-            hits.append(hit);
+        ctx.hits.clear();
+        castRay(m_forwardX + rightX * offset, m_forwardZ + rightZ * offset, ctx.hits);
+        
+        if (!ctx.hits.isEmpty()) {
+            ctx.hitColumns++;
         }
+        
+        // Render this strip
+        renderStrip(ctx, x, ctx.hits);
     }
     
-    if (debugFirstRay && stripX == m_screenWidth / 2) {
-        qDebug() << "Center ray found" << hits.size() << "hits";
-        debugFirstRay = false;
-    }
-    
-    // Sort hits by distance
-    std::sort(hits.begin(), hits.end(), [](const RayHit &a, const RayHit &b) {
-        return a.distance < b.distance;
-    });
+    // Floors and ceilings as horizontal spans
+    drawPlanes(ctx);
+    ctx.totalPlanes += ctx.planeCount;
 }
 
-void RaycastRenderer::renderStrip(int x, const QVector<RayHit> &hits)
+void RaycastRenderer::castRay(float rayDirX, float rayDirZ, QVector<RayHit> &hits) const
 {
-    const Sector &sector = m_mapData.sectors[m_currentSector];
-    
-    if (hits.isEmpty()) {
+    if (m_currentSector < 0 || m_currentSector >= m_mapData.sectors.size()) {
         return;
     }
     
-    // Render closest hit
-    const RayHit &hit = hits.first();
-    
-    // Calculate screen distance for perspective
-    float screenDist = (m_screenWidth / 2.0f) / tanf(m_fov / 2.0f);
-    
-    // Calculate wall heights relative to camera
-    float wallFloorHeight = sector.floor_z - m_cameraY;
-    float wallCeilingHeight = sector.ceiling_z - m_cameraY;
+    // Column span buffer: rows [clipTop, clipBottom) are still unfilled
+    int clipTop = 0;
+    int clipBottom = m_screenHeight;
     
-    // Project heights to screen space
-    float wallFloorScreen = (screenDist / hit.distance) * wallFloorHeight;
-    float wallCeilingScreen = (screenDist / hit.distance) * wallCeilingHeight;
-    
-    // Apply pitch offset (looking up/down)
-    float pitchOffset = m_screenHeight * tanf(m_cameraPitch);
-    
-    // Calculate final screen Y coordinates
-    float wallTop = m_screenHeight / 2.0f - wallCeilingScreen + pitchOffset;
-    float wallBottom = m_screenHeight / 2.0f - wallFloorScreen + pitchOffset;
+    // Clamp in float space first so near-plane projections cannot overflow int
+    auto clipRow = [&clipTop, &clipBottom](float y) {
+        return (int)ceilf(qBound((float)clipTop, y, (float)clipBottom));
+    };
     
-    // Calculate ray angle for this column
-    float columnAngle = m_cameraYaw - m_fov / 2.0f + (x / (float)m_screenWidth) * m_fov;
-    float rayDirX = cosf(columnAngle);
-    float rayDirZ = sinf(columnAngle);
+    int sectorIndex = m_currentSector;
+    int entryPortalId = -1;
+    float lastDistance = 0.0f;
     
-    // Render ceiling with proper perspective
-    if (wallTop > 0 && sector.ceiling_texture_id > 0) {
-        for (int y = 0; y < wallTop && y < m_screenHeight; y++) {
-            // Calculate distance to ceiling at this screen Y
-            float screenY = y - m_screenHeight / 2.0f - pitchOffset;
-            float ceilingDist = screenDist * wallCeilingHeight / screenY;
+    for (int depth = 0; depth < MAX_PORTAL_DEPTH; depth++) {
+        const Sector &sector = m_mapData.sectors[sectorIndex];
+        
+        const SectorWalls &walls = m_wallCache[sectorIndex];
+        const float *wallX1 = walls.x1.constData();
+        const float *wallY1 = walls.y1.constData();
+        const float *wallDX = walls.dx.constData();
+        const float *wallDY = walls.dy.constData();
+        const int *wallPortal = walls.portalId.constData();
+        
+        // Find the nearest wall in front of the ray, ignoring the portal we
+        // just came through. Each batch is computed branch-free so the
+        // compiler can vectorize it, then reduced with a scalar scan.
+        int bestWall = -1;
+        float bestT = FLT_MAX;
+        float bestS = 0.0f;
+        
+        for (int base = 0; base < walls.count; base += WALL_BATCH) {
+            float batchT[WALL_BATCH];
+            float batchS[WALL_BATCH];
             
-            if (ceilingDist > 0 && ceilingDist < 10000.0f) {
-                // Calculate world position
-                float worldX = m_cameraX + rayDirX * ceilingDist;
-                float worldZ = m_cameraZ + rayDirZ * ceilingDist;
+            for (int k = 0; k < WALL_BATCH; k++) {
+                int i = base + k;
+                float ex = wallDX[i];
+                float ez = wallDY[i];
+                float denom = rayDirX * ez - rayDirZ * ex;
+                bool parallel = fabsf(denom) < 0.0001f;
+                float invDenom = 1.0f / (parallel ? 1.0f : denom);
                 
-                // Calculate texture coordinates (tile every 64 units)
-                float texU = fmodf(worldX / 64.0f, 1.0f);
-                float texV = fmodf(worldZ / 64.0f, 1.0f);
-                if (texU < 0) texU += 1.0f;
-                if (texV < 0) texV += 1.0f;
+                float wx = wallX1[i] - m_cameraX;
+                float wz = wallY1[i] - m_cameraZ;
+                float t = (wx * ez - wz * ex) * invDenom;
+                float s = (wx * rayDirZ - wz * rayDirX) * invDenom;
                 
-                // Render single pixel
-                renderWallStrip(x, y, y + 1, texU, sector.ceiling_texture_id);
+                bool valid = !parallel && s >= 0.0f && s <= 1.0f && t >= lastDistance
+                             && (entryPortalId < 0 || wallPortal[i] != entryPortalId);
+                batchT[k] = valid ? t : FLT_MAX;
+                batchS[k] = s;
             }
+            
+            for (int k = 0; k < WALL_BATCH; k++) {
+                if (batchT[k] < bestT) {
+                    bestWall = base + k;
+                    bestT = batchT[k];
+                    bestS = batchS[k];
+                }
+            }
+        }
+        
+        if (bestWall < 0) {
+            break; // Open sector, nothing more to draw in this column
+        }
+        
+        RayHit hit;
+        hit.distance = qMax(bestT, 0.1f);
+        hit.hitX = m_cameraX + rayDirX * bestT;
+        hit.hitY = m_cameraZ + rayDirZ * bestT;
+        hit.texU = bestS * walls.length[bestWall];
+        hit.sectorIndex = sectorIndex;
+        hit.neighborIndex = walls.neighborIndex[bestWall];
+        
+        hit.ceilingY = projectHeight(sector.ceiling_z, hit.distance);
+        hit.floorY = projectHeight(sector.floor_z, hit.distance);
+        int ceilingRow = clipRow(hit.ceilingY);
+        int floorRow = qMax(clipRow(hit.floorY), ceilingRow);
+        
+        hit.ceilingTop = clipTop;
+        hit.ceilingBottom = ceilingRow;
+        hit.floorTop = floorRow;
+        hit.floorBottom = clipBottom;
+        hit.lowerTop = hit.lowerBottom = 0;
+        
+        if (hit.neighborIndex < 0) {
+            // Solid wall closes the column
+            hit.neighborCeilingY = hit.ceilingY;
+            hit.neighborFloorY = hit.floorY;
+            hit.upperTop = ceilingRow;
+            hit.upperBottom = floorRow;
+            hit.upperTextureId = walls.textureMiddle[bestWall];
+            hit.lowerTextureId = walls.textureMiddle[bestWall];
+            hits.append(hit);
+            break;
+        }
+        
+        const Sector &neighbor = m_mapData.sectors[hit.neighborIndex];
+        hit.neighborCeilingY = projectHeight(neighbor.ceiling_z, hit.distance);
+        hit.neighborFloorY = projectHeight(neighbor.floor_z, hit.distance);
+        int neighborCeilingRow = qBound(ceilingRow, clipRow(hit.neighborCeilingY), floorRow);
+        int neighborFloorRow = qBound(ceilingRow, clipRow(hit.neighborFloorY), floorRow);
+        
+        // Upper step: neighbor ceiling is lower than ours
+        hit.upperTop = ceilingRow;
+        hit.upperBottom = neighbor.ceiling_z < sector.ceiling_z ? neighborCeilingRow : ceilingRow;
+        hit.upperTextureId = walls.textureUpper[bestWall];
+        
+        // Lower step: neighbor floor is higher than ours
+        hit.lowerTop = neighbor.floor_z > sector.floor_z ? neighborFloorRow : floorRow;
+        hit.lowerBottom = floorRow;
+        hit.lowerTextureId = walls.textureLower[bestWall];
+        
+        hits.append(hit);
+        
+        // Narrow the window to what is visible through the portal opening
+        clipTop = qMax(hit.upperBottom, clipTop);
+        clipBottom = qMin(hit.lowerTop, clipBottom);
+        if (clipTop >= clipBottom) {
+            break; // Column is full
         }
+        
+        entryPortalId = walls.portalId[bestWall];
+        lastDistance = bestT;
+        sectorIndex = hit.neighborIndex;
+    }
+}
+
+void RaycastRenderer::renderStrip(TileContext &ctx, int x, const QVector<RayHit> &hits)
+{
+    for (const RayHit &hit : hits) {
+        const Sector &sector = m_mapData.sectors[hit.sectorIndex];
+        
+        // Ceiling and floor rows are only recorded here, drawPlanes() fills them
+        if (sector.ceiling_texture_id > 0 && hit.ceilingTop < hit.ceilingBottom) {
+            addPlaneColumn(ctx, sector.ceiling_z, sector.ceiling_texture_id, x,
+                           hit.ceilingTop, hit.ceilingBottom - 1);
+        }
+        if (sector.floor_texture_id > 0 && hit.floorTop < hit.floorBottom) {
+            addPlaneColumn(ctx, sector.floor_z, sector.floor_texture_id, x,
+                           hit.floorTop, hit.floorBottom - 1);
+        }
+        
+        // Render wall strips (texture stretched over the unclipped section)
+        if (hit.upperTop < hit.upperBottom) {
+            float bottom = hit.neighborIndex < 0 ? hit.floorY : hit.neighborCeilingY;
+            drawWallColumn(x, hit.upperTop, hit.upperBottom, hit.texU,
+                           hit.ceilingY, bottom, hit.upperTextureId);
+        }
+        if (hit.lowerTop < hit.lowerBottom) {
+            drawWallColumn(x, hit.lowerTop, hit.lowerBottom, hit.texU,
+                           hit.neighborFloorY, hit.floorY, hit.lowerTextureId);
+        }
+    }
+}
+
+void RaycastRenderer::drawWallColumn(int x, int y1, int y2, float texU, float topY, float bottomY,
+                                     int textureId) const
+{
+    const QImage &texture = textureFor(textureId);
+    const int texW = texture.width();
+    const int texH = texture.height();
+    const QRgb *texels = reinterpret_cast<const QRgb *>(texture.constBits());
+    
+    // Texture column (wraps every WALL_TILE_SIZE world units)
+    int texX = (int)floorf(texU / WALL_TILE_SIZE * texW) % texW;
+    if (texX < 0) texX += texW;
+    
+    // 16.16 fixed-point V stepping down the column
+    float span = qMax(bottomY - topY, 1.0f);
+    float step = texH / span;
+    uint32_t v = (uint32_t)(qMax(y1 + 0.5f - topY, 0.0f) * step * 65536.0f);
+    uint32_t vStep = (uint32_t)(step * 65536.0f);
+    
+    QRgb *dst = m_framePixels + y1 * m_frameStride + x;
+    for (int y = y1; y < y2; y++) {
+        int texY = qMin((int)(v >> 16), texH - 1);
+        *dst = texels[texY * texW + texX];
+        dst += m_frameStride;
+        v += vStep;
+    }
+}
+
+void RaycastRenderer::addPlaneColumn(TileContext &ctx, float height, int textureId, int x,
+                                     int top, int bottom)
+{
+    quint32 heightBits;
+    memcpy(&heightBits, &height, sizeof(heightBits));
+    quint64 key = ((quint64)heightBits << 32) | (quint32)textureId;
+    
+    // Reuse a plane with the same height/texture whose column is still free,
+    // or whose range touches this one (same floor seen through a portal)
+    const int column = x - ctx.x0 + 1;
+    int index = ctx.planeIndexByKey.value(key, -1);
+    int last = -1;
+    while (index >= 0) {
+        VisPlane &plane = ctx.planes[index];
+        int planeTop = plane.top[column];
+        int planeBottom = plane.bottom[column];
+        if (planeTop > planeBottom) {
+            break;
+        }
+        if (planeTop == bottom + 1 || planeBottom + 1 == top) {
+            plane.top[column] = qMin(planeTop, top);
+            plane.bottom[column] = qMax(planeBottom, bottom);
+            return;
+        }
+        last = index;
+        index = plane.next;
     }
     
-    // Render wall strip
-    if (!hit.isPortal || hit.portalSectorId < 0) {
-        renderWallStrip(x, wallTop, wallBottom, hit.texU, hit.textureId);
-    } else {
-        renderWallStrip(x, wallTop, wallBottom, hit.texU, hit.textureId);
+    if (index < 0) {
+        if (ctx.planeCount == ctx.planes.size()) {
+            ctx.planes.append(VisPlane());
+        }
+        index = ctx.planeCount++;
+        
+        VisPlane &plane = ctx.planes[index];
+        plane.height = height;
+        plane.textureId = textureId;
+        plane.minX = ctx.x1;
+        plane.maxX = ctx.x0 - 1;
+        plane.next = -1;
+        // Empty columns have top > bottom, including the two sentinels
+        plane.top.fill(m_screenHeight, ctx.x1 - ctx.x0 + 2);
+        plane.bottom.fill(-1, ctx.x1 - ctx.x0 + 2);
+        
+        if (last >= 0) {
+            ctx.planes[last].next = index;
+        } else {
+            ctx.planeIndexByKey.insert(key, index);
+        }
     }
     
-    // Render floor with proper perspective
-    if (wallBottom < m_screenHeight && sector.floor_texture_id > 0) {
-        for (int y = qMax(0, (int)wallBottom); y < m_screenHeight; y++) {
-            // Calculate distance to floor at this screen Y
-            float screenY = y - m_screenHeight / 2.0f - pitchOffset;
-            float floorDist = screenDist * wallFloorHeight / screenY;
+    VisPlane &plane = ctx.planes[index];
+    plane.top[column] = top;
+    plane.bottom[column] = bottom;
+    plane.minX = qMin(plane.minX, x);
+    plane.maxX = qMax(plane.maxX, x);
+}
+
+void RaycastRenderer::drawPlanes(TileContext &ctx)
+{
+    for (int p = 0; p < ctx.planeCount; p++) {
+        const VisPlane &plane = ctx.planes[p];
+        if (plane.minX > plane.maxX) {
+            continue;
+        }
+        
+        const QImage &texture = textureFor(plane.textureId);
+        
+        // Walk the column ranges left to right; a row opens a span when it
+        // enters the plane and is drawn in one go once it leaves it
+        for (int x = plane.minX; x <= plane.maxX + 1; x++) {
+            int column = x - ctx.x0 + 1;
+            int t1 = plane.top[column - 1];
+            int b1 = plane.bottom[column - 1];
+            int t2 = plane.top[column];
+            int b2 = plane.bottom[column];
             
-            if (floorDist > 0 && floorDist < 10000.0f) {
-                // Calculate world position
-                float worldX = m_cameraX + rayDirX * floorDist;
-                float worldZ = m_cameraZ + rayDirZ * floorDist;
-                
-                // Calculate texture coordinates (tile every 64 units)
-                float texU = fmodf(worldX / 64.0f, 1.0f);
-                float texV = fmodf(worldZ / 64.0f, 1.0f);
-                if (texU < 0) texU += 1.0f;
-                if (texV < 0) texV += 1.0f;
-                
-                // Render single pixel
-                renderWallStrip(x, y, y + 1, texU, sector.floor_texture_id);
+            while (t1 < t2 && t1 <= b1) {
+                drawSpan(plane, texture, t1, ctx.spanStart[t1], x - 1);
+                t1++;
+            }
+            while (b1 > b2 && b1 >= t1) {
+                drawSpan(plane, texture, b1, ctx.spanStart[b1], x - 1);
+                b1--;
+            }
+            while (t2 < t1 && t2 <= b2) {
+                ctx.spanStart[t2] = x;
+                t2++;
+            }
+            while (b2 > b1 && b2 >= t2) {
+                ctx.spanStart[b2] = x;
+                b2--;
             }
         }
     }
 }
 
-void RaycastRenderer::renderWallStrip(int x, float y1, float y2, float texU, int textureId)
+void RaycastRenderer::drawSpan(const VisPlane &plane, const QImage &texture, int y, int x1,
+                               int x2) const
 {
-    // Create quad for this vertical strip
-    float vertices[] = {
-        // x, y, u, v
-        (float)x,     y1, texU, 0.0f,
-        (float)x + 1, y1, texU, 0.0f,
-        (float)x + 1, y2, texU, 1.0f,
-        
-        (float)x,     y1, texU, 0.0f,
-        (float)x + 1, y2, texU, 1.0f,
-        (float)x,     y2, texU, 1.0f
-    };
-    
-    // Update VBO
-    m_stripVBO->bind();
-    m_stripVBO->write(0, vertices, sizeof(vertices));
-    
-    // Bind texture
-    QOpenGLTexture *tex = m_textures.value(textureId, m_defaultTexture);
-    if (tex) tex->bind(0);
+    // One distance per scanline
+    float dy = y + 0.5f - m_horizonY;
+    if (fabsf(dy) < 0.01f) {
+        return;
+    }
+    float rowDist = m_projDist * (plane.height - m_cameraY) / -dy;
+    if (rowDist <= 0.0f || rowDist > MAX_DRAW_DISTANCE) {
+        return;
+    }
     
-    // Draw
-    m_stripVAO->bind();
-    glDrawArrays(GL_TRIANGLES, 0, 6);
-    m_stripVAO->release();
+    const int texW = texture.width();
+    const int texH = texture.height();
+    const QRgb *texels = reinterpret_cast<const QRgb *>(texture.constBits());
+    const float scaleU = texW / FLAT_TILE_SIZE;
+    const float scaleV = texH / FLAT_TILE_SIZE;
+    
+    // Per-pixel step of the world position along the row
+    float stepX = rowDist * -m_forwardZ / m_projDist;
+    float stepZ = rowDist * m_forwardX / m_projDist;
+    int64_t du = (int64_t)(stepX * scaleU * 65536.0f);
+    int64_t dv = (int64_t)(stepZ * scaleV * 65536.0f);
+    
+    // Texel coordinates in 16.16 fixed point. Deterministic mode starts from
+    // column 0 and steps in integers, so a pixel's texel only depends on its
+    // (x, y) and not on where the span (or tile) begins.
+    int startX = m_deterministic ? 0 : x1;
+    float offset = (startX + 0.5f - m_screenWidth / 2.0f) / m_projDist;
+    float worldX = m_cameraX + rowDist * (m_forwardX - m_forwardZ * offset);
+    float worldZ = m_cameraZ + rowDist * (m_forwardZ + m_forwardX * offset);
+    
+    // Wrap the start into the texture and bias it by a whole number of
+    // repeats so the accumulators stay positive for the whole row
+    float u0 = fmodf(worldX * scaleU, (float)texW);
+    float v0 = fmodf(worldZ * scaleV, (float)texH);
+    if (u0 < 0) u0 += texW;
+    if (v0 < 0) v0 += texH;
+    int64_t u = ((int64_t)texW << 40) + (int64_t)(u0 * 65536.0f) + du * (x1 - startX);
+    int64_t v = ((int64_t)texH << 40) + (int64_t)(v0 * 65536.0f) + dv * (x1 - startX);
+    
+    QRgb *dst = m_framePixels + y * m_frameStride + x1;
+    QRgb *end = dst + (x2 - x1 + 1);
+    
+    if ((texW & (texW - 1)) == 0 && (texH & (texH - 1)) == 0) {
+        const int64_t maskU = texW - 1;
+        const int64_t maskV = texH - 1;
+        while (dst < end) {
+            *dst++ = texels[((v >> 16) & maskV) * texW + ((u >> 16) & maskU)];
+            u += du;
+            v += dv;
+        }
+    } else {
+        while (dst < end) {
+            *dst++ = texels[((v >> 16) % texH) * texW + ((u >> 16) % texW)];
+            u += du;
+            v += dv;
+        }
+    }
+}
+
+const QImage &RaycastRenderer::textureFor(int textureId) const
+{
+    QMap<int, QImage>::const_iterator it = m_textures.constFind(textureId);
+    return it != m_textures.constEnd() ? it.value() : m_defaultTexture;
 }
 
 // Geometry helper functions
 
-bool RaycastRenderer::lineIntersect(QPointF p1, QPointF p2, QPointF p3, QPointF p4, QPointF &intersection)
+void RaycastRenderer::rebuildWallCache()
 {
-    float x1 = p1.x(), y1 = p1.y();
-    float x2 = p2.x(), y2 = p2.y();
-    float x3 = p3.x(), y3 = p3.y();
-    float x4 = p4.x(), y4 = p4.y();
-    
-    float denom = (x1 - x2) * (y3 - y4) - (y1 - y2) * (x3 - x4);
-    if (fabs(denom) < 0.0001f) {
-        return false; // Parallel lines
+    m_wallCache.resize(m_mapData.sectors.size());
+    for (int i = 0; i < m_mapData.sectors.size(); i++) {
+        rebuildSectorWalls(i);
+    }
+}
+
+void RaycastRenderer::rebuildSectorWalls(int sectorIndex)
+{
+    const Sector &sector = m_mapData.sectors[sectorIndex];
+    SectorWalls &walls = m_wallCache[sectorIndex];
+    
+    int count = sector.walls.size();
+    int padded = (count + WALL_BATCH - 1) / WALL_BATCH * WALL_BATCH;
+    walls.count = count;
+    walls.x1.fill(0.0f, padded);
+    walls.y1.fill(0.0f, padded);
+    walls.dx.fill(0.0f, padded);
+    walls.dy.fill(0.0f, padded);
+    walls.length.fill(0.0f, padded);
+    walls.portalId.fill(-1, padded);
+    walls.neighborIndex.fill(-1, padded);
+    walls.textureUpper.fill(0, padded);
+    walls.textureMiddle.fill(0, padded);
+    walls.textureLower.fill(0, padded);
+    
+    for (int i = 0; i < count; i++) {
+        const Wall &wall = sector.walls[i];
+        float dx = wall.x2 - wall.x1;
+        float dy = wall.y2 - wall.y1;
+        
+        walls.x1[i] = wall.x1;
+        walls.y1[i] = wall.y1;
+        walls.dx[i] = dx;
+        walls.dy[i] = dy;
+        walls.length[i] = sqrtf(dx * dx + dy * dy);
+        walls.portalId[i] = wall.portal_id;
+        walls.neighborIndex[i] = findNeighborSector(sectorIndex, wall.portal_id);
+        
+        // Steps fall back to the middle texture, resolved once here
+        walls.textureMiddle[i] = wall.texture_id_middle;
+        walls.textureUpper[i] = wall.texture_id_upper > 0 ? wall.texture_id_upper : wall.texture_id_middle;
+        walls.textureLower[i] = wall.texture_id_lower > 0 ? wall.texture_id_lower : wall.texture_id_middle;
+    }
+}
+
+void RaycastRenderer::rebuildPortalIndex()
+{
+    m_portalIndexById.clear();
+    m_portalIndexById.reserve(m_mapData.portals.size());
+    for (int i = 0; i < m_mapData.portals.size(); i++) {
+        m_portalIndexById.insert(m_mapData.portals[i].portal_id, i);
+    }
+}
+
+// Re-resolves the sector behind every portal wall; wall geometry is kept
+void RaycastRenderer::refreshNeighbors()
+{
+    for (int s = 0; s < m_wallCache.size(); s++) {
+        SectorWalls &walls = m_wallCache[s];
+        for (int i = 0; i < walls.count; i++) {
+            walls.neighborIndex[i] = findNeighborSector(s, walls.portalId[i]);
+        }
+    }
+}
+
+int RaycastRenderer::findNeighborSector(int sectorIndex, int portalId) const
+{
+    if (portalId < 0) {
+        return -1;
     }
     
-    float t = ((x1 - x3) * (y3 - y4) - (y1 - y3) * (x3 - x4)) / denom;
-    float u = -((x1 - x2) * (y1 - y3) - (y1 - y2) * (x1 - x3)) / denom;
-    
-    if (t >= 0.0f && t <= 1.0f && u >= 0.0f && u <= 1.0f) {
-        intersection.setX(x1 + t * (x2 - x1));
-        intersection.setY(y1 + t * (y2 - y1));
-        return true;
+    int portalIndex = m_portalIndexById.value(portalId, -1);
+    if (portalIndex < 0) {
+        return -1; // Dangling portal, treat as solid
     }
     
-    return false;
+    const Portal &portal = m_mapData.portals[portalIndex];
+    int sectorId = m_mapData.sectors[sectorIndex].sector_id;
+    int neighborId = (portal.sector_a == sectorId) ? portal.sector_b : portal.sector_a;
+    
+    int neighborIndex = m_sectorIndexById.value(neighborId, -1);
+    return neighborIndex == sectorIndex ? -1 : neighborIndex;
+}
+
+float RaycastRenderer::projectHeight(float worldZ, float distance) const
+{
+    return m_horizonY - (worldZ - m_cameraY) * m_projDist / distance;
 }
 
 float RaycastRenderer::pointToLineDistance(QPointF point, QPointF lineStart, QPointF lineEnd)
@@ -7,14 +7,20 @@
 #include <QOpenGLVertexArrayObject>
 #include <QOpenGLTexture>
 #include <QMatrix4x4>
+#include <QHash>
+#include <QImage>
 #include <QMap>
 #include <QVector>
 #include <QPointF>
+#include <atomic>
 #include "mapdata.h"
 
+class QThreadPool;
+
 /**
- * Pure OpenGL raycasting renderer - no BennuGD2 dependencies
- * Implements Build Engine-style portal rendering
+ * Software raycasting renderer - no BennuGD2 dependencies
+ * Implements Build Engine-style portal rendering into a CPU framebuffer.
+ * OpenGL is only used to present the finished frame as a single textured quad.
  */
 class RaycastRenderer : protected QOpenGLFunctions
 {
@@ -26,54 +32,176 @@ public:
     void cleanup();
     
     void setMapData(const MapData &mapData);
+    // Replace one sector (matched by sector_id) and rebuild only its wall
+    // table. portals is the map's current portal list: when it changed, the
+    // portal index and every sector's neighbor column are refreshed too
+    bool updateSector(const Sector &sector, const QVector<Portal> &portals);
     void loadTexture(int id, const QImage &image);
     
     void setCamera(float x, float y, float z, float yaw, float pitch);
     void render(int width, int height);
     
+    // Software path: raycast into the CPU framebuffer without touching OpenGL
+    const QImage &renderToImage(int width, int height);
+    
+    // Column tiles are rendered on a persistent worker pool.
+    // 0 = one thread per core (QThread::idealThreadCount), 1 = serial.
+    void setThreadCount(int threads);
+    int threadCount() const { return m_threadCount; }
+    
+    // Deterministic mode anchors floor/ceiling texture stepping to screen
+    // column 0, so the frame is byte-identical for any thread/tile layout.
+    // Otherwise spans step from their first pixel and may differ by one
+    // texel at tile seams.
+    void setDeterministic(bool deterministic) { m_deterministic = deterministic; }
+    bool isDeterministic() const { return m_deterministic; }
+    
     // Camera getters (for retrieving auto-positioned camera)
     float getCameraX() const { return m_cameraX; }
     float getCameraY() const { return m_cameraY; }
     float getCameraZ() const { return m_cameraZ; }
-    
+
 private:
+    // Maximum number of portals a single column may cross
+    static const int MAX_PORTAL_DEPTH = 64;
+    
+    // Wall tables are padded to a multiple of this so the intersection loop
+    // always runs on full batches
+    static const int WALL_BATCH = 8;
+    
+    // Narrowest column tile handed to a worker
+    static const int MIN_TILE_WIDTH = 16;
+    
+    // Floors/ceilings tile every FLAT_TILE_SIZE world units, walls every
+    // WALL_TILE_SIZE units horizontally (same as VisualRenderer)
+    static constexpr float FLAT_TILE_SIZE = 64.0f;
+    static constexpr float WALL_TILE_SIZE = 128.0f;
+    static constexpr float MAX_DRAW_DISTANCE = 10000.0f;
+    
     // Raycasting structures
+    // One RayHit per wall crossed by a column, front to back. Screen rows are
+    // already clipped against the column span buffer (top/bottom window left
+    // open by the nearer portals), so empty ranges have top >= bottom.
     struct RayHit {
-        float distance;
+        float distance;      // Perpendicular distance to the wall
         float hitX, hitY;
-        float wallHeight;
-        float texU;
+        float texU;          // World units along the wall from (x1, y1)
+        int sectorIndex;     // Sector the ray was travelling through
+        int neighborIndex;   // Sector behind a portal wall (-1 = solid)
+        
+        // Unclipped projected heights (for texture V mapping)
+        float ceilingY, floorY;
+        float neighborCeilingY, neighborFloorY;
+        
+        // Clipped row ranges [top, bottom)
+        int ceilingTop, ceilingBottom;  // Ceiling of sectorIndex
+        int upperTop, upperBottom;      // Upper step, or full wall if solid
+        int lowerTop, lowerBottom;      // Lower step (portals only)
+        int floorTop, floorBottom;      // Floor of sectorIndex
+        
+        int upperTextureId;
+        int lowerTextureId;
+    };
+    
+    // Visible floor or ceiling area sharing height and texture, stored as one
+    // inclusive row range per tile column (index x - x0 + 1, with empty
+    // sentinel columns at both ends). Converted to horizontal spans after the
+    // tile's walls.
+    struct VisPlane {
+        float height;
         int textureId;
-        bool isPortal;
-        int portalSectorId;
+        int minX, maxX;
+        int next;            // Next plane with the same key, -1 = none
+        QVector<int> top;
+        QVector<int> bottom;
+    };
+    
+    // Per-sector wall table in structure-of-arrays form, built once from the
+    // map so castRay does not touch Wall/QPointF. Padding walls are zero
+    // length and never hit.
+    struct SectorWalls {
+        int count;           // Real walls, arrays are padded past this
+        QVector<float> x1, y1;
+        QVector<float> dx, dy;
+        QVector<float> length;
+        QVector<int> portalId;
+        QVector<int> neighborIndex;    // Sector index behind the wall, -1 = solid
+        QVector<int> textureUpper, textureMiddle, textureLower;
+        
+        SectorWalls() : count(0) {}
     };
     
+    // Per-thread scratch, reused between frames to avoid allocations
+    struct TileContext {
+        QVector<RayHit> hits;
+        QVector<VisPlane> planes;
+        int planeCount;
+        QHash<quint64, int> planeIndexByKey;
+        QVector<int> spanStart;
+        int x0, x1;          // Columns [x0, x1) of the current tile
+        int hitColumns;      // Stats for the last frame
+        int totalPlanes;
+        
+        TileContext() : planeCount(0), x0(0), x1(0), hitColumns(0), totalPlanes(0) {}
+    };
+    
+    class TileWorker;
+    
     // Rendering functions
     bool createShaders();
     void destroyShaders();
     
     void renderFrame();
-    void castRay(float angle, int stripX, QVector<RayHit> &hits);
-    void renderStrip(int x, const QVector<RayHit> &hits);
-    void renderWallStrip(int x, float y1, float y2, float texU, int textureId);
+    void renderTiles(TileContext &ctx);
+    void renderTile(TileContext &ctx, int x0, int x1);
+    void castRay(float rayDirX, float rayDirZ, QVector<RayHit> &hits) const;
+    void renderStrip(TileContext &ctx, int x, const QVector<RayHit> &hits);
+    void drawWallColumn(int x, int y1, int y2, float texU, float topY, float bottomY,
+                        int textureId) const;
+    
+    // Floor/ceiling span rasterizer
+    void addPlaneColumn(TileContext &ctx, float height, int textureId, int x, int top, int bottom);
+    void drawPlanes(TileContext &ctx);
+    void drawSpan(const VisPlane &plane, const QImage &texture, int y, int x1, int x2) const;
+    const QImage &textureFor(int textureId) const;
     
     // Geometry helpers
-    bool lineIntersect(QPointF p1, QPointF p2, QPointF p3, QPointF p4, QPointF &intersection);
+    void rebuildWallCache();
+    void rebuildSectorWalls(int sectorIndex);
+    void rebuildPortalIndex();
+    void refreshNeighbors();
+    int findNeighborSector(int sectorIndex, int portalId) const;
+    float projectHeight(float worldZ, float distance) const;
     float pointToLineDistance(QPointF point, QPointF lineStart, QPointF lineEnd);
     int findSectorAt(float x, float y);
     bool pointInPolygon(float x, float y, const QVector<QPointF> &polygon);
     
     // OpenGL resources
     QOpenGLShaderProgram *m_shaderProgram;
-    QOpenGLBuffer *m_stripVBO;
-    QOpenGLVertexArrayObject *m_stripVAO;
-    QMap<int, QOpenGLTexture*> m_textures;
-    QOpenGLTexture *m_defaultTexture;
+    QOpenGLBuffer *m_quadVBO;
+    QOpenGLVertexArrayObject *m_quadVAO;
+    QOpenGLTexture *m_frameTexture;
     
     // Shader uniforms
     int m_uniformProjection;
     int m_uniformTexture;
     
+    // Software framebuffer and textures (Format_RGB32)
+    QImage m_frame;
+    QRgb *m_framePixels;    // Detached once per frame, shared by all tiles
+    int m_frameStride;      // In pixels
+    QMap<int, QImage> m_textures;
+    QImage m_defaultTexture;
+    
+    // Column tiles
+    QThreadPool *m_threadPool;
+    QVector<TileContext> m_contexts;
+    std::atomic<int> m_nextTile;
+    int m_tileCount;
+    int m_tileWidth;
+    int m_threadCount;
+    bool m_deterministic;
+    
     // Camera state
     float m_cameraX;
     float m_cameraY;
@@ -86,10 +214,21 @@ private:
     int m_screenWidth;
     int m_screenHeight;
     float m_fov;
+    float m_projDist;   // Distance to the projection plane, in pixels
+    float m_horizonY;   // Screen row of the horizon (pitch applied)
+    float m_forwardX;   // Camera forward vector in the XZ plane
+    float m_forwardZ;
     
     // Map data
     MapData m_mapData;
-    int m_currentSector;
+    int m_currentSector;  // Index into m_mapData.sectors
+    
+    // ID -> index lookups for portal traversal
+    QHash<int, int> m_sectorIndexById;
+    QHash<int, int> m_portalIndexById;
+    
+    // Wall tables, parallel to m_mapData.sectors
+    QVector<SectorWalls> m_wallCache;
     
     // State
     bool m_initialized;
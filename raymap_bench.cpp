@@ -0,0 +1,613 @@
+/*
+ * raymap_bench - headless renderer benchmark
+ *
+ * Loads a .raymap, flies the camera along a path and renders every frame
+ * offscreen, then prints frame time statistics as JSON so runs can be
+ * compared between commits.
+ *
+ *   raymap_bench map.raymap [--path flight.campath] [--fpg textures.fpg]
+ *                [--renderer raycast|visual|both] [--frames 300]
+ *                [--no-culling] [--deterministic] [--self-test]
+ *                [--sector-updates]
+ *
+ * --deterministic renders the raycaster in deterministic mode and checks a
+ * few frames of the path byte for byte against a single-threaded render;
+ * the exit code is 2 when any of them differs.
+ *
+ * --self-test round-trips the map through every save format (v32, gzip,
+ * chunked v33) in a temporary directory, checks that a chunk with a bad
+ * CRC and a truncated chunked file are rejected, and exits with code 3 when
+ * a check fails. Maps are compared through their v32 encoding, which is
+ * what the engine reads.
+ *
+ * --sector-updates edits a few sectors through RaycastRenderer::updateSector
+ * (the last one with a new portal list), renders the same frames as a
+ * renderer given the edited map with setMapData, and exits with code 4
+ * when they differ. Both timings are reported.
+ *
+ * No window is opened. On headless machines use QT_QPA_PLATFORM=offscreen
+ * for the raycaster; the visual renderer needs an OpenGL 3.3 context, use
+ * LIBGL_ALWAYS_SOFTWARE=1 (Mesa llvmpipe) when there is no GPU.
+ */
+
+#include "camerapath.h"
+#include "camerapathio.h"
+#include "fpgloader.h"
+#include "mapdata.h"
+#include "raycastrenderer.h"
+#include "raymapformat.h"
+#include "visualrenderer.h"
+#include <QApplication>
+#include <QCommandLineParser>
+#include <QElapsedTimer>
+#include <QFile>
+#include <QJsonArray>
+#include <QJsonDocument>
+#include <QJsonObject>
+#include <QOffscreenSurface>
+#include <QOpenGLContext>
+#include <QOpenGLFramebufferObject>
+#include <QOpenGLFunctions>
+#include <QSurfaceFormat>
+#include <QTemporaryDir>
+#include <QtMath>
+#include <algorithm>
+#include <cstdio>
+
+namespace {
+
+struct BenchOptions {
+  int frames;
+  int warmup;
+  int width;
+  int height;
+  float fps; // Path time advanced per frame is 1 / fps
+  int threads;
+  bool culling; // Visual renderer frustum/portal culling
+  bool deterministic; // Raycaster deterministic mode, checked per thread
+};
+
+// Frames compared against the single-threaded render in deterministic mode
+const int DETERMINISTIC_CHECKS = 8;
+// Sectors edited by --sector-updates
+const int SECTOR_UPDATES = 16;
+
+void loadTextures(RaycastRenderer &renderer, const MapData &mapData) {
+  for (const TextureEntry &entry : mapData.textures)
+    renderer.loadTexture(entry.id, entry.pixmap.toImage());
+}
+
+// Renders the same path frames with both renderers, returns how many differ
+int compareFrames(RaycastRenderer &a, RaycastRenderer &b,
+                  const CameraPath &path, const BenchOptions &options,
+                  int checks) {
+  int mismatches = 0;
+  for (int i = 0; i < checks; i++) {
+    int frame = i * options.frames / checks;
+    float x, y, z, yaw, pitch;
+    cameraAt(path, frame / options.fps, x, y, z, yaw, pitch);
+    a.setCamera(x, y, z, yaw, pitch);
+    b.setCamera(x, y, z, yaw, pitch);
+
+    QImage first = a.renderToImage(options.width, options.height);
+    if (first != b.renderToImage(options.width, options.height)) {
+      qWarning() << "raymap_bench: frame" << frame << "differs";
+      mismatches++;
+    }
+  }
+  return mismatches;
+}
+
+// Frame times in milliseconds
+QJsonObject frameStats(QVector<double> times) {
+  QJsonObject stats;
+  if (times.isEmpty())
+    return stats;
+
+  std::sort(times.begin(), times.end());
+  double total = 0.0;
+  for (double t : times)
+    total += t;
+
+  int count = times.size();
+  int p99 = qBound(0, (int)ceil(count * 0.99) - 1, count - 1);
+  stats["frames"] = count;
+  stats["min_ms"] = times.first();
+  stats["avg_ms"] = total / count;
+  stats["p99_ms"] = times[p99];
+  stats["max_ms"] = times.last();
+  stats["total_ms"] = total;
+  return stats;
+}
+
+// Keyframe heights are map Z, renderers take (x, height, y)
+void cameraAt(const CameraPath &path, float time, float &x, float &y,
+              float &z, float &yaw, float &pitch) {
+  CameraKeyframe kf = path.interpolateAt(time);
+  x = kf.x;
+  y = kf.z;
+  z = kf.y;
+  yaw = qDegreesToRadians(kf.yaw);
+  pitch = qDegreesToRadians(kf.pitch);
+}
+
+// Fallback flight when no path is given: visit sector centers in order,
+// one second per hop, looking towards the next stop
+CameraPath defaultPath(const MapData &mapData) {
+  CameraPath path;
+  path.setInterpolation(InterpolationType::LINEAR);
+  path.setLoop(true);
+
+  QVector<CameraKeyframe> stops;
+  for (const Sector &sector : mapData.sectors) {
+    if (sector.vertices.isEmpty())
+      continue;
+    QPointF center;
+    for (const QPointF &v : sector.vertices)
+      center += v;
+    center /= sector.vertices.size();
+    stops.append(CameraKeyframe(center.x(), center.y(),
+                                sector.floor_z + 32.0f));
+    if (stops.size() == 16)
+      break;
+  }
+
+  for (int i = 0; i < stops.size(); i++) {
+    const CameraKeyframe &next = stops[(i + 1) % stops.size()];
+    stops[i].yaw =
+        qRadiansToDegrees(atan2f(next.y - stops[i].y, next.x - stops[i].x));
+    stops[i].time = i;
+    path.addKeyframe(stops[i]);
+  }
+  return path;
+}
+
+QJsonObject benchRaycast(const MapData &mapData, const CameraPath &path,
+                         const BenchOptions &options) {
+  RaycastRenderer renderer;
+  renderer.setThreadCount(options.threads);
+  renderer.setDeterministic(options.deterministic);
+  loadTextures(renderer, mapData);
+  renderer.setMapData(mapData);
+
+  QVector<double> times;
+  times.reserve(options.frames);
+  QElapsedTimer timer;
+
+  for (int frame = -options.warmup; frame < options.frames; frame++) {
+    float x, y, z, yaw, pitch;
+    cameraAt(path, qMax(0, frame) / options.fps, x, y, z, yaw, pitch);
+    renderer.setCamera(x, y, z, yaw, pitch);
+
+    timer.start();
+    renderer.renderToImage(options.width, options.height);
+    double ms = timer.nsecsElapsed() / 1e6;
+    if (frame >= 0)
+      times.append(ms);
+  }
+
+  QJsonObject result = frameStats(times);
+  double seconds = result["total_ms"].toDouble() / 1000.0;
+  double rays = (double)options.width * result["frames"].toInt();
+  result["threads"] = options.threads;
+  result["rays_per_second"] = seconds > 0.0 ? rays / seconds : 0.0;
+  result["deterministic"] = options.deterministic;
+  if (!options.deterministic)
+    return result;
+
+  // Same frames on one thread must come out identical
+  RaycastRenderer reference;
+  reference.setThreadCount(1);
+  reference.setDeterministic(true);
+  loadTextures(reference, mapData);
+  reference.setMapData(mapData);
+
+  int checks = qMin(DETERMINISTIC_CHECKS, options.frames);
+  result["deterministic_checks"] = checks;
+  result["deterministic_mismatches"] =
+      compareFrames(renderer, reference, path, options, checks);
+  return result;
+}
+
+QJsonObject benchSectorUpdates(const MapData &mapData, const CameraPath &path,
+                               const BenchOptions &options) {
+  QJsonObject result;
+  RaycastRenderer updated;
+  updated.setThreadCount(options.threads);
+  loadTextures(updated, mapData);
+  updated.setMapData(mapData);
+
+  // Raise a few sectors spread over the map, floor and ceiling together
+  MapData edited = mapData;
+  int count = qMin(SECTOR_UPDATES, (int)edited.sectors.size());
+  QElapsedTimer timer;
+  double updateMs = 0.0;
+  for (int i = 0; i < count; i++) {
+    Sector &sector = edited.sectors[i * edited.sectors.size() / count];
+    sector.floor_z += 8.0f;
+    sector.ceiling_z += 8.0f;
+    sector.light_level = qMax(0, sector.light_level - 32);
+    // The last update also hands over a new portal list
+    if (i == count - 1)
+      edited.portals.detach();
+
+    timer.start();
+    updated.updateSector(sector, edited.portals);
+    updateMs += timer.nsecsElapsed() / 1e6;
+  }
+
+  RaycastRenderer reloaded;
+  reloaded.setThreadCount(options.threads);
+  loadTextures(reloaded, edited);
+  timer.start();
+  reloaded.setMapData(edited);
+  double setMapDataMs = timer.nsecsElapsed() / 1e6;
+
+  int checks = qMin(DETERMINISTIC_CHECKS, options.frames);
+  result["sectors_updated"] = count;
+  result["update_sector_ms"] = updateMs;
+  result["set_map_data_ms"] = setMapDataMs;
+  result["checks"] = checks;
+  result["mismatches"] =
+      compareFrames(updated, reloaded, path, options, checks);
+  return result;
+}
+
+QJsonObject benchVisual(const MapData &mapData, const CameraPath &path,
+                        const BenchOptions &options) {
+  QJsonObject result;
+
+  QSurfaceFormat format;
+  format.setVersion(3, 3);
+  format.setProfile(QSurfaceFormat::CoreProfile);
+  format.setDepthBufferSize(24);
+
+  QOpenGLContext context;
+  context.setFormat(format);
+  if (!context.create()) {
+    qWarning() << "raymap_bench: could not create an OpenGL context";
+    result["error"] = "no OpenGL context";
+    return result;
+  }
+
+  QOffscreenSurface surface;
+  surface.setFormat(context.format());
+  surface.create();
+  if (!context.makeCurrent(&surface)) {
+    qWarning() << "raymap_bench: could not make the OpenGL context current";
+    result["error"] = "makeCurrent failed";
+    return result;
+  }
+
+  QOpenGLFunctions *gl = context.functions();
+  QVector<double> times;
+  double triangles = 0.0;
+  double drawCalls = 0.0;
+  double textureBinds = 0.0;
+  double sectorsDrawn = 0.0;
+  double sectorsCulled = 0.0;
+  double entitiesDrawn = 0.0;
+  double entitiesCulled = 0.0;
+
+  {
+    QOpenGLFramebufferObject fbo(
+        options.width, options.height,
+        QOpenGLFramebufferObject::CombinedDepthStencil);
+    fbo.bind();
+    gl->glViewport(0, 0, options.width, options.height);
+
+    VisualRenderer renderer;
+    if (!renderer.initialize()) {
+      result["error"] = "renderer initialization failed";
+      context.doneCurrent();
+      return result;
+    }
+    renderer.setCullingEnabled(options.culling);
+    for (const TextureEntry &entry : mapData.textures)
+      renderer.loadTexture(entry.id, entry.pixmap.toImage());
+    renderer.setMapData(mapData);
+
+    times.reserve(options.frames);
+    QElapsedTimer timer;
+
+    for (int frame = -options.warmup; frame < options.frames; frame++) {
+      float x, y, z, yaw, pitch;
+      cameraAt(path, qMax(0, frame) / options.fps, x, y, z, yaw, pitch);
+      renderer.setCamera(x, y, z, yaw, pitch);
+
+      timer.start();
+      renderer.render(options.width, options.height);
+      gl->glFinish(); // Count GPU (or llvmpipe) time, not just submission
+      double ms = timer.nsecsElapsed() / 1e6;
+      if (frame >= 0) {
+        times.append(ms);
+        const VisualRenderer::FrameStats &stats = renderer.frameStats();
+        triangles += stats.triangles;
+        drawCalls += stats.drawCalls;
+        textureBinds += stats.textureBinds;
+        sectorsDrawn += stats.sectorsDrawn;
+        sectorsCulled += stats.sectorsCulled;
+        entitiesDrawn += stats.entitiesDrawn;
+        entitiesCulled += stats.entitiesCulled;
+      }
+    }
+
+    renderer.cleanup();
+    fbo.release();
+  }
+
+  result = frameStats(times);
+  double seconds = result["total_ms"].toDouble() / 1000.0;
+  result["renderer_string"] = QString(
+      reinterpret_cast<const char *>(gl->glGetString(GL_RENDERER)));
+  result["triangles_per_second"] = seconds > 0.0 ? triangles / seconds : 0.0;
+  int frames = qMax(1, result["frames"].toInt());
+  result["avg_triangles"] = triangles / frames;
+  result["avg_draw_calls"] = drawCalls / frames;
+  result["avg_texture_binds"] = textureBinds / frames;
+  result["culling"] = options.culling;
+  result["avg_sectors_drawn"] = sectorsDrawn / frames;
+  result["avg_sectors_culled"] = sectorsCulled / frames;
+  result["avg_entities_drawn"] = entitiesDrawn / frames;
+  result["avg_entities_culled"] = entitiesCulled / frames;
+
+  context.doneCurrent();
+  return result;
+}
+
+QByteArray readFile(const QString &filename) {
+  QFile file(filename);
+  return file.open(QIODevice::ReadOnly) ? file.readAll() : QByteArray();
+}
+
+bool writeFile(const QString &filename, const QByteArray &data) {
+  QFile file(filename);
+  return file.open(QIODevice::WriteOnly) && file.write(data) == data.size();
+}
+
+// v32 encoding of the map stored in filename, empty if it does not load
+QByteArray reencode(const QString &filename, const QString &scratch) {
+  MapData loaded;
+  if (!RayMapFormat::loadMap(filename, loaded) ||
+      !RayMapFormat::saveMap(scratch, loaded))
+    return QByteArray();
+  return readFile(scratch);
+}
+
+QJsonObject selfTest(const MapData &mapData) {
+  QJsonObject result;
+  QTemporaryDir dir;
+  if (!dir.isValid()) {
+    QJsonArray failed;
+    failed.append("temporary_directory");
+    result["failed"] = failed;
+    return result;
+  }
+  const QString v32 = dir.filePath("map.raymap");
+  const QString gzip = dir.filePath("map.gz.raymap");
+  const QString v33 = dir.filePath("map.v33.raymap");
+  const QString scratch = dir.filePath("scratch.raymap");
+
+  // Saving what a load returns is the reference: loading may normalize
+  // IDs and links, a second round trip must not change anything
+  MapData loaded;
+  bool saved = RayMapFormat::saveMap(v32, mapData) &&
+               RayMapFormat::loadMap(v32, loaded) &&
+               RayMapFormat::saveMap(v32, loaded);
+  QByteArray reference = saved ? readFile(v32) : QByteArray();
+  result["v32"] = !reference.isEmpty() && reencode(v32, scratch) == reference;
+
+  result["gzip"] =
+      RayMapFormat::saveMap(gzip, loaded, nullptr,
+                            RayMapFormat::DefaultCompression) &&
+      !reference.isEmpty() && reencode(gzip, scratch) == reference;
+
+  MapData chunked;
+  bool v33Saved = RayMapFormat::saveChunkedMap(v33, loaded);
+  QByteArray v33Bytes = v33Saved ? readFile(v33) : QByteArray();
+  result["v33"] = v33Saved && !reference.isEmpty() &&
+                  reencode(v33, scratch) == reference &&
+                  RayMapFormat::loadMap(v33, chunked) &&
+                  RayMapFormat::saveChunkedMap(scratch, chunked) &&
+                  readFile(scratch) == v33Bytes;
+
+  // The last byte belongs to the payload of the last chunk
+  MapData rejected;
+  QByteArray corrupt = v33Bytes;
+  if (!corrupt.isEmpty())
+    corrupt[corrupt.size() - 1] = ~corrupt[corrupt.size() - 1];
+  result["bad_crc_rejected"] = !corrupt.isEmpty() &&
+                               writeFile(scratch, corrupt) &&
+                               !RayMapFormat::loadMap(scratch, rejected);
+
+  QByteArray truncated = v33Bytes.left(v33Bytes.size() - 2);
+  result["truncated_rejected"] = !v33Bytes.isEmpty() &&
+                                 writeFile(scratch, truncated) &&
+                                 !RayMapFormat::loadMap(scratch, rejected);
+
+  QJsonArray failed;
+  for (auto it = result.constBegin(); it != result.constEnd(); ++it) {
+    if (!it.value().toBool())
+      failed.append(it.key());
+  }
+  result["failed"] = failed;
+  return result;
+}
+
+} // namespace
+
+int main(int argc, char *argv[]) {
+  // Renderers log every frame, keep the console readable
+  qputenv("QT_LOGGING_RULES", "default.debug=false");
+
+  QApplication app(argc, argv);
+  app.setApplicationName("raymap_bench");
+
+  QCommandLineParser parser;
+  parser.setApplicationDescription("Headless RayMap renderer benchmark");
+  parser.addHelpOption();
+  parser.addPositionalArgument("map", "Map file (.raymap)");
+  QCommandLineOption pathOption("path", "Camera path (.campath) to fly.",
+                                "file");
+  QCommandLineOption fpgOption("fpg", "FPG with the map textures.", "file");
+  QCommandLineOption rendererOption(
+      "renderer", "raycast, visual or both (default raycast).", "name",
+      "raycast");
+  QCommandLineOption framesOption("frames", "Measured frames (default 300).",
+                                  "n", "300");
+  QCommandLineOption warmupOption("warmup", "Unmeasured frames (default 10).",
+                                  "n", "10");
+  QCommandLineOption widthOption("width", "Frame width (default 640).", "px",
+                                 "640");
+  QCommandLineOption heightOption("height", "Frame height (default 480).",
+                                  "px", "480");
+  QCommandLineOption fpsOption("fps", "Path time step, frames per second "
+                                      "(default 60).",
+                               "n", "60");
+  QCommandLineOption threadsOption(
+      "threads", "Raycaster threads, 0 = one per core (default 0).", "n", "0");
+  QCommandLineOption noCullingOption(
+      "no-culling", "Draw every sector and entity in the visual renderer.");
+  QCommandLineOption deterministicOption(
+      "deterministic", "Raycaster deterministic mode, checked against a "
+                       "single-threaded render.");
+  QCommandLineOption sectorUpdatesOption(
+      "sector-updates", "Check RaycastRenderer::updateSector against a full "
+                        "setMapData.");
+  QCommandLineOption selfTestOption(
+      "self-test", "Round-trip the map through every save format.");
+  QCommandLineOption outputOption("output", "Write JSON here, not stdout.",
+                                  "file");
+  parser.addOption(pathOption);
+  parser.addOption(fpgOption);
+  parser.addOption(rendererOption);
+  parser.addOption(framesOption);
+  parser.addOption(warmupOption);
+  parser.addOption(widthOption);
+  parser.addOption(heightOption);
+  parser.addOption(fpsOption);
+  parser.addOption(threadsOption);
+  parser.addOption(noCullingOption);
+  parser.addOption(deterministicOption);
+  parser.addOption(selfTestOption);
+  parser.addOption(sectorUpdatesOption);
+  parser.addOption(outputOption);
+  parser.process(app);
+
+  if (parser.positionalArguments().size() != 1) {
+    parser.showHelp(1);
+  }
+
+  BenchOptions options;
+  options.frames = qMax(1, parser.value(framesOption).toInt());
+  options.warmup = qMax(0, parser.value(warmupOption).toInt());
+  options.width = qMax(16, parser.value(widthOption).toInt());
+  options.height = qMax(16, parser.value(heightOption).toInt());
+  options.fps = qMax(1.0f, parser.value(fpsOption).toFloat());
+  options.threads = qMax(0, parser.value(threadsOption).toInt());
+  options.culling = !parser.isSet(noCullingOption);
+  options.deterministic = parser.isSet(deterministicOption);
+
+  QString rendererName = parser.value(rendererOption);
+  if (rendererName != "raycast" && rendererName != "visual" &&
+      rendererName != "both") {
+    fprintf(stderr, "Unknown renderer: %s\n", qPrintable(rendererName));
+    return 1;
+  }
+
+  QString mapFile = parser.positionalArguments().first();
+  MapData mapData;
+  QElapsedTimer loadTimer;
+  loadTimer.start();
+  if (!RayMapFormat::loadMap(mapFile, mapData)) {
+    fprintf(stderr, "Could not load map: %s\n", qPrintable(mapFile));
+    return 1;
+  }
+  double loadMs = loadTimer.nsecsElapsed() / 1e6;
+
+  // What the code generator reads: only the entity chunk on v33 maps
+  MapData entityData;
+  loadTimer.restart();
+  bool entitiesLoaded = RayMapFormat::loadMapChunks(
+      mapFile, entityData, RayMapFormat::ChunkEntities);
+  double entitiesLoadMs = loadTimer.nsecsElapsed() / 1e6;
+
+  double fpgLoadMs = -1;
+  double fpgIndexMs = -1;
+  if (parser.isSet(fpgOption)) {
+    // What opening the map costs: index plus the textures it references
+    QVector<FPGIndexEntry> fpgIndex;
+    QVector<FPGImage> usedImages;
+    loadTimer.restart();
+    FPGLoader::indexFPG(parser.value(fpgOption), fpgIndex, &usedImages,
+                        mapData.textureIds());
+    fpgIndexMs = loadTimer.nsecsElapsed() / 1e6;
+
+    loadTimer.restart();
+    if (!FPGLoader::loadFPG(parser.value(fpgOption), mapData.textures)) {
+      fprintf(stderr, "Could not load FPG: %s\n",
+              qPrintable(parser.value(fpgOption)));
+      return 1;
+    }
+    fpgLoadMs = loadTimer.nsecsElapsed() / 1e6;
+  }
+
+  CameraPath path;
+  if (parser.isSet(pathOption)) {
+    bool ok = false;
+    path = CameraPathIO::load(parser.value(pathOption), &ok);
+    if (!ok || path.keyframeCount() == 0) {
+      fprintf(stderr, "Could not load camera path: %s\n",
+              qPrintable(parser.value(pathOption)));
+      return 1;
+    }
+  } else {
+    path = defaultPath(mapData);
+  }
+
+  QJsonObject report;
+  report["map"] = mapFile;
+  report["sectors"] = (int)mapData.sectors.size();
+  report["portals"] = (int)mapData.portals.size();
+  report["textures"] = (int)mapData.textures.size();
+  report["width"] = options.width;
+  report["height"] = options.height;
+  report["load_ms"] = loadMs;
+  if (fpgLoadMs >= 0)
+    report["fpg_load_ms"] = fpgLoadMs;
+  if (fpgIndexMs >= 0)
+    report["fpg_index_ms"] = fpgIndexMs;
+  report["chunked"] = RayMapFormat::isChunkedMap(mapFile);
+  if (entitiesLoaded)
+    report["entities_load_ms"] = entitiesLoadMs;
+
+  if (parser.isSet(selfTestOption))
+    report["self_test"] = selfTest(mapData);
+  if (rendererName == "raycast" || rendererName == "both")
+    report["raycast"] = benchRaycast(mapData, path, options);
+  if (parser.isSet(sectorUpdatesOption))
+    report["sector_updates"] = benchSectorUpdates(mapData, path, options);
+  if (rendererName == "visual" || rendererName == "both")
+    report["visual"] = benchVisual(mapData, path, options);
+
+  QByteArray json = QJsonDocument(report).toJson(QJsonDocument::Indented);
+  if (parser.isSet(outputOption)) {
+    QFile file(parser.value(outputOption));
+    if (!file.open(QIODevice::WriteOnly)) {
+      fprintf(stderr, "Could not write %s\n",
+              qPrintable(parser.value(outputOption)));
+      return 1;
+    }
+    file.write(json);
+  } else {
+    fwrite(json.constData(), 1, json.size(), stdout);
+  }
+
+  if (report["raycast"].toObject()["deterministic_mismatches"].toInt() > 0)
+    return 2;
+  if (!report["self_test"].toObject()["failed"].toArray().isEmpty())
+    return 3;
+  if (report["sector_updates"].toObject()["mismatches"].toInt() > 0)
+    return 4;
+  return 0;
+}
@@ -40,6 +40,12 @@ HEADERS += \
     insertboxdialog.h \
     mainwindow.h \
     mapdata.h \
+    mapspatialindex.h \
+    mapundo.h \
+    mapsaveservice.h \
+    maploader.h \
+    fpgtextureprovider.h \
+    textureregistry.h \
     md3generator.h \
     md3loader.h \
     meshgeneratordialog.h \
@@ -47,6 +53,7 @@ HEADERS += \
     newprojectdialog.h \
     objimportdialog.h \
     objtomd3converter.h \
+    polygontriangulator.h \
     processgenerator.h \
     projectmanager.h \
     projectsettingsdialog.h \
@@ -96,6 +103,12 @@ SOURCES += \
     mainwindow_build.cpp \
     mainwindow_darkmode.cpp \
     mainwindow_project.cpp \
+    mapspatialindex.cpp \
+    mapundo.cpp \
+    mapsaveservice.cpp \
+    maploader.cpp \
+    fpgtextureprovider.cpp \
+    textureregistry.cpp \
     md3generator.cpp \
     md3loader.cpp \
     meshgeneratordialog.cpp \
@@ -103,6 +116,7 @@ SOURCES += \
     newprojectdialog.cpp \
     objimportdialog.cpp \
     objtomd3converter.cpp \
+    polygontriangulator.cpp \
     processgenerator.cpp \
     projectmanager.cpp \
     projectsettingsdialog.cpp \
@@ -6,220 +6,1764 @@
 
 #include "raymapformat.h"
 #include "mapdata.h"
+#include <QBuffer>
 #include <QDataStream>
 #include <QDebug>
 #include <QFile>
 #include <QFileInfo>
 #include <QMap>
+#include <QMultiHash>
+#include <QSaveFile>
+#include <QSet>
 #include <cstring>
+#include <zlib.h>
 
 RayMapFormat::RayMapFormat() {}
 
-/* ============================================================================
-   MAP LOADING
-   ============================================================================
- */
+namespace {
+
+// Safety limits against corrupt files
+const uint32_t MAX_SECTOR_VERTICES = 10000;
+const uint32_t MAX_SECTOR_WALLS = 32768;
+
+// Smallest on-disk records, to bound header counts by the file size
+const qint64 MIN_SECTOR_BYTES = 40;
+const qint64 PORTAL_BYTES = 36;
+const qint64 SPRITE_BYTES = 28;
+const qint64 SPAWN_FLAG_BYTES = 16;
+const qint64 MIN_ENTITY_BYTES = 24;
+const qint64 WAYPOINT_BYTES = 24;
+
+/* Bounds-checked little-endian cursor over the whole file in memory. Reads
+   past the end copy what is left, zero the rest and set the status, like
+   QDataStream::ReadPastEnd, so a truncated file cannot read out of bounds. */
+class MapReader {
+public:
+  MapReader(const char *data, qint64 size)
+      : m_data(data), m_size(size), m_pos(0), m_status(QDataStream::Ok) {}
+
+  int readRawData(char *out, int len) {
+    if (len <= 0)
+      return 0;
+    qint64 count = qMin<qint64>(len, m_size - m_pos);
+    memcpy(out, m_data + m_pos, count);
+    if (count < len) {
+      memset(out + count, 0, len - count);
+      m_status = QDataStream::ReadPastEnd;
+    }
+    m_pos += count;
+    return (int)count;
+  }
 
-bool RayMapFormat::loadMap(
-    const QString &filename, MapData &mapData,
-    std::function<void(const QString &)> progressCallback) {
-  QFile file(filename);
-  if (!file.open(QIODevice::ReadOnly)) {
-    qWarning() << "No se pudo abrir el archivo:" << filename;
+  // Pointer to the next bytes without copying, nullptr if fewer are left
+  const char *take(qint64 len) {
+    if (len < 0 || len > m_size - m_pos) {
+      m_pos = m_size;
+      m_status = QDataStream::ReadPastEnd;
+      return nullptr;
+    }
+    const char *p = m_data + m_pos;
+    m_pos += len;
+    return p;
+  }
+
+  template <class T> T read() {
+    T value;
+    readRawData(reinterpret_cast<char *>(&value), sizeof(T));
+    return value;
+  }
+
+  // Length-prefixed UTF-8 string
+  QString readString() {
+    uint32_t len = 0;
+    readRawData(reinterpret_cast<char *>(&len), sizeof(uint32_t));
+    const char *p = take(len);
+    return p ? QString::fromUtf8(p, (int)len) : QString();
+  }
+
+  bool atEnd() const { return m_pos >= m_size; }
+  qint64 pos() const { return m_pos; }
+  qint64 size() const { return m_size; }
+  qint64 remaining() const { return m_size - m_pos; }
+  bool seek(qint64 pos) {
+    if (pos < 0 || pos > m_size)
+      return false;
+    m_pos = pos;
+    return true;
+  }
+  QDataStream::Status status() const { return m_status; }
+
+private:
+  const char *m_data;
+  qint64 m_size;
+  qint64 m_pos;
+  QDataStream::Status m_status;
+};
+
+template <class T> T readValue(const char *p) {
+  T value;
+  memcpy(&value, p, sizeof(T));
+  return value;
+}
+
+// Block size for the streaming deflate/inflate of compressed maps
+const int GZIP_CHUNK = 64 * 1024;
+const qint64 MAX_INFLATE_RESERVE = 256 * 1024 * 1024;
+
+bool isGzipData(const char *data, qint64 size) {
+  return size >= 2 && (uchar)data[0] == 0x1f && (uchar)data[1] == 0x8b;
+}
+
+// Inflates a gzip file (compressed saveMap) one block at a time
+bool inflateGzip(const char *data, qint64 size, QByteArray &out) {
+  z_stream strm;
+  memset(&strm, 0, sizeof(strm));
+  if (inflateInit2(&strm, 15 + 16) != Z_OK)
     return false;
+
+  // The gzip trailer holds the inflated size (mod 2^32): a good reserve
+  if (size >= 18)
+    out.reserve((int)qMin<qint64>(readValue<uint32_t>(data + size - 4),
+                                  MAX_INFLATE_RESERVE));
+
+  strm.next_in = reinterpret_cast<Bytef *>(const_cast<char *>(data));
+  strm.avail_in = (uInt)size;
+  QByteArray block(GZIP_CHUNK, Qt::Uninitialized);
+  int ret;
+  do {
+    strm.next_out = reinterpret_cast<Bytef *>(block.data());
+    strm.avail_out = GZIP_CHUNK;
+    ret = inflate(&strm, Z_NO_FLUSH);
+    if (ret != Z_OK && ret != Z_STREAM_END) {
+      inflateEnd(&strm);
+      return false;
+    }
+    out.append(block.constData(), GZIP_CHUNK - (int)strm.avail_out);
+  } while (ret != Z_STREAM_END);
+
+  inflateEnd(&strm);
+  return true;
+}
+
+/* Whole file in memory: mapped when the platform allows, read in one block
+   otherwise. The mapping lives as long as the QFile stays open. Compressed
+   maps are inflated into buffer. */
+bool mapFile(QFile &file, QByteArray &buffer, const char *&data,
+             qint64 &size) {
+  size = file.size();
+  data = size > 0 ? reinterpret_cast<const char *>(file.map(0, size))
+                  : nullptr;
+  if (!data) {
+    buffer = file.readAll();
+    if (buffer.size() != size)
+      return false;
+    data = buffer.constData();
   }
 
-  QDataStream in(&file);
-  in.setByteOrder(QDataStream::LittleEndian);
+  if (isGzipData(data, size)) {
+    QByteArray inflated;
+    if (!inflateGzip(data, size, inflated)) {
+      qWarning() << "Mapa comprimido dañado:" << file.fileName();
+      return false;
+    }
+    buffer.swap(inflated);
+    data = buffer.constData();
+    size = buffer.size();
+  }
+  return true;
+}
 
-  /* Read header */
-  char magic[8];
-  uint32_t version, num_sectors, num_portals, num_sprites, num_spawn_flags;
-  float camera_x, camera_y, camera_z, camera_rot, camera_pitch;
-  int32_t skyTextureID;
-
-  in.readRawData(magic, 8);
-  in.readRawData(reinterpret_cast<char *>(&version), sizeof(uint32_t));
-  in.readRawData(reinterpret_cast<char *>(&num_sectors), sizeof(uint32_t));
-  in.readRawData(reinterpret_cast<char *>(&num_portals), sizeof(uint32_t));
-  in.readRawData(reinterpret_cast<char *>(&num_sprites), sizeof(uint32_t));
-  in.readRawData(reinterpret_cast<char *>(&num_spawn_flags), sizeof(uint32_t));
-  in.readRawData(reinterpret_cast<char *>(&camera_x), sizeof(float));
-  in.readRawData(reinterpret_cast<char *>(&camera_y), sizeof(float));
-  in.readRawData(reinterpret_cast<char *>(&camera_z), sizeof(float));
-  in.readRawData(reinterpret_cast<char *>(&camera_rot), sizeof(float));
-  in.readRawData(reinterpret_cast<char *>(&camera_pitch), sizeof(float));
-  in.readRawData(reinterpret_cast<char *>(&skyTextureID), sizeof(int32_t));
+/* Write-only device that deflates everything written to it into a gzip
+   file. Input is compressed in GZIP_CHUNK blocks and written out as it is
+   produced, so the map is never held in memory twice. */
+class GzipWriter : public QIODevice {
+public:
+  GzipWriter(QIODevice &file, int level)
+      : m_file(file), m_level(level), m_ok(true) {
+    memset(&m_stream, 0, sizeof(m_stream));
+  }
+  ~GzipWriter() override { finish(); }
+
+  bool open(OpenMode mode) override {
+    if (deflateInit2(&m_stream, m_level, Z_DEFLATED, 15 + 16, 8,
+                     Z_DEFAULT_STRATEGY) != Z_OK)
+      return false;
+    m_pending.reserve(GZIP_CHUNK);
+    m_block.resize(GZIP_CHUNK);
+    return QIODevice::open(mode);
+  }
+
+  // Compresses what is pending and writes the gzip trailer
+  bool finish() {
+    if (!isOpen())
+      return m_ok;
+    m_ok = deflateBlock(Z_FINISH) && m_ok;
+    deflateEnd(&m_stream);
+    QIODevice::close();
+    return m_ok;
+  }
+
+protected:
+  qint64 readData(char *, qint64) override { return -1; }
+
+  qint64 writeData(const char *data, qint64 len) override {
+    m_pending.append(data, (int)len);
+    if (m_pending.size() >= GZIP_CHUNK && !deflateBlock(Z_NO_FLUSH))
+      m_ok = false;
+    return m_ok ? len : -1;
+  }
+
+private:
+  bool deflateBlock(int flush) {
+    m_stream.next_in = reinterpret_cast<Bytef *>(m_pending.data());
+    m_stream.avail_in = m_pending.size();
+    int ret;
+    do {
+      m_stream.next_out = reinterpret_cast<Bytef *>(m_block.data());
+      m_stream.avail_out = GZIP_CHUNK;
+      ret = deflate(&m_stream, flush);
+      if (ret == Z_STREAM_ERROR)
+        return false;
+      qint64 have = GZIP_CHUNK - m_stream.avail_out;
+      if (have > 0 && m_file.write(m_block.constData(), have) != have)
+        return false;
+    } while (m_stream.avail_out == 0);
+    m_pending.resize(0); // Keeps the reserved capacity
+    return flush != Z_FINISH || ret == Z_STREAM_END;
+  }
+
+  QIODevice &m_file;
+  int m_level;
+  bool m_ok;
+  z_stream m_stream;
+  QByteArray m_pending;
+  QByteArray m_block;
+};
+
+// Count that fits in what is left of the file, for reserve()
+int reserveCount(const MapReader &in, uint32_t count, qint64 recordBytes) {
+  return (int)qMin<qint64>(count, in.remaining() / recordBytes);
+}
+
+bool readHeader(MapReader &in, RAY_MapHeader &header) {
+  in.readRawData(header.magic, 8);
+  in.readRawData(reinterpret_cast<char *>(&header.version), sizeof(uint32_t));
+  in.readRawData(reinterpret_cast<char *>(&header.num_sectors),
+                 sizeof(uint32_t));
+  in.readRawData(reinterpret_cast<char *>(&header.num_portals),
+                 sizeof(uint32_t));
+  in.readRawData(reinterpret_cast<char *>(&header.num_sprites),
+                 sizeof(uint32_t));
+  in.readRawData(reinterpret_cast<char *>(&header.num_spawn_flags),
+                 sizeof(uint32_t));
+  in.readRawData(reinterpret_cast<char *>(&header.camera_x), sizeof(float));
+  in.readRawData(reinterpret_cast<char *>(&header.camera_y), sizeof(float));
+  in.readRawData(reinterpret_cast<char *>(&header.camera_z), sizeof(float));
+  in.readRawData(reinterpret_cast<char *>(&header.camera_rot), sizeof(float));
+  in.readRawData(reinterpret_cast<char *>(&header.camera_pitch),
+                 sizeof(float));
+  in.readRawData(reinterpret_cast<char *>(&header.skyTextureID),
+                 sizeof(int32_t));
 
   /* Verify magic number */
-  if (memcmp(magic, "RAYMAP\x1a", 7) != 0) {
+  if (memcmp(header.magic, "RAYMAP\x1a", 7) != 0) {
     qWarning() << "Formato de archivo inválido";
-    file.close();
     return false;
   }
 
   /* Verify version */
-  if (version < 8 || version > 99) {
-    qWarning() << "Versión no soportada:" << version << "(solo v8-v99)";
-    file.close();
+  if (header.version < 8 || header.version > 99) {
+    qWarning() << "Versión no soportada:" << header.version
+               << "(solo v8-v99)";
     return false;
   }
+  return true;
+}
 
-  qDebug() << "Cargando mapa v" << version << ":" << num_sectors << "sectores,"
-           << num_portals << "portales";
+// Scalar sector fields up to the vertex list
+void readSectorFields(MapReader &in, uint32_t version, Sector &sector) {
+  in.readRawData(reinterpret_cast<char *>(&sector.sector_id), sizeof(int));
+  in.readRawData(reinterpret_cast<char *>(&sector.floor_z), sizeof(float));
+  in.readRawData(reinterpret_cast<char *>(&sector.ceiling_z), sizeof(float));
+  in.readRawData(reinterpret_cast<char *>(&sector.floor_texture_id),
+                 sizeof(int));
+  in.readRawData(reinterpret_cast<char *>(&sector.ceiling_texture_id),
+                 sizeof(int));
+  in.readRawData(reinterpret_cast<char *>(&sector.light_level), sizeof(int));
+
+  if (version >= 24) {
+    in.readRawData(reinterpret_cast<char *>(&sector.floor_normal_id),
+                   sizeof(int));
+    in.readRawData(reinterpret_cast<char *>(&sector.ceiling_normal_id),
+                   sizeof(int));
+  } else {
+    sector.floor_normal_id = 0;
+    sector.ceiling_normal_id = 0;
+  }
 
-  if (progressCallback)
-    progressCallback("Cargando sectores...");
+  if (version >= 22) {
+    in.readRawData(reinterpret_cast<char *>(&sector.flags), sizeof(int));
+  } else {
+    sector.flags = 0;
+  }
 
-  /* Set camera */
-  mapData.camera.x = camera_x;
-  mapData.camera.y = camera_y;
-  mapData.camera.z = camera_z;
-  mapData.camera.rotation = camera_rot;
-  mapData.camera.pitch = camera_pitch;
-  mapData.camera.enabled = true;
-  mapData.skyTextureID = skyTextureID;
+  if (version >= 26) {
+    in.readRawData(reinterpret_cast<char *>(&sector.liquid_intensity),
+                   sizeof(float));
+  } else {
+    sector.liquid_intensity = 1.0f;
+  }
+  if (version >= 27) {
+    in.readRawData(reinterpret_cast<char *>(&sector.liquid_speed),
+                   sizeof(float));
+  } else {
+    sector.liquid_speed = 1.0f;
+  }
 
-  /* Load sectors */
-  mapData.sectors.clear();
-  for (uint32_t i = 0; i < num_sectors; i++) {
-    Sector sector;
+  /* v28+: Fog settings */
+  if (version >= 28) {
+    in.readRawData(reinterpret_cast<char *>(&sector.fog_color_r),
+                   sizeof(float));
+    in.readRawData(reinterpret_cast<char *>(&sector.fog_color_g),
+                   sizeof(float));
+    in.readRawData(reinterpret_cast<char *>(&sector.fog_color_b),
+                   sizeof(float));
+    in.readRawData(reinterpret_cast<char *>(&sector.fog_density),
+                   sizeof(float));
+    in.readRawData(reinterpret_cast<char *>(&sector.fog_start), sizeof(float));
+    in.readRawData(reinterpret_cast<char *>(&sector.fog_end), sizeof(float));
+  } else {
+    sector.fog_color_r = 0.5f;
+    sector.fog_color_g = 0.5f;
+    sector.fog_color_b = 0.5f;
+    sector.fog_density = 0.0f;
+    sector.fog_start = 100.0f;
+    sector.fog_end = 1000.0f;
+  }
+}
+
+// Vertex list of one sector: float x, y pairs
+bool readVertices(MapReader &in, QPointF *out, uint32_t count) {
+  const char *p = in.take((qint64)count * 8);
+  if (!p)
+    return false;
+  for (uint32_t v = 0; v < count; v++, p += 8)
+    out[v] = QPointF(readValue<float>(p), readValue<float>(p + 4));
+  return true;
+}
+
+// Wall records of one sector, bounds-checked once for the whole block
+bool readWalls(MapReader &in, uint32_t version, Wall *out, uint32_t count) {
+  const qint64 stride = version >= 24 ? 60 : 48;
+  const char *p = in.take((qint64)count * stride);
+  if (!p)
+    return false;
+
+  for (uint32_t w = 0; w < count; w++, p += stride) {
+    Wall &wall = out[w];
+    wall.wall_id = readValue<int>(p);
+    wall.x1 = readValue<float>(p + 4);
+    wall.y1 = readValue<float>(p + 8);
+    wall.x2 = readValue<float>(p + 12);
+    wall.y2 = readValue<float>(p + 16);
+    wall.texture_id_lower = readValue<int>(p + 20);
+    wall.texture_id_middle = readValue<int>(p + 24);
+    wall.texture_id_upper = readValue<int>(p + 28);
+    wall.texture_split_z_lower = readValue<float>(p + 32);
+    wall.texture_split_z_upper = readValue<float>(p + 36);
+    wall.portal_id = readValue<int>(p + 40);
+    wall.flags = readValue<int>(p + 44);
+
+    if (version >= 24) {
+      wall.texture_id_lower_normal = readValue<int>(p + 48);
+      wall.texture_id_middle_normal = readValue<int>(p + 52);
+      wall.texture_id_upper_normal = readValue<int>(p + 56);
+    } else {
+      wall.texture_id_lower_normal = 0;
+      wall.texture_id_middle_normal = 0;
+      wall.texture_id_upper_normal = 0;
+    }
+  }
+  return true;
+}
+
+bool readPortals(MapReader &in, QVector<Portal> &portals, uint32_t count) {
+  const char *p = in.take((qint64)count * PORTAL_BYTES);
+  if (!p)
+    return false;
+
+  portals.resize(count);
+  for (uint32_t i = 0; i < count; i++, p += PORTAL_BYTES) {
+    Portal &portal = portals[i];
+    portal.portal_id = readValue<int>(p);
+    portal.sector_a = readValue<int>(p + 4);
+    portal.sector_b = readValue<int>(p + 8);
+    portal.wall_id_a = readValue<int>(p + 12);
+    portal.wall_id_b = readValue<int>(p + 16);
+    portal.x1 = readValue<float>(p + 20);
+    portal.y1 = readValue<float>(p + 24);
+    portal.x2 = readValue<float>(p + 28);
+    portal.y2 = readValue<float>(p + 32);
+  }
+  return true;
+}
+
+// One sector record. False if it is truncated or over the safety limits.
+bool readSector(MapReader &in, uint32_t version, uint32_t i, Sector &sector) {
+  readSectorFields(in, version, sector);
+
+  /* Read vertices */
+  uint32_t num_vertices;
+  in.readRawData(reinterpret_cast<char *>(&num_vertices), sizeof(uint32_t));
+
+  if (num_vertices > MAX_SECTOR_VERTICES) { // Safety check to prevent hang
+    qWarning() << "Error: Too many vertices in sector" << i << ":"
+               << num_vertices;
+    return false;
+  }
+
+  sector.vertices.resize(num_vertices);
+  if (!readVertices(in, sector.vertices.data(), num_vertices))
+    return false;
+
+  /* Read walls */
+  uint32_t num_walls;
+  in.readRawData(reinterpret_cast<char *>(&num_walls), sizeof(uint32_t));
+
+  if (num_walls > MAX_SECTOR_WALLS) { // Increased safety check for large maps
+    qWarning() << "Error: Too many walls in sector" << i << ":" << num_walls;
+    return false;
+  }
 
-    in.readRawData(reinterpret_cast<char *>(&sector.sector_id), sizeof(int));
-    in.readRawData(reinterpret_cast<char *>(&sector.floor_z), sizeof(float));
-    in.readRawData(reinterpret_cast<char *>(&sector.ceiling_z), sizeof(float));
-    in.readRawData(reinterpret_cast<char *>(&sector.floor_texture_id),
+  sector.walls.resize(num_walls);
+  if (!readWalls(in, version, sector.walls.data(), num_walls))
+    return false;
+
+  // Load hierarchy fields (parent and children)
+  in.readRawData(reinterpret_cast<char *>(&sector.parent_sector_id),
+                 sizeof(int));
+  int numChildren;
+  in.readRawData(reinterpret_cast<char *>(&numChildren), sizeof(int));
+  const char *children = in.take((qint64)qMax(0, numChildren) * 4);
+  if (!children)
+    return false;
+  sector.child_sector_ids.resize(qMax(0, numChildren));
+  for (int c = 0; c < numChildren; c++)
+    sector.child_sector_ids[c] = readValue<int>(children + c * 4);
+  return true;
+}
+
+// One entity record (spawn_id up to the v32 animation fields)
+void readEntity(MapReader &in, uint32_t version, EntityInstance &entity) {
+  in.readRawData(reinterpret_cast<char *>(&entity.spawn_id), sizeof(int));
+  in.readRawData(reinterpret_cast<char *>(&entity.x), sizeof(float));
+  in.readRawData(reinterpret_cast<char *>(&entity.y), sizeof(float));
+  in.readRawData(reinterpret_cast<char *>(&entity.z), sizeof(float));
+
+  // Asset path
+  entity.assetPath = in.readString();
+
+  // Type
+  QString rawType = in.readString().trimmed();
+
+  // Cleanup type string (remove potential garbage)
+  QString cleanType;
+  for (QChar c : rawType) {
+    if (c.isLetterOrNumber() || c == '_' || c == '-')
+      cleanType.append(c);
+  }
+  entity.type = cleanType;
+
+  // Fallback logic for corrupted types
+  if (entity.type != "model" && entity.type != "campath" &&
+      entity.type != "info_player_start") {
+    if (entity.assetPath.endsWith(".md3", Qt::CaseInsensitive))
+      entity.type = "model";
+    else if (entity.assetPath.endsWith(".campath", Qt::CaseInsensitive) ||
+             entity.assetPath.contains(".campath"))
+      entity.type = "campath";
+  }
+
+  // Version 10 fields (Behaviors)
+  if (version >= 10) {
+    int32_t actType;
+    in.readRawData(reinterpret_cast<char *>(&actType), sizeof(int32_t));
+    entity.activationType =
+        static_cast<EntityInstance::ActivationType>(actType);
+
+    int32_t visible;
+    in.readRawData(reinterpret_cast<char *>(&visible), sizeof(int32_t));
+    entity.isVisible = (visible != 0);
+
+    entity.collisionTarget = in.readString();
+
+    entity.customAction = in.readString();
+
+    entity.eventName = in.readString();
+  }
+
+  // Version 11 fields (Player & Controls)
+  if (version >= 11) {
+    int32_t isPlayer;
+    in.readRawData(reinterpret_cast<char *>(&isPlayer), sizeof(int32_t));
+    entity.isPlayer = (isPlayer != 0);
+
+    int32_t ctrlType;
+    in.readRawData(reinterpret_cast<char *>(&ctrlType), sizeof(int32_t));
+    entity.controlType = static_cast<EntityInstance::ControlType>(ctrlType);
+
+    int32_t camFollow;
+    in.readRawData(reinterpret_cast<char *>(&camFollow), sizeof(int32_t));
+    entity.cameraFollow = (camFollow != 0);
+
+    in.readRawData(reinterpret_cast<char *>(&entity.cameraOffset_x),
+                   sizeof(float));
+    in.readRawData(reinterpret_cast<char *>(&entity.cameraOffset_y),
+                   sizeof(float));
+    in.readRawData(reinterpret_cast<char *>(&entity.cameraOffset_z),
+                   sizeof(float));
+    in.readRawData(reinterpret_cast<char *>(&entity.cameraRotation),
+                   sizeof(float));
+  }
+
+  // Version 12 fields (Intro)
+  if (version >= 12 && !in.atEnd()) {
+    int32_t isIntroVal = 0;
+    in.readRawData(reinterpret_cast<char *>(&isIntroVal), sizeof(int32_t));
+    entity.isIntro = (isIntroVal != 0);
+  }
+
+  // Version 13 fields (NPC Path)
+  if (version >= 13 && !in.atEnd()) {
+    int32_t npcPathIdVal = -1;
+    in.readRawData(reinterpret_cast<char *>(&npcPathIdVal),
+                   sizeof(int32_t));
+    entity.npcPathId = npcPathIdVal;
+  }
+
+  // Version 14 fields (Extended NPC Path properties)
+  if (version >= 14 && !in.atEnd()) {
+    int8_t autoStart = 0;
+    in.readRawData(reinterpret_cast<char *>(&autoStart), sizeof(int8_t));
+    entity.autoStartPath = (autoStart != 0);
+  } else {
+    entity.autoStartPath = false;
+  }
+
+  // Version 15 fields (Snap to ground)
+  if (version >= 15 && !in.atEnd()) {
+    int8_t snap = 0;
+    in.readRawData(reinterpret_cast<char *>(&snap), sizeof(int8_t));
+    entity.snapToFloor = (snap != 0);
+  } else {
+    entity.snapToFloor = false;
+  }
+
+  // Version 29 fields (Physics Engine)
+  if (version >= 29 && !in.atEnd()) {
+    int8_t physEnabled = 0;
+    in.readRawData(reinterpret_cast<char *>(&physEnabled), sizeof(int8_t));
+    entity.physicsEnabled = (physEnabled != 0);
+    in.readRawData(reinterpret_cast<char *>(&entity.physicsMass),
+                   sizeof(float));
+    in.readRawData(reinterpret_cast<char *>(&entity.physicsFriction),
+                   sizeof(float));
+    in.readRawData(reinterpret_cast<char *>(&entity.physicsRestitution),
+                   sizeof(float));
+    in.readRawData(reinterpret_cast<char *>(&entity.physicsGravityScale),
+                   sizeof(float));
+    in.readRawData(reinterpret_cast<char *>(&entity.physicsLinearDamping),
+                   sizeof(float));
+    in.readRawData(reinterpret_cast<char *>(&entity.physicsAngularDamping),
+                   sizeof(float));
+    int8_t flags[6];
+    in.readRawData(reinterpret_cast<char *>(flags), 6);
+    entity.physicsIsStatic = (flags[0] != 0);
+    entity.physicsIsKinematic = (flags[1] != 0);
+    entity.physicsIsTrigger = (flags[2] != 0);
+    entity.physicsLockRotX = (flags[3] != 0);
+    entity.physicsLockRotY = (flags[4] != 0);
+    entity.physicsLockRotZ = (flags[5] != 0);
+    int32_t layer, mask;
+    in.readRawData(reinterpret_cast<char *>(&layer), sizeof(int32_t));
+    in.readRawData(reinterpret_cast<char *>(&mask), sizeof(int32_t));
+    entity.physicsCollisionLayer = layer;
+    entity.physicsCollisionMask = mask;
+  }
+
+  // Version 30 fields (Behavior Nodes)
+  if (version >= 30 && !in.atEnd()) {
+    uint32_t numNodes;
+    in.readRawData(reinterpret_cast<char *>(&numNodes), sizeof(uint32_t));
+    for (uint32_t n = 0; n < numNodes && in.status() == QDataStream::Ok;
+         ++n) {
+      NodeData node;
+      in.readRawData(reinterpret_cast<char *>(&node.nodeId),
+                     sizeof(int32_t));
+      node.type = in.readString();
+      in.readRawData(reinterpret_cast<char *>(&node.x), sizeof(float));
+      in.readRawData(reinterpret_cast<char *>(&node.y), sizeof(float));
+
+      uint32_t numPins;
+      in.readRawData(reinterpret_cast<char *>(&numPins), sizeof(uint32_t));
+      for (uint32_t p = 0; p < numPins; ++p) {
+        NodePinData pin;
+        in.readRawData(reinterpret_cast<char *>(&pin.pinId),
+                       sizeof(int32_t));
+        pin.name = in.readString();
+        int8_t bIn, bExec;
+        in.readRawData(reinterpret_cast<char *>(&bIn), sizeof(int8_t));
+        in.readRawData(reinterpret_cast<char *>(&bExec), sizeof(int8_t));
+        pin.isInput = (bIn != 0);
+        pin.isExecution = (bExec != 0);
+
+        pin.value = in.readString();
+
+        // Read links (handle list or single int for backward compatibility)
+        int32_t numLinks = 1;
+        // Version 31+ will store list size, earlier versions just one int
+        // For now, let's keep it simple: if version < 31, read one.
+        // If we want to support it now, we check version or just assume
+        // it's one for now. Let's use version 31 as the pivot.
+        if (version >= 31) {
+          in.readRawData(reinterpret_cast<char *>(&numLinks),
+                         sizeof(int32_t));
+          for (int k = 0; k < numLinks; ++k) {
+            int32_t lid;
+            in.readRawData(reinterpret_cast<char *>(&lid), sizeof(int32_t));
+            if (lid != -1)
+              pin.linkedPinIds.append(lid);
+          }
+        } else {
+          int32_t lid;
+          in.readRawData(reinterpret_cast<char *>(&lid), sizeof(int32_t));
+          if (lid != -1)
+            pin.linkedPinIds.append(lid);
+        }
+        node.pins.append(pin);
+      }
+      entity.behaviorGraph.nodes.append(node);
+    }
+    in.readRawData(
+        reinterpret_cast<char *>(&entity.behaviorGraph.nextNodeId),
+        sizeof(int32_t));
+    in.readRawData(
+        reinterpret_cast<char *>(&entity.behaviorGraph.nextPinId),
+        sizeof(int32_t));
+  }
+
+  // Animation fields (v32)
+  if (version >= 32 && !in.atEnd()) {
+    int32_t sG = 0, eG = 0;
+    float aS = 0.0f;
+    in.readRawData(reinterpret_cast<char *>(&sG), sizeof(int32_t));
+    in.readRawData(reinterpret_cast<char *>(&eG), sizeof(int32_t));
+    in.readRawData(reinterpret_cast<char *>(&aS), sizeof(float));
+    entity.startGraph = sG;
+    entity.endGraph = eG;
+    entity.animSpeed = aS;
+  } else {
+    entity.startGraph = 0;
+    entity.endGraph = 0;
+    entity.animSpeed = 0.0f;
+  }
+
+  // Generate processName from asset path if not set
+  // (for backward compatibility with old maps or if explicit name missing)
+  // Note: We always regenerate for now to ensure consistency with filename
+  // but ideally we should only do it if empty.
+  QFileInfo assetInfo(entity.assetPath);
+  QString rawName = assetInfo.completeBaseName();
+
+  // SANITIZE processName for BennuGD (must be valid identifier)
+  QString cleanProcName;
+  for (QChar c : rawName) {
+    if (c.isLetterOrNumber() || c == '_')
+      cleanProcName.append(c);
+    else
+      cleanProcName.append('_');
+  }
+
+  // Ensure it doesnt start with number or is empty
+  if (cleanProcName.isEmpty())
+    cleanProcName = "entity_" + QString::number(entity.spawn_id);
+  if (cleanProcName[0].isDigit())
+    cleanProcName.prepend("proc_");
+
+  entity.processName = cleanProcName;
+}
+
+// One NPC path (v13+). False if the waypoint list is truncated.
+bool readNpcPath(MapReader &in, NPCPath &path) {
+  // Path ID
+  int32_t pathId;
+  in.readRawData(reinterpret_cast<char *>(&pathId), sizeof(int32_t));
+  path.path_id = pathId;
+
+  // Path name
+  path.name = in.readString();
+
+  // Loop mode
+  int32_t loopMode;
+  in.readRawData(reinterpret_cast<char *>(&loopMode), sizeof(int32_t));
+  path.loop_mode = static_cast<NPCPath::LoopMode>(loopMode);
+
+  // Visibility
+  int32_t visibleVal;
+  in.readRawData(reinterpret_cast<char *>(&visibleVal), sizeof(int32_t));
+  path.visible = (visibleVal != 0);
+
+  // Waypoints
+  uint32_t num_waypoints;
+  in.readRawData(reinterpret_cast<char *>(&num_waypoints),
+                 sizeof(uint32_t));
+
+  const char *wp = in.take((qint64)num_waypoints * WAYPOINT_BYTES);
+  if (!wp)
+    return false;
+  path.waypoints.resize(num_waypoints);
+  for (Waypoint &waypoint : path.waypoints) {
+    waypoint.x = readValue<float>(wp);
+    waypoint.y = readValue<float>(wp + 4);
+    waypoint.z = readValue<float>(wp + 8);
+    waypoint.speed = readValue<float>(wp + 12);
+    waypoint.wait_time = readValue<int32_t>(wp + 16);
+    waypoint.look_angle = readValue<float>(wp + 20);
+    wp += WAYPOINT_BYTES;
+  }
+  return true;
+}
+
+// Fill Sector::portal_ids from the portal list
+void linkSectorPortals(QVector<Sector> &sectors,
+                       const QVector<Portal> &portals) {
+  QMultiHash<int, int> sectorsById; // Sector IDs may repeat in old maps
+  for (int s = 0; s < sectors.size(); s++)
+    sectorsById.insert(sectors[s].sector_id, s);
+
+  for (const Portal &portal : portals) {
+    const int linked[2] = {portal.sector_a, portal.sector_b};
+    for (int sectorId : linked) {
+      for (int s : sectorsById.values(sectorId)) {
+        Sector &sector = sectors[s];
+        if (!sector.portal_ids.contains(portal.portal_id)) {
+          sector.portal_ids.append(portal.portal_id);
+        }
+      }
+    }
+  }
+}
+
+/* ============================================================================
+   RECORD WRITERS (v32 encoding, shared by the stream and chunked formats)
+   ============================================================================
+ */
+
+// Portal and parent/child references are written through the ID maps
+void writeSector(QDataStream &out, const Sector &sector,
+                 const QMap<int, int> &portalIdMap,
+                 const QMap<int, int> &sectorIdMap) {
+  // Write ID (we write the sequential one to match engine expectation, or
+  // original? Engine v9 loads sectors into array index. It doesn't use the
+  // stored ID for indexing usually, but assumes order. Let's write the
+  // original ID just in case, but hierarchy must use INDEX.)
+  out.writeRawData(reinterpret_cast<const char *>(&sector.sector_id),
+                   sizeof(int));
+  out.writeRawData(reinterpret_cast<const char *>(&sector.floor_z),
+                   sizeof(float));
+  out.writeRawData(reinterpret_cast<const char *>(&sector.ceiling_z),
+                   sizeof(float));
+  out.writeRawData(reinterpret_cast<const char *>(&sector.floor_texture_id),
+                   sizeof(int));
+  out.writeRawData(reinterpret_cast<const char *>(&sector.ceiling_texture_id),
                    sizeof(int));
-    in.readRawData(reinterpret_cast<char *>(&sector.ceiling_texture_id),
+  out.writeRawData(reinterpret_cast<const char *>(&sector.light_level),
                    sizeof(int));
-    in.readRawData(reinterpret_cast<char *>(&sector.light_level), sizeof(int));
 
-    if (version >= 24) {
-      in.readRawData(reinterpret_cast<char *>(&sector.floor_normal_id),
+  /* v24+: Normal maps */
+  out.writeRawData(reinterpret_cast<const char *>(&sector.floor_normal_id),
+                   sizeof(int));
+  out.writeRawData(reinterpret_cast<const char *>(&sector.ceiling_normal_id),
+                   sizeof(int));
+
+  // v22+: Sector flags (Fluid types, etc.)
+  out.writeRawData(reinterpret_cast<const char *>(&sector.flags),
+                   sizeof(int));
+  out.writeRawData(reinterpret_cast<const char *>(&sector.liquid_intensity),
+                   sizeof(float));
+  out.writeRawData(reinterpret_cast<const char *>(&sector.liquid_speed),
+                   sizeof(float));
+
+  // v28+: Fog settings
+  out.writeRawData(reinterpret_cast<const char *>(&sector.fog_color_r),
+                   sizeof(float));
+  out.writeRawData(reinterpret_cast<const char *>(&sector.fog_color_g),
+                   sizeof(float));
+  out.writeRawData(reinterpret_cast<const char *>(&sector.fog_color_b),
+                   sizeof(float));
+  out.writeRawData(reinterpret_cast<const char *>(&sector.fog_density),
+                   sizeof(float));
+  out.writeRawData(reinterpret_cast<const char *>(&sector.fog_start),
+                   sizeof(float));
+  out.writeRawData(reinterpret_cast<const char *>(&sector.fog_end),
+                   sizeof(float));
+
+  /* Write vertices */
+  uint32_t num_vertices = sector.vertices.size();
+  out.writeRawData(reinterpret_cast<const char *>(&num_vertices),
+                   sizeof(uint32_t));
+
+  for (const QPointF &vertex : sector.vertices) {
+    float x = vertex.x();
+    float y = vertex.y();
+    out.writeRawData(reinterpret_cast<const char *>(&x), sizeof(float));
+    out.writeRawData(reinterpret_cast<const char *>(&y), sizeof(float));
+  }
+
+  /* Write walls */
+  uint32_t num_walls = sector.walls.size();
+  out.writeRawData(reinterpret_cast<const char *>(&num_walls),
+                   sizeof(uint32_t));
+
+  for (const Wall &wall : sector.walls) {
+    out.writeRawData(reinterpret_cast<const char *>(&wall.wall_id),
                      sizeof(int));
-      in.readRawData(reinterpret_cast<char *>(&sector.ceiling_normal_id),
+    out.writeRawData(reinterpret_cast<const char *>(&wall.x1), sizeof(float));
+    out.writeRawData(reinterpret_cast<const char *>(&wall.y1), sizeof(float));
+    out.writeRawData(reinterpret_cast<const char *>(&wall.x2), sizeof(float));
+    out.writeRawData(reinterpret_cast<const char *>(&wall.y2), sizeof(float));
+    out.writeRawData(reinterpret_cast<const char *>(&wall.texture_id_lower),
                      sizeof(int));
-    } else {
-      sector.floor_normal_id = 0;
-      sector.ceiling_normal_id = 0;
+    out.writeRawData(reinterpret_cast<const char *>(&wall.texture_id_middle),
+                     sizeof(int));
+    out.writeRawData(reinterpret_cast<const char *>(&wall.texture_id_upper),
+                     sizeof(int));
+    out.writeRawData(
+        reinterpret_cast<const char *>(&wall.texture_split_z_lower),
+        sizeof(float));
+    out.writeRawData(
+        reinterpret_cast<const char *>(&wall.texture_split_z_upper),
+        sizeof(float));
+
+    // USE MAPPED ID for Portals
+    int savedPortalId = -1;
+    if (wall.portal_id >= 0 && portalIdMap.contains(wall.portal_id)) {
+      savedPortalId = portalIdMap[wall.portal_id];
+    } else if (wall.portal_id >= 0) {
+      // qWarning() << "Warning: Wall points to non-existent portal ID:" <<
+      // wall.portal_id;
     }
+    out.writeRawData(reinterpret_cast<const char *>(&savedPortalId),
+                     sizeof(int));
 
-    if (version >= 22) {
-      in.readRawData(reinterpret_cast<char *>(&sector.flags), sizeof(int));
-    } else {
-      sector.flags = 0;
+    out.writeRawData(reinterpret_cast<const char *>(&wall.flags),
+                     sizeof(int));
+
+    /* v24+: Normal maps */
+    out.writeRawData(
+        reinterpret_cast<const char *>(&wall.texture_id_lower_normal),
+        sizeof(int));
+    out.writeRawData(
+        reinterpret_cast<const char *>(&wall.texture_id_middle_normal),
+        sizeof(int));
+    out.writeRawData(
+        reinterpret_cast<const char *>(&wall.texture_id_upper_normal),
+        sizeof(int));
+  }
+
+  // Save hierarchy (parent and children) - WITH REMAPPING
+  int savedParentId = -1;
+  if (sector.parent_sector_id >= 0 &&
+      sectorIdMap.contains(sector.parent_sector_id)) {
+    savedParentId = sectorIdMap[sector.parent_sector_id];
+  }
+  out.writeRawData(reinterpret_cast<const char *>(&savedParentId),
+                   sizeof(int));
+
+  // Remap children
+  QVector<int> remappedChildren;
+  for (int childId : sector.child_sector_ids) {
+    if (sectorIdMap.contains(childId)) {
+      remappedChildren.append(sectorIdMap[childId]);
     }
+  }
+
+  int numChildren = remappedChildren.size();
+  out.writeRawData(reinterpret_cast<const char *>(&numChildren), sizeof(int));
+  for (int childId : remappedChildren) {
+    out.writeRawData(reinterpret_cast<const char *>(&childId), sizeof(int));
+  }
+}
+
+void writePortal(QDataStream &out, const Portal &portal, int savedPortalId) {
+  out.writeRawData(reinterpret_cast<const char *>(&savedPortalId),
+                   sizeof(int));
+  out.writeRawData(reinterpret_cast<const char *>(&portal.sector_a),
+                   sizeof(int));
+  out.writeRawData(reinterpret_cast<const char *>(&portal.sector_b),
+                   sizeof(int));
+  out.writeRawData(reinterpret_cast<const char *>(&portal.wall_id_a),
+                   sizeof(int));
+  out.writeRawData(reinterpret_cast<const char *>(&portal.wall_id_b),
+                   sizeof(int));
+  out.writeRawData(reinterpret_cast<const char *>(&portal.x1), sizeof(float));
+  out.writeRawData(reinterpret_cast<const char *>(&portal.y1), sizeof(float));
+  out.writeRawData(reinterpret_cast<const char *>(&portal.x2), sizeof(float));
+  out.writeRawData(reinterpret_cast<const char *>(&portal.y2), sizeof(float));
+}
+
+void writeSprite(QDataStream &out, const SpriteData &sprite) {
+  out.writeRawData(reinterpret_cast<const char *>(&sprite.texture_id),
+                   sizeof(int));
+  out.writeRawData(reinterpret_cast<const char *>(&sprite.x), sizeof(float));
+  out.writeRawData(reinterpret_cast<const char *>(&sprite.y), sizeof(float));
+  out.writeRawData(reinterpret_cast<const char *>(&sprite.z), sizeof(float));
+  out.writeRawData(reinterpret_cast<const char *>(&sprite.w), sizeof(int));
+  out.writeRawData(reinterpret_cast<const char *>(&sprite.h), sizeof(int));
+  out.writeRawData(reinterpret_cast<const char *>(&sprite.rot),
+                   sizeof(float));
+}
+
+void writeEntity(QDataStream &out, const EntityInstance &entity) {
+  out.writeRawData(reinterpret_cast<const char *>(&entity.spawn_id),
+                   sizeof(int));
+  out.writeRawData(reinterpret_cast<const char *>(&entity.x), sizeof(float));
+  out.writeRawData(reinterpret_cast<const char *>(&entity.y), sizeof(float));
+  out.writeRawData(reinterpret_cast<const char *>(&entity.z), sizeof(float));
+
+  // Asset path
+  QByteArray pathBytes = entity.assetPath.toUtf8();
+  uint32_t pathLen = pathBytes.size();
+  out.writeRawData(reinterpret_cast<const char *>(&pathLen),
+                   sizeof(uint32_t));
+  out.writeRawData(pathBytes.data(), pathLen);
+
+  // Type
+  QByteArray typeBytes = entity.type.toUtf8();
+  uint32_t typeLen = typeBytes.size();
+  out.writeRawData(reinterpret_cast<const char *>(&typeLen),
+                   sizeof(uint32_t));
+  out.writeRawData(typeBytes.data(), typeLen);
+
+  // Behavior (v10)
+  int32_t actType = static_cast<int32_t>(entity.activationType);
+  out.writeRawData(reinterpret_cast<const char *>(&actType), sizeof(int32_t));
+
+  int32_t visible = entity.isVisible ? 1 : 0;
+  out.writeRawData(reinterpret_cast<const char *>(&visible), sizeof(int32_t));
+
+  QByteArray collBytes = entity.collisionTarget.toUtf8();
+  uint32_t collLen = collBytes.size();
+  out.writeRawData(reinterpret_cast<const char *>(&collLen),
+                   sizeof(uint32_t));
+  out.writeRawData(collBytes.data(), collLen);
+
+  QByteArray actionBytes = entity.customAction.toUtf8();
+  uint32_t actionLen = actionBytes.size();
+  out.writeRawData(reinterpret_cast<const char *>(&actionLen),
+                   sizeof(uint32_t));
+  out.writeRawData(actionBytes.data(), actionLen);
+
+  QByteArray eventBytes = entity.eventName.toUtf8();
+  uint32_t eventLen = eventBytes.size();
+  out.writeRawData(reinterpret_cast<const char *>(&eventLen),
+                   sizeof(uint32_t));
+  out.writeRawData(eventBytes.data(), eventLen);
+
+  // Player & Controls (v11)
+  int32_t isPlayer = entity.isPlayer ? 1 : 0;
+  out.writeRawData(reinterpret_cast<const char *>(&isPlayer),
+                   sizeof(int32_t));
+
+  int32_t ctrlType = static_cast<int32_t>(entity.controlType);
+  out.writeRawData(reinterpret_cast<const char *>(&ctrlType),
+                   sizeof(int32_t));
+
+  int32_t camFollow = entity.cameraFollow ? 1 : 0;
+  out.writeRawData(reinterpret_cast<const char *>(&camFollow),
+                   sizeof(int32_t));
+
+  out.writeRawData(reinterpret_cast<const char *>(&entity.cameraOffset_x),
+                   sizeof(float));
+  out.writeRawData(reinterpret_cast<const char *>(&entity.cameraOffset_y),
+                   sizeof(float));
+  out.writeRawData(reinterpret_cast<const char *>(&entity.cameraOffset_z),
+                   sizeof(float));
+  out.writeRawData(reinterpret_cast<const char *>(&entity.cameraRotation),
+                   sizeof(float));
+
+  // Intro (v12)
+  int32_t isIntroVal = entity.isIntro ? 1 : 0;
+  out.writeRawData(reinterpret_cast<const char *>(&isIntroVal),
+                   sizeof(int32_t));
+
+  // NPC Path (v13)
+  int32_t npcPathIdVal = entity.npcPathId;
+  out.writeRawData(reinterpret_cast<const char *>(&npcPathIdVal),
+                   sizeof(int32_t));
+
+  // Auto-start (v14)
+  int8_t autoStartVal = entity.autoStartPath ? 1 : 0;
+  out.writeRawData(reinterpret_cast<const char *>(&autoStartVal),
+                   sizeof(int8_t));
+
+  // Snap to floor (v15)
+  int8_t snapVal = entity.snapToFloor ? 1 : 0;
+  out.writeRawData(reinterpret_cast<const char *>(&snapVal), sizeof(int8_t));
 
-    if (version >= 26) {
-      in.readRawData(reinterpret_cast<char *>(&sector.liquid_intensity),
+  // Physics Engine (v29)
+  int8_t physEnabled = entity.physicsEnabled ? 1 : 0;
+  out.writeRawData(reinterpret_cast<const char *>(&physEnabled),
+                   sizeof(int8_t));
+  out.writeRawData(reinterpret_cast<const char *>(&entity.physicsMass),
+                   sizeof(float));
+  out.writeRawData(reinterpret_cast<const char *>(&entity.physicsFriction),
+                   sizeof(float));
+  out.writeRawData(reinterpret_cast<const char *>(&entity.physicsRestitution),
+                   sizeof(float));
+  out.writeRawData(
+      reinterpret_cast<const char *>(&entity.physicsGravityScale),
+      sizeof(float));
+  out.writeRawData(
+      reinterpret_cast<const char *>(&entity.physicsLinearDamping),
+      sizeof(float));
+  out.writeRawData(
+      reinterpret_cast<const char *>(&entity.physicsAngularDamping),
+      sizeof(float));
+  int8_t flags[6] = {(int8_t)(entity.physicsIsStatic ? 1 : 0),
+                     (int8_t)(entity.physicsIsKinematic ? 1 : 0),
+                     (int8_t)(entity.physicsIsTrigger ? 1 : 0),
+                     (int8_t)(entity.physicsLockRotX ? 1 : 0),
+                     (int8_t)(entity.physicsLockRotY ? 1 : 0),
+                     (int8_t)(entity.physicsLockRotZ ? 1 : 0)};
+  out.writeRawData(reinterpret_cast<const char *>(flags), 6);
+  int32_t layer = entity.physicsCollisionLayer;
+  int32_t mask = entity.physicsCollisionMask;
+  out.writeRawData(reinterpret_cast<const char *>(&layer), sizeof(int32_t));
+  out.writeRawData(reinterpret_cast<const char *>(&mask), sizeof(int32_t));
+
+  // Behavior Graph (v30)
+  uint32_t numNodes = entity.behaviorGraph.nodes.size();
+  out.writeRawData(reinterpret_cast<const char *>(&numNodes),
+                   sizeof(uint32_t));
+  for (const auto &node : entity.behaviorGraph.nodes) {
+    out.writeRawData(reinterpret_cast<const char *>(&node.nodeId),
+                     sizeof(int32_t));
+    QByteArray typeBytes = node.type.toUtf8();
+    uint32_t typeLen = typeBytes.size();
+    out.writeRawData(reinterpret_cast<const char *>(&typeLen),
+                     sizeof(uint32_t));
+    out.writeRawData(typeBytes.data(), typeLen);
+    out.writeRawData(reinterpret_cast<const char *>(&node.x),
                      sizeof(float));
-    } else {
-      sector.liquid_intensity = 1.0f;
-    }
-    if (version >= 27) {
-      in.readRawData(reinterpret_cast<char *>(&sector.liquid_speed),
+    out.writeRawData(reinterpret_cast<const char *>(&node.y),
                      sizeof(float));
-    } else {
-      sector.liquid_speed = 1.0f;
+
+    uint32_t numPins = node.pins.size();
+    out.writeRawData(reinterpret_cast<const char *>(&numPins),
+                     sizeof(uint32_t));
+    for (const auto &pin : node.pins) {
+      out.writeRawData(reinterpret_cast<const char *>(&pin.pinId),
+                       sizeof(int32_t));
+      QByteArray pinNameBytes = pin.name.toUtf8();
+      uint32_t pinNameLen = pinNameBytes.size();
+      out.writeRawData(reinterpret_cast<const char *>(&pinNameLen),
+                       sizeof(uint32_t));
+      out.writeRawData(pinNameBytes.data(), pinNameLen);
+      int8_t bIn = pin.isInput ? 1 : 0;
+      int8_t bExec = pin.isExecution ? 1 : 0;
+      out.writeRawData(reinterpret_cast<const char *>(&bIn),
+                       sizeof(int8_t));
+      out.writeRawData(reinterpret_cast<const char *>(&bExec),
+                       sizeof(int8_t));
+      QByteArray pinValBytes = pin.value.toUtf8();
+      uint32_t pinValLen = pinValBytes.size();
+      out.writeRawData(reinterpret_cast<const char *>(&pinValLen),
+                       sizeof(uint32_t));
+      out.writeRawData(pinValBytes.data(), pinValLen);
+      // Write links (size + ids)
+      int32_t numLinks = pin.linkedPinIds.size();
+      out.writeRawData(reinterpret_cast<const char *>(&numLinks),
+                       sizeof(int32_t));
+      for (int lid : pin.linkedPinIds) {
+        int32_t lid32 = lid;
+        out.writeRawData(reinterpret_cast<const char *>(&lid32),
+                         sizeof(int32_t));
+      }
     }
+  }
+  out.writeRawData(
+      reinterpret_cast<const char *>(&entity.behaviorGraph.nextNodeId),
+      sizeof(int32_t));
+  out.writeRawData(
+      reinterpret_cast<const char *>(&entity.behaviorGraph.nextPinId),
+      sizeof(int32_t));
+
+  // Animation fields (v32)
+  int32_t startGraphVal = entity.startGraph;
+  int32_t endGraphVal = entity.endGraph;
+  float animSpeedVal = entity.animSpeed;
+  out.writeRawData(reinterpret_cast<const char *>(&startGraphVal),
+                   sizeof(int32_t));
+  out.writeRawData(reinterpret_cast<const char *>(&endGraphVal),
+                   sizeof(int32_t));
+  out.writeRawData(reinterpret_cast<const char *>(&animSpeedVal),
+                   sizeof(float));
+}
 
-    /* v28+: Fog settings */
-    if (version >= 28) {
-      in.readRawData(reinterpret_cast<char *>(&sector.fog_color_r),
-                     sizeof(float));
-      in.readRawData(reinterpret_cast<char *>(&sector.fog_color_g),
-                     sizeof(float));
-      in.readRawData(reinterpret_cast<char *>(&sector.fog_color_b),
-                     sizeof(float));
-      in.readRawData(reinterpret_cast<char *>(&sector.fog_density),
+void writeNpcPath(QDataStream &out, const NPCPath &path) {
+  // Path ID
+  int32_t pathId = path.path_id;
+  out.writeRawData(reinterpret_cast<const char *>(&pathId), sizeof(int32_t));
+
+  // Path name
+  QByteArray nameBytes = path.name.toUtf8();
+  uint32_t nameLen = nameBytes.size();
+  out.writeRawData(reinterpret_cast<const char *>(&nameLen),
+                   sizeof(uint32_t));
+  out.writeRawData(nameBytes.constData(), nameLen);
+
+  // Loop mode
+  int32_t loopMode = static_cast<int32_t>(path.loop_mode);
+  out.writeRawData(reinterpret_cast<const char *>(&loopMode),
+                   sizeof(int32_t));
+
+  // Visibility
+  int32_t visibleVal = path.visible ? 1 : 0;
+  out.writeRawData(reinterpret_cast<const char *>(&visibleVal),
+                   sizeof(int32_t));
+
+  // Waypoints
+  uint32_t num_waypoints = path.waypoints.size();
+  out.writeRawData(reinterpret_cast<const char *>(&num_waypoints),
+                   sizeof(uint32_t));
+
+  for (const Waypoint &wp : path.waypoints) {
+    out.writeRawData(reinterpret_cast<const char *>(&wp.x), sizeof(float));
+    out.writeRawData(reinterpret_cast<const char *>(&wp.y), sizeof(float));
+    out.writeRawData(reinterpret_cast<const char *>(&wp.z), sizeof(float));
+    out.writeRawData(reinterpret_cast<const char *>(&wp.speed),
                      sizeof(float));
-      in.readRawData(reinterpret_cast<char *>(&sector.fog_start),
+    out.writeRawData(reinterpret_cast<const char *>(&wp.wait_time),
+                     sizeof(int32_t));
+    out.writeRawData(reinterpret_cast<const char *>(&wp.look_angle),
                      sizeof(float));
-      in.readRawData(reinterpret_cast<char *>(&sector.fog_end), sizeof(float));
-    } else {
-      sector.fog_color_r = 0.5f;
-      sector.fog_color_g = 0.5f;
-      sector.fog_color_b = 0.5f;
-      sector.fog_density = 0.0f;
-      sector.fog_start = 100.0f;
-      sector.fog_end = 1000.0f;
+  }
+}
+
+/* ============================================================================
+   CHUNKED FORMAT (v33)
+   ============================================================================
+   "RAYMAPC\x1a", uint32 version, uint32 chunk count, a table of contents of
+   CHUNK_ENTRY_BYTES entries (tag, size, offset, crc32, reserved) and the
+   chunk payloads. Each payload is a uint32 record count followed by the
+   records, in the v32 encoding where the stream format has one. A reader
+   seeks straight to the chunks it needs and verifies only those.
+ */
+
+const char CHUNKED_MAGIC[8] = {'R', 'A', 'Y', 'M', 'A', 'P', 'C', '\x1a'};
+const uint32_t CHUNKED_VERSION = 33;
+const uint32_t CHUNK_RECORD_VERSION = 32;
+const qint64 CHUNK_TABLE_OFFSET = 16;
+const qint64 CHUNK_ENTRY_BYTES = 24;
+const uint32_t MAX_CHUNKS = 256;
+
+struct ChunkEntry {
+  char tag[4];
+  uint32_t size;
+  quint64 offset;
+  uint32_t crc;
+  uint32_t reserved;
+};
+
+struct ChunkType {
+  char tag[5];
+  int chunk; // RayMapFormat::MapChunk, 0 = always read
+  const char *label;
+};
+
+// Written in this order; HEAD (camera and sky) is mandatory
+const ChunkType CHUNK_TYPES[] = {
+    {"HEAD", 0, "cabecera"},
+    {"SECT", RayMapFormat::ChunkSectors, "sectores"},
+    {"PORT", RayMapFormat::ChunkPortals, "portales"},
+    {"SPRT", RayMapFormat::ChunkSprites, "sprites"},
+    {"FLAG", RayMapFormat::ChunkSpawnFlags, "spawn flags"},
+    {"ENTS", RayMapFormat::ChunkEntities, "entidades"},
+    {"NPCP", RayMapFormat::ChunkNpcPaths, "rutas NPC"},
+    {"LITE", RayMapFormat::ChunkLights, "luces"},
+    {"TERR", RayMapFormat::ChunkTerrains, "terrenos"},
+    {"DECL", RayMapFormat::ChunkDecals, "decals"},
+    {"GRUP", RayMapFormat::ChunkGroups, "grupos"},
+};
+const int CHUNK_TYPE_COUNT = sizeof(CHUNK_TYPES) / sizeof(CHUNK_TYPES[0]);
+
+bool isTag(const char *tag, const char *name) {
+  return memcmp(tag, name, 4) == 0;
+}
+
+bool isChunkedData(const char *data, qint64 size) {
+  return size >= 8 && memcmp(data, CHUNKED_MAGIC, 8) == 0;
+}
+
+template <class T> void writeValue(QDataStream &out, const T &value) {
+  out.writeRawData(reinterpret_cast<const char *>(&value), sizeof(T));
+}
+
+void writeString(QDataStream &out, const QString &text) {
+  QByteArray bytes = text.toUtf8();
+  writeValue<uint32_t>(out, bytes.size());
+  out.writeRawData(bytes.constData(), bytes.size());
+}
+
+/* Builds each chunk in memory and appends it to the file behind a
+   placeholder table of contents, which finish() fills in. Only one payload
+   is held at a time. */
+class ChunkWriter {
+public:
+  explicit ChunkWriter(QIODevice &file) : m_file(file) {
+    m_stream.setByteOrder(QDataStream::LittleEndian);
+  }
+
+  bool begin(uint32_t chunkCount) {
+    QByteArray header(
+        (int)(CHUNK_TABLE_OFFSET + chunkCount * CHUNK_ENTRY_BYTES), char(0));
+    memcpy(header.data(), CHUNKED_MAGIC, 8);
+    memcpy(header.data() + 8, &CHUNKED_VERSION, sizeof(uint32_t));
+    memcpy(header.data() + 12, &chunkCount, sizeof(uint32_t));
+    m_toc.reserve(chunkCount);
+    return m_file.write(header) == header.size();
+  }
+
+  // Stream for the payload of the next chunk
+  QDataStream &start(const char *tag) {
+    memcpy(m_tag, tag, 4);
+    m_buffer.close();
+    m_payload.clear();
+    m_buffer.setBuffer(&m_payload);
+    m_buffer.open(QIODevice::WriteOnly);
+    m_stream.setDevice(&m_buffer);
+    return m_stream;
+  }
+
+  bool end() {
+    ChunkEntry entry;
+    memcpy(entry.tag, m_tag, 4);
+    entry.size = m_payload.size();
+    entry.offset = m_file.pos();
+    entry.crc =
+        crc32(0L, reinterpret_cast<const Bytef *>(m_payload.constData()),
+              m_payload.size());
+    entry.reserved = 0;
+    m_toc.append(entry);
+    return m_file.write(m_payload) == m_payload.size();
+  }
+
+  bool finish() {
+    if (!m_file.seek(CHUNK_TABLE_OFFSET))
+      return false;
+    QDataStream out(&m_file);
+    for (const ChunkEntry &entry : m_toc) {
+      out.writeRawData(entry.tag, 4);
+      writeValue(out, entry.size);
+      writeValue(out, entry.offset);
+      writeValue(out, entry.crc);
+      writeValue(out, entry.reserved);
+    }
+    return out.status() == QDataStream::Ok;
+  }
+
+private:
+  QIODevice &m_file;
+  QByteArray m_payload;
+  QBuffer m_buffer;
+  QDataStream m_stream;
+  QVector<ChunkEntry> m_toc;
+  char m_tag[4];
+};
+
+bool readChunkTable(MapReader &in, QVector<ChunkEntry> &toc) {
+  in.seek(8);
+  uint32_t version = in.read<uint32_t>();
+  uint32_t count = in.read<uint32_t>();
+  if (version != CHUNKED_VERSION) {
+    qWarning() << "Versión no soportada:" << version << "(formato por bloques)";
+    return false;
+  }
+
+  const char *p = count <= MAX_CHUNKS
+                      ? in.take((qint64)count * CHUNK_ENTRY_BYTES)
+                      : nullptr;
+  if (!p) {
+    qWarning() << "Índice de bloques inválido o truncado";
+    return false;
+  }
+
+  toc.resize(count);
+  for (ChunkEntry &entry : toc) {
+    memcpy(entry.tag, p, 4);
+    entry.size = readValue<uint32_t>(p + 4);
+    entry.offset = readValue<quint64>(p + 8);
+    entry.crc = readValue<uint32_t>(p + 16);
+    entry.reserved = readValue<uint32_t>(p + 20);
+    p += CHUNK_ENTRY_BYTES;
+  }
+  return true;
+}
+
+const ChunkEntry *findChunk(const QVector<ChunkEntry> &toc, const char *tag) {
+  for (const ChunkEntry &entry : toc) {
+    if (isTag(entry.tag, tag))
+      return &entry;
+  }
+  return nullptr;
+}
+
+// Cursor over one chunk's payload, after checking its bounds and checksum
+bool openChunk(const char *data, qint64 size, const ChunkEntry &entry,
+               MapReader &chunk) {
+  if (entry.offset > (quint64)size || entry.size > size - entry.offset) {
+    qWarning() << "Bloque fuera del archivo:" << QByteArray(entry.tag, 4);
+    return false;
+  }
+  const char *payload = data + entry.offset;
+  if (crc32(0L, reinterpret_cast<const Bytef *>(payload), entry.size) !=
+      entry.crc) {
+    qWarning() << "Checksum incorrecto en el bloque:"
+               << QByteArray(entry.tag, 4);
+    return false;
+  }
+  chunk = MapReader(payload, entry.size);
+  return true;
+}
+
+/* Records the stream format never stored (terrains, decals, groups) or
+   stored in a reduced form (spawn flags and lights). */
+
+void writeSpawnFlag(QDataStream &out, const SpawnFlag &flag) {
+  writeValue<int32_t>(out, flag.flagId);
+  writeValue(out, flag.x);
+  writeValue(out, flag.y);
+  writeValue(out, flag.z);
+  writeValue<int8_t>(out, flag.isIntro ? 1 : 0);
+  writeValue<int32_t>(out, flag.npcPathId);
+  writeValue<int8_t>(out, flag.autoStartPath ? 1 : 0);
+}
+
+void readSpawnFlag(MapReader &in, SpawnFlag &flag) {
+  flag.flagId = in.read<int32_t>();
+  flag.x = in.read<float>();
+  flag.y = in.read<float>();
+  flag.z = in.read<float>();
+  flag.isIntro = in.read<int8_t>() != 0;
+  flag.npcPathId = in.read<int32_t>();
+  flag.autoStartPath = in.read<int8_t>() != 0;
+}
+
+void writeLight(QDataStream &out, const Light &light) {
+  writeValue<int32_t>(out, light.id);
+  writeValue(out, light.x);
+  writeValue(out, light.y);
+  writeValue(out, light.z);
+  writeValue(out, light.radius);
+  writeValue<int32_t>(out, light.color_r);
+  writeValue<int32_t>(out, light.color_g);
+  writeValue<int32_t>(out, light.color_b);
+  writeValue(out, light.intensity);
+  writeValue(out, light.falloff);
+  writeValue<int8_t>(out, light.active ? 1 : 0);
+}
+
+void readLight(MapReader &in, Light &light) {
+  light.id = in.read<int32_t>();
+  light.x = in.read<float>();
+  light.y = in.read<float>();
+  light.z = in.read<float>();
+  light.radius = in.read<float>();
+  light.color_r = in.read<int32_t>();
+  light.color_g = in.read<int32_t>();
+  light.color_b = in.read<int32_t>();
+  light.intensity = in.read<float>();
+  light.falloff = in.read<float>();
+  light.active = in.read<int8_t>() != 0;
+}
+
+void writeTerrain(QDataStream &out, const Terrain &terrain) {
+  writeValue<int32_t>(out, terrain.id);
+  writeValue(out, terrain.x);
+  writeValue(out, terrain.y);
+  writeValue(out, terrain.z);
+  writeValue<int32_t>(out, terrain.cols);
+  writeValue<int32_t>(out, terrain.rows);
+  writeValue(out, terrain.cell_size);
+
+  writeValue<uint32_t>(out, terrain.heights.size());
+  out.writeRawData(reinterpret_cast<const char *>(terrain.heights.constData()),
+                   terrain.heights.size() * sizeof(float));
+
+  for (int i = 0; i < 4; i++) {
+    writeValue<int32_t>(out, terrain.texture_ids[i]);
+    writeValue(out, terrain.u_scales[i]);
+    writeValue(out, terrain.v_scales[i]);
+  }
+
+  writeValue<int32_t>(out, terrain.blendmap_width);
+  writeValue<int32_t>(out, terrain.blendmap_height);
+  writeValue<uint32_t>(out, terrain.blendmap_data.size());
+  out.writeRawData(terrain.blendmap_data.constData(),
+                   terrain.blendmap_data.size());
+}
+
+bool readTerrain(MapReader &in, Terrain &terrain) {
+  terrain.id = in.read<int32_t>();
+  terrain.x = in.read<float>();
+  terrain.y = in.read<float>();
+  terrain.z = in.read<float>();
+  terrain.cols = in.read<int32_t>();
+  terrain.rows = in.read<int32_t>();
+  terrain.cell_size = in.read<float>();
+
+  uint32_t numHeights = in.read<uint32_t>();
+  const char *heights = in.take((qint64)numHeights * sizeof(float));
+  if (!heights)
+    return false;
+  terrain.heights.resize(numHeights);
+  memcpy(terrain.heights.data(), heights, numHeights * sizeof(float));
+
+  for (int i = 0; i < 4; i++) {
+    terrain.texture_ids[i] = in.read<int32_t>();
+    terrain.u_scales[i] = in.read<float>();
+    terrain.v_scales[i] = in.read<float>();
+  }
+
+  terrain.blendmap_width = in.read<int32_t>();
+  terrain.blendmap_height = in.read<int32_t>();
+  uint32_t blendBytes = in.read<uint32_t>();
+  const char *blend = in.take(blendBytes);
+  if (!blend)
+    return false;
+  terrain.blendmap_data = QByteArray(blend, (int)blendBytes);
+  return true;
+}
+
+void writeDecal(QDataStream &out, const Decal &decal) {
+  writeValue<int32_t>(out, decal.id);
+  writeValue<int32_t>(out, decal.sector_id);
+  writeValue<int8_t>(out, decal.is_floor ? 1 : 0);
+  writeValue(out, decal.x);
+  writeValue(out, decal.y);
+  writeValue(out, decal.width);
+  writeValue(out, decal.height);
+  writeValue(out, decal.rotation);
+  writeValue<int32_t>(out, decal.texture_id);
+  writeValue(out, decal.alpha);
+  writeValue<int32_t>(out, decal.render_order);
+}
+
+void readDecal(MapReader &in, Decal &decal) {
+  decal.id = in.read<int32_t>();
+  decal.sector_id = in.read<int32_t>();
+  decal.is_floor = in.read<int8_t>() != 0;
+  decal.x = in.read<float>();
+  decal.y = in.read<float>();
+  decal.width = in.read<float>();
+  decal.height = in.read<float>();
+  decal.rotation = in.read<float>();
+  decal.texture_id = in.read<int32_t>();
+  decal.alpha = in.read<float>();
+  decal.render_order = in.read<int32_t>();
+}
+
+void writeGroup(QDataStream &out, const SectorGroup &group) {
+  writeValue<int32_t>(out, group.group_id);
+  writeString(out, group.name);
+  writeValue<uint32_t>(out, group.sector_ids.size());
+  for (int sectorId : group.sector_ids)
+    writeValue<int32_t>(out, sectorId);
+}
+
+bool readGroup(MapReader &in, SectorGroup &group) {
+  group.group_id = in.read<int32_t>();
+  group.name = in.readString();
+  uint32_t count = in.read<uint32_t>();
+  const char *ids = in.take((qint64)count * 4);
+  if (!ids)
+    return false;
+  group.sector_ids.resize(count);
+  for (uint32_t i = 0; i < count; i++)
+    group.sector_ids[i] = readValue<int>(ids + i * 4);
+  return true;
+}
+
+void encodeChunk(QDataStream &out, const char *tag, const MapData &mapData) {
+  if (isTag(tag, "HEAD")) {
+    writeValue(out, mapData.camera.x);
+    writeValue(out, mapData.camera.y);
+    writeValue(out, mapData.camera.z);
+    writeValue(out, mapData.camera.rotation);
+    writeValue(out, mapData.camera.pitch);
+    writeValue<int32_t>(out, mapData.skyTextureID);
+  } else if (isTag(tag, "SECT")) {
+    // Identity maps: this format keeps the editor IDs, gaps included
+    QMap<int, int> portalIds, sectorIds;
+    for (const Portal &portal : mapData.portals)
+      portalIds[portal.portal_id] = portal.portal_id;
+    for (const Sector &sector : mapData.sectors)
+      sectorIds[sector.sector_id] = sector.sector_id;
+
+    writeValue<uint32_t>(out, mapData.sectors.size());
+    for (const Sector &sector : mapData.sectors)
+      writeSector(out, sector, portalIds, sectorIds);
+  } else if (isTag(tag, "PORT")) {
+    writeValue<uint32_t>(out, mapData.portals.size());
+    for (const Portal &portal : mapData.portals)
+      writePortal(out, portal, portal.portal_id);
+  } else if (isTag(tag, "SPRT")) {
+    writeValue<uint32_t>(out, mapData.sprites.size());
+    for (const SpriteData &sprite : mapData.sprites)
+      writeSprite(out, sprite);
+  } else if (isTag(tag, "FLAG")) {
+    // Only real spawn flags: entities are not duplicated here
+    writeValue<uint32_t>(out, mapData.spawnFlags.size());
+    for (const SpawnFlag &flag : mapData.spawnFlags)
+      writeSpawnFlag(out, flag);
+  } else if (isTag(tag, "ENTS")) {
+    writeValue<uint32_t>(out, mapData.entities.size());
+    for (const EntityInstance &entity : mapData.entities)
+      writeEntity(out, entity);
+  } else if (isTag(tag, "NPCP")) {
+    writeValue<uint32_t>(out, mapData.npcPaths.size());
+    for (const NPCPath &path : mapData.npcPaths)
+      writeNpcPath(out, path);
+  } else if (isTag(tag, "LITE")) {
+    writeValue<uint32_t>(out, mapData.lights.size());
+    for (const Light &light : mapData.lights)
+      writeLight(out, light);
+  } else if (isTag(tag, "TERR")) {
+    writeValue<uint32_t>(out, mapData.terrains.size());
+    for (const Terrain &terrain : mapData.terrains)
+      writeTerrain(out, terrain);
+  } else if (isTag(tag, "DECL")) {
+    writeValue<uint32_t>(out, mapData.decals.size());
+    for (const Decal &decal : mapData.decals)
+      writeDecal(out, decal);
+  } else if (isTag(tag, "GRUP")) {
+    writeValue<uint32_t>(out, mapData.sectorGroups.size());
+    for (const SectorGroup &group : mapData.sectorGroups)
+      writeGroup(out, group);
+  }
+}
+
+// Replaces the section of mapData stored in the chunk
+bool decodeChunk(MapReader &in, const char *tag, MapData &mapData) {
+  if (isTag(tag, "HEAD")) {
+    mapData.camera.x = in.read<float>();
+    mapData.camera.y = in.read<float>();
+    mapData.camera.z = in.read<float>();
+    mapData.camera.rotation = in.read<float>();
+    mapData.camera.pitch = in.read<float>();
+    mapData.camera.enabled = true;
+    mapData.skyTextureID = in.read<int32_t>();
+    return in.status() == QDataStream::Ok;
+  }
+
+  const uint32_t count = in.read<uint32_t>();
+  bool ok = true;
+  if (isTag(tag, "SECT")) {
+    mapData.sectors.clear();
+    mapData.sectors.reserve(reserveCount(in, count, MIN_SECTOR_BYTES));
+    for (uint32_t i = 0; i < count && ok; i++) {
+      mapData.sectors.append(Sector());
+      ok = readSector(in, CHUNK_RECORD_VERSION, i, mapData.sectors.last());
+    }
+  } else if (isTag(tag, "PORT")) {
+    mapData.portals.clear();
+    ok = readPortals(in, mapData.portals, count);
+  } else if (isTag(tag, "SPRT")) {
+    mapData.sprites.clear();
+    const char *record = in.take((qint64)count * SPRITE_BYTES);
+    ok = record != nullptr;
+    if (ok)
+      mapData.sprites.resize(count);
+    for (SpriteData &sprite : mapData.sprites) {
+      sprite.texture_id = readValue<int>(record);
+      sprite.x = readValue<float>(record + 4);
+      sprite.y = readValue<float>(record + 8);
+      sprite.z = readValue<float>(record + 12);
+      sprite.w = readValue<int>(record + 16);
+      sprite.h = readValue<int>(record + 20);
+      sprite.rot = readValue<float>(record + 24);
+      record += SPRITE_BYTES;
+    }
+  } else if (isTag(tag, "FLAG")) {
+    mapData.spawnFlags.clear();
+    for (uint32_t i = 0; i < count && in.status() == QDataStream::Ok; i++) {
+      SpawnFlag flag;
+      readSpawnFlag(in, flag);
+      mapData.spawnFlags.append(flag);
+    }
+  } else if (isTag(tag, "ENTS")) {
+    mapData.entities.clear();
+    mapData.entities.reserve(reserveCount(in, count, MIN_ENTITY_BYTES));
+    for (uint32_t i = 0; i < count && in.status() == QDataStream::Ok; i++) {
+      EntityInstance entity;
+      readEntity(in, CHUNK_RECORD_VERSION, entity);
+      mapData.entities.append(entity);
+    }
+  } else if (isTag(tag, "NPCP")) {
+    mapData.npcPaths.clear();
+    for (uint32_t i = 0; i < count && ok; i++) {
+      NPCPath path;
+      ok = readNpcPath(in, path);
+      mapData.npcPaths.append(path);
+    }
+  } else if (isTag(tag, "LITE")) {
+    mapData.lights.clear();
+    for (uint32_t i = 0; i < count && in.status() == QDataStream::Ok; i++) {
+      Light light;
+      readLight(in, light);
+      mapData.lights.append(light);
+    }
+  } else if (isTag(tag, "TERR")) {
+    mapData.terrains.clear();
+    for (uint32_t i = 0; i < count && ok; i++) {
+      Terrain terrain;
+      ok = readTerrain(in, terrain);
+      mapData.terrains.append(terrain);
+    }
+  } else if (isTag(tag, "DECL")) {
+    mapData.decals.clear();
+    for (uint32_t i = 0; i < count && in.status() == QDataStream::Ok; i++) {
+      Decal decal;
+      readDecal(in, decal);
+      mapData.decals.append(decal);
     }
+  } else if (isTag(tag, "GRUP")) {
+    mapData.sectorGroups.clear();
+    for (uint32_t i = 0; i < count && ok; i++) {
+      SectorGroup group;
+      ok = readGroup(in, group);
+      mapData.sectorGroups.append(group);
+    }
+  }
+  return ok && in.status() == QDataStream::Ok;
+}
+
+/* Reads the requested chunks of a v33 file. A chunk missing from the table
+   of contents leaves its section empty. */
+bool loadChunkedMap(
+    const char *data, qint64 size, MapData &mapData, int chunks,
+    std::function<void(const QString &)> progressCallback,
+    std::function<void(const MapData &)> geometryCallback = nullptr) {
+  MapReader in(data, size);
+  QVector<ChunkEntry> toc;
+  if (!readChunkTable(in, toc))
+    return false;
+
+  // Sector portal lists are rebuilt from the portal chunk
+  if (chunks & RayMapFormat::ChunkSectors)
+    chunks |= RayMapFormat::ChunkPortals;
+
+  static const char noRecords[4] = {0, 0, 0, 0};
+  for (const ChunkType &type : CHUNK_TYPES) {
+    if (type.chunk != 0 && !(chunks & type.chunk))
+      continue;
+
+    if (progressCallback)
+      progressCallback(QString("Cargando %1...").arg(type.label));
+
+    MapReader chunk(noRecords, sizeof(noRecords));
+    const ChunkEntry *entry = findChunk(toc, type.tag);
+    if (entry && !openChunk(data, size, *entry, chunk))
+      return false;
+    if (!decodeChunk(chunk, type.tag, mapData)) {
+      qWarning() << "Bloque inválido o truncado:" << type.tag;
+      return false;
+    }
+
+    // PORT follows SECT: the geometry is complete from here on
+    if (type.chunk == RayMapFormat::ChunkPortals &&
+        (chunks & RayMapFormat::ChunkSectors)) {
+      linkSectorPortals(mapData.sectors, mapData.portals);
+      if (geometryCallback)
+        geometryCallback(mapData);
+    }
+  }
+  return true;
+}
+
+} // namespace
+
+/* ============================================================================
+   MAP LOADING
+   ============================================================================
+ */
 
-    /* Read vertices */
-    uint32_t num_vertices;
-    in.readRawData(reinterpret_cast<char *>(&num_vertices), sizeof(uint32_t));
+bool RayMapFormat::loadMap(
+    const QString &filename, MapData &mapData,
+    std::function<void(const QString &)> progressCallback,
+    std::function<void(const MapData &)> geometryCallback) {
+  QFile file(filename);
+  if (!file.open(QIODevice::ReadOnly)) {
+    qWarning() << "No se pudo abrir el archivo:" << filename;
+    return false;
+  }
 
-    if (num_vertices > 10000) { // Safety check to prevent hang
-      qWarning() << "Error: Too many vertices in sector" << i << ":"
-                 << num_vertices;
-      return false;
-    }
+  QByteArray buffer;
+  const char *data;
+  qint64 size;
+  if (!mapFile(file, buffer, data, size)) {
+    qWarning() << "No se pudo leer el archivo:" << filename;
+    return false;
+  }
 
-    for (uint32_t v = 0; v < num_vertices; v++) {
-      float x, y;
-      in.readRawData(reinterpret_cast<char *>(&x), sizeof(float));
-      in.readRawData(reinterpret_cast<char *>(&y), sizeof(float));
-      sector.vertices.append(QPointF(x, y));
-    }
+  /* v33: chunked format */
+  if (isChunkedData(data, size)) {
+    if (!loadChunkedMap(data, size, mapData, ChunkAll, progressCallback,
+                        geometryCallback))
+      return false;
+    file.close();
+    mapData.rebuildIndexes();
+    qDebug() << "Mapa cargado (v33):" << mapData.sectors.size()
+             << "sectores," << mapData.portals.size() << "portales,"
+             << mapData.entities.size() << "entidades";
+    return true;
+  }
 
-    /* Read walls */
-    uint32_t num_walls;
-    in.readRawData(reinterpret_cast<char *>(&num_walls), sizeof(uint32_t));
+  MapReader in(data, size);
 
-    if (num_walls > 32768) { // Increased safety check for large maps
-      qWarning() << "Error: Too many walls in sector" << i << ":" << num_walls;
-      return false;
-    }
+  RAY_MapHeader header;
+  if (!readHeader(in, header)) {
+    file.close();
+    return false;
+  }
+  const uint32_t version = header.version;
 
-    for (uint32_t w = 0; w < num_walls; w++) {
-      Wall wall;
+  qDebug() << "Cargando mapa v" << version << ":" << header.num_sectors
+           << "sectores," << header.num_portals << "portales";
 
-      in.readRawData(reinterpret_cast<char *>(&wall.wall_id), sizeof(int));
-      in.readRawData(reinterpret_cast<char *>(&wall.x1), sizeof(float));
-      in.readRawData(reinterpret_cast<char *>(&wall.y1), sizeof(float));
-      in.readRawData(reinterpret_cast<char *>(&wall.x2), sizeof(float));
-      in.readRawData(reinterpret_cast<char *>(&wall.y2), sizeof(float));
-      in.readRawData(reinterpret_cast<char *>(&wall.texture_id_lower),
-                     sizeof(int));
-      in.readRawData(reinterpret_cast<char *>(&wall.texture_id_middle),
-                     sizeof(int));
-      in.readRawData(reinterpret_cast<char *>(&wall.texture_id_upper),
-                     sizeof(int));
-      in.readRawData(reinterpret_cast<char *>(&wall.texture_split_z_lower),
-                     sizeof(float));
-      in.readRawData(reinterpret_cast<char *>(&wall.texture_split_z_upper),
-                     sizeof(float));
-      in.readRawData(reinterpret_cast<char *>(&wall.portal_id), sizeof(int));
-      in.readRawData(reinterpret_cast<char *>(&wall.flags), sizeof(int));
-
-      if (version >= 24) {
-        in.readRawData(reinterpret_cast<char *>(&wall.texture_id_lower_normal),
-                       sizeof(int));
-        in.readRawData(reinterpret_cast<char *>(&wall.texture_id_middle_normal),
-                       sizeof(int));
-        in.readRawData(reinterpret_cast<char *>(&wall.texture_id_upper_normal),
-                       sizeof(int));
-      } else {
-        wall.texture_id_lower_normal = 0;
-        wall.texture_id_middle_normal = 0;
-        wall.texture_id_upper_normal = 0;
-      }
+  if (progressCallback)
+    progressCallback("Cargando sectores...");
 
-      sector.walls.append(wall);
-    }
+  /* Set camera */
+  mapData.camera.x = header.camera_x;
+  mapData.camera.y = header.camera_y;
+  mapData.camera.z = header.camera_z;
+  mapData.camera.rotation = header.camera_rot;
+  mapData.camera.pitch = header.camera_pitch;
+  mapData.camera.enabled = true;
+  mapData.skyTextureID = header.skyTextureID;
 
-    // Load hierarchy fields (parent and children)
-    in.readRawData(reinterpret_cast<char *>(&sector.parent_sector_id),
-                   sizeof(int));
-    int numChildren;
-    in.readRawData(reinterpret_cast<char *>(&numChildren), sizeof(int));
-    for (int c = 0; c < numChildren; c++) {
-      int childId;
-      in.readRawData(reinterpret_cast<char *>(&childId), sizeof(int));
-      sector.child_sector_ids.append(childId);
+  /* Load sectors */
+  mapData.sectors.clear();
+  mapData.sectors.reserve(
+      reserveCount(in, header.num_sectors, MIN_SECTOR_BYTES));
+  for (uint32_t i = 0; i < header.num_sectors; i++) {
+    mapData.sectors.append(Sector());
+    if (!readSector(in, version, i, mapData.sectors.last())) {
+      qWarning() << "Sector inválido o truncado:" << i;
+      return false;
     }
-
-    mapData.sectors.append(sector);
   }
 
   if (progressCallback)
@@ -227,49 +1771,34 @@ bool RayMapFormat::loadMap(
 
   /* Load portals */
   mapData.portals.clear();
-  for (uint32_t i = 0; i < num_portals; i++) {
-    Portal portal;
-
-    in.readRawData(reinterpret_cast<char *>(&portal.portal_id), sizeof(int));
-    in.readRawData(reinterpret_cast<char *>(&portal.sector_a), sizeof(int));
-    in.readRawData(reinterpret_cast<char *>(&portal.sector_b), sizeof(int));
-    in.readRawData(reinterpret_cast<char *>(&portal.wall_id_a), sizeof(int));
-    in.readRawData(reinterpret_cast<char *>(&portal.wall_id_b), sizeof(int));
-    in.readRawData(reinterpret_cast<char *>(&portal.x1), sizeof(float));
-    in.readRawData(reinterpret_cast<char *>(&portal.y1), sizeof(float));
-    in.readRawData(reinterpret_cast<char *>(&portal.x2), sizeof(float));
-    in.readRawData(reinterpret_cast<char *>(&portal.y2), sizeof(float));
-
-    /* Add portal IDs to sectors */
-    for (Sector &sector : mapData.sectors) {
-      if (sector.sector_id == portal.sector_a ||
-          sector.sector_id == portal.sector_b) {
-        if (!sector.portal_ids.contains(portal.portal_id)) {
-          sector.portal_ids.append(portal.portal_id);
-        }
-      }
-    }
-
-    mapData.portals.append(portal);
+  if (!readPortals(in, mapData.portals, header.num_portals)) {
+    qWarning() << "Mapa truncado (portales):" << filename;
+    return false;
   }
 
+  /* Add portal IDs to sectors */
+  linkSectorPortals(mapData.sectors, mapData.portals);
+
+  if (geometryCallback)
+    geometryCallback(mapData);
+
   if (progressCallback)
     progressCallback("Cargando sprites...");
 
   /* Load sprites */
   mapData.sprites.clear();
-  for (uint32_t i = 0; i < num_sprites; i++) {
-    SpriteData sprite;
-
-    in.readRawData(reinterpret_cast<char *>(&sprite.texture_id), sizeof(int));
-    in.readRawData(reinterpret_cast<char *>(&sprite.x), sizeof(float));
-    in.readRawData(reinterpret_cast<char *>(&sprite.y), sizeof(float));
-    in.readRawData(reinterpret_cast<char *>(&sprite.z), sizeof(float));
-    in.readRawData(reinterpret_cast<char *>(&sprite.w), sizeof(int));
-    in.readRawData(reinterpret_cast<char *>(&sprite.h), sizeof(int));
-    in.readRawData(reinterpret_cast<char *>(&sprite.rot), sizeof(float));
-
-    mapData.sprites.append(sprite);
+  mapData.sprites.resize(
+      reserveCount(in, header.num_sprites, SPRITE_BYTES));
+  const char *record = in.take((qint64)mapData.sprites.size() * SPRITE_BYTES);
+  for (SpriteData &sprite : mapData.sprites) {
+    sprite.texture_id = readValue<int>(record);
+    sprite.x = readValue<float>(record + 4);
+    sprite.y = readValue<float>(record + 8);
+    sprite.z = readValue<float>(record + 12);
+    sprite.w = readValue<int>(record + 16);
+    sprite.h = readValue<int>(record + 20);
+    sprite.rot = readValue<float>(record + 24);
+    record += SPRITE_BYTES;
   }
 
   if (progressCallback)
@@ -277,20 +1806,20 @@ bool RayMapFormat::loadMap(
 
   /* Load spawn flags */
   mapData.spawnFlags.clear();
-  for (uint32_t i = 0; i < num_spawn_flags; i++) {
-    SpawnFlag flag;
-
-    in.readRawData(reinterpret_cast<char *>(&flag.flagId), sizeof(int));
-    in.readRawData(reinterpret_cast<char *>(&flag.x), sizeof(float));
-    in.readRawData(reinterpret_cast<char *>(&flag.y), sizeof(float));
-    in.readRawData(reinterpret_cast<char *>(&flag.z), sizeof(float));
+  mapData.spawnFlags.resize(
+      reserveCount(in, header.num_spawn_flags, SPAWN_FLAG_BYTES));
+  record = in.take((qint64)mapData.spawnFlags.size() * SPAWN_FLAG_BYTES);
+  for (SpawnFlag &flag : mapData.spawnFlags) {
+    flag.flagId = readValue<int>(record);
+    flag.x = readValue<float>(record + 4);
+    flag.y = readValue<float>(record + 8);
+    flag.z = readValue<float>(record + 12);
+    record += SPAWN_FLAG_BYTES;
 
     // Reset extended fields for basic spawn flags
     flag.isIntro = false;
     flag.npcPathId = -1;
     flag.autoStartPath = false;
-
-    mapData.spawnFlags.append(flag);
   }
 
   /* Load entities (appended at end for compatibility) */
@@ -300,286 +1829,14 @@ bool RayMapFormat::loadMap(
   if (!in.atEnd()) {
     uint32_t num_entities;
     in.readRawData(reinterpret_cast<char *>(&num_entities), sizeof(uint32_t));
+    mapData.entities.reserve(
+        reserveCount(in, num_entities, MIN_ENTITY_BYTES));
 
-    for (uint32_t i = 0; i < num_entities; i++) {
+    // Stop at the end of the data if a count is corrupt
+    for (uint32_t i = 0; i < num_entities && in.status() == QDataStream::Ok;
+         i++) {
       EntityInstance entity;
-
-      in.readRawData(reinterpret_cast<char *>(&entity.spawn_id), sizeof(int));
-      in.readRawData(reinterpret_cast<char *>(&entity.x), sizeof(float));
-      in.readRawData(reinterpret_cast<char *>(&entity.y), sizeof(float));
-      in.readRawData(reinterpret_cast<char *>(&entity.z), sizeof(float));
-
-      // Asset path
-      uint32_t pathLen;
-      in.readRawData(reinterpret_cast<char *>(&pathLen), sizeof(uint32_t));
-      QByteArray pathBytes;
-      pathBytes.resize(pathLen);
-      in.readRawData(pathBytes.data(), pathLen);
-      entity.assetPath = QString::fromUtf8(pathBytes);
-
-      // Type
-      uint32_t typeLen;
-      in.readRawData(reinterpret_cast<char *>(&typeLen), sizeof(uint32_t));
-      QByteArray typeBytes;
-      typeBytes.resize(typeLen);
-      in.readRawData(typeBytes.data(), typeLen);
-
-      // Cleanup type string (remove potential garbage)
-      QString rawType = QString::fromUtf8(typeBytes).trimmed();
-      QString cleanType;
-      for (QChar c : rawType) {
-        if (c.isLetterOrNumber() || c == '_' || c == '-')
-          cleanType.append(c);
-      }
-      entity.type = cleanType;
-
-      // Fallback logic for corrupted types
-      if (entity.type != "model" && entity.type != "campath" &&
-          entity.type != "info_player_start") {
-        if (entity.assetPath.endsWith(".md3", Qt::CaseInsensitive))
-          entity.type = "model";
-        else if (entity.assetPath.endsWith(".campath", Qt::CaseInsensitive) ||
-                 entity.assetPath.contains(".campath"))
-          entity.type = "campath";
-      }
-
-      // Version 10 fields (Behaviors)
-      if (version >= 10) {
-        int32_t actType;
-        in.readRawData(reinterpret_cast<char *>(&actType), sizeof(int32_t));
-        entity.activationType =
-            static_cast<EntityInstance::ActivationType>(actType);
-
-        int32_t visible;
-        in.readRawData(reinterpret_cast<char *>(&visible), sizeof(int32_t));
-        entity.isVisible = (visible != 0);
-
-        uint32_t collLen;
-        in.readRawData(reinterpret_cast<char *>(&collLen), sizeof(uint32_t));
-        QByteArray collBytes;
-        collBytes.resize(collLen);
-        in.readRawData(collBytes.data(), collLen);
-        entity.collisionTarget = QString::fromUtf8(collBytes);
-
-        uint32_t actionLen;
-        in.readRawData(reinterpret_cast<char *>(&actionLen), sizeof(uint32_t));
-        QByteArray actionBytes;
-        actionBytes.resize(actionLen);
-        in.readRawData(actionBytes.data(), actionLen);
-        entity.customAction = QString::fromUtf8(actionBytes);
-
-        uint32_t eventLen;
-        in.readRawData(reinterpret_cast<char *>(&eventLen), sizeof(uint32_t));
-        QByteArray eventBytes;
-        eventBytes.resize(eventLen);
-        in.readRawData(eventBytes.data(), eventLen);
-        entity.eventName = QString::fromUtf8(eventBytes);
-      }
-
-      // Version 11 fields (Player & Controls)
-      if (version >= 11) {
-        int32_t isPlayer;
-        in.readRawData(reinterpret_cast<char *>(&isPlayer), sizeof(int32_t));
-        entity.isPlayer = (isPlayer != 0);
-
-        int32_t ctrlType;
-        in.readRawData(reinterpret_cast<char *>(&ctrlType), sizeof(int32_t));
-        entity.controlType = static_cast<EntityInstance::ControlType>(ctrlType);
-
-        int32_t camFollow;
-        in.readRawData(reinterpret_cast<char *>(&camFollow), sizeof(int32_t));
-        entity.cameraFollow = (camFollow != 0);
-
-        in.readRawData(reinterpret_cast<char *>(&entity.cameraOffset_x),
-                       sizeof(float));
-        in.readRawData(reinterpret_cast<char *>(&entity.cameraOffset_y),
-                       sizeof(float));
-        in.readRawData(reinterpret_cast<char *>(&entity.cameraOffset_z),
-                       sizeof(float));
-        in.readRawData(reinterpret_cast<char *>(&entity.cameraRotation),
-                       sizeof(float));
-      }
-
-      // Version 12 fields (Intro)
-      if (version >= 12 && !in.atEnd()) {
-        int32_t isIntroVal = 0;
-        in.readRawData(reinterpret_cast<char *>(&isIntroVal), sizeof(int32_t));
-        entity.isIntro = (isIntroVal != 0);
-      }
-
-      // Version 13 fields (NPC Path)
-      if (version >= 13 && !in.atEnd()) {
-        int32_t npcPathIdVal = -1;
-        in.readRawData(reinterpret_cast<char *>(&npcPathIdVal),
-                       sizeof(int32_t));
-        entity.npcPathId = npcPathIdVal;
-      }
-
-      // Version 14 fields (Extended NPC Path properties)
-      if (version >= 14 && !in.atEnd()) {
-        int8_t autoStart = 0;
-        in.readRawData(reinterpret_cast<char *>(&autoStart), sizeof(int8_t));
-        entity.autoStartPath = (autoStart != 0);
-      } else {
-        entity.autoStartPath = false;
-      }
-
-      // Version 15 fields (Snap to ground)
-      if (version >= 15 && !in.atEnd()) {
-        int8_t snap = 0;
-        in.readRawData(reinterpret_cast<char *>(&snap), sizeof(int8_t));
-        entity.snapToFloor = (snap != 0);
-      } else {
-        entity.snapToFloor = false;
-      }
-
-      // Version 29 fields (Physics Engine)
-      if (version >= 29 && !in.atEnd()) {
-        int8_t physEnabled = 0;
-        in.readRawData(reinterpret_cast<char *>(&physEnabled), sizeof(int8_t));
-        entity.physicsEnabled = (physEnabled != 0);
-        in.readRawData(reinterpret_cast<char *>(&entity.physicsMass),
-                       sizeof(float));
-        in.readRawData(reinterpret_cast<char *>(&entity.physicsFriction),
-                       sizeof(float));
-        in.readRawData(reinterpret_cast<char *>(&entity.physicsRestitution),
-                       sizeof(float));
-        in.readRawData(reinterpret_cast<char *>(&entity.physicsGravityScale),
-                       sizeof(float));
-        in.readRawData(reinterpret_cast<char *>(&entity.physicsLinearDamping),
-                       sizeof(float));
-        in.readRawData(reinterpret_cast<char *>(&entity.physicsAngularDamping),
-                       sizeof(float));
-        int8_t flags[6];
-        in.readRawData(reinterpret_cast<char *>(flags), 6);
-        entity.physicsIsStatic = (flags[0] != 0);
-        entity.physicsIsKinematic = (flags[1] != 0);
-        entity.physicsIsTrigger = (flags[2] != 0);
-        entity.physicsLockRotX = (flags[3] != 0);
-        entity.physicsLockRotY = (flags[4] != 0);
-        entity.physicsLockRotZ = (flags[5] != 0);
-        int32_t layer, mask;
-        in.readRawData(reinterpret_cast<char *>(&layer), sizeof(int32_t));
-        in.readRawData(reinterpret_cast<char *>(&mask), sizeof(int32_t));
-        entity.physicsCollisionLayer = layer;
-        entity.physicsCollisionMask = mask;
-      }
-
-      // Version 30 fields (Behavior Nodes)
-      if (version >= 30 && !in.atEnd()) {
-        uint32_t numNodes;
-        in.readRawData(reinterpret_cast<char *>(&numNodes), sizeof(uint32_t));
-        for (uint32_t n = 0; n < numNodes; ++n) {
-          NodeData node;
-          in.readRawData(reinterpret_cast<char *>(&node.nodeId),
-                         sizeof(int32_t));
-          uint32_t typeLen;
-          in.readRawData(reinterpret_cast<char *>(&typeLen), sizeof(uint32_t));
-          QByteArray typeBytes;
-          typeBytes.resize(typeLen);
-          in.readRawData(typeBytes.data(), typeLen);
-          node.type = QString::fromUtf8(typeBytes);
-          in.readRawData(reinterpret_cast<char *>(&node.x), sizeof(float));
-          in.readRawData(reinterpret_cast<char *>(&node.y), sizeof(float));
-
-          uint32_t numPins;
-          in.readRawData(reinterpret_cast<char *>(&numPins), sizeof(uint32_t));
-          for (uint32_t p = 0; p < numPins; ++p) {
-            NodePinData pin;
-            in.readRawData(reinterpret_cast<char *>(&pin.pinId),
-                           sizeof(int32_t));
-            uint32_t nameLen;
-            in.readRawData(reinterpret_cast<char *>(&nameLen),
-                           sizeof(uint32_t));
-            QByteArray nameBytes;
-            nameBytes.resize(nameLen);
-            in.readRawData(nameBytes.data(), nameLen);
-            pin.name = QString::fromUtf8(nameBytes);
-            int8_t bIn, bExec;
-            in.readRawData(reinterpret_cast<char *>(&bIn), sizeof(int8_t));
-            in.readRawData(reinterpret_cast<char *>(&bExec), sizeof(int8_t));
-            pin.isInput = (bIn != 0);
-            pin.isExecution = (bExec != 0);
-
-            uint32_t valLen;
-            in.readRawData(reinterpret_cast<char *>(&valLen), sizeof(uint32_t));
-            QByteArray valBytes;
-            valBytes.resize(valLen);
-            in.readRawData(valBytes.data(), valLen);
-            pin.value = QString::fromUtf8(valBytes);
-
-            // Read links (handle list or single int for backward compatibility)
-            int32_t numLinks = 1;
-            // Version 31+ will store list size, earlier versions just one int
-            // For now, let's keep it simple: if version < 31, read one.
-            // If we want to support it now, we check version or just assume
-            // it's one for now. Let's use version 31 as the pivot.
-            if (version >= 31) {
-              in.readRawData(reinterpret_cast<char *>(&numLinks),
-                             sizeof(int32_t));
-              for (int k = 0; k < numLinks; ++k) {
-                int32_t lid;
-                in.readRawData(reinterpret_cast<char *>(&lid), sizeof(int32_t));
-                if (lid != -1)
-                  pin.linkedPinIds.append(lid);
-              }
-            } else {
-              int32_t lid;
-              in.readRawData(reinterpret_cast<char *>(&lid), sizeof(int32_t));
-              if (lid != -1)
-                pin.linkedPinIds.append(lid);
-            }
-            node.pins.append(pin);
-          }
-          entity.behaviorGraph.nodes.append(node);
-        }
-        in.readRawData(
-            reinterpret_cast<char *>(&entity.behaviorGraph.nextNodeId),
-            sizeof(int32_t));
-        in.readRawData(
-            reinterpret_cast<char *>(&entity.behaviorGraph.nextPinId),
-            sizeof(int32_t));
-      }
-
-      // Animation fields (v32)
-      if (version >= 32 && !in.atEnd()) {
-        int32_t sG = 0, eG = 0;
-        float aS = 0.0f;
-        in.readRawData(reinterpret_cast<char *>(&sG), sizeof(int32_t));
-        in.readRawData(reinterpret_cast<char *>(&eG), sizeof(int32_t));
-        in.readRawData(reinterpret_cast<char *>(&aS), sizeof(float));
-        entity.startGraph = sG;
-        entity.endGraph = eG;
-        entity.animSpeed = aS;
-      } else {
-        entity.startGraph = 0;
-        entity.endGraph = 0;
-        entity.animSpeed = 0.0f;
-      }
-
-      // Generate processName from asset path if not set
-      // (for backward compatibility with old maps or if explicit name missing)
-      // Note: We always regenerate for now to ensure consistency with filename
-      // but ideally we should only do it if empty.
-      QFileInfo assetInfo(entity.assetPath);
-      QString rawName = assetInfo.completeBaseName();
-
-      // SANITIZE processName for BennuGD (must be valid identifier)
-      QString cleanProcName;
-      for (QChar c : rawName) {
-        if (c.isLetterOrNumber() || c == '_')
-          cleanProcName.append(c);
-        else
-          cleanProcName.append('_');
-      }
-
-      // Ensure it doesnt start with number or is empty
-      if (cleanProcName.isEmpty())
-        cleanProcName = "entity_" + QString::number(entity.spawn_id);
-      if (cleanProcName[0].isDigit())
-        cleanProcName.prepend("proc_");
-
-      entity.processName = cleanProcName;
+      readEntity(in, version, entity);
 
       mapData.entities.append(entity);
     }
@@ -589,19 +1846,16 @@ bool RayMapFormat::loadMap(
     // spawn_flags section for engine compatibility. When loading back into
     // the editor, we must remove the duplicates from the spawnFlags vector
     // so they are only managed via the entities vector.
-    for (int i = mapData.spawnFlags.size() - 1; i >= 0; --i) {
-      int flagId = mapData.spawnFlags[i].flagId;
-      bool isEntity = false;
-      for (const EntityInstance &ent : mapData.entities) {
-        if (ent.spawn_id == flagId) {
-          isEntity = true;
-          break;
-        }
-      }
-      if (isEntity) {
-        mapData.spawnFlags.removeAt(i);
-      }
+    QSet<int> entitySpawnIds;
+    for (const EntityInstance &ent : mapData.entities)
+      entitySpawnIds.insert(ent.spawn_id);
+    QVector<SpawnFlag> flags;
+    flags.reserve(mapData.spawnFlags.size());
+    for (const SpawnFlag &flag : mapData.spawnFlags) {
+      if (!entitySpawnIds.contains(flag.flagId))
+        flags.append(flag);
     }
+    mapData.spawnFlags = flags;
   }
 
   // ===== NPC PATHS (v13) =====
@@ -611,45 +1865,8 @@ bool RayMapFormat::loadMap(
 
     for (uint32_t i = 0; i < num_npc_paths; ++i) {
       NPCPath path;
-
-      // Path ID
-      int32_t pathId;
-      in.readRawData(reinterpret_cast<char *>(&pathId), sizeof(int32_t));
-      path.path_id = pathId;
-
-      // Path name
-      uint32_t nameLen;
-      in.readRawData(reinterpret_cast<char *>(&nameLen), sizeof(uint32_t));
-      QByteArray nameBytes(nameLen, Qt::Uninitialized);
-      in.readRawData(nameBytes.data(), nameLen);
-      path.name = QString::fromUtf8(nameBytes);
-
-      // Loop mode
-      int32_t loopMode;
-      in.readRawData(reinterpret_cast<char *>(&loopMode), sizeof(int32_t));
-      path.loop_mode = static_cast<NPCPath::LoopMode>(loopMode);
-
-      // Visibility
-      int32_t visibleVal;
-      in.readRawData(reinterpret_cast<char *>(&visibleVal), sizeof(int32_t));
-      path.visible = (visibleVal != 0);
-
-      // Waypoints
-      uint32_t num_waypoints;
-      in.readRawData(reinterpret_cast<char *>(&num_waypoints),
-                     sizeof(uint32_t));
-
-      for (uint32_t j = 0; j < num_waypoints; ++j) {
-        Waypoint wp;
-        in.readRawData(reinterpret_cast<char *>(&wp.x), sizeof(float));
-        in.readRawData(reinterpret_cast<char *>(&wp.y), sizeof(float));
-        in.readRawData(reinterpret_cast<char *>(&wp.z), sizeof(float));
-        in.readRawData(reinterpret_cast<char *>(&wp.speed), sizeof(float));
-        in.readRawData(reinterpret_cast<char *>(&wp.wait_time),
-                       sizeof(int32_t));
-        in.readRawData(reinterpret_cast<char *>(&wp.look_angle), sizeof(float));
-        path.waypoints.append(wp);
-      }
+      if (!readNpcPath(in, path))
+        break;
 
       mapData.npcPaths.append(path);
     }
@@ -659,8 +1876,8 @@ bool RayMapFormat::loadMap(
   if (version >= 25) {
     // Lights are at the end of the file
     // Strategy: seek num_lights based on file size and fixed struct size (36)
-    qint64 savedPos = file.pos();
-    qint64 fileSize = file.size();
+    qint64 savedPos = in.pos();
+    qint64 fileSize = in.size();
 
     bool foundLights = false;
     for (int n = 0; n <= 32; ++n) {
@@ -668,7 +1885,7 @@ bool RayMapFormat::loadMap(
       if (candidate < savedPos)
         break;
 
-      file.seek(candidate);
+      in.seek(candidate);
       uint32_t numL;
       in.readRawData(reinterpret_cast<char *>(&numL), sizeof(uint32_t));
       if (numL == (uint32_t)n) {
@@ -699,11 +1916,14 @@ bool RayMapFormat::loadMap(
       }
     }
     if (!foundLights)
-      file.seek(savedPos);
+      in.seek(savedPos);
   }
 
   file.close();
 
+  // IDs come from the file: restart the ID counters from them
+  mapData.rebuildIndexes();
+
   qDebug() << "Mapa cargado:" << mapData.sectors.size() << "sectores,"
            << mapData.portals.size() << "portales," << mapData.sprites.size()
            << "sprites," << mapData.spawnFlags.size() << "spawn flags,"
@@ -712,6 +1932,43 @@ bool RayMapFormat::loadMap(
   return true;
 }
 
+bool RayMapFormat::loadMapChunks(const QString &filename, MapData &mapData,
+                                 int chunks) {
+  QFile file(filename);
+  if (!file.open(QIODevice::ReadOnly)) {
+    qWarning() << "No se pudo abrir el archivo:" << filename;
+    return false;
+  }
+
+  QByteArray buffer;
+  const char *data;
+  qint64 size;
+  if (!mapFile(file, buffer, data, size)) {
+    qWarning() << "No se pudo leer el archivo:" << filename;
+    return false;
+  }
+
+  // Stream files have no index: everything has to be parsed
+  if (!isChunkedData(data, size)) {
+    file.close();
+    return loadMap(filename, mapData);
+  }
+
+  if (!loadChunkedMap(data, size, mapData, chunks, nullptr))
+    return false;
+  file.close();
+  mapData.rebuildIndexes();
+  return true;
+}
+
+bool RayMapFormat::isChunkedMap(const QString &filename) {
+  QFile file(filename);
+  if (!file.open(QIODevice::ReadOnly))
+    return false;
+  QByteArray magic = file.read(8);
+  return isChunkedData(magic.constData(), magic.size());
+}
+
 /* ============================================================================
    MAP SAVING
    ============================================================================
@@ -719,14 +1976,25 @@ bool RayMapFormat::loadMap(
 
 bool RayMapFormat::saveMap(
     const QString &filename, const MapData &mapData,
-    std::function<void(const QString &)> progressCallback) {
-  QFile file(filename);
+    std::function<void(const QString &)> progressCallback,
+    int compressionLevel) {
+  // Written to a temporary file that replaces the map only when complete
+  QSaveFile file(filename);
   if (!file.open(QIODevice::WriteOnly)) {
     qWarning() << "No se pudo crear el archivo:" << filename;
     return false;
   }
 
-  QDataStream out(&file);
+  // Compressed maps go through deflate as they are written
+  compressionLevel = qBound(0, compressionLevel, 9);
+  GzipWriter gzip(file, compressionLevel);
+  if (compressionLevel > 0 && !gzip.open(QIODevice::WriteOnly)) {
+    qWarning() << "No se pudo iniciar la compresión:" << filename;
+    return false;
+  }
+
+  QDataStream out(compressionLevel > 0 ? static_cast<QIODevice *>(&gzip)
+                                       : &file);
   out.setByteOrder(QDataStream::LittleEndian);
 
   /* Prepare header */
@@ -797,136 +2065,7 @@ bool RayMapFormat::saveMap(
 
   /* Write sectors */
   for (const Sector &sector : mapData.sectors) {
-    // Write ID (we write the sequential one to match engine expectation, or
-    // original? Engine v9 loads sectors into array index. It doesn't use the
-    // stored ID for indexing usually, but assumes order. Let's write the
-    // original ID just in case, but hierarchy must use INDEX.)
-    out.writeRawData(reinterpret_cast<const char *>(&sector.sector_id),
-                     sizeof(int));
-    out.writeRawData(reinterpret_cast<const char *>(&sector.floor_z),
-                     sizeof(float));
-    out.writeRawData(reinterpret_cast<const char *>(&sector.ceiling_z),
-                     sizeof(float));
-    out.writeRawData(reinterpret_cast<const char *>(&sector.floor_texture_id),
-                     sizeof(int));
-    out.writeRawData(reinterpret_cast<const char *>(&sector.ceiling_texture_id),
-                     sizeof(int));
-    out.writeRawData(reinterpret_cast<const char *>(&sector.light_level),
-                     sizeof(int));
-
-    /* v24+: Normal maps */
-    out.writeRawData(reinterpret_cast<const char *>(&sector.floor_normal_id),
-                     sizeof(int));
-    out.writeRawData(reinterpret_cast<const char *>(&sector.ceiling_normal_id),
-                     sizeof(int));
-
-    // v22+: Sector flags (Fluid types, etc.)
-    out.writeRawData(reinterpret_cast<const char *>(&sector.flags),
-                     sizeof(int));
-    out.writeRawData(reinterpret_cast<const char *>(&sector.liquid_intensity),
-                     sizeof(float));
-    out.writeRawData(reinterpret_cast<const char *>(&sector.liquid_speed),
-                     sizeof(float));
-
-    // v28+: Fog settings
-    out.writeRawData(reinterpret_cast<const char *>(&sector.fog_color_r),
-                     sizeof(float));
-    out.writeRawData(reinterpret_cast<const char *>(&sector.fog_color_g),
-                     sizeof(float));
-    out.writeRawData(reinterpret_cast<const char *>(&sector.fog_color_b),
-                     sizeof(float));
-    out.writeRawData(reinterpret_cast<const char *>(&sector.fog_density),
-                     sizeof(float));
-    out.writeRawData(reinterpret_cast<const char *>(&sector.fog_start),
-                     sizeof(float));
-    out.writeRawData(reinterpret_cast<const char *>(&sector.fog_end),
-                     sizeof(float));
-
-    /* Write vertices */
-    uint32_t num_vertices = sector.vertices.size();
-    out.writeRawData(reinterpret_cast<const char *>(&num_vertices),
-                     sizeof(uint32_t));
-
-    for (const QPointF &vertex : sector.vertices) {
-      float x = vertex.x();
-      float y = vertex.y();
-      out.writeRawData(reinterpret_cast<const char *>(&x), sizeof(float));
-      out.writeRawData(reinterpret_cast<const char *>(&y), sizeof(float));
-    }
-
-    /* Write walls */
-    uint32_t num_walls = sector.walls.size();
-    out.writeRawData(reinterpret_cast<const char *>(&num_walls),
-                     sizeof(uint32_t));
-
-    for (const Wall &wall : sector.walls) {
-      out.writeRawData(reinterpret_cast<const char *>(&wall.wall_id),
-                       sizeof(int));
-      out.writeRawData(reinterpret_cast<const char *>(&wall.x1), sizeof(float));
-      out.writeRawData(reinterpret_cast<const char *>(&wall.y1), sizeof(float));
-      out.writeRawData(reinterpret_cast<const char *>(&wall.x2), sizeof(float));
-      out.writeRawData(reinterpret_cast<const char *>(&wall.y2), sizeof(float));
-      out.writeRawData(reinterpret_cast<const char *>(&wall.texture_id_lower),
-                       sizeof(int));
-      out.writeRawData(reinterpret_cast<const char *>(&wall.texture_id_middle),
-                       sizeof(int));
-      out.writeRawData(reinterpret_cast<const char *>(&wall.texture_id_upper),
-                       sizeof(int));
-      out.writeRawData(
-          reinterpret_cast<const char *>(&wall.texture_split_z_lower),
-          sizeof(float));
-      out.writeRawData(
-          reinterpret_cast<const char *>(&wall.texture_split_z_upper),
-          sizeof(float));
-
-      // USE MAPPED ID for Portals
-      int savedPortalId = -1;
-      if (wall.portal_id >= 0 && portalIdMap.contains(wall.portal_id)) {
-        savedPortalId = portalIdMap[wall.portal_id];
-      } else if (wall.portal_id >= 0) {
-        // qWarning() << "Warning: Wall points to non-existent portal ID:" <<
-        // wall.portal_id;
-      }
-      out.writeRawData(reinterpret_cast<const char *>(&savedPortalId),
-                       sizeof(int));
-
-      out.writeRawData(reinterpret_cast<const char *>(&wall.flags),
-                       sizeof(int));
-
-      /* v24+: Normal maps */
-      out.writeRawData(
-          reinterpret_cast<const char *>(&wall.texture_id_lower_normal),
-          sizeof(int));
-      out.writeRawData(
-          reinterpret_cast<const char *>(&wall.texture_id_middle_normal),
-          sizeof(int));
-      out.writeRawData(
-          reinterpret_cast<const char *>(&wall.texture_id_upper_normal),
-          sizeof(int));
-    }
-
-    // Save hierarchy (parent and children) - WITH REMAPPING
-    int savedParentId = -1;
-    if (sector.parent_sector_id >= 0 &&
-        sectorIdMap.contains(sector.parent_sector_id)) {
-      savedParentId = sectorIdMap[sector.parent_sector_id];
-    }
-    out.writeRawData(reinterpret_cast<const char *>(&savedParentId),
-                     sizeof(int));
-
-    // Remap children
-    QVector<int> remappedChildren;
-    for (int childId : sector.child_sector_ids) {
-      if (sectorIdMap.contains(childId)) {
-        remappedChildren.append(sectorIdMap[childId]);
-      }
-    }
-
-    int numChildren = remappedChildren.size();
-    out.writeRawData(reinterpret_cast<const char *>(&numChildren), sizeof(int));
-    for (int childId : remappedChildren) {
-      out.writeRawData(reinterpret_cast<const char *>(&childId), sizeof(int));
-    }
+    writeSector(out, sector, portalIdMap, sectorIdMap);
   }
 
   if (progressCallback)
@@ -935,22 +2074,7 @@ bool RayMapFormat::saveMap(
   /* Write portals */
   for (const Portal &portal : mapData.portals) {
     // USE MAPPED ID (which is sequential 0..N-1)
-    int savedPortalId = portalIdMap[portal.portal_id];
-
-    out.writeRawData(reinterpret_cast<const char *>(&savedPortalId),
-                     sizeof(int));
-    out.writeRawData(reinterpret_cast<const char *>(&portal.sector_a),
-                     sizeof(int));
-    out.writeRawData(reinterpret_cast<const char *>(&portal.sector_b),
-                     sizeof(int));
-    out.writeRawData(reinterpret_cast<const char *>(&portal.wall_id_a),
-                     sizeof(int));
-    out.writeRawData(reinterpret_cast<const char *>(&portal.wall_id_b),
-                     sizeof(int));
-    out.writeRawData(reinterpret_cast<const char *>(&portal.x1), sizeof(float));
-    out.writeRawData(reinterpret_cast<const char *>(&portal.y1), sizeof(float));
-    out.writeRawData(reinterpret_cast<const char *>(&portal.x2), sizeof(float));
-    out.writeRawData(reinterpret_cast<const char *>(&portal.y2), sizeof(float));
+    writePortal(out, portal, portalIdMap[portal.portal_id]);
   }
 
   if (progressCallback)
@@ -958,15 +2082,7 @@ bool RayMapFormat::saveMap(
 
   /* Write sprites */
   for (const SpriteData &sprite : mapData.sprites) {
-    out.writeRawData(reinterpret_cast<const char *>(&sprite.texture_id),
-                     sizeof(int));
-    out.writeRawData(reinterpret_cast<const char *>(&sprite.x), sizeof(float));
-    out.writeRawData(reinterpret_cast<const char *>(&sprite.y), sizeof(float));
-    out.writeRawData(reinterpret_cast<const char *>(&sprite.z), sizeof(float));
-    out.writeRawData(reinterpret_cast<const char *>(&sprite.w), sizeof(int));
-    out.writeRawData(reinterpret_cast<const char *>(&sprite.h), sizeof(int));
-    out.writeRawData(reinterpret_cast<const char *>(&sprite.rot),
-                     sizeof(float));
+    writeSprite(out, sprite);
   }
 
   if (progressCallback)
@@ -1011,192 +2127,7 @@ bool RayMapFormat::saveMap(
                    sizeof(uint32_t));
 
   for (const EntityInstance &entity : mapData.entities) {
-    out.writeRawData(reinterpret_cast<const char *>(&entity.spawn_id),
-                     sizeof(int));
-    out.writeRawData(reinterpret_cast<const char *>(&entity.x), sizeof(float));
-    out.writeRawData(reinterpret_cast<const char *>(&entity.y), sizeof(float));
-    out.writeRawData(reinterpret_cast<const char *>(&entity.z), sizeof(float));
-
-    // Asset path
-    QByteArray pathBytes = entity.assetPath.toUtf8();
-    uint32_t pathLen = pathBytes.size();
-    out.writeRawData(reinterpret_cast<const char *>(&pathLen),
-                     sizeof(uint32_t));
-    out.writeRawData(pathBytes.data(), pathLen);
-
-    // Type
-    QByteArray typeBytes = entity.type.toUtf8();
-    uint32_t typeLen = typeBytes.size();
-    out.writeRawData(reinterpret_cast<const char *>(&typeLen),
-                     sizeof(uint32_t));
-    out.writeRawData(typeBytes.data(), typeLen);
-
-    // Behavior (v10)
-    int32_t actType = static_cast<int32_t>(entity.activationType);
-    out.writeRawData(reinterpret_cast<const char *>(&actType), sizeof(int32_t));
-
-    int32_t visible = entity.isVisible ? 1 : 0;
-    out.writeRawData(reinterpret_cast<const char *>(&visible), sizeof(int32_t));
-
-    QByteArray collBytes = entity.collisionTarget.toUtf8();
-    uint32_t collLen = collBytes.size();
-    out.writeRawData(reinterpret_cast<const char *>(&collLen),
-                     sizeof(uint32_t));
-    out.writeRawData(collBytes.data(), collLen);
-
-    QByteArray actionBytes = entity.customAction.toUtf8();
-    uint32_t actionLen = actionBytes.size();
-    out.writeRawData(reinterpret_cast<const char *>(&actionLen),
-                     sizeof(uint32_t));
-    out.writeRawData(actionBytes.data(), actionLen);
-
-    QByteArray eventBytes = entity.eventName.toUtf8();
-    uint32_t eventLen = eventBytes.size();
-    out.writeRawData(reinterpret_cast<const char *>(&eventLen),
-                     sizeof(uint32_t));
-    out.writeRawData(eventBytes.data(), eventLen);
-
-    // Player & Controls (v11)
-    int32_t isPlayer = entity.isPlayer ? 1 : 0;
-    out.writeRawData(reinterpret_cast<const char *>(&isPlayer),
-                     sizeof(int32_t));
-
-    int32_t ctrlType = static_cast<int32_t>(entity.controlType);
-    out.writeRawData(reinterpret_cast<const char *>(&ctrlType),
-                     sizeof(int32_t));
-
-    int32_t camFollow = entity.cameraFollow ? 1 : 0;
-    out.writeRawData(reinterpret_cast<const char *>(&camFollow),
-                     sizeof(int32_t));
-
-    out.writeRawData(reinterpret_cast<const char *>(&entity.cameraOffset_x),
-                     sizeof(float));
-    out.writeRawData(reinterpret_cast<const char *>(&entity.cameraOffset_y),
-                     sizeof(float));
-    out.writeRawData(reinterpret_cast<const char *>(&entity.cameraOffset_z),
-                     sizeof(float));
-    out.writeRawData(reinterpret_cast<const char *>(&entity.cameraRotation),
-                     sizeof(float));
-
-    // Intro (v12)
-    int32_t isIntroVal = entity.isIntro ? 1 : 0;
-    out.writeRawData(reinterpret_cast<const char *>(&isIntroVal),
-                     sizeof(int32_t));
-
-    // NPC Path (v13)
-    int32_t npcPathIdVal = entity.npcPathId;
-    out.writeRawData(reinterpret_cast<const char *>(&npcPathIdVal),
-                     sizeof(int32_t));
-
-    // Auto-start (v14)
-    int8_t autoStartVal = entity.autoStartPath ? 1 : 0;
-    out.writeRawData(reinterpret_cast<const char *>(&autoStartVal),
-                     sizeof(int8_t));
-
-    // Snap to floor (v15)
-    int8_t snapVal = entity.snapToFloor ? 1 : 0;
-    out.writeRawData(reinterpret_cast<const char *>(&snapVal), sizeof(int8_t));
-
-    // Physics Engine (v29)
-    int8_t physEnabled = entity.physicsEnabled ? 1 : 0;
-    out.writeRawData(reinterpret_cast<const char *>(&physEnabled),
-                     sizeof(int8_t));
-    out.writeRawData(reinterpret_cast<const char *>(&entity.physicsMass),
-                     sizeof(float));
-    out.writeRawData(reinterpret_cast<const char *>(&entity.physicsFriction),
-                     sizeof(float));
-    out.writeRawData(reinterpret_cast<const char *>(&entity.physicsRestitution),
-                     sizeof(float));
-    out.writeRawData(
-        reinterpret_cast<const char *>(&entity.physicsGravityScale),
-        sizeof(float));
-    out.writeRawData(
-        reinterpret_cast<const char *>(&entity.physicsLinearDamping),
-        sizeof(float));
-    out.writeRawData(
-        reinterpret_cast<const char *>(&entity.physicsAngularDamping),
-        sizeof(float));
-    int8_t flags[6] = {(int8_t)(entity.physicsIsStatic ? 1 : 0),
-                       (int8_t)(entity.physicsIsKinematic ? 1 : 0),
-                       (int8_t)(entity.physicsIsTrigger ? 1 : 0),
-                       (int8_t)(entity.physicsLockRotX ? 1 : 0),
-                       (int8_t)(entity.physicsLockRotY ? 1 : 0),
-                       (int8_t)(entity.physicsLockRotZ ? 1 : 0)};
-    out.writeRawData(reinterpret_cast<const char *>(flags), 6);
-    int32_t layer = entity.physicsCollisionLayer;
-    int32_t mask = entity.physicsCollisionMask;
-    out.writeRawData(reinterpret_cast<const char *>(&layer), sizeof(int32_t));
-    out.writeRawData(reinterpret_cast<const char *>(&mask), sizeof(int32_t));
-
-    // Behavior Graph (v30)
-    if (version >= 30) {
-      uint32_t numNodes = entity.behaviorGraph.nodes.size();
-      out.writeRawData(reinterpret_cast<const char *>(&numNodes),
-                       sizeof(uint32_t));
-      for (const auto &node : entity.behaviorGraph.nodes) {
-        out.writeRawData(reinterpret_cast<const char *>(&node.nodeId),
-                         sizeof(int32_t));
-        QByteArray typeBytes = node.type.toUtf8();
-        uint32_t typeLen = typeBytes.size();
-        out.writeRawData(reinterpret_cast<const char *>(&typeLen),
-                         sizeof(uint32_t));
-        out.writeRawData(typeBytes.data(), typeLen);
-        out.writeRawData(reinterpret_cast<const char *>(&node.x),
-                         sizeof(float));
-        out.writeRawData(reinterpret_cast<const char *>(&node.y),
-                         sizeof(float));
-
-        uint32_t numPins = node.pins.size();
-        out.writeRawData(reinterpret_cast<const char *>(&numPins),
-                         sizeof(uint32_t));
-        for (const auto &pin : node.pins) {
-          out.writeRawData(reinterpret_cast<const char *>(&pin.pinId),
-                           sizeof(int32_t));
-          QByteArray pinNameBytes = pin.name.toUtf8();
-          uint32_t pinNameLen = pinNameBytes.size();
-          out.writeRawData(reinterpret_cast<const char *>(&pinNameLen),
-                           sizeof(uint32_t));
-          out.writeRawData(pinNameBytes.data(), pinNameLen);
-          int8_t bIn = pin.isInput ? 1 : 0;
-          int8_t bExec = pin.isExecution ? 1 : 0;
-          out.writeRawData(reinterpret_cast<const char *>(&bIn),
-                           sizeof(int8_t));
-          out.writeRawData(reinterpret_cast<const char *>(&bExec),
-                           sizeof(int8_t));
-          QByteArray pinValBytes = pin.value.toUtf8();
-          uint32_t pinValLen = pinValBytes.size();
-          out.writeRawData(reinterpret_cast<const char *>(&pinValLen),
-                           sizeof(uint32_t));
-          out.writeRawData(pinValBytes.data(), pinValLen);
-          // Write links (size + ids)
-          int32_t numLinks = pin.linkedPinIds.size();
-          out.writeRawData(reinterpret_cast<const char *>(&numLinks),
-                           sizeof(int32_t));
-          for (int lid : pin.linkedPinIds) {
-            int32_t lid32 = lid;
-            out.writeRawData(reinterpret_cast<const char *>(&lid32),
-                             sizeof(int32_t));
-          }
-        }
-      }
-      out.writeRawData(
-          reinterpret_cast<const char *>(&entity.behaviorGraph.nextNodeId),
-          sizeof(int32_t));
-      out.writeRawData(
-          reinterpret_cast<const char *>(&entity.behaviorGraph.nextPinId),
-          sizeof(int32_t));
-    }
-
-    // Animation fields (v32)
-    int32_t startGraphVal = entity.startGraph;
-    int32_t endGraphVal = entity.endGraph;
-    float animSpeedVal = entity.animSpeed;
-    out.writeRawData(reinterpret_cast<const char *>(&startGraphVal),
-                     sizeof(int32_t));
-    out.writeRawData(reinterpret_cast<const char *>(&endGraphVal),
-                     sizeof(int32_t));
-    out.writeRawData(reinterpret_cast<const char *>(&animSpeedVal),
-                     sizeof(float));
+    writeEntity(out, entity);
   }
 
   // ===== NPC PATHS (v13) =====
@@ -1205,43 +2136,7 @@ bool RayMapFormat::saveMap(
                    sizeof(uint32_t));
 
   for (const NPCPath &path : mapData.npcPaths) {
-    // Path ID
-    int32_t pathId = path.path_id;
-    out.writeRawData(reinterpret_cast<const char *>(&pathId), sizeof(int32_t));
-
-    // Path name
-    QByteArray nameBytes = path.name.toUtf8();
-    uint32_t nameLen = nameBytes.size();
-    out.writeRawData(reinterpret_cast<const char *>(&nameLen),
-                     sizeof(uint32_t));
-    out.writeRawData(nameBytes.constData(), nameLen);
-
-    // Loop mode
-    int32_t loopMode = static_cast<int32_t>(path.loop_mode);
-    out.writeRawData(reinterpret_cast<const char *>(&loopMode),
-                     sizeof(int32_t));
-
-    // Visibility
-    int32_t visibleVal = path.visible ? 1 : 0;
-    out.writeRawData(reinterpret_cast<const char *>(&visibleVal),
-                     sizeof(int32_t));
-
-    // Waypoints
-    uint32_t num_waypoints = path.waypoints.size();
-    out.writeRawData(reinterpret_cast<const char *>(&num_waypoints),
-                     sizeof(uint32_t));
-
-    for (const Waypoint &wp : path.waypoints) {
-      out.writeRawData(reinterpret_cast<const char *>(&wp.x), sizeof(float));
-      out.writeRawData(reinterpret_cast<const char *>(&wp.y), sizeof(float));
-      out.writeRawData(reinterpret_cast<const char *>(&wp.z), sizeof(float));
-      out.writeRawData(reinterpret_cast<const char *>(&wp.speed),
-                       sizeof(float));
-      out.writeRawData(reinterpret_cast<const char *>(&wp.wait_time),
-                       sizeof(int32_t));
-      out.writeRawData(reinterpret_cast<const char *>(&wp.look_angle),
-                       sizeof(float));
-    }
+    writeNpcPath(out, path);
   }
 
   // ===== LIGHTS (v25) =====
@@ -1273,8 +2168,14 @@ bool RayMapFormat::saveMap(
 
   /* Flush */
   out.device()->waitForBytesWritten(-1);
-  file.flush();
-  file.close();
+  if (compressionLevel > 0 && !gzip.finish()) {
+    qWarning() << "Error comprimiendo el mapa:" << filename;
+    return false;
+  }
+  if (!file.commit()) {
+    qWarning() << "Error escribiendo el archivo:" << filename;
+    return false;
+  }
 
   qDebug() << "Mapa guardado:" << mapData.sectors.size() << "sectores,"
            << mapData.portals.size() << "portales," << mapData.entities.size()
@@ -1282,3 +2183,41 @@ bool RayMapFormat::saveMap(
 
   return true;
 }
+
+bool RayMapFormat::saveChunkedMap(
+    const QString &filename, const MapData &mapData,
+    std::function<void(const QString &)> progressCallback) {
+  QSaveFile file(filename);
+  if (!file.open(QIODevice::WriteOnly)) {
+    qWarning() << "No se pudo crear el archivo:" << filename;
+    return false;
+  }
+
+  ChunkWriter writer(file);
+  if (!writer.begin(CHUNK_TYPE_COUNT)) {
+    qWarning() << "Error escribiendo el archivo:" << filename;
+    return false;
+  }
+
+  for (const ChunkType &type : CHUNK_TYPES) {
+    if (progressCallback)
+      progressCallback(QString("Guardando %1...").arg(type.label));
+
+    encodeChunk(writer.start(type.tag), type.tag, mapData);
+    if (!writer.end()) {
+      qWarning() << "Error escribiendo el bloque" << type.tag << ":"
+                 << filename;
+      return false;
+    }
+  }
+
+  if (!writer.finish() || !file.commit()) {
+    qWarning() << "Error escribiendo el índice de bloques:" << filename;
+    return false;
+  }
+
+  qDebug() << "Mapa guardado (v33):" << mapData.sectors.size() << "sectores,"
+           << mapData.portals.size() << "portales," << mapData.entities.size()
+           << "entidades";
+  return true;
+}
@@ -3,6 +3,7 @@
 
 #include "mapdata.h"
 #include <QString>
+#include <QVector>
 #include <cstdint>
 #include <functional>
 
@@ -28,15 +29,64 @@ class RayMapFormat {
 public:
   RayMapFormat();
 
+  // Secciones del formato por bloques (v33), combinables con |
+  enum MapChunk {
+    ChunkSectors = 0x001, // Implica ChunkPortals (para enlazar portal_ids)
+    ChunkPortals = 0x002,
+    ChunkSprites = 0x004,
+    ChunkSpawnFlags = 0x008,
+    ChunkEntities = 0x010,
+    ChunkNpcPaths = 0x020,
+    ChunkLights = 0x040,
+    ChunkTerrains = 0x080,
+    ChunkDecals = 0x100,
+    ChunkGroups = 0x200,
+    ChunkAll = 0x3ff
+  };
+
   // Cargar mapa desde archivo .raymap (soporta v1 y v2)
-  static bool loadMap(const QString &filename, MapData &mapData,
-                      std::function<void(const QString &)> progressCallback =
-                          nullptr); // Support for v27 (Fluid Speed)
+  // geometryCallback recibe el mapa en cuanto cámara, sectores y portales
+  // están leídos, antes que el resto (carga progresiva de MapLoader).
+  static bool loadMap(
+      const QString &filename, MapData &mapData,
+      std::function<void(const QString &)> progressCallback = nullptr,
+      std::function<void(const MapData &)> geometryCallback =
+          nullptr); // Support for v27 (Fluid Speed)
+
+  // Cargar solo las secciones indicadas (MapChunk). En mapas v33 se leen y
+  // verifican únicamente esos bloques; el resto de MapData no se toca. Los
+  // mapas secuenciales (v8-v32) no tienen índice y se cargan enteros.
+  static bool loadMapChunks(const QString &filename, MapData &mapData,
+                            int chunks);
+
+  // true si el archivo usa el formato por bloques (v33)
+  static bool isChunkedMap(const QString &filename);
 
-  // Guardar mapa a archivo .raymap (versión 4)
+  // Niveles de compresión de saveMap (zlib): 0 = sin comprimir
+  enum CompressionLevel {
+    NoCompression = 0,
+    FastCompression = 1,
+    DefaultCompression = 6,
+    BestCompression = 9
+  };
+
+  // Guardar mapa a archivo .raymap (versión 4). Se escribe en un temporal
+  // que reemplaza al mapa solo si todo fue bien (QSaveFile). Con
+  // compressionLevel 1-9 se comprime con gzip por bloques; loadMap lo
+  // detecta. Reentrante: MapSaveService la llama desde otro hilo.
   static bool
   saveMap(const QString &filename, const MapData &mapData,
-          std::function<void(const QString &)> progressCallback = nullptr);
+          std::function<void(const QString &)> progressCallback = nullptr,
+          int compressionLevel = NoCompression);
+
+  // Guardar en formato por bloques v33: índice de bloques con tamaño,
+  // posición y CRC32 de cada uno. Conserva los IDs del editor e incluye
+  // terrenos, decals y grupos. El motor solo lee el formato de saveMap; lo
+  // usan el autoguardado de MapSaveService y los guardados con
+  // MapSaveService::ChunkedFormat, que solo reabre el editor.
+  static bool saveChunkedMap(
+      const QString &filename, const MapData &mapData,
+      std::function<void(const QString &)> progressCallback = nullptr);
 
   // Exportar a formato de texto (CSV)
   static bool exportToText(const QString &directory, const MapData &mapData);
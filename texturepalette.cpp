@@ -1,9 +1,11 @@
 #include "texturepalette.h"
+#include "textureregistry.h"
 #include <QVBoxLayout>
 #include <QLabel>
 
 TexturePalette::TexturePalette(QWidget *parent)
     : QWidget(parent)
+    , m_textureRegistry(nullptr)
     , m_selectedTexture(0)
 {
     QVBoxLayout *layout = new QVBoxLayout(this);
@@ -24,29 +26,33 @@ TexturePalette::TexturePalette(QWidget *parent)
     setLayout(layout);
 }
 
-void TexturePalette::setTextures(const QVector<TextureEntry> &textures)
+void TexturePalette::setTextureRegistry(TextureRegistry *registry)
 {
-    m_listWidget->clear();
-    m_textureMap.clear();
+    if (m_textureRegistry)
+        disconnect(m_textureRegistry, nullptr, this, nullptr);
     
-    for (const TextureEntry &entry : textures) {
-        // Create scaled pixmap for icon
-        QPixmap scaledPixmap = entry.pixmap.scaled(64, 64, Qt::KeepAspectRatio, Qt::SmoothTransformation);
-        
-        // Create list item
-        QListWidgetItem *item = new QListWidgetItem();
-        item->setIcon(QIcon(scaledPixmap));
-        item->setText(QString::number(entry.id));
-        item->setData(Qt::UserRole, entry.id);
-        item->setToolTip(QString("ID: %1\nFile: %2\nSize: %3x%4")
-                        .arg(entry.id)
-                        .arg(entry.filename)
-                        .arg(entry.pixmap.width())
-                        .arg(entry.pixmap.height()));
-        
-        m_listWidget->addItem(item);
-        m_textureMap[entry.id] = entry.pixmap;
+    m_textureRegistry = registry;
+    if (m_textureRegistry) {
+        connect(m_textureRegistry, &TextureRegistry::textureChanged,
+                this, &TexturePalette::onTextureChanged);
+        connect(m_textureRegistry, &TextureRegistry::texturesReset,
+                this, &TexturePalette::updateList);
     }
+    updateList();
+}
+
+void TexturePalette::updateItem(QListWidgetItem *item, int id, const QPixmap &pixmap)
+{
+    // Create scaled pixmap for icon
+    QPixmap scaledPixmap = pixmap.scaled(64, 64, Qt::KeepAspectRatio, Qt::SmoothTransformation);
+    
+    item->setIcon(QIcon(scaledPixmap));
+    item->setText(QString::number(id));
+    item->setData(Qt::UserRole, id);
+    item->setToolTip(QString("ID: %1\nSize: %2x%3")
+                    .arg(id)
+                    .arg(pixmap.width())
+                    .arg(pixmap.height()));
 }
 
 int TexturePalette::getSelectedTexture() const
@@ -63,7 +69,38 @@ void TexturePalette::onItemClicked(QListWidgetItem *item)
     emit textureSelected(textureId);
 }
 
+void TexturePalette::onTextureChanged(int id)
+{
+    // Only the edited texture's item is touched; the list stays sorted by ID
+    int row = 0;
+    while (row < m_listWidget->count() &&
+           m_listWidget->item(row)->data(Qt::UserRole).toInt() < id)
+        row++;
+    
+    QListWidgetItem *item = m_listWidget->item(row);
+    bool found = item && item->data(Qt::UserRole).toInt() == id;
+    if (!m_textureRegistry->contains(id)) {
+        if (found)
+            delete m_listWidget->takeItem(row);
+        return;
+    }
+    
+    if (!found) {
+        item = new QListWidgetItem();
+        m_listWidget->insertItem(row, item);
+    }
+    updateItem(item, id, m_textureRegistry->pixmap(id));
+}
+
 void TexturePalette::updateList()
 {
-    // Already handled in setTextures
+    m_listWidget->clear();
+    if (!m_textureRegistry)
+        return;
+    
+    for (int id : m_textureRegistry->ids()) {
+        QListWidgetItem *item = new QListWidgetItem();
+        updateItem(item, id, m_textureRegistry->pixmap(id));
+        m_listWidget->addItem(item);
+    }
 }
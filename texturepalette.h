@@ -3,9 +3,9 @@
 
 #include <QWidget>
 #include <QListWidget>
-#include <QMap>
 #include <QPixmap>
-#include "mapdata.h"
+
+class TextureRegistry;
 
 class TexturePalette : public QWidget
 {
@@ -14,8 +14,8 @@ class TexturePalette : public QWidget
 public:
     explicit TexturePalette(QWidget *parent = nullptr);
     
-    // Cargar texturas desde FPG
-    void setTextures(const QVector<TextureEntry> &textures);
+    // Texturas compartidas; la paleta sigue sus cambios
+    void setTextureRegistry(TextureRegistry *registry);
     
     // Obtener textura seleccionada
     int getSelectedTexture() const;
@@ -25,13 +25,15 @@ signals:
     
 private slots:
     void onItemClicked(QListWidgetItem *item);
+    void onTextureChanged(int id);
     
 private:
     QListWidget *m_listWidget;
-    QMap<int, QPixmap> m_textureMap;
+    TextureRegistry *m_textureRegistry;
     int m_selectedTexture;
     
     void updateList();
+    void updateItem(QListWidgetItem *item, int id, const QPixmap &pixmap);
 };
 
 #endif // TEXTUREPALETTE_H
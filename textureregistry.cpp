@@ -0,0 +1,66 @@
+#include "textureregistry.h"
+#include <algorithm>
+
+TextureRegistry::TextureRegistry(QObject *parent)
+    : QObject(parent), m_nextGeneration(1) {}
+
+void TextureRegistry::setTexture(int id, const QPixmap &pixmap) {
+  auto it = m_entries.find(id);
+  if (it != m_entries.end() && it->pixmap.cacheKey() == pixmap.cacheKey())
+    return; // Same pixels, views are already up to date
+
+  Entry entry;
+  entry.pixmap = pixmap;
+  entry.generation = m_nextGeneration++;
+  m_entries.insert(id, entry);
+  emit textureChanged(id);
+}
+
+void TextureRegistry::setTextures(const QMap<int, QPixmap> &textures) {
+  for (auto it = textures.constBegin(); it != textures.constEnd(); ++it)
+    setTexture(it.key(), it.value());
+}
+
+void TextureRegistry::removeTexture(int id) {
+  if (m_entries.remove(id) > 0)
+    emit textureChanged(id);
+}
+
+void TextureRegistry::clear() {
+  if (m_entries.isEmpty())
+    return;
+  m_entries.clear();
+  emit texturesReset();
+}
+
+QList<int> TextureRegistry::ids() const {
+  QList<int> result = m_entries.keys();
+  std::sort(result.begin(), result.end());
+  return result;
+}
+
+QPixmap TextureRegistry::pixmap(int id) const {
+  auto it = m_entries.constFind(id);
+  return it != m_entries.constEnd() ? it->pixmap : QPixmap();
+}
+
+QImage TextureRegistry::image(int id) const {
+  auto it = m_entries.constFind(id);
+  if (it == m_entries.constEnd())
+    return QImage();
+  if (it->image.isNull())
+    it->image = it->pixmap.toImage();
+  return it->image;
+}
+
+quint64 TextureRegistry::generation(int id) const {
+  auto it = m_entries.constFind(id);
+  return it != m_entries.constEnd() ? it->generation : 0;
+}
+
+QMap<int, QPixmap> TextureRegistry::textures() const {
+  QMap<int, QPixmap> result;
+  for (auto it = m_entries.constBegin(); it != m_entries.constEnd(); ++it)
+    result.insert(it.key(), it->pixmap);
+  return result;
+}
@@ -0,0 +1,67 @@
+#ifndef TEXTUREREGISTRY_H
+#define TEXTUREREGISTRY_H
+
+#include <QHash>
+#include <QImage>
+#include <QList>
+#include <QMap>
+#include <QObject>
+#include <QPixmap>
+
+/**
+ * TextureRegistry - The editor's single store of textures, keyed by ID
+ *
+ * Views hold a pointer to the registry instead of their own QMap of pixmaps.
+ * Pixmaps and images are implicitly shared, so what a view takes out is a
+ * reference, not a copy of the pixels.
+ *
+ * Every ID has a generation that grows each time its texture is replaced.
+ * A view that converts textures (the 3D view uploads them to GL) remembers
+ * the generation it converted and redoes only the IDs whose generation
+ * changed. textureChanged() is emitted for each edited ID and
+ * texturesReset() after clear().
+ *
+ * GUI thread only (QPixmap).
+ */
+class TextureRegistry : public QObject {
+  Q_OBJECT
+
+public:
+  explicit TextureRegistry(QObject *parent = nullptr);
+
+  // Replaces a texture; unchanged pixmaps keep their generation
+  void setTexture(int id, const QPixmap &pixmap);
+  // Adds or replaces several textures, the rest are kept
+  void setTextures(const QMap<int, QPixmap> &textures);
+  void removeTexture(int id);
+  void clear();
+
+  bool contains(int id) const { return m_entries.contains(id); }
+  int count() const { return m_entries.size(); }
+  QList<int> ids() const; // Ascending
+
+  QPixmap pixmap(int id) const;
+  // QImage of the pixmap, converted once per generation
+  QImage image(int id) const;
+  // 0 if the ID is not registered
+  quint64 generation(int id) const;
+
+  // All textures, sharing the registry's pixels (texture pickers)
+  QMap<int, QPixmap> textures() const;
+
+signals:
+  void textureChanged(int id);
+  void texturesReset();
+
+private:
+  struct Entry {
+    QPixmap pixmap;
+    mutable QImage image; // Filled by image() on first use
+    quint64 generation;
+  };
+
+  QHash<int, Entry> m_entries;
+  quint64 m_nextGeneration;
+};
+
+#endif // TEXTUREREGISTRY_H
@@ -2,14 +2,41 @@
 #include <QVBoxLayout>
 #include <QLabel>
 #include <QDialogButtonBox>
+#include <QScrollBar>
+
+namespace {
+TextureSource sourceFromMap(const QMap<int, QPixmap> &textures)
+{
+    TextureSource source;
+    source.ids = textures.keys();
+    source.load = [textures](const QSet<int> &ids) -> QMap<int, QPixmap> {
+        QMap<int, QPixmap> result;
+        for (int id : ids)
+            result.insert(id, textures.value(id));
+        return result;
+    };
+    return source;
+}
+} // namespace
 
 TextureSelector::TextureSelector(const QMap<int, QPixmap> &textures, QWidget *parent)
+    : TextureSelector(sourceFromMap(textures), parent)
+{
+}
+
+TextureSelector::TextureSelector(const TextureSource &source, QWidget *parent)
     : QDialog(parent)
-    , m_textures(textures)
+    , m_source(source)
+    , m_scrollArea(nullptr)
     , m_selectedId(-1)
 {
     setWindowTitle(tr("Seleccionar Textura"));
     setMinimumSize(600, 400);
+
+    m_thumbnailTimer.setSingleShot(true);
+    m_thumbnailTimer.setInterval(0);
+    connect(&m_thumbnailTimer, &QTimer::timeout, this, &TextureSelector::loadVisibleThumbnails);
+
     setupUI();
 }
 
@@ -18,8 +45,8 @@ void TextureSelector::setupUI()
     QVBoxLayout *mainLayout = new QVBoxLayout(this);
     
     // Scroll area for texture grid
-    QScrollArea *scrollArea = new QScrollArea();
-    scrollArea->setWidgetResizable(true);
+    m_scrollArea = new QScrollArea();
+    m_scrollArea->setWidgetResizable(true);
     
     QWidget *gridWidget = new QWidget();
     QGridLayout *gridLayout = new QGridLayout(gridWidget);
@@ -32,18 +59,15 @@ void TextureSelector::setupUI()
     connect(noneBtn, &QPushButton::clicked, this, &TextureSelector::onNoneClicked);
     gridLayout->addWidget(noneBtn, 0, 0);
     
-    // Add texture buttons
+    // Add texture buttons. They show their ID until the thumbnail is
+    // decoded, which happens once they scroll into view
     int row = 0;
     int col = 1;
     const int cols = 6;
     
-    QList<int> textureIds = m_textures.keys();
-    std::sort(textureIds.begin(), textureIds.end());
-    
-    for (int id : textureIds) {
-        QPushButton *btn = new QPushButton();
+    for (int id : m_source.ids) {
+        QPushButton *btn = new QPushButton(QString::number(id));
         btn->setFixedSize(80, 80);
-        btn->setIcon(QIcon(m_textures[id].scaled(76, 76, Qt::KeepAspectRatio, Qt::SmoothTransformation)));
         btn->setIconSize(QSize(76, 76));
         btn->setToolTip(tr("Textura %1").arg(id));
         
@@ -52,6 +76,7 @@ void TextureSelector::setupUI()
         });
         
         gridLayout->addWidget(btn, row, col);
+        m_pendingButtons.insert(id, btn);
         
         col++;
         if (col >= cols) {
@@ -61,8 +86,11 @@ void TextureSelector::setupUI()
     }
     
     gridWidget->setLayout(gridLayout);
-    scrollArea->setWidget(gridWidget);
-    mainLayout->addWidget(scrollArea);
+    m_scrollArea->setWidget(gridWidget);
+    mainLayout->addWidget(m_scrollArea);
+
+    connect(m_scrollArea->verticalScrollBar(), &QScrollBar::valueChanged,
+            &m_thumbnailTimer, QOverload<>::of(&QTimer::start));
     
     // Button box
     QDialogButtonBox *buttonBox = new QDialogButtonBox(QDialogButtonBox::Cancel);
@@ -70,6 +98,48 @@ void TextureSelector::setupUI()
     mainLayout->addWidget(buttonBox);
 }
 
+void TextureSelector::showEvent(QShowEvent *event)
+{
+    QDialog::showEvent(event);
+    m_thumbnailTimer.start(); // After the layout has placed the buttons
+}
+
+void TextureSelector::resizeEvent(QResizeEvent *event)
+{
+    QDialog::resizeEvent(event);
+    m_thumbnailTimer.start();
+}
+
+void TextureSelector::loadVisibleThumbnails()
+{
+    if (m_pendingButtons.isEmpty() || !m_scrollArea->widget())
+        return;
+
+    // Viewport rectangle in grid widget coordinates
+    QWidget *viewport = m_scrollArea->viewport();
+    QRect visible(m_scrollArea->widget()->mapFrom(viewport, QPoint(0, 0)),
+                  viewport->size());
+
+    QSet<int> ids;
+    for (auto it = m_pendingButtons.constBegin(); it != m_pendingButtons.constEnd(); ++it) {
+        if (it.value()->geometry().intersects(visible))
+            ids.insert(it.key());
+    }
+    if (ids.isEmpty() || !m_source.load)
+        return;
+
+    // One batch per scroll position
+    QMap<int, QPixmap> pixmaps = m_source.load(ids);
+    for (int id : ids) {
+        QPushButton *btn = m_pendingButtons.take(id);
+        QPixmap pixmap = pixmaps.value(id);
+        if (pixmap.isNull())
+            continue;
+        btn->setText(QString());
+        btn->setIcon(QIcon(pixmap.scaled(76, 76, Qt::KeepAspectRatio, Qt::SmoothTransformation)));
+    }
+}
+
 void TextureSelector::onTextureClicked(int textureId)
 {
     m_selectedId = textureId;
@@ -2,29 +2,54 @@
 #define TEXTURESELECTOR_H
 
 #include <QDialog>
+#include <QList>
 #include <QMap>
 #include <QPixmap>
 #include <QScrollArea>
 #include <QGridLayout>
 #include <QPushButton>
+#include <QSet>
+#include <QTimer>
+#include <functional>
+
+/**
+ * Textures a picker can offer: every ID up front, pixmaps on demand.
+ * load() is called with the IDs whose thumbnails became visible, so only
+ * what the user scrolls to is decoded.
+ */
+struct TextureSource
+{
+    QList<int> ids; // Ascending
+    std::function<QMap<int, QPixmap>(const QSet<int> &)> load;
+};
 
 class TextureSelector : public QDialog
 {
     Q_OBJECT
 
 public:
+    explicit TextureSelector(const TextureSource &source, QWidget *parent = nullptr);
+    // Textures already decoded
     explicit TextureSelector(const QMap<int, QPixmap> &textures, QWidget *parent = nullptr);
     
     int selectedTextureId() const { return m_selectedId; }
     
+protected:
+    void showEvent(QShowEvent *event) override;
+    void resizeEvent(QResizeEvent *event) override;
+
 private slots:
     void onTextureClicked(int textureId);
     void onNoneClicked();
+    void loadVisibleThumbnails();
     
 private:
     void setupUI();
     
-    QMap<int, QPixmap> m_textures;
+    TextureSource m_source;
+    QScrollArea *m_scrollArea;
+    QMap<int, QPushButton *> m_pendingButtons; // Thumbnail not loaded yet
+    QTimer m_thumbnailTimer; // Coalesces scroll and resize events
     int m_selectedId;
 };
 
@@ -1,4 +1,5 @@
 #include "visualmodewidget.h"
+#include "textureregistry.h"
 #include <QApplication>
 #include <QCursor>
 #include <QDebug>
@@ -11,7 +12,8 @@ VisualModeWidget::VisualModeWidget(QWidget *parent)
       m_updateTimer(new QTimer(this)), m_cameraX(384.0f), m_cameraY(32.0f),
       m_cameraZ(384.0f), m_cameraYaw(0.0f), m_cameraPitch(0.0f),
       m_moveSpeed(200.0f), m_strafeSpeed(200.0f), m_verticalSpeed(150.0f),
-      m_mouseSensitivity(0.002f), m_mouseCaptured(false), m_firstMouse(true) {
+      m_mouseSensitivity(0.002f), m_mouseCaptured(false), m_firstMouse(true),
+      m_textureRegistry(nullptr) {
   setWindowTitle(tr("Modo Visual - RayMap Editor"));
   setWindowFlags(windowFlags() | Qt::WindowStaysOnTopHint);
   resize(800, 600);
@@ -52,19 +54,34 @@ void VisualModeWidget::initializeGL() {
            << (const char *)glGetString(GL_SHADING_LANGUAGE_VERSION);
 
   // Load map data if it was set before initialization
-  if (!m_mapData.sectors.isEmpty()) {
+  if (!m_pendingMapData.sectors.isEmpty()) {
     qDebug() << "Loading deferred map data...";
 
     // IMPORTANT: Load textures FIRST, before generating geometry
     qDebug() << "Loading textures first...";
-    for (const TextureEntry &entry : m_mapData.textures) {
-      m_renderer->loadTexture(entry.id, entry.pixmap.toImage());
+    for (const TextureEntry &entry : m_pendingMapData.textures) {
+      if (!m_pendingTextures.contains(entry.id))
+        m_renderer->loadTexture(entry.id, entry.pixmap.toImage());
     }
-    qDebug() << "Loaded" << m_mapData.textures.size() << "textures";
+    qDebug() << "Loaded" << m_pendingMapData.textures.size() << "textures";
+  }
 
-    // NOW generate geometry (textures are already loaded)
-    m_renderer->setMapData(m_mapData);
+  for (QMap<int, QImage>::const_iterator it = m_pendingTextures.constBegin();
+       it != m_pendingTextures.constEnd(); ++it) {
+    m_renderer->loadTexture(it.key(), it.value());
+  }
+  if (m_textureRegistry) {
+    for (int id : m_textureRegistry->ids())
+      syncTexture(id);
   }
+
+  // NOW generate geometry (textures are already loaded)
+  if (!m_pendingMapData.sectors.isEmpty())
+    m_renderer->setMapData(m_pendingMapData);
+
+  // The renderer owns everything from here on
+  m_pendingMapData = MapData();
+  m_pendingTextures.clear();
 }
 
 void VisualModeWidget::resizeGL(int w, int h) { glViewport(0, 0, w, h); }
@@ -83,8 +100,6 @@ void VisualModeWidget::paintGL() {
 }
 
 void VisualModeWidget::setMapData(const MapData &mapData, bool resetCamera) {
-  m_mapData = mapData;
-
   qDebug() << "setMapData called with" << mapData.sectors.size() << "sectors";
 
   if (m_renderer) {
@@ -95,6 +110,7 @@ void VisualModeWidget::setMapData(const MapData &mapData, bool resetCamera) {
   } else {
     // Renderer doesn't exist yet, data will be loaded in initializeGL()
     qDebug() << "Renderer not initialized yet, deferring map data load";
+    m_pendingMapData = mapData;
   }
 
   // Set camera to map's camera position if available and requested
@@ -110,29 +126,98 @@ void VisualModeWidget::setMapData(const MapData &mapData, bool resetCamera) {
            << m_cameraZ;
 }
 
-void VisualModeWidget::loadTexture(int id, const QImage &image) {
-  // Store texture in map data
-  bool found = false;
-  for (TextureEntry &entry : m_mapData.textures) {
-    if (entry.id == id) {
-      entry.pixmap = QPixmap::fromImage(image);
-      found = true;
-      break;
-    }
+void VisualModeWidget::updateSectors(const MapData &mapData,
+                                     const QSet<int> &sectorIds) {
+  if (sectorIds.isEmpty())
+    return;
+
+  if (!m_renderer) {
+    m_pendingMapData = mapData;
+    return;
   }
 
-  if (!found) {
-    TextureEntry entry;
-    entry.id = id;
-    entry.pixmap = QPixmap::fromImage(image);
-    m_mapData.textures.append(entry);
+  makeCurrent();
+  m_renderer->updateSectors(mapData, sectorIds);
+  doneCurrent();
+}
+
+void VisualModeWidget::updateEntities(const MapData &mapData) {
+  if (!m_renderer) {
+    m_pendingMapData = mapData;
+    return;
   }
 
-  // Load to renderer if it exists
+  makeCurrent();
+  m_renderer->updateEntities(mapData);
+  doneCurrent();
+}
+
+void VisualModeWidget::loadTexture(int id, const QImage &image) {
+  // Load to renderer if it exists, otherwise keep it for initializeGL()
   if (m_renderer) {
     makeCurrent();
     m_renderer->loadTexture(id, image);
     doneCurrent();
+  } else {
+    m_pendingTextures.insert(id, image);
+  }
+}
+
+void VisualModeWidget::setTextureRegistry(TextureRegistry *registry) {
+  if (m_textureRegistry == registry)
+    return;
+  if (m_textureRegistry)
+    disconnect(m_textureRegistry, nullptr, this, nullptr);
+
+  m_textureRegistry = registry;
+  if (m_textureRegistry) {
+    connect(m_textureRegistry, &TextureRegistry::textureChanged, this,
+            &VisualModeWidget::onTextureChanged);
+    connect(m_textureRegistry, &TextureRegistry::texturesReset, this,
+            &VisualModeWidget::onTexturesReset);
+  }
+  onTexturesReset();
+}
+
+void VisualModeWidget::onTextureChanged(int id) {
+  // Before initializeGL() everything is uploaded there
+  if (!m_renderer)
+    return;
+
+  makeCurrent();
+  syncTexture(id);
+  doneCurrent();
+}
+
+void VisualModeWidget::onTexturesReset() {
+  if (!m_renderer) {
+    m_uploadedGenerations.clear();
+    return;
+  }
+
+  makeCurrent();
+  QList<int> uploaded = m_uploadedGenerations.keys();
+  for (int id : uploaded)
+    syncTexture(id); // Unloads the IDs that are gone
+  if (m_textureRegistry) {
+    for (int id : m_textureRegistry->ids())
+      syncTexture(id);
+  }
+  doneCurrent();
+}
+
+void VisualModeWidget::syncTexture(int id) {
+  quint64 generation =
+      m_textureRegistry ? m_textureRegistry->generation(id) : 0;
+  if (m_uploadedGenerations.value(id) == generation)
+    return;
+
+  if (generation == 0) {
+    m_renderer->unloadTexture(id);
+    m_uploadedGenerations.remove(id);
+  } else {
+    m_renderer->loadTexture(id, m_textureRegistry->image(id));
+    m_uploadedGenerations.insert(id, generation);
   }
 }
 
@@ -5,11 +5,15 @@
 #include <QOpenGLFunctions>
 #include <QTimer>
 #include <QElapsedTimer>
+#include <QHash>
+#include <QMap>
 #include <QSet>
 #include <QPoint>
 #include "visualrenderer.h"
 #include "mapdata.h"
 
+class TextureRegistry;
+
 /**
  * VisualModeWidget - 3D view widget for the Visual Mode
  * 
@@ -26,7 +30,14 @@ public:
     
     // Map data
     void setMapData(const MapData &mapData, bool resetCamera = true);
+    // Rebuild only the given sectors (by sector_id), see VisualRenderer
+    void updateSectors(const MapData &mapData, const QSet<int> &sectorIds);
+    // Rebuild entities and the sky only, sector geometry is kept
+    void updateEntities(const MapData &mapData);
     void loadTexture(int id, const QImage &image);
+    // Textures are uploaded from the registry and kept in step with it: only
+    // IDs whose generation changed are uploaded again
+    void setTextureRegistry(TextureRegistry *registry);
     
     // Camera control
     void setCameraPosition(float x, float y, float z);
@@ -48,11 +59,14 @@ protected:
     
 private slots:
     void updateFrame();
+    void onTextureChanged(int id);
+    void onTexturesReset();
     
 private:
     void updateCamera(float deltaTime);
     void captureMouse();
     void releaseMouse();
+    void syncTexture(int id); // GL context must be current
     
     // Renderer
     VisualRenderer *m_renderer;
@@ -80,8 +94,14 @@ private:
     bool m_mouseCaptured;
     bool m_firstMouse;
     
-    // Map data reference
-    MapData m_mapData;
+    // Map and textures handed over before initializeGL(), released once the
+    // renderer has built its geometry
+    MapData m_pendingMapData;
+    QMap<int, QImage> m_pendingTextures;
+
+    // Shared textures and the generation of each one the renderer holds
+    TextureRegistry *m_textureRegistry;
+    QHash<int, quint64> m_uploadedGenerations;
 };
 
 #endif // VISUALMODEWIDGET_H
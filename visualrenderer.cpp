@@ -1,9 +1,16 @@
 #include "visualrenderer.h"
+#include "polygontriangulator.h"
 #include <QDebug>
+#include <QOpenGLContext>
+#include <QOpenGLExtraFunctions>
+#include <QVector4D>
 #include <QtMath>
 
 VisualRenderer::VisualRenderer()
-    : m_shaderProgram(nullptr), m_defaultTexture(nullptr), m_cameraX(0.0f),
+    : m_shaderProgram(nullptr), m_staticVBO(nullptr), m_staticIBO(nullptr),
+      m_staticVAO(nullptr), m_staticLayersDirty(false),
+      m_portalCulling(false), m_cullingEnabled(true), m_maxArrayLayers(256),
+      m_defaultTexture(nullptr), m_defaultArray(nullptr), m_cameraX(0.0f),
       m_cameraY(0.0f), m_cameraZ(32.0f), m_cameraYaw(0.0f), m_cameraPitch(0.0f),
       m_skyTextureId(-1), m_time(0.0f), m_initialized(false) {}
 
@@ -40,6 +47,22 @@ bool VisualRenderer::initialize() {
   m_defaultTexture->setMinificationFilter(QOpenGLTexture::Nearest);
   m_defaultTexture->setMagnificationFilter(QOpenGLTexture::Nearest);
 
+  // And its texture array twin for world surfaces
+  const quint32 white = 0xffffffff;
+  m_defaultArray = new QOpenGLTexture(QOpenGLTexture::Target2DArray);
+  m_defaultArray->setSize(1, 1);
+  m_defaultArray->setLayers(1);
+  m_defaultArray->setFormat(QOpenGLTexture::RGBA8_UNorm);
+  m_defaultArray->allocateStorage(QOpenGLTexture::RGBA,
+                                  QOpenGLTexture::UInt8);
+  m_defaultArray->setData(0, 0, QOpenGLTexture::RGBA, QOpenGLTexture::UInt8,
+                          &white);
+  m_defaultArray->setMinificationFilter(QOpenGLTexture::Nearest);
+  m_defaultArray->setMagnificationFilter(QOpenGLTexture::Nearest);
+
+  glGetIntegerv(GL_MAX_ARRAY_TEXTURE_LAYERS, &m_maxArrayLayers);
+  m_maxArrayLayers = qMax(1, m_maxArrayLayers);
+
   // Set default projection
   setProjection(90.0f, 4.0f / 3.0f, 0.1f, 10000.0f);
 
@@ -54,6 +77,7 @@ void VisualRenderer::cleanup() {
   }
 
   clearGeometry();
+  m_flatCache.clear();
   destroyShaders();
 
   // Clean up textures
@@ -62,10 +86,18 @@ void VisualRenderer::cleanup() {
   }
   m_textures.clear();
 
+  for (TextureArray &array : m_textureArrays)
+    delete array.texture;
+  m_textureArrays.clear();
+  m_textureSlots.clear();
+  m_pendingImages.clear();
+
   if (m_defaultTexture) {
     delete m_defaultTexture;
     m_defaultTexture = nullptr;
   }
+  delete m_defaultArray;
+  m_defaultArray = nullptr;
 
   // Clean up models
   for (MD3Loader *loader : m_models) {
@@ -85,18 +117,28 @@ bool VisualRenderer::createShaders() {
         layout(location = 0) in vec3 position;
         layout(location = 1) in vec2 texCoord;
         layout(location = 2) in vec3 normal;
+        layout(location = 3) in vec4 material; // light, flags, liquid intensity, liquid speed
+        layout(location = 4) in float layer;   // Texture array layer
         
         uniform mat4 mvp;
         
         out vec2 fragTexCoord;
         out vec3 fragNormal;
         out float fragDepth;
+        out float fragLight;
+        flat out int fragFlags;
+        out float fragLiquidIntensity;
+        flat out float fragLayer;
         
         void main() {
             gl_Position = mvp * vec4(position, 1.0);
             fragTexCoord = texCoord;
             fragNormal = normal;
             fragDepth = gl_Position.z;
+            fragLight = material.x;
+            fragFlags = int(material.y + 0.5);
+            fragLiquidIntensity = material.z;
+            fragLayer = layer;
         }
     )";
 
@@ -106,17 +148,23 @@ bool VisualRenderer::createShaders() {
         in vec2 fragTexCoord;
         in vec3 fragNormal;
         in float fragDepth;
+        in float fragLight;
+        flat in int fragFlags;
+        in float fragLiquidIntensity;
+        flat in float fragLayer;
         
-        uniform sampler2D textureSampler;
-        uniform float lightLevel;
+        uniform sampler2D textureSampler;     // Sprites and sky
+        uniform sampler2DArray textureArray; // World surfaces
+        uniform bool u_useArray;
         uniform float u_time;
-        uniform int u_sectorFlags;
-        uniform float u_liquidIntensity;
         
         out vec4 color;
         
         void main() {
             vec2 finalUV = fragTexCoord;
+            int u_sectorFlags = fragFlags;
+            float u_liquidIntensity = fragLiquidIntensity;
+            float lightLevel = fragLight;
             
             // Liquidos logic
             int fluidType = u_sectorFlags & 7;
@@ -146,7 +194,9 @@ bool VisualRenderer::createShaders() {
             if (scrollX) finalUV.x += u_time * 1.0;
             if (scrollY) finalUV.y += u_time * 1.0;
 
-            vec4 texColor = texture(textureSampler, finalUV);
+            vec4 texColor = u_useArray
+                ? texture(textureArray, vec3(finalUV, fragLayer))
+                : texture(textureSampler, finalUV);
             
             // Apply lighting
             float lighting = max(abs(dot(fragNormal, vec3(0.0, 1.0, 0.0))), 0.5);
@@ -182,12 +232,9 @@ bool VisualRenderer::createShaders() {
   // Get uniform locations
   m_uniformMVP = m_shaderProgram->uniformLocation("mvp");
   m_uniformTexture = m_shaderProgram->uniformLocation("textureSampler");
-  m_uniformLightLevel = m_shaderProgram->uniformLocation("lightLevel");
+  m_uniformTextureArray = m_shaderProgram->uniformLocation("textureArray");
+  m_uniformUseArray = m_shaderProgram->uniformLocation("u_useArray");
   m_uniformTime = m_shaderProgram->uniformLocation("u_time");
-  m_uniformSectorFlags = m_shaderProgram->uniformLocation("u_sectorFlags");
-  m_uniformLiquidIntensity =
-      m_shaderProgram->uniformLocation("u_liquidIntensity");
-  m_uniformLiquidSpeed = m_shaderProgram->uniformLocation("u_liquidSpeed");
 
   qDebug() << "Shaders created successfully";
   return true;
@@ -206,9 +253,6 @@ void VisualRenderer::setMapData(const MapData &mapData) {
     return;
   }
 
-  // Store map data for portal lookups
-  m_mapData = mapData;
-
   // Store sky texture ID
   m_skyTextureId = mapData.skyTextureID;
 
@@ -223,12 +267,32 @@ void VisualRenderer::setMapData(const MapData &mapData) {
            << "entities, sky texture:" << m_skyTextureId;
 }
 
+// Axis-aligned bounds of the positions in an interleaved vertex array
+static void vertexBounds(const QVector<float> &vertices, int stride,
+                         QVector3D &boundsMin, QVector3D &boundsMax) {
+  if (vertices.size() < 3)
+    return;
+  boundsMin = boundsMax = QVector3D(vertices[0], vertices[1], vertices[2]);
+  for (int i = stride; i + 2 < vertices.size(); i += stride) {
+    QVector3D p(vertices[i], vertices[i + 1], vertices[i + 2]);
+    boundsMin = QVector3D(qMin(boundsMin.x(), p.x()), qMin(boundsMin.y(), p.y()),
+                          qMin(boundsMin.z(), p.z()));
+    boundsMax = QVector3D(qMax(boundsMax.x(), p.x()), qMax(boundsMax.y(), p.y()),
+                          qMax(boundsMax.z(), p.z()));
+  }
+}
+
 void VisualRenderer::generateGeometry(const MapData &mapData) {
   qDebug() << "=== Generating geometry for" << mapData.sectors.size()
            << "sectors ===";
 
-  // Generate geometry for each sector
-  for (const Sector &sector : mapData.sectors) {
+  // Generate geometry for each sector, grouped by texture and material.
+  // Each sector keeps its own vertices so it can be rebuilt on its own.
+  m_sectorGeometry.resize(mapData.sectors.size());
+  m_sectorIds.resize(mapData.sectors.size());
+  m_sectorIndexById.clear();
+  for (int i = 0; i < mapData.sectors.size(); i++) {
+    const Sector &sector = mapData.sectors[i];
     qDebug() << "Sector" << sector.sector_id
              << ": vertices=" << sector.vertices.size()
              << "walls=" << sector.walls.size() << "floor_z=" << sector.floor_z
@@ -236,31 +300,59 @@ void VisualRenderer::generateGeometry(const MapData &mapData) {
              << "light=" << sector.light_level
              << "floor_tex=" << sector.floor_texture_id
              << "ceiling_tex=" << sector.ceiling_texture_id;
-    generateSectorGeometry(sector);
+    m_sectorIds[i] = sector.sector_id;
+    m_sectorIndexById.insert(sector.sector_id, i);
+    m_sectorGeometry[i].clear();
+    generateSectorGeometry(mapData, sector, m_sectorGeometry[i]);
+  }
+
+  m_sectorVisibility.resize(mapData.sectors.size());
+  for (int i = 0; i < mapData.sectors.size(); i++)
+    buildSectorVisibility(mapData, i);
+
+  // Drop cached triangulations of deleted sectors
+  for (QHash<int, FlatTriangulation>::iterator it = m_flatCache.begin();
+       it != m_flatCache.end();) {
+    if (m_sectorIndexById.contains(it.key()))
+      ++it;
+    else
+      it = m_flatCache.erase(it);
   }
 
-  qDebug() << "Generated:" << m_wallBuffers.size() << "walls,"
-           << m_floorBuffers.size() << "floors," << m_ceilingBuffers.size()
-           << "ceilings";
+  uploadStaticGeometry();
 
   // Debug: Show texture IDs being used
   QSet<int> usedTextures;
-  for (const GeometryBuffer &buf : m_wallBuffers)
-    usedTextures.insert(buf.textureId);
-  for (const GeometryBuffer &buf : m_floorBuffers)
-    usedTextures.insert(buf.textureId);
-  for (const GeometryBuffer &buf : m_ceilingBuffers)
-    usedTextures.insert(buf.textureId);
+  for (const BatchMeshes &geometry : m_sectorGeometry) {
+    for (BatchMeshes::const_iterator it = geometry.constBegin();
+         it != geometry.constEnd(); ++it)
+      usedTextures.insert((int)(quint32)it.key());
+  }
 
   qDebug() << "Texture IDs used by geometry:" << usedTextures;
-  qDebug() << "Texture IDs loaded in renderer:" << m_textures.keys();
+  qDebug() << "Texture IDs loaded in renderer:" << m_textureSlots.keys();
+
+  generateEntities(mapData);
+}
 
-  // Generate entity billboards or 3D models
+void VisualRenderer::updateEntities(const MapData &mapData) {
+  if (!m_initialized)
+    return;
+
+  m_skyTextureId = mapData.skyTextureID;
+  clearEntities();
+  generateEntities(mapData);
+}
+
+// Entity billboards or 3D models. Needs the sector visibility data, which
+// places each entity in its sector for culling.
+void VisualRenderer::generateEntities(const MapData &mapData) {
   int entityIndex = 0;
   for (const EntityInstance &entity : mapData.entities) {
 
     bool modelLoaded = false;
     int entityTextureId = 1000 + entityIndex;
+    int entitySector = sectorAt(entity.x, entity.y);
 
     // Try to find/load texture first (for both model and billboard)
     QString texturePath = entity.assetPath;
@@ -272,14 +364,14 @@ void VisualRenderer::generateGeometry(const MapData &mapData) {
 
     QImage entityImage(texturePath);
     if (!entityImage.isNull()) {
-      loadTexture(entityTextureId, entityImage);
+      loadSpriteTexture(entityTextureId, entityImage);
     } else {
       // Placeholder texture
       QImage placeholder(64, 64, QImage::Format_RGB888);
       QColor colors[] = {Qt::red,    Qt::green, Qt::blue,
                          Qt::yellow, Qt::cyan,  Qt::magenta};
       placeholder.fill(colors[entityIndex % 6]);
-      loadTexture(entityTextureId, placeholder);
+      loadSpriteTexture(entityTextureId, placeholder);
     }
 
     // Try to load and render MD3 model
@@ -359,6 +451,8 @@ void VisualRenderer::generateGeometry(const MapData &mapData) {
             buffer.textureId =
                 entityTextureId; // Use the entity texture we loaded
             buffer.lightLevel = 1.0f;
+            vertexBounds(vertices, 8, buffer.boundsMin, buffer.boundsMax);
+            buffer.sectorIndex = entitySector;
 
             m_entityBuffers.append(buffer);
           }
@@ -425,6 +519,8 @@ void VisualRenderer::generateGeometry(const MapData &mapData) {
         buffer.vertexCount = 6;
         buffer.textureId = entityTextureId;
         buffer.lightLevel = 1.0f;
+        vertexBounds(vertices, 8, buffer.boundsMin, buffer.boundsMax);
+        buffer.sectorIndex = entitySector;
 
         m_entityBuffers.append(buffer);
       }
@@ -436,157 +532,165 @@ void VisualRenderer::generateGeometry(const MapData &mapData) {
   qDebug() << "Generated" << m_entityBuffers.size() << "entity billboards";
 }
 
-void VisualRenderer::generateSectorGeometry(const Sector &sector) {
-  if (sector.vertices.size() < 3) {
-    return; // Invalid sector
-  }
+// Batch keys sort opaque before liquid, flats before walls, then by texture
+static quint64 batchKey(bool liquid, bool wall, int textureId) {
+  return ((quint64)liquid << 33) | ((quint64)wall << 32) | (quint32)textureId;
+}
 
-  // Generate floor geometry (triangulated polygon)
-  {
-    QVector<float> vertices;
-
-    // Simple fan triangulation from first vertex
-    for (int i = 1; i < sector.vertices.size() - 1; i++) {
-      // Triangle: 0, i, i+1
-
-      // Vertex 0
-      vertices << sector.vertices[0].x() << sector.floor_z
-               << sector.vertices[0].y();
-      vertices << sector.vertices[0].x() / 128.0f
-               << sector.vertices[0].y() / 128.0f; // UV
-      vertices << 0.0f << 1.0f << 0.0f;            // Normal (up)
-
-      // Vertex i
-      vertices << sector.vertices[i].x() << sector.floor_z
-               << sector.vertices[i].y();
-      vertices << sector.vertices[i].x() / 128.0f
-               << sector.vertices[i].y() / 128.0f;
-      vertices << 0.0f << 1.0f << 0.0f;
-
-      // Vertex i+1
-      vertices << sector.vertices[i + 1].x() << sector.floor_z
-               << sector.vertices[i + 1].y();
-      vertices << sector.vertices[i + 1].x() / 128.0f
-               << sector.vertices[i + 1].y() / 128.0f;
-      vertices << 0.0f << 1.0f << 0.0f;
+// Floats written by appendVertex (VisualRenderer::STATIC_VERTEX_FLOATS)
+static const int VERTEX_FLOATS = 13;
+static const int LAYER_FLOAT = 12;
+
+// The layer is filled in by applyTextureLayers() once the texture is known
+static void appendVertex(QVector<float> &out, float x, float y, float z,
+                         float u, float v, float nx, float ny, float nz,
+                         const QVector4D &material) {
+  out << x << y << z;
+  out << u << v;
+  out << nx << ny << nz;
+  out << material.x() << material.y() << material.z() << material.w();
+  out << 0.0f;
+}
+
+// Two triangles from (x1, y1) to (x2, y2) between bottom and top heights,
+// sharing the diagonal's vertices
+static void appendWallQuad(QVector<float> &vertices, QVector<quint32> &indices,
+                           const Wall &wall, float bottom, float top,
+                           float length, float nx, float nz,
+                           const QVector4D &material) {
+  float u1 = 0.0f;
+  float u2 = length / 128.0f; // Horizontal tiling based on wall length
+  float v1 = 0.0f;
+  float v2 = 1.0f; // Stretch vertically to fit wall height (no tiling)
+
+  quint32 base = vertices.size() / VERTEX_FLOATS;
+  appendVertex(vertices, wall.x1, bottom, wall.y1, u1, v1, nx, 0.0f, nz,
+               material);
+  appendVertex(vertices, wall.x2, bottom, wall.y2, u2, v1, nx, 0.0f, nz,
+               material);
+  appendVertex(vertices, wall.x2, top, wall.y2, u2, v2, nx, 0.0f, nz,
+               material);
+  appendVertex(vertices, wall.x1, top, wall.y1, u1, v2, nx, 0.0f, nz,
+               material);
+
+  indices << base << base + 1 << base + 2;
+  indices << base << base + 2 << base + 3;
+}
+
+// FNV-1a over the outline and hole coordinates
+static quint64 outlineHash(const QVector<QPointF> &outline,
+                           const QVector<QVector<QPointF>> &holes) {
+  quint64 hash = 14695981039346656037ULL;
+  auto mix = [&hash](const void *data, int size) {
+    const unsigned char *bytes = static_cast<const unsigned char *>(data);
+    for (int i = 0; i < size; i++) {
+      hash ^= bytes[i];
+      hash *= 1099511628211ULL;
+    }
+  };
+  auto mixRing = [&mix](const QVector<QPointF> &ring) {
+    int count = ring.size();
+    mix(&count, sizeof(count));
+    for (const QPointF &p : ring) {
+      double xy[2] = {p.x(), p.y()};
+      mix(xy, sizeof(xy));
     }
+  };
+  mixRing(outline);
+  for (const QVector<QPointF> &hole : holes)
+    mixRing(hole);
+  return hash;
+}
 
-    if (!vertices.isEmpty()) {
-      GeometryBuffer buffer;
-      buffer.vbo = new QOpenGLBuffer(QOpenGLBuffer::VertexBuffer);
-      buffer.vbo->create();
-      buffer.vbo->bind();
-      buffer.vbo->allocate(vertices.constData(),
-                           vertices.size() * sizeof(float));
+const QVector<quint32> &
+VisualRenderer::flatTriangulation(const Sector &sector,
+                                  const QVector<QVector<QPointF>> &holes) {
+  quint64 hash = outlineHash(sector.vertices, holes);
+  QHash<int, FlatTriangulation>::iterator it =
+      m_flatCache.find(sector.sector_id);
+  if (it != m_flatCache.end() && it->outlineHash == hash)
+    return it->indices;
+
+  FlatTriangulation entry;
+  entry.outlineHash = hash;
+  if (!PolygonTriangulator::triangulate(sector.vertices, holes,
+                                        entry.indices)) {
+    qWarning() << "Sector" << sector.sector_id
+               << "outline intersects itself, floor may overlap";
+  }
+  return m_flatCache.insert(sector.sector_id, entry)->indices;
+}
 
-      buffer.vao = new QOpenGLVertexArrayObject();
-      buffer.vao->create();
-      buffer.vao->bind();
+// Per-surface shader inputs: light, flags, liquid intensity, liquid speed.
+// liquidFlag is the sector flag that makes this surface use the liquid type.
+static QVector4D sectorMaterial(const Sector &sector, int liquidFlag) {
+  int flags = sector.flags & (8 | 16 | 256); // Scroll & Ripples always
+  if (sector.flags & liquidFlag)
+    flags |= (sector.flags & 7);
+  float light = sector.light_level > 0 ? sector.light_level / 255.0f : 1.0f;
+  return QVector4D(light, flags, sector.liquid_intensity,
+                   sector.liquid_speed);
+}
 
-      // Position attribute
-      glEnableVertexAttribArray(0);
-      glVertexAttribPointer(0, 3, GL_FLOAT, GL_FALSE, 8 * sizeof(float),
-                            (void *)0);
+void VisualRenderer::generateSectorGeometry(const MapData &mapData,
+                                            const Sector &sector,
+                                            BatchMeshes &batches) {
+  if (sector.vertices.size() < 3) {
+    return; // Invalid sector
+  }
 
-      // TexCoord attribute
-      glEnableVertexAttribArray(1);
-      glVertexAttribPointer(1, 2, GL_FLOAT, GL_FALSE, 8 * sizeof(float),
-                            (void *)(3 * sizeof(float)));
+  // Floor and ceiling share one triangulation of the outline, with child
+  // sectors cut out (they draw their own flats)
+  QVector<QVector<QPointF>> holes;
+  for (int childId : sector.child_sector_ids) {
+    const Sector *child = mapData.findSector(childId);
+    if (child && child->vertices.size() >= 3)
+      holes.append(child->vertices);
+  }
+  const QVector<quint32> &triangles = flatTriangulation(sector, holes);
 
-      // Normal attribute
-      glEnableVertexAttribArray(2);
-      glVertexAttribPointer(2, 3, GL_FLOAT, GL_FALSE, 8 * sizeof(float),
-                            (void *)(5 * sizeof(float)));
+  // Points in the order the triangulation indexes them
+  QVector<QPointF> points = sector.vertices;
+  for (const QVector<QPointF> &hole : holes)
+    points += hole;
 
-      buffer.vao->release();
-      buffer.vbo->release();
-
-      buffer.vertexCount = vertices.size() / 8;
-      buffer.textureId = sector.floor_texture_id;
-      buffer.lightLevel =
-          sector.light_level > 0 ? sector.light_level / 255.0f : 1.0f;
-      buffer.flags = (sector.flags & (8 | 16 | 256)); // Scroll & Ripples always
-      if (sector.flags & 32)
-        buffer.flags |= (sector.flags & 7); // Liquid type if floor is liquid
-      buffer.liquidIntensity = sector.liquid_intensity;
-      buffer.liquidSpeed = sector.liquid_speed;
-
-      m_floorBuffers.append(buffer);
+  // Generate floor geometry
+  {
+    QVector4D material = sectorMaterial(sector, 32);
+    BatchMesh &mesh = batches[batchKey(((int)material.y() & 7) != 0, false,
+                                       sector.floor_texture_id)];
+    quint32 base = mesh.vertices.size() / STATIC_VERTEX_FLOATS;
+    for (const QPointF &p : points) {
+      appendVertex(mesh.vertices, p.x(), sector.floor_z, p.y(), p.x() / 128.0f,
+                   p.y() / 128.0f, 0.0f, 1.0f, 0.0f, material);
     }
+    for (quint32 index : triangles)
+      mesh.indices << base + index;
   }
 
-  // Generate ceiling geometry (triangulated polygon, facing down)
+  // Generate ceiling geometry (facing down)
   // Only generate if not Sky (ID > 0)
   if (sector.ceiling_texture_id > 0) {
-    QVector<float> vertices;
-
-    // Simple fan triangulation from first vertex (reversed winding for downward
-    // face)
-    for (int i = 1; i < sector.vertices.size() - 1; i++) {
-      // Triangle: 0, i+1, i (reversed)
-
-      // Vertex 0
-      vertices << sector.vertices[0].x() << sector.ceiling_z
-               << sector.vertices[0].y();
-      vertices << sector.vertices[0].x() / 128.0f
-               << sector.vertices[0].y() / 128.0f;
-      vertices << 0.0f << -1.0f << 0.0f; // Normal (down)
-
-      // Vertex i+1
-      vertices << sector.vertices[i + 1].x() << sector.ceiling_z
-               << sector.vertices[i + 1].y();
-      vertices << sector.vertices[i + 1].x() / 128.0f
-               << sector.vertices[i + 1].y() / 128.0f;
-      vertices << 0.0f << -1.0f << 0.0f;
-
-      // Vertex i
-      vertices << sector.vertices[i].x() << sector.ceiling_z
-               << sector.vertices[i].y();
-      vertices << sector.vertices[i].x() / 128.0f
-               << sector.vertices[i].y() / 128.0f;
-      vertices << 0.0f << -1.0f << 0.0f;
+    QVector4D material = sectorMaterial(sector, 64);
+    BatchMesh &mesh = batches[batchKey(((int)material.y() & 7) != 0, false,
+                                       sector.ceiling_texture_id)];
+    quint32 base = mesh.vertices.size() / STATIC_VERTEX_FLOATS;
+    for (const QPointF &p : points) {
+      appendVertex(mesh.vertices, p.x(), sector.ceiling_z, p.y(),
+                   p.x() / 128.0f, p.y() / 128.0f, 0.0f, -1.0f, 0.0f,
+                   material);
     }
-
-    if (!vertices.isEmpty()) {
-      GeometryBuffer buffer;
-      buffer.vbo = new QOpenGLBuffer(QOpenGLBuffer::VertexBuffer);
-      buffer.vbo->create();
-      buffer.vbo->bind();
-      buffer.vbo->allocate(vertices.constData(),
-                           vertices.size() * sizeof(float));
-
-      buffer.vao = new QOpenGLVertexArrayObject();
-      buffer.vao->create();
-      buffer.vao->bind();
-
-      glEnableVertexAttribArray(0);
-      glVertexAttribPointer(0, 3, GL_FLOAT, GL_FALSE, 8 * sizeof(float),
-                            (void *)0);
-      glEnableVertexAttribArray(1);
-      glVertexAttribPointer(1, 2, GL_FLOAT, GL_FALSE, 8 * sizeof(float),
-                            (void *)(3 * sizeof(float)));
-      glEnableVertexAttribArray(2);
-      glVertexAttribPointer(2, 3, GL_FLOAT, GL_FALSE, 8 * sizeof(float),
-                            (void *)(5 * sizeof(float)));
-
-      buffer.vao->release();
-      buffer.vbo->release();
-
-      buffer.vertexCount = vertices.size() / 8;
-      buffer.textureId = sector.ceiling_texture_id;
-      buffer.lightLevel =
-          sector.light_level > 0 ? sector.light_level / 255.0f : 1.0f;
-      buffer.flags = (sector.flags & (8 | 16 | 256)); // Scroll & Ripples
-      if (sector.flags & 64)
-        buffer.flags |= (sector.flags & 7); // Liquid type if ceiling is liquid
-      buffer.liquidIntensity = sector.liquid_intensity;
-      buffer.liquidSpeed = sector.liquid_speed;
-
-      m_ceilingBuffers.append(buffer);
+    // Reversed winding for the downward face
+    for (int i = 0; i + 2 < triangles.size(); i += 3) {
+      mesh.indices << base + triangles[i] << base + triangles[i + 2]
+                   << base + triangles[i + 1];
     }
   }
 
   // Generate wall geometry
+  QVector4D wallMaterial = sectorMaterial(sector, 128);
+  bool wallLiquid = ((int)wallMaterial.y() & 7) != 0;
+
   for (const Wall &wall : sector.walls) {
     float dx = wall.x2 - wall.x1;
     float dy = wall.y2 - wall.y1;
@@ -595,47 +699,26 @@ void VisualRenderer::generateSectorGeometry(const Sector &sector) {
       continue;
 
     float nx = -dy / length;
-    float ny = 0.0f;
     float nz = dx / length;
 
     // Check if this wall is a portal
     if (wall.portal_id >= 0) {
-      qDebug() << "Portal wall detected: portal_id=" << wall.portal_id
-               << "upper_tex=" << wall.texture_id_upper
-               << "lower_tex=" << wall.texture_id_lower;
-
       // This is a portal - render upper and lower sections if needed
       // We need to find the connected sector to get its floor/ceiling heights
-      // For now, we'll skip rendering the middle part but render upper/lower
 
       // Find the portal to get the neighbor sector
-      const Portal *portal = nullptr;
-      for (const Portal &p : m_mapData.portals) {
-        if (p.portal_id == wall.portal_id) {
-          portal = &p;
-          break;
-        }
-      }
+      const Portal *portal = mapData.findPortal(wall.portal_id);
 
       if (!portal) {
         qWarning() << "Portal" << wall.portal_id << "not found in portal list!";
         continue;
       }
 
-      qDebug() << "Found portal:" << portal->portal_id << "connecting sectors"
-               << portal->sector_a << "and" << portal->sector_b;
-
       // Find neighbor sector
       int neighborSectorId = (portal->sector_a == sector.sector_id)
                                  ? portal->sector_b
                                  : portal->sector_a;
-      const Sector *neighborSector = nullptr;
-      for (const Sector &s : m_mapData.sectors) {
-        if (s.sector_id == neighborSectorId) {
-          neighborSector = &s;
-          break;
-        }
-      }
+      const Sector *neighborSector = mapData.findSector(neighborSectorId);
 
       if (!neighborSector) {
         // Neighbor sector doesn't exist (was skipped during import)
@@ -645,270 +728,320 @@ void VisualRenderer::generateSectorGeometry(const Sector &sector) {
 
         // Fall through to solid wall rendering below
       } else {
-        qDebug() << "Current sector" << sector.sector_id
-                 << ": floor=" << sector.floor_z
-                 << "ceiling=" << sector.ceiling_z;
-        qDebug() << "Neighbor sector" << neighborSector->sector_id
-                 << ": floor=" << neighborSector->floor_z
-                 << "ceiling=" << neighborSector->ceiling_z;
-
         // Render UPPER wall (if neighbor ceiling is lower than current ceiling)
         if (neighborSector->ceiling_z < sector.ceiling_z) {
-          qDebug() << "Should render UPPER wall: texture_id="
-                   << wall.texture_id_upper;
-
           if (wall.texture_id_upper > 0) {
-            QVector<float> vertices;
-            float u1 = 0.0f;
-            float u2 = length / 128.0f;
-            float v1 = 0.0f;
-            float v2 = 1.0f;
-
             // Upper section: from neighbor ceiling to current ceiling
-            vertices << wall.x1 << neighborSector->ceiling_z << wall.y1;
-            vertices << u1 << v1;
-            vertices << nx << ny << nz;
-
-            vertices << wall.x2 << neighborSector->ceiling_z << wall.y2;
-            vertices << u2 << v1;
-            vertices << nx << ny << nz;
-
-            vertices << wall.x2 << sector.ceiling_z << wall.y2;
-            vertices << u2 << v2;
-            vertices << nx << ny << nz;
-
-            vertices << wall.x1 << neighborSector->ceiling_z << wall.y1;
-            vertices << u1 << v1;
-            vertices << nx << ny << nz;
-
-            vertices << wall.x2 << sector.ceiling_z << wall.y2;
-            vertices << u2 << v2;
-            vertices << nx << ny << nz;
-
-            vertices << wall.x1 << sector.ceiling_z << wall.y1;
-            vertices << u1 << v2;
-            vertices << nx << ny << nz;
-
-            if (!vertices.isEmpty()) {
-              GeometryBuffer buffer;
-              buffer.vbo = new QOpenGLBuffer(QOpenGLBuffer::VertexBuffer);
-              buffer.vbo->create();
-              buffer.vbo->bind();
-              buffer.vbo->allocate(vertices.constData(),
-                                   vertices.size() * sizeof(float));
-
-              buffer.vao = new QOpenGLVertexArrayObject();
-              buffer.vao->create();
-              buffer.vao->bind();
-
-              glEnableVertexAttribArray(0);
-              glVertexAttribPointer(0, 3, GL_FLOAT, GL_FALSE, 8 * sizeof(float),
-                                    (void *)0);
-              glEnableVertexAttribArray(1);
-              glVertexAttribPointer(1, 2, GL_FLOAT, GL_FALSE, 8 * sizeof(float),
-                                    (void *)(3 * sizeof(float)));
-              glEnableVertexAttribArray(2);
-              glVertexAttribPointer(2, 3, GL_FLOAT, GL_FALSE, 8 * sizeof(float),
-                                    (void *)(5 * sizeof(float)));
-
-              buffer.vao->release();
-              buffer.vbo->release();
-
-              buffer.vertexCount = vertices.size() / 8;
-              buffer.textureId = wall.texture_id_upper;
-              buffer.lightLevel =
-                  sector.light_level > 0 ? sector.light_level / 255.0f : 1.0f;
-              buffer.flags = (sector.flags & (8 | 16 | 256));
-              if (sector.flags & 128)
-                buffer.flags |= (sector.flags & 7);
-              buffer.liquidIntensity = sector.liquid_intensity;
-
-              m_wallBuffers.append(buffer);
-            }
+            BatchMesh &mesh =
+                batches[batchKey(wallLiquid, true, wall.texture_id_upper)];
+            appendWallQuad(mesh.vertices, mesh.indices, wall,
+                           neighborSector->ceiling_z, sector.ceiling_z, length,
+                           nx, nz, wallMaterial);
           }
 
           // Render LOWER wall (if current floor is lower than neighbor floor)
           // This shows the step UP from current sector to neighbor sector
           if (sector.floor_z < neighborSector->floor_z &&
               wall.texture_id_lower > 0) {
-            QVector<float> vertices;
-            float u1 = 0.0f;
-            float u2 = length / 128.0f;
-            float v1 = 0.0f;
-            float v2 = 1.0f;
-
-            qDebug() << "Rendering LOWER wall: sector" << sector.sector_id
-                     << "floor=" << sector.floor_z
-                     << "neighbor floor=" << neighborSector->floor_z
-                     << "texture=" << wall.texture_id_lower;
-
             // Lower section: from current floor to neighbor floor
-            vertices << wall.x1 << sector.floor_z << wall.y1;
-            vertices << u1 << v1;
-            vertices << nx << ny << nz;
-
-            vertices << wall.x2 << sector.floor_z << wall.y2;
-            vertices << u2 << v1;
-            vertices << nx << ny << nz;
-
-            vertices << wall.x2 << neighborSector->floor_z << wall.y2;
-            vertices << u2 << v2;
-            vertices << nx << ny << nz;
-
-            vertices << wall.x1 << sector.floor_z << wall.y1;
-            vertices << u1 << v1;
-            vertices << nx << ny << nz;
-
-            vertices << wall.x2 << neighborSector->floor_z << wall.y2;
-            vertices << u2 << v2;
-            vertices << nx << ny << nz;
-
-            vertices << wall.x1 << neighborSector->floor_z << wall.y1;
-            vertices << u1 << v2;
-            vertices << nx << ny << nz;
-
-            if (!vertices.isEmpty()) {
-              GeometryBuffer buffer;
-              buffer.vbo = new QOpenGLBuffer(QOpenGLBuffer::VertexBuffer);
-              buffer.vbo->create();
-              buffer.vbo->bind();
-              buffer.vbo->allocate(vertices.constData(),
-                                   vertices.size() * sizeof(float));
-
-              buffer.vao = new QOpenGLVertexArrayObject();
-              buffer.vao->create();
-              buffer.vao->bind();
-
-              glEnableVertexAttribArray(0);
-              glVertexAttribPointer(0, 3, GL_FLOAT, GL_FALSE, 8 * sizeof(float),
-                                    (void *)0);
-              glEnableVertexAttribArray(1);
-              glVertexAttribPointer(1, 2, GL_FLOAT, GL_FALSE, 8 * sizeof(float),
-                                    (void *)(3 * sizeof(float)));
-              glEnableVertexAttribArray(2);
-              glVertexAttribPointer(2, 3, GL_FLOAT, GL_FALSE, 8 * sizeof(float),
-                                    (void *)(5 * sizeof(float)));
-
-              buffer.vao->release();
-              buffer.vbo->release();
-
-              buffer.vertexCount = vertices.size() / 8;
-              buffer.textureId = wall.texture_id_lower;
-              buffer.lightLevel =
-                  sector.light_level > 0 ? sector.light_level / 255.0f : 1.0f;
-              buffer.flags = (sector.flags & (8 | 16 | 256));
-              if (sector.flags & 128)
-                buffer.flags |= (sector.flags & 7);
-              buffer.liquidIntensity = sector.liquid_intensity;
-
-              m_wallBuffers.append(buffer);
-            }
+            BatchMesh &mesh =
+                batches[batchKey(wallLiquid, true, wall.texture_id_lower)];
+            appendWallQuad(mesh.vertices, mesh.indices, wall, sector.floor_z,
+                           neighborSector->floor_z, length, nx, nz,
+                           wallMaterial);
           }
         }
 
-        qDebug() << "Portal wall - skipping middle texture (texture_id_middle="
-                 << wall.texture_id_middle << ")";
         continue; // Skip rendering middle texture for valid portals
       }
     }
 
     // This is a solid wall (or a portal to a non-existent sector) - render the
     // full middle texture
-    QVector<float> vertices;
-
-    // Texture coordinates: stretch vertically to fit wall height
-    float u1 = 0.0f;
-    float u2 = length / 128.0f; // Horizontal tiling based on wall length
-    float v1 = 0.0f;
-    float v2 = 1.0f; // Stretch vertically to fit wall height (no tiling)
-
-    float wallHeight = sector.ceiling_z - sector.floor_z;
-
-    // Triangle 1
-    vertices << wall.x1 << sector.floor_z << wall.y1;
-    vertices << u1 << v1;
-    vertices << nx << ny << nz;
-
-    vertices << wall.x2 << sector.floor_z << wall.y2;
-    vertices << u2 << v1;
-    vertices << nx << ny << nz;
-
-    vertices << wall.x2 << sector.ceiling_z << wall.y2;
-    vertices << u2 << v2;
-    vertices << nx << ny << nz;
-
-    // Triangle 2
-    vertices << wall.x1 << sector.floor_z << wall.y1;
-    vertices << u1 << v1;
-    vertices << nx << ny << nz;
-
-    vertices << wall.x2 << sector.ceiling_z << wall.y2;
-    vertices << u2 << v2;
-    vertices << nx << ny << nz;
-
-    vertices << wall.x1 << sector.ceiling_z << wall.y1;
-    vertices << u1 << v2;
-    vertices << nx << ny << nz;
-
-    if (!vertices.isEmpty()) {
-      GeometryBuffer buffer;
-      buffer.vbo = new QOpenGLBuffer(QOpenGLBuffer::VertexBuffer);
-      buffer.vbo->create();
-      buffer.vbo->bind();
-      buffer.vbo->allocate(vertices.constData(),
-                           vertices.size() * sizeof(float));
-
-      buffer.vao = new QOpenGLVertexArrayObject();
-      buffer.vao->create();
-      buffer.vao->bind();
+    BatchMesh &mesh =
+        batches[batchKey(wallLiquid, true, wall.texture_id_middle)];
+    appendWallQuad(mesh.vertices, mesh.indices, wall, sector.floor_z,
+                   sector.ceiling_z, length, nx, nz, wallMaterial);
+  }
+}
 
-      glEnableVertexAttribArray(0);
-      glVertexAttribPointer(0, 3, GL_FLOAT, GL_FALSE, 8 * sizeof(float),
-                            (void *)0);
-      glEnableVertexAttribArray(1);
-      glVertexAttribPointer(1, 2, GL_FLOAT, GL_FALSE, 8 * sizeof(float),
-                            (void *)(3 * sizeof(float)));
-      glEnableVertexAttribArray(2);
-      glVertexAttribPointer(2, 3, GL_FLOAT, GL_FALSE, 8 * sizeof(float),
-                            (void *)(5 * sizeof(float)));
+// Draw batch of a sector mesh: its batchKey() with the texture replaced by
+// the texture array holding it + 1 (0 = default texture)
+quint64 VisualRenderer::drawBatchKey(quint64 meshKey) const {
+  int textureId = (int)(quint32)meshKey;
+  QHash<int, TextureSlot>::const_iterator slot =
+      m_textureSlots.constFind(textureId);
+  int array = slot != m_textureSlots.constEnd() ? slot->array : -1;
+  return (meshKey & ~(quint64)0xffffffff) | (quint32)(array + 1);
+}
 
-      buffer.vao->release();
-      buffer.vbo->release();
-
-      buffer.vertexCount = vertices.size() / 8;
-      buffer.textureId = wall.texture_id_middle;
-      buffer.lightLevel =
-          sector.light_level > 0 ? sector.light_level / 255.0f : 1.0f;
-      buffer.flags = (sector.flags & (8 | 16 | 256));
-      if (sector.flags & 128)
-        buffer.flags |= (sector.flags & 7);
-      buffer.liquidIntensity = sector.liquid_intensity;
-      buffer.liquidSpeed = sector.liquid_speed;
-
-      m_wallBuffers.append(buffer);
+void VisualRenderer::applyTextureLayers(BatchMeshes &meshes) const {
+  for (BatchMeshes::iterator it = meshes.begin(); it != meshes.end(); ++it) {
+    QHash<int, TextureSlot>::const_iterator slot =
+        m_textureSlots.constFind((int)(quint32)it.key());
+    float layer = slot != m_textureSlots.constEnd() ? (float)slot->layer : 0.0f;
+    QVector<float> &vertices = it.value().vertices;
+    for (int i = LAYER_FLOAT; i < vertices.size(); i += VERTEX_FLOATS)
+      vertices[i] = layer;
+  }
+}
+
+void VisualRenderer::uploadStaticGeometry() {
+  m_staticLayersDirty = false;
+
+  // Every draw batch used by any sector, in draw order
+  QMap<quint64, int> batchIndexCount;
+  int totalFloats = 0;
+  int totalIndices = 0;
+  for (BatchMeshes &geometry : m_sectorGeometry) {
+    applyTextureLayers(geometry);
+    for (BatchMeshes::const_iterator it = geometry.constBegin();
+         it != geometry.constEnd(); ++it) {
+      batchIndexCount[drawBatchKey(it.key())] += it.value().indices.size();
+      totalFloats += it.value().vertices.size();
+      totalIndices += it.value().indices.size();
+    }
+  }
+
+  // Concatenate batches in key order; each becomes one indexed draw range
+  // made of consecutive per-sector ranges. Inside a sector, the meshes of
+  // every texture in the batch's array are adjacent.
+  QVector<float> vertices;
+  QVector<quint32> indices;
+  vertices.reserve(totalFloats);
+  indices.reserve(totalIndices);
+  m_staticBatches.clear();
+  m_sectorOffsets.fill(QHash<quint64, MeshOffset>(), m_sectorGeometry.size());
+
+  for (QMap<quint64, int>::const_iterator it = batchIndexCount.constBegin();
+       it != batchIndexCount.constEnd(); ++it) {
+    if (it.value() == 0)
+      continue;
+
+    DrawBatch batch;
+    batch.textureArray = (int)(quint32)it.key() - 1;
+    batch.wall = (it.key() >> 32) & 1;
+    batch.liquid = (it.key() >> 33) & 1;
+    batch.first = indices.size();
+    batch.count = it.value();
+
+    for (int i = 0; i < m_sectorGeometry.size(); i++) {
+      SectorRange range;
+      range.sectorIndex = i;
+      range.first = indices.size();
+      for (BatchMeshes::const_iterator part = m_sectorGeometry[i].constBegin();
+           part != m_sectorGeometry[i].constEnd(); ++part) {
+        if (part.value().indices.isEmpty() ||
+            drawBatchKey(part.key()) != it.key())
+          continue;
+        MeshOffset offset;
+        offset.firstVertex = vertices.size() / STATIC_VERTEX_FLOATS;
+        offset.firstIndex = indices.size();
+        m_sectorOffsets[i].insert(part.key(), offset);
+        vertices += part.value().vertices;
+        for (quint32 index : part.value().indices)
+          indices.append(offset.firstVertex + index);
+      }
+      range.count = indices.size() - range.first;
+      if (range.count > 0)
+        batch.ranges.append(range);
     }
+
+    m_staticBatches.append(batch);
   }
+
+  if (indices.isEmpty())
+    return;
+
+  // The VAO references both buffer objects, so reallocating keeps it valid.
+  // The index buffer binding is VAO state: bind the VAO first and release it
+  // before the index buffer.
+  if (m_staticVBO) {
+    m_staticVBO->bind();
+    m_staticVBO->allocate(vertices.constData(),
+                          vertices.size() * sizeof(float));
+    m_staticVBO->release();
+    m_staticVAO->bind();
+    m_staticIBO->bind();
+    m_staticIBO->allocate(indices.constData(),
+                          indices.size() * sizeof(quint32));
+    m_staticVAO->release();
+    m_staticIBO->release();
+    return;
+  }
+
+  m_staticVBO = new QOpenGLBuffer(QOpenGLBuffer::VertexBuffer);
+  m_staticVBO->create();
+  m_staticVBO->bind();
+  m_staticVBO->allocate(vertices.constData(), vertices.size() * sizeof(float));
+
+  m_staticVAO = new QOpenGLVertexArrayObject();
+  m_staticVAO->create();
+  m_staticVAO->bind();
+
+  m_staticIBO = new QOpenGLBuffer(QOpenGLBuffer::IndexBuffer);
+  m_staticIBO->create();
+  m_staticIBO->bind();
+  m_staticIBO->allocate(indices.constData(), indices.size() * sizeof(quint32));
+
+  const int stride = STATIC_VERTEX_FLOATS * sizeof(float);
+
+  // Position attribute
+  glEnableVertexAttribArray(0);
+  glVertexAttribPointer(0, 3, GL_FLOAT, GL_FALSE, stride, (void *)0);
+
+  // TexCoord attribute
+  glEnableVertexAttribArray(1);
+  glVertexAttribPointer(1, 2, GL_FLOAT, GL_FALSE, stride,
+                        (void *)(3 * sizeof(float)));
+
+  // Normal attribute
+  glEnableVertexAttribArray(2);
+  glVertexAttribPointer(2, 3, GL_FLOAT, GL_FALSE, stride,
+                        (void *)(5 * sizeof(float)));
+
+  // Material attribute (light, flags, liquid intensity, liquid speed)
+  glEnableVertexAttribArray(3);
+  glVertexAttribPointer(3, 4, GL_FLOAT, GL_FALSE, stride,
+                        (void *)(8 * sizeof(float)));
+
+  // Texture array layer
+  glEnableVertexAttribArray(4);
+  glVertexAttribPointer(4, 1, GL_FLOAT, GL_FALSE, stride,
+                        (void *)(12 * sizeof(float)));
+
+  m_staticVAO->release();
+  m_staticIBO->release();
+  m_staticVBO->release();
+
+  qDebug() << "Static geometry:" << vertices.size() / STATIC_VERTEX_FLOATS
+           << "vertices," << indices.size() / 3 << "triangles in"
+           << m_staticBatches.size() << "batches";
 }
 
-void VisualRenderer::clearGeometry() {
-  for (GeometryBuffer &buffer : m_wallBuffers) {
-    delete buffer.vbo;
-    delete buffer.vao;
+void VisualRenderer::updateSectors(const MapData &mapData,
+                                   const QSet<int> &sectorIds) {
+  if (!m_initialized) {
+    qWarning() << "Cannot update sectors: renderer not initialized";
+    return;
   }
-  m_wallBuffers.clear();
 
-  for (GeometryBuffer &buffer : m_floorBuffers) {
-    delete buffer.vbo;
-    delete buffer.vao;
+  // Sectors added, removed or reordered: ranges no longer line up
+  bool sameSectors = mapData.sectors.size() == m_sectorIds.size();
+  for (int i = 0; sameSectors && i < mapData.sectors.size(); i++)
+    sameSectors = mapData.sectors[i].sector_id == m_sectorIds[i];
+  if (!sameSectors) {
+    setMapData(mapData);
+    return;
   }
-  m_floorBuffers.clear();
 
-  for (GeometryBuffer &buffer : m_ceilingBuffers) {
-    delete buffer.vbo;
-    delete buffer.vao;
+  // Portal steps take their heights from the neighbor and parents cut their
+  // children out of their flats, rebuild those too
+  QSet<int> rebuild = sectorIds;
+  for (int sectorId : sectorIds) {
+    int index = m_sectorIndexById.value(sectorId, -1);
+    if (index < 0)
+      continue;
+    const Sector &sector = mapData.sectors[index];
+    for (const Wall &wall : sector.walls) {
+      const Portal *portal =
+          wall.portal_id >= 0 ? mapData.findPortal(wall.portal_id) : nullptr;
+      if (portal) {
+        rebuild.insert(portal->sector_a == sectorId ? portal->sector_b
+                                                    : portal->sector_a);
+      }
+    }
+    if (sector.parent_sector_id >= 0)
+      rebuild.insert(sector.parent_sector_id);
+  }
+
+  QVector<int> changed;
+  bool layoutChanged = false;
+  for (int sectorId : rebuild) {
+    int index = m_sectorIndexById.value(sectorId, -1);
+    if (index < 0)
+      continue;
+
+    BatchMeshes geometry;
+    generateSectorGeometry(mapData, mapData.sectors[index], geometry);
+    applyTextureLayers(geometry);
+
+    const BatchMeshes &previous = m_sectorGeometry[index];
+    if (geometry.size() != previous.size())
+      layoutChanged = true;
+    for (BatchMeshes::const_iterator it = geometry.constBegin();
+         !layoutChanged && it != geometry.constEnd(); ++it) {
+      // In place needs the same vertex and index counts in every batch
+      BatchMeshes::const_iterator old = previous.constFind(it.key());
+      if (old == previous.constEnd() ||
+          old.value().vertices.size() != it.value().vertices.size() ||
+          old.value().indices.size() != it.value().indices.size())
+        layoutChanged = true;
+    }
+
+    m_sectorGeometry[index] = geometry;
+    buildSectorVisibility(mapData, index);
+    changed.append(index);
+  }
+
+  if (layoutChanged) {
+    // Texture or topology changed: re-merge the cached per-sector meshes,
+    // other sectors are not regenerated
+    uploadStaticGeometry();
+    return;
+  }
+
+  // Same layout: overwrite the sector ranges in place
+  if (!m_staticVBO)
+    return;
+  const int stride = STATIC_VERTEX_FLOATS * sizeof(float);
+  m_staticVBO->bind();
+  m_staticVAO->bind();
+  m_staticIBO->bind();
+  for (int index : changed) {
+    const BatchMeshes &geometry = m_sectorGeometry[index];
+    for (BatchMeshes::const_iterator it = geometry.constBegin();
+         it != geometry.constEnd(); ++it) {
+      if (it.value().indices.isEmpty())
+        continue;
+      const MeshOffset offset = m_sectorOffsets[index].value(it.key());
+      m_staticVBO->write(offset.firstVertex * stride,
+                         it.value().vertices.constData(),
+                         it.value().vertices.size() * sizeof(float));
+
+      // A reshaped outline can triangulate differently with the same counts
+      QVector<quint32> indices = it.value().indices;
+      for (quint32 &i : indices)
+        i += offset.firstVertex;
+      m_staticIBO->write(offset.firstIndex * sizeof(quint32),
+                         indices.constData(),
+                         indices.size() * sizeof(quint32));
+    }
   }
-  m_ceilingBuffers.clear();
+  m_staticVAO->release();
+  m_staticIBO->release();
+  m_staticVBO->release();
+}
+
+void VisualRenderer::clearGeometry() {
+  delete m_staticVBO;
+  delete m_staticIBO;
+  delete m_staticVAO;
+  m_staticVBO = nullptr;
+  m_staticIBO = nullptr;
+  m_staticVAO = nullptr;
+  m_staticBatches.clear();
+  m_sectorGeometry.clear();
+  m_sectorOffsets.clear();
+  m_sectorIds.clear();
+  m_sectorIndexById.clear();
+  m_sectorVisibility.clear();
+  m_sectorVisible.clear();
+  m_sectorWindow.clear();
+  clearEntities();
+}
 
+void VisualRenderer::clearEntities() {
   for (GeometryBuffer &buffer : m_entityBuffers) {
     delete buffer.vbo;
     delete buffer.vao;
@@ -916,6 +1049,242 @@ void VisualRenderer::clearGeometry() {
   m_entityBuffers.clear();
 }
 
+static bool pointInOutline(float x, float y, const QVector<QPointF> &outline) {
+  bool inside = false;
+  for (int i = 0, j = outline.size() - 1; i < outline.size(); j = i++) {
+    const QPointF &a = outline[i];
+    const QPointF &b = outline[j];
+    if ((a.y() > y) != (b.y() > y) &&
+        x < (b.x() - a.x()) * (y - a.y()) / (b.y() - a.y()) + a.x())
+      inside = !inside;
+  }
+  return inside;
+}
+
+void VisualRenderer::buildSectorVisibility(const MapData &mapData,
+                                           int sectorIndex) {
+  const Sector &sector = mapData.sectors[sectorIndex];
+  SectorVisibility &vis = m_sectorVisibility[sectorIndex];
+  vis.outline = sector.vertices;
+  vis.floorZ = qMin(sector.floor_z, sector.ceiling_z);
+  vis.ceilingZ = qMax(sector.floor_z, sector.ceiling_z);
+  vis.portals.clear();
+  vis.nested.clear();
+
+  int parentIndex = m_sectorIndexById.value(sector.parent_sector_id, -1);
+  if (parentIndex >= 0 && parentIndex != sectorIndex)
+    vis.nested.append(parentIndex);
+  for (int childId : sector.child_sector_ids) {
+    int childIndex = m_sectorIndexById.value(childId, -1);
+    if (childIndex >= 0 && childIndex != sectorIndex &&
+        !vis.nested.contains(childIndex))
+      vis.nested.append(childIndex);
+  }
+
+  // Empty bounds never pass the frustum test
+  vis.boundsMin = QVector3D(1.0f, 1.0f, 1.0f);
+  vis.boundsMax = QVector3D(-1.0f, -1.0f, -1.0f);
+  if (sector.vertices.size() < 3)
+    return;
+
+  float minX = sector.vertices[0].x(), maxX = minX;
+  float minY = sector.vertices[0].y(), maxY = minY;
+  for (const QPointF &v : sector.vertices) {
+    minX = qMin(minX, (float)v.x());
+    maxX = qMax(maxX, (float)v.x());
+    minY = qMin(minY, (float)v.y());
+    maxY = qMax(maxY, (float)v.y());
+  }
+  vis.boundsMin = QVector3D(minX, vis.floorZ, minY);
+  vis.boundsMax = QVector3D(maxX, vis.ceilingZ, maxY);
+
+  for (const Wall &wall : sector.walls) {
+    if (wall.portal_id < 0)
+      continue;
+    const Portal *portal = mapData.findPortal(wall.portal_id);
+    if (!portal)
+      continue;
+
+    int neighborId = (portal->sector_a == sector.sector_id) ? portal->sector_b
+                                                            : portal->sector_a;
+    int neighborIndex = m_sectorIndexById.value(neighborId, -1);
+    if (neighborIndex < 0 || neighborIndex == sectorIndex)
+      continue;
+
+    // Only the shared opening can be seen through
+    const Sector &neighbor = mapData.sectors[neighborIndex];
+    float bottom = qMax(sector.floor_z, neighbor.floor_z);
+    float top = qMin(sector.ceiling_z, neighbor.ceiling_z);
+    if (top <= bottom)
+      continue;
+
+    VisPortal vp;
+    vp.portalId = wall.portal_id;
+    vp.neighborIndex = neighborIndex;
+    vp.corners[0] = QVector3D(wall.x1, bottom, wall.y1);
+    vp.corners[1] = QVector3D(wall.x2, bottom, wall.y2);
+    vp.corners[2] = QVector3D(wall.x2, top, wall.y2);
+    vp.corners[3] = QVector3D(wall.x1, top, wall.y1);
+    vis.portals.append(vp);
+  }
+}
+
+int VisualRenderer::sectorAt(float x, float y) const {
+  // Child sectors lie inside their parents, prefer the smallest match
+  int best = -1;
+  float bestArea = 0.0f;
+  for (int i = 0; i < m_sectorVisibility.size(); i++) {
+    const SectorVisibility &vis = m_sectorVisibility[i];
+    if (vis.outline.size() < 3 || x < vis.boundsMin.x() ||
+        x > vis.boundsMax.x() || y < vis.boundsMin.z() ||
+        y > vis.boundsMax.z() || !pointInOutline(x, y, vis.outline))
+      continue;
+    float area = (vis.boundsMax.x() - vis.boundsMin.x()) *
+                 (vis.boundsMax.z() - vis.boundsMin.z());
+    if (best < 0 || area < bestArea) {
+      best = i;
+      bestArea = area;
+    }
+  }
+  return best;
+}
+
+bool VisualRenderer::boxInFrustum(const QVector3D &boundsMin,
+                                  const QVector3D &boundsMax) const {
+  if (boundsMin.x() > boundsMax.x())
+    return false;
+  for (const QVector4D &plane : m_frustumPlanes) {
+    // Corner furthest along the plane normal
+    float x = plane.x() >= 0.0f ? boundsMax.x() : boundsMin.x();
+    float y = plane.y() >= 0.0f ? boundsMax.y() : boundsMin.y();
+    float z = plane.z() >= 0.0f ? boundsMax.z() : boundsMin.z();
+    if (plane.x() * x + plane.y() * y + plane.z() * z + plane.w() < 0.0f)
+      return false;
+  }
+  return true;
+}
+
+// Screen rectangle covered by a portal opening, clipped to the near plane
+bool VisualRenderer::projectPortal(const QVector3D corners[4],
+                                   const QMatrix4x4 &mvp,
+                                   ScreenRect &rect) const {
+  const float nearW = 0.01f;
+  QVector4D clip[4];
+  for (int i = 0; i < 4; i++)
+    clip[i] = mvp.map(QVector4D(corners[i], 1.0f));
+
+  rect = ScreenRect();
+  bool any = false;
+  auto addPoint = [&](const QVector4D &p) {
+    float x = p.x() / p.w();
+    float y = p.y() / p.w();
+    rect.x0 = any ? qMin(rect.x0, x) : x;
+    rect.y0 = any ? qMin(rect.y0, y) : y;
+    rect.x1 = any ? qMax(rect.x1, x) : x;
+    rect.y1 = any ? qMax(rect.y1, y) : y;
+    any = true;
+  };
+
+  for (int i = 0; i < 4; i++) {
+    const QVector4D &a = clip[i];
+    const QVector4D &b = clip[(i + 1) % 4];
+    if (a.w() >= nearW)
+      addPoint(a);
+    if ((a.w() >= nearW) != (b.w() >= nearW)) {
+      float t = (nearW - a.w()) / (b.w() - a.w());
+      addPoint(a + (b - a) * t);
+    }
+  }
+  if (!any)
+    return false; // Behind the camera
+
+  rect.x0 = qMax(rect.x0, -1.0f);
+  rect.y0 = qMax(rect.y0, -1.0f);
+  rect.x1 = qMin(rect.x1, 1.0f);
+  rect.y1 = qMin(rect.y1, 1.0f);
+  return !rect.isEmpty();
+}
+
+void VisualRenderer::computeVisibility(const QMatrix4x4 &mvp) {
+  int sectorCount = m_sectorVisibility.size();
+  m_sectorVisible.fill(0, sectorCount);
+  m_portalCulling = false;
+
+  if (!m_cullingEnabled) {
+    m_sectorVisible.fill(1, sectorCount);
+    return;
+  }
+
+  // Clip space planes (Gribb/Hartmann), inside when dot(plane, p) >= 0
+  QVector4D row[4] = {mvp.row(0), mvp.row(1), mvp.row(2), mvp.row(3)};
+  m_frustumPlanes[0] = row[3] + row[0];
+  m_frustumPlanes[1] = row[3] - row[0];
+  m_frustumPlanes[2] = row[3] + row[1];
+  m_frustumPlanes[3] = row[3] - row[1];
+  m_frustumPlanes[4] = row[3] + row[2];
+  m_frustumPlanes[5] = row[3] - row[2];
+
+  // Portal traversal needs the camera inside a sector, between its floor
+  // and ceiling; flying outside the map falls back to the frustum alone
+  int cameraSector = sectorAt(m_cameraX, m_cameraZ);
+  if (cameraSector >= 0 &&
+      m_cameraY >= m_sectorVisibility[cameraSector].floorZ &&
+      m_cameraY <= m_sectorVisibility[cameraSector].ceilingZ) {
+    m_portalCulling = true;
+    m_sectorWindow.fill(ScreenRect(), sectorCount);
+    traversePortals(cameraSector, ScreenRect(-1.0f, -1.0f, 1.0f, 1.0f), -1, 0,
+                    mvp);
+  } else {
+    m_sectorVisible.fill(1, sectorCount);
+  }
+
+  for (int i = 0; i < sectorCount; i++) {
+    if (m_sectorVisible[i] && !boxInFrustum(m_sectorVisibility[i].boundsMin,
+                                            m_sectorVisibility[i].boundsMax))
+      m_sectorVisible[i] = 0;
+  }
+}
+
+// Marks sectorIndex visible and recurses through every portal whose opening
+// overlaps window, and into its parent and child sectors. A sector reached
+// again is only revisited with the union of its windows, and only when that
+// union grew, so loops terminate.
+void VisualRenderer::traversePortals(int sectorIndex, ScreenRect window,
+                                     int entryPortalId, int depth,
+                                     const QMatrix4x4 &mvp) {
+  ScreenRect &seen = m_sectorWindow[sectorIndex];
+  if (!seen.isEmpty()) {
+    if (window.x0 >= seen.x0 && window.y0 >= seen.y0 && window.x1 <= seen.x1 &&
+        window.y1 <= seen.y1)
+      return;
+    window = ScreenRect(qMin(window.x0, seen.x0), qMin(window.y0, seen.y0),
+                        qMax(window.x1, seen.x1), qMax(window.y1, seen.y1));
+  }
+  seen = window;
+  m_sectorVisible[sectorIndex] = 1;
+
+  if (depth >= MAX_PORTAL_DEPTH)
+    return;
+
+  for (const VisPortal &portal : m_sectorVisibility[sectorIndex].portals) {
+    if (portal.portalId == entryPortalId)
+      continue;
+    ScreenRect rect;
+    if (!projectPortal(portal.corners, mvp, rect))
+      continue;
+    rect = ScreenRect(qMax(rect.x0, window.x0), qMax(rect.y0, window.y0),
+                      qMin(rect.x1, window.x1), qMin(rect.y1, window.y1));
+    if (rect.isEmpty())
+      continue;
+    traversePortals(portal.neighborIndex, rect, portal.portalId, depth + 1,
+                    mvp);
+  }
+
+  // A whole nesting group is visible through any opening into one of them
+  for (int nestedIndex : m_sectorVisibility[sectorIndex].nested)
+    traversePortals(nestedIndex, window, -1, depth + 1, mvp);
+}
+
 void VisualRenderer::loadTexture(int id, const QImage &image) {
   if (!m_initialized) {
     qWarning() << "Cannot load texture: renderer not initialized";
@@ -927,20 +1296,213 @@ void VisualRenderer::loadTexture(int id, const QImage &image) {
     return;
   }
 
-  // Delete existing texture if present
-  if (m_textures.contains(id)) {
-    delete m_textures[id];
+  // GL rows start at the bottom
+  QImage pixels =
+      image.convertToFormat(QImage::Format_RGBA8888).mirrored(false, true);
+  m_pendingImages.insert(id, pixels);
+
+  // The sky's 2D copy is made again from the new pixels
+  delete m_textures.take(id);
+
+  QHash<int, TextureSlot>::iterator slot = m_textureSlots.find(id);
+  if (slot != m_textureSlots.end() &&
+      m_textureArrays[slot->array].size == pixels.size()) {
+    // Same size: only this layer is uploaded again
+    m_textureArrays[slot->array].dirtyLayers.insert(slot->layer);
+    qDebug() << "Reloaded texture ID" << id << "size:" << image.size();
+    return;
+  }
+  releaseTextureSlot(id);
+
+  // First array of this size with a free layer, else a new array
+  TextureSlot newSlot = {-1, -1};
+  for (int i = 0; i < m_textureArrays.size() && newSlot.array < 0; i++) {
+    TextureArray &array = m_textureArrays[i];
+    if (array.size != pixels.size())
+      continue;
+    int layer = array.layers.indexOf(-1);
+    if (layer >= 0) {
+      array.layers[layer] = id;
+    } else if (array.layers.size() < m_maxArrayLayers) {
+      layer = array.layers.size();
+      array.layers.append(id);
+      if (!array.texture || layer >= array.texture->layers())
+        array.reallocate = true;
+    } else {
+      continue;
+    }
+    array.dirtyLayers.insert(layer);
+    newSlot.array = i;
+    newSlot.layer = layer;
+  }
+  if (newSlot.array < 0) {
+    TextureArray array;
+    array.size = pixels.size();
+    array.layers.append(id);
+    m_textureArrays.append(array);
+    newSlot.array = m_textureArrays.size() - 1;
+    newSlot.layer = 0;
   }
+  m_textureSlots.insert(id, newSlot);
+  m_staticLayersDirty = true;
+
+  qDebug() << "Loaded texture ID" << id << "size:" << image.size()
+           << "format:" << image.format() << "array:" << newSlot.array
+           << "layer:" << newSlot.layer;
+}
+
+void VisualRenderer::unloadTexture(int id) {
+  // Surfaces using it fall back to the default texture
+  m_pendingImages.remove(id);
+  delete m_textures.take(id);
+  releaseTextureSlot(id);
+}
+
+void VisualRenderer::releaseTextureSlot(int id) {
+  QHash<int, TextureSlot>::iterator slot = m_textureSlots.find(id);
+  if (slot == m_textureSlots.end())
+    return;
+
+  // The layer is left as a hole for the next texture of the same size
+  TextureArray &array = m_textureArrays[slot->array];
+  array.layers[slot->layer] = -1;
+  array.dirtyLayers.remove(slot->layer);
+  m_textureSlots.erase(slot);
+  m_staticLayersDirty = true;
+}
+
+void VisualRenderer::loadSpriteTexture(int id, const QImage &image) {
+  delete m_textures.take(id);
 
-  // Create new texture
   QOpenGLTexture *texture = new QOpenGLTexture(image.mirrored(false, true));
   texture->setMinificationFilter(QOpenGLTexture::Linear);
   texture->setMagnificationFilter(QOpenGLTexture::Linear);
   texture->setWrapMode(QOpenGLTexture::Repeat);
+  m_textures[id] = texture;
+}
 
+// Plain 2D texture for an ID: entity sprites, or a world texture made on
+// first use from its array layer (the sky is not drawn from the arrays)
+QOpenGLTexture *VisualRenderer::standaloneTexture(int id) {
+  QOpenGLTexture *texture = m_textures.value(id);
+  if (texture)
+    return texture;
+
+  QHash<int, QImage>::const_iterator image = m_pendingImages.constFind(id);
+  if (image != m_pendingImages.constEnd()) {
+    texture = new QOpenGLTexture(*image); // Already mirrored
+  } else {
+    QHash<int, TextureSlot>::const_iterator slot = m_textureSlots.constFind(id);
+    if (slot == m_textureSlots.constEnd() ||
+        !m_textureArrays[slot->array].texture)
+      return nullptr;
+    const TextureArray &array = m_textureArrays[slot->array];
+    texture = new QOpenGLTexture(QOpenGLTexture::Target2D);
+    texture->setSize(array.size.width(), array.size.height());
+    texture->setFormat(QOpenGLTexture::RGBA8_UNorm);
+    texture->allocateStorage(QOpenGLTexture::RGBA, QOpenGLTexture::UInt8);
+    copyTextureLayer(array.texture, slot->layer, texture, -1);
+  }
+  texture->setMinificationFilter(QOpenGLTexture::Linear);
+  texture->setMagnificationFilter(QOpenGLTexture::Linear);
+  texture->setWrapMode(QOpenGLTexture::Repeat);
   m_textures[id] = texture;
-  qDebug() << "Loaded texture ID" << id << "size:" << image.size()
-           << "format:" << image.format();
+  return texture;
+}
+
+// Copies level 0 of an array layer into a layer of another array, or into
+// a 2D texture when destLayer < 0, through a read framebuffer
+void VisualRenderer::copyTextureLayer(QOpenGLTexture *source, int layer,
+                                      QOpenGLTexture *dest, int destLayer) {
+  QOpenGLExtraFunctions *f =
+      QOpenGLContext::currentContext()->extraFunctions();
+  GLint previous = 0;
+  f->glGetIntegerv(GL_READ_FRAMEBUFFER_BINDING, &previous);
+  GLuint framebuffer = 0;
+  f->glGenFramebuffers(1, &framebuffer);
+  f->glBindFramebuffer(GL_READ_FRAMEBUFFER, framebuffer);
+  f->glFramebufferTextureLayer(GL_READ_FRAMEBUFFER, GL_COLOR_ATTACHMENT0,
+                               source->textureId(), 0, layer);
+
+  dest->bind();
+  if (destLayer >= 0)
+    f->glCopyTexSubImage3D(GL_TEXTURE_2D_ARRAY, 0, 0, 0, destLayer, 0, 0,
+                           source->width(), source->height());
+  else
+    f->glCopyTexSubImage2D(GL_TEXTURE_2D, 0, 0, 0, 0, 0, source->width(),
+                           source->height());
+  dest->release();
+
+  f->glBindFramebuffer(GL_READ_FRAMEBUFFER, previous);
+  f->glDeleteFramebuffers(1, &framebuffer);
+}
+
+// Creates grown arrays and uploads changed layers, then rebuilds the
+// mipmaps of every array that changed. Loads between two frames cost one
+// allocation per array at most; layers already in a grown array are copied
+// on the GPU, only new pixels come from memory.
+void VisualRenderer::updateTextureArrays() {
+  for (TextureArray &array : m_textureArrays) {
+    bool empty = array.layers.count(-1) == array.layers.size();
+    if (empty) {
+      // Kept so slot indices stay valid, its storage is not
+      delete array.texture;
+      array.texture = nullptr;
+      array.layers.clear();
+      array.dirtyLayers.clear();
+      array.reallocate = true;
+      continue;
+    }
+
+    if (array.reallocate) {
+      // Grow by powers of two so a stream of loads reallocates rarely
+      int capacity = 1;
+      while (capacity < array.layers.size())
+        capacity *= 2;
+      capacity = qMin(capacity, m_maxArrayLayers);
+
+      QOpenGLTexture *previous = array.texture;
+      array.texture = new QOpenGLTexture(QOpenGLTexture::Target2DArray);
+      array.texture->setSize(array.size.width(), array.size.height());
+      array.texture->setLayers(capacity);
+      array.texture->setFormat(QOpenGLTexture::RGBA8_UNorm);
+      array.texture->setMipLevels(array.texture->maximumMipLevels());
+      array.texture->allocateStorage(QOpenGLTexture::RGBA,
+                                     QOpenGLTexture::UInt8);
+      array.texture->setMinificationFilter(
+          QOpenGLTexture::LinearMipMapLinear);
+      array.texture->setMagnificationFilter(QOpenGLTexture::Linear);
+      array.texture->setWrapMode(QOpenGLTexture::Repeat);
+
+      bool copied = false;
+      int previousLayers = previous ? previous->layers() : 0;
+      for (int layer = 0; layer < array.layers.size(); layer++) {
+        if (array.layers[layer] < 0 || array.dirtyLayers.contains(layer))
+          continue;
+        if (layer < previousLayers) {
+          copyTextureLayer(previous, layer, array.texture, layer);
+          copied = true;
+        }
+      }
+      delete previous;
+      array.reallocate = false;
+      if (copied && array.dirtyLayers.isEmpty())
+        array.texture->generateMipMaps();
+    }
+
+    if (array.dirtyLayers.isEmpty())
+      continue;
+    for (int layer : array.dirtyLayers) {
+      // The pixels are on the GPU from here on, the copy is released
+      QImage pixels = m_pendingImages.take(array.layers[layer]);
+      if (pixels.isNull())
+        continue;
+      array.texture->setData(0, layer, QOpenGLTexture::RGBA,
+                             QOpenGLTexture::UInt8, pixels.constBits());
+    }
+    array.dirtyLayers.clear();
+    array.texture->generateMipMaps();
+  }
 }
 
 void VisualRenderer::setCamera(float x, float y, float z, float yaw,
@@ -981,6 +1543,14 @@ void VisualRenderer::render(int width, int height) {
              << "pitch=" << qRadiansToDegrees(m_cameraPitch);
   }
 
+  m_frameStats = FrameStats();
+
+  // Textures loaded since the last frame: fill their array layers, and move
+  // surfaces whose texture changed array or layer
+  updateTextureArrays();
+  if (m_staticLayersDirty && !m_sectorGeometry.isEmpty())
+    uploadStaticGeometry();
+
   // Update projection aspect ratio
   setProjection(90.0f, (float)width / (float)height, 0.1f, 10000.0f);
 
@@ -990,9 +1560,12 @@ void VisualRenderer::render(int width, int height) {
 
   // Use shader program
   m_shaderProgram->bind();
+  m_shaderProgram->setUniformValue(m_uniformTexture, 0);
+  m_shaderProgram->setUniformValue(m_uniformTextureArray, 1);
+  m_shaderProgram->setUniformValue(m_uniformUseArray, 0);
 
   // Draw Skybox (if available)
-  if (m_skyTextureId > 0 && m_textures.contains(m_skyTextureId)) {
+  if (m_skyTextureId > 0 && standaloneTexture(m_skyTextureId)) {
     drawSkybox(QVector3D(m_cameraX, m_cameraY, m_cameraZ));
 
     // Restore state
@@ -1003,77 +1576,108 @@ void VisualRenderer::render(int width, int height) {
   // Calculate MVP matrix for world
   QMatrix4x4 mvp = m_projectionMatrix * m_viewMatrix;
   m_shaderProgram->setUniformValue(m_uniformMVP, mvp);
-  m_shaderProgram->setUniformValue(m_uniformTexture, 0);
 
   // Update time for animations
   m_shaderProgram->setUniformValue(m_uniformTime, m_time);
 
-  // Render opaque world
-  auto renderOpaque = [&](const QVector<GeometryBuffer> &buffers) {
-    for (const GeometryBuffer &buffer : buffers) {
-      if (buffer.flags & 7)
-        continue; // Skip liquids in opaque pass
-      QOpenGLTexture *texture =
-          m_textures.value(buffer.textureId, m_defaultTexture);
-      if (texture)
-        texture->bind(0);
-      m_shaderProgram->setUniformValue(m_uniformLightLevel, buffer.lightLevel);
-      m_shaderProgram->setUniformValue(m_uniformSectorFlags, buffer.flags);
-      m_shaderProgram->setUniformValue(m_uniformLiquidIntensity,
-                                       buffer.liquidIntensity);
-      m_shaderProgram->setUniformValue(m_uniformLiquidSpeed,
-                                       buffer.liquidSpeed);
-      buffer.vao->bind();
-      glDrawArrays(GL_TRIANGLES, 0, buffer.vertexCount);
-      buffer.vao->release();
-    }
-  };
+  computeVisibility(mvp);
+  for (char visible : m_sectorVisible) {
+    if (visible)
+      m_frameStats.sectorsDrawn++;
+    else
+      m_frameStats.sectorsCulled++;
+  }
 
-  // Render translucent liquids
-  auto renderLiquids = [&](const QVector<GeometryBuffer> &buffers) {
-    glDepthMask(GL_FALSE); // Don't write water to depth buffer
-    for (const GeometryBuffer &buffer : buffers) {
-      if (!(buffer.flags & 7))
-        continue; // Only liquids in this pass
-      QOpenGLTexture *texture =
-          m_textures.value(buffer.textureId, m_defaultTexture);
-      if (texture)
-        texture->bind(0);
-      m_shaderProgram->setUniformValue(m_uniformLightLevel, buffer.lightLevel);
-      m_shaderProgram->setUniformValue(m_uniformSectorFlags, buffer.flags);
-      m_shaderProgram->setUniformValue(m_uniformLiquidIntensity,
-                                       buffer.liquidIntensity);
-      m_shaderProgram->setUniformValue(m_uniformLiquidSpeed,
-                                       buffer.liquidSpeed);
-      buffer.vao->bind();
-      glDrawArrays(GL_TRIANGLES, 0, buffer.vertexCount);
-      buffer.vao->release();
+  // Draw the static batches matching the pass. Visible sectors that are
+  // adjacent inside a batch are merged into one draw, and the texture array
+  // is only bound again when it changes.
+  auto renderBatches = [&](bool liquid) {
+    if (!m_staticVAO)
+      return;
+    m_shaderProgram->setUniformValue(m_uniformUseArray, 1);
+    m_staticVAO->bind();
+    QOpenGLTexture *boundArray = nullptr;
+    for (const DrawBatch &batch : m_staticBatches) {
+      if (batch.liquid != liquid)
+        continue;
+
+      bool bound = false;
+      int runFirst = 0;
+      int runCount = 0;
+      auto flush = [&]() {
+        if (runCount == 0)
+          return;
+        if (!bound) {
+          if (batch.wall)
+            glEnable(GL_CULL_FACE);
+          else
+            glDisable(GL_CULL_FACE);
+          QOpenGLTexture *array = m_defaultArray;
+          if (batch.textureArray >= 0 &&
+              m_textureArrays[batch.textureArray].texture)
+            array = m_textureArrays[batch.textureArray].texture;
+          if (array != boundArray) {
+            array->bind(1);
+            boundArray = array;
+            m_frameStats.textureBinds++;
+          }
+          bound = true;
+        }
+        glDrawElements(GL_TRIANGLES, runCount, GL_UNSIGNED_INT,
+                       (void *)(runFirst * sizeof(quint32)));
+        m_frameStats.drawCalls++;
+        m_frameStats.triangles += runCount / 3;
+        runCount = 0;
+      };
+
+      for (const SectorRange &range : batch.ranges) {
+        if (!m_sectorVisible.value(range.sectorIndex, 1)) {
+          flush();
+        } else if (runCount > 0 && runFirst + runCount == range.first) {
+          runCount += range.count;
+        } else {
+          flush();
+          runFirst = range.first;
+          runCount = range.count;
+        }
+      }
+      flush();
     }
-    glDepthMask(GL_TRUE);
+    m_staticVAO->release();
+    m_shaderProgram->setUniformValue(m_uniformUseArray, 0);
   };
 
   // Render entities (billboards / md3)
   auto renderEntities = [&](const QVector<GeometryBuffer> &buffers) {
     for (const GeometryBuffer &buffer : buffers) {
+      if (m_cullingEnabled &&
+          (!boxInFrustum(buffer.boundsMin, buffer.boundsMax) ||
+           (m_portalCulling && buffer.sectorIndex >= 0 &&
+            !m_sectorVisible.value(buffer.sectorIndex, 1)))) {
+        m_frameStats.entitiesCulled++;
+        continue;
+      }
+      m_frameStats.entitiesDrawn++;
+
       QOpenGLTexture *texture =
           m_textures.value(buffer.textureId, m_defaultTexture);
-      if (texture)
+      if (texture) {
         texture->bind(0);
-      m_shaderProgram->setUniformValue(m_uniformLightLevel, buffer.lightLevel);
-      m_shaderProgram->setUniformValue(m_uniformSectorFlags, buffer.flags);
-      m_shaderProgram->setUniformValue(m_uniformLiquidIntensity, 0.0f);
+        m_frameStats.textureBinds++;
+      }
+      // Entity VAOs carry no material attribute, set it as a constant
+      glVertexAttrib4f(3, buffer.lightLevel, buffer.flags, 0.0f, 0.0f);
       buffer.vao->bind();
       glDrawArrays(GL_TRIANGLES, 0, buffer.vertexCount);
       buffer.vao->release();
+      m_frameStats.drawCalls++;
+      m_frameStats.triangles += buffer.vertexCount / 3;
     }
   };
 
   // Render opaque world
-  glDisable(GL_CULL_FACE);
-  renderOpaque(m_floorBuffers);
-  renderOpaque(m_ceilingBuffers);
+  renderBatches(false);
   glEnable(GL_CULL_FACE);
-  renderOpaque(m_wallBuffers);
 
   // Render entities (billboards / md3)
   glEnable(GL_BLEND);
@@ -1083,9 +1687,10 @@ void VisualRenderer::render(int width, int height) {
   // Draw liquids last with blending and depth mask off
   glEnable(GL_BLEND);
   glBlendFunc(GL_SRC_ALPHA, GL_ONE_MINUS_SRC_ALPHA);
-  renderLiquids(m_floorBuffers);
-  renderLiquids(m_ceilingBuffers);
-  renderLiquids(m_wallBuffers);
+  glDepthMask(GL_FALSE); // Don't write water to depth buffer
+  renderBatches(true);
+  glDepthMask(GL_TRUE);
+  glEnable(GL_CULL_FACE);
   glDisable(GL_BLEND);
 
   m_shaderProgram->release();
@@ -1093,10 +1698,10 @@ void VisualRenderer::render(int width, int height) {
 
 // 2D Parallax Skybox
 void VisualRenderer::drawSkybox(const QVector3D &cameraPos) {
-  if (m_skyTextureId <= 0 || !m_textures.contains(m_skyTextureId))
+  if (m_skyTextureId <= 0)
     return;
 
-  QOpenGLTexture *tex = m_textures[m_skyTextureId];
+  QOpenGLTexture *tex = standaloneTexture(m_skyTextureId);
   if (!tex)
     return;
 
@@ -1104,10 +1709,11 @@ void VisualRenderer::drawSkybox(const QVector3D &cameraPos) {
   glDepthMask(GL_FALSE);
   glDisable(GL_CULL_FACE);
 
-  tex->bind();
+  tex->bind(0);
+  m_frameStats.textureBinds++;
 
   m_shaderProgram->setUniformValue(m_uniformMVP, QMatrix4x4()); // Screen space
-  m_shaderProgram->setUniformValue(m_uniformLightLevel, 1.0f);  // Full bright
+  glVertexAttrib4f(3, 1.0f, 0.0f, 0.0f, 0.0f);                  // Full bright
 
   // Parallax calculation
   float fovRatio = 90.0f / 360.0f;
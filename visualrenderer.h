@@ -3,6 +3,7 @@
 
 #include "mapdata.h"
 #include "md3loader.h"
+#include <QHash>
 #include <QImage>
 #include <QMap>
 #include <QMatrix4x4>
@@ -11,6 +12,9 @@
 #include <QOpenGLShaderProgram>
 #include <QOpenGLTexture>
 #include <QOpenGLVertexArrayObject>
+#include <QSet>
+#include <QVector3D>
+#include <QVector4D>
 
 /**
  * VisualRenderer - OpenGL renderer for the Visual Mode
@@ -27,9 +31,20 @@ public:
   bool initialize();
   void cleanup();
 
-  // Map data
+  // Map data. The map is not copied; geometry is built from it immediately.
   void setMapData(const MapData &mapData);
+  // Rebuild only the given sectors (by sector_id) and their portal
+  // neighbors, re-uploading their vertex ranges in place when possible
+  void updateSectors(const MapData &mapData, const QSet<int> &sectorIds);
+  // Rebuild entity models and billboards and pick up the sky texture,
+  // keeping all sector geometry
+  void updateEntities(const MapData &mapData);
+  // World textures are packed into mipmapped texture arrays, one layer per
+  // ID and one array per texture size; the arrays are (re)built on the next
+  // render(). Pixels are only held until their layer is uploaded; a grown
+  // array copies its layers on the GPU.
   void loadTexture(int id, const QImage &image);
+  void unloadTexture(int id);
 
   // Camera
   void setCamera(float x, float y, float z, float yaw, float pitch);
@@ -39,15 +54,83 @@ public:
   void render(int width, int height);
   void updateAnimation(float deltaTime);
 
+  // Frustum and portal culling of sectors and entities (on by default).
+  // Sectors are only drawn if reachable from the camera's sector through
+  // portals that project onto the screen or through parent/child nesting;
+  // outside any sector, only the view frustum is used.
+  void setCullingEnabled(bool enabled) { m_cullingEnabled = enabled; }
+  bool isCullingEnabled() const { return m_cullingEnabled; }
+
+  // Statistics for the last render() call. Entities count entity buffers
+  // (one per billboard or MD3 surface).
+  struct FrameStats {
+    int drawCalls;
+    int textureBinds;
+    int triangles;
+    int sectorsDrawn;
+    int sectorsCulled;
+    int entitiesDrawn;
+    int entitiesCulled;
+
+    FrameStats()
+        : drawCalls(0), textureBinds(0), triangles(0), sectorsDrawn(0),
+          sectorsCulled(0), entitiesDrawn(0), entitiesCulled(0) {}
+  };
+  const FrameStats &frameStats() const { return m_frameStats; }
+
 private:
   // Shader management
   bool createShaders();
   void destroyShaders();
 
+  // Indexed static world geometry for one batch key (see DrawBatch)
+  struct BatchMesh {
+    QVector<float> vertices;  // STATIC_VERTEX_FLOATS per vertex
+    QVector<quint32> indices; // Relative to the first vertex of this mesh
+  };
+  typedef QMap<quint64, BatchMesh> BatchMeshes;
+
   // Geometry generation
   void generateGeometry(const MapData &mapData);
-  void generateSectorGeometry(const Sector &sector);
+  void generateSectorGeometry(const MapData &mapData, const Sector &sector,
+                              BatchMeshes &batches);
+  const QVector<quint32> &
+  flatTriangulation(const Sector &sector,
+                    const QVector<QVector<QPointF>> &holes);
+  void uploadStaticGeometry();
+  void applyTextureLayers(BatchMeshes &meshes) const;
+  quint64 drawBatchKey(quint64 meshKey) const;
   void clearGeometry();
+  void generateEntities(const MapData &mapData);
+  void clearEntities();
+
+  // Textures
+  void loadSpriteTexture(int id, const QImage &image);
+  QOpenGLTexture *standaloneTexture(int id);
+  void releaseTextureSlot(int id);
+  void copyTextureLayer(QOpenGLTexture *source, int layer,
+                        QOpenGLTexture *dest, int destLayer);
+  void updateTextureArrays();
+
+  // Visibility
+  struct ScreenRect {
+    float x0, y0, x1, y1; // Normalized device coordinates
+
+    ScreenRect() : x0(1.0f), y0(1.0f), x1(-1.0f), y1(-1.0f) {}
+    ScreenRect(float ax0, float ay0, float ax1, float ay1)
+        : x0(ax0), y0(ay0), x1(ax1), y1(ay1) {}
+    bool isEmpty() const { return x0 >= x1 || y0 >= y1; }
+  };
+
+  void buildSectorVisibility(const MapData &mapData, int sectorIndex);
+  int sectorAt(float x, float y) const; // Map plane, -1 = outside
+  bool boxInFrustum(const QVector3D &boundsMin,
+                    const QVector3D &boundsMax) const;
+  bool projectPortal(const QVector3D corners[4], const QMatrix4x4 &mvp,
+                     ScreenRect &rect) const;
+  void computeVisibility(const QMatrix4x4 &mvp);
+  void traversePortals(int sectorIndex, ScreenRect window, int entryPortalId,
+                       int depth, const QMatrix4x4 &mvp);
 
   // Rendering helpers
   void renderSectors();
@@ -62,11 +145,9 @@ private:
   // Shader uniform locations
   int m_uniformMVP;
   int m_uniformTexture;
-  int m_uniformLightLevel;
+  int m_uniformTextureArray;
+  int m_uniformUseArray;
   int m_uniformTime;
-  int m_uniformSectorFlags;
-  int m_uniformLiquidIntensity;
-  int m_uniformLiquidSpeed;
   float m_time;
 
   // Geometry buffers
@@ -79,20 +160,121 @@ private:
     int flags;
     float liquidIntensity;
     float liquidSpeed;
+    QVector3D boundsMin, boundsMax; // For culling
+    int sectorIndex;                // Sector containing it, -1 = none
+
+    GeometryBuffer()
+        : vbo(nullptr), vao(nullptr), vertexCount(0), textureId(0),
+          lightLevel(1.0f), flags(0), liquidIntensity(0.0f),
+          liquidSpeed(0.0f), sectorIndex(-1) {}
   };
 
-  QVector<GeometryBuffer> m_wallBuffers;
-  QVector<GeometryBuffer> m_floorBuffers;
-  QVector<GeometryBuffer> m_ceilingBuffers;
   QVector<GeometryBuffer> m_entityBuffers; // Billboard sprites for entities
 
+  // Static world geometry (floors, ceilings, walls) merged into one indexed
+  // vertex buffer. Light, flags, liquid parameters and the texture array
+  // layer are per-vertex attributes, so a batch only changes with texture
+  // array, pass (opaque/liquid) and cull mode.
+  static const int STATIC_VERTEX_FLOATS = 13; // pos3 uv2 normal3 mat4 layer
+
+  // Index range of one sector inside a batch
+  struct SectorRange {
+    int sectorIndex;
+    int first;
+    int count;
+  };
+
+  struct DrawBatch {
+    int textureArray; // Index in m_textureArrays, -1 = default texture
+    bool wall; // Walls are back-face culled, flats are not
+    bool liquid;
+    int first; // Index range in m_staticIBO
+    int count;
+    QVector<SectorRange> ranges; // Consecutive, in sector order
+  };
+
+  QOpenGLBuffer *m_staticVBO;
+  QOpenGLBuffer *m_staticIBO;
+  QOpenGLVertexArrayObject *m_staticVAO;
+  QVector<DrawBatch> m_staticBatches;
+  bool m_staticLayersDirty; // Texture layers moved since the last upload
+
+  // Per-sector meshes (parallel to MapData::sectors), keyed by texture ID,
+  // and where each of its meshes landed in the static buffers, for in-place
+  // updates
+  struct MeshOffset {
+    int firstVertex;
+    int firstIndex;
+  };
+  QVector<BatchMeshes> m_sectorGeometry;
+  QVector<QHash<quint64, MeshOffset>> m_sectorOffsets;
+  QVector<int> m_sectorIds;
+  QHash<int, int> m_sectorIndexById;
+
+  // Floor/ceiling triangulation per sector_id, reused while the outline and
+  // child sector holes hash the same
+  struct FlatTriangulation {
+    quint64 outlineHash;
+    QVector<quint32> indices;
+  };
+  QHash<int, FlatTriangulation> m_flatCache;
+
+  // Portal culling data per sector (parallel to m_sectorGeometry)
+  static const int MAX_PORTAL_DEPTH = 64;
+
+  struct VisPortal {
+    int portalId;
+    int neighborIndex;
+    QVector3D corners[4]; // Opening between both sectors' floors/ceilings
+  };
+
+  struct SectorVisibility {
+    QVector3D boundsMin, boundsMax;
+    QVector<QPointF> outline;
+    float floorZ, ceilingZ;
+    QVector<VisPortal> portals;
+    // Parent and child sectors: nested sectors have no portal between them
+    // and are open to each other, so they are entered with the same window
+    QVector<int> nested;
+  };
+
+  QVector<SectorVisibility> m_sectorVisibility;
+  QVector<char> m_sectorVisible;    // Last frame
+  QVector<ScreenRect> m_sectorWindow; // Screen area already traversed
+  QVector4D m_frustumPlanes[6];
+  bool m_portalCulling; // Last frame started from the camera's sector
+  bool m_cullingEnabled;
+
   // Sky rendering
   GeometryBuffer m_skyBuffer;
   int m_skyTextureId;
 
-  // Textures
+  // World textures: one 2D array per size, each ID owns one layer
+  struct TextureArray {
+    QOpenGLTexture *texture; // Null until updateTextureArrays()
+    QSize size;
+    QVector<int> layers;  // Texture ID per layer, -1 = free
+    QSet<int> dirtyLayers; // Uploaded on the next updateTextureArrays()
+    bool reallocate;       // More layers than the texture was created with
+
+    TextureArray() : texture(nullptr), reallocate(true) {}
+  };
+
+  struct TextureSlot {
+    int array;
+    int layer;
+  };
+
+  QVector<TextureArray> m_textureArrays;
+  QHash<int, TextureSlot> m_textureSlots;
+  QHash<int, QImage> m_pendingImages; // Mirrored RGBA8888, until uploaded
+  int m_maxArrayLayers;
+
+  // Entity sprites, and world textures needed outside the arrays (the sky),
+  // as plain 2D textures
   QMap<int, QOpenGLTexture *> m_textures;
   QOpenGLTexture *m_defaultTexture;
+  QOpenGLTexture *m_defaultArray; // 1x1 white, for unknown texture IDs
 
   // Models
   QMap<QString, MD3Loader *> m_models;
@@ -105,8 +287,7 @@ private:
   float m_cameraX, m_cameraY, m_cameraZ;
   float m_cameraYaw, m_cameraPitch;
 
-  // Map data (needed for portal lookups)
-  MapData m_mapData;
+  FrameStats m_frameStats;
 
   // Initialization state
   bool m_initialized;
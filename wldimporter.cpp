@@ -44,6 +44,7 @@ bool WLDImporter::importWLD(const QString &filename, MapData &mapData) {
     convertRegionsToSectors(points, walls, regions, mapData);
     detectPortals(points, walls, mapData);
     convertFlags(flags, mapData);
+    mapData.rebuildIndexes();
     
     qDebug() << "WLDImporter: Created" << mapData.sectors.size() << "sectors,"
              << mapData.portals.size() << "portals,"